@@ -0,0 +1,14 @@
+/**
+ * @file concurrent.hpp
+ * @brief 并发容器: 有界MPMC/SPSC队列、侵入式MPSC队列、读无锁哈希表和纪元回收
+ */
+#ifndef __KONG_CONCURRENT_H__
+#define __KONG_CONCURRENT_H__
+
+#include "epoch.hpp"
+#include "hash_map.hpp"
+#include "mpmc_queue.hpp"
+#include "mpsc_queue.hpp"
+#include "spsc_queue.hpp"
+
+#endif
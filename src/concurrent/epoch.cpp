@@ -0,0 +1,195 @@
+#include "epoch.hpp"
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <sched.h>
+#include <stdexcept>
+#include <vector>
+
+namespace kong {
+namespace concurrent {
+
+namespace {
+
+/// 最多同时使用Epoch的线程数
+static const uint32_t s_maxThreads = 1024;
+
+/**
+ * @brief 线程的登记槽位, 独占一个缓存行
+ */
+struct alignas(64) EpochSlot {
+    /// (纪元 << 1) | 是否在Guard作用域内
+    std::atomic<uint64_t> state;
+    std::atomic<uint32_t> used;
+};
+
+struct Retired {
+    void* ptr;
+    void (*deleter)(void*);
+    uint64_t epoch;
+};
+
+/// 全局纪元, 独占一个缓存行
+struct alignas(64) GlobalEpoch {
+    std::atomic<uint64_t> value{0};
+};
+
+static GlobalEpoch s_epoch;
+static EpochSlot s_slots[s_maxThreads];
+/// 用过的最大槽位下标+1, 推进纪元时只扫描到这里
+static std::atomic<uint32_t> s_slotHigh{0};
+
+/// 已退出线程留下的待释放节点
+static std::mutex s_orphanMutex;
+static std::vector<Retired> s_orphans;
+
+struct EpochRecord {
+    EpochSlot* slot = nullptr;
+    uint32_t nest = 0;
+    uint32_t retires = 0;
+    /// 按纪元递增排列
+    std::deque<Retired> pending;
+
+    EpochSlot* getSlot() {
+        if(slot) {
+            return slot;
+        }
+        for(uint32_t i = 0; i < s_maxThreads; ++i) {
+            uint32_t expect = 0;
+            if(s_slots[i].used.load(std::memory_order_relaxed) == 0
+                    && s_slots[i].used.compare_exchange_strong(expect, 1, std::memory_order_acq_rel)) {
+                uint32_t high = s_slotHigh.load(std::memory_order_relaxed);
+                while(high < i + 1 && !s_slotHigh.compare_exchange_weak(high, i + 1, std::memory_order_seq_cst)) {
+                }
+                slot = &s_slots[i];
+                return slot;
+            }
+        }
+        throw std::logic_error("Epoch: too many threads");
+    }
+
+    ~EpochRecord() {
+        if(slot) {
+            slot->state.store(0, std::memory_order_release);
+            slot->used.store(0, std::memory_order_release);
+        }
+        if(!pending.empty()) {
+            std::lock_guard<std::mutex> lock(s_orphanMutex);
+            s_orphans.insert(s_orphans.end(), pending.begin(), pending.end());
+        }
+    }
+};
+
+static thread_local EpochRecord t_record;
+
+/**
+ * @brief 所有在作用域内的线程都已登记到当前纪元时, 全局纪元加1
+ */
+bool TryAdvance() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t e = s_epoch.value.load(std::memory_order_seq_cst);
+    uint32_t n = s_slotHigh.load(std::memory_order_acquire);
+    for(uint32_t i = 0; i < n; ++i) {
+        uint64_t st = s_slots[i].state.load(std::memory_order_acquire);
+        if((st & 1) && (st >> 1) != e) {
+            return false;
+        }
+    }
+    return s_epoch.value.compare_exchange_strong(e, e + 1, std::memory_order_seq_cst);
+}
+
+size_t CollectOrphans(uint64_t global) {
+    std::unique_lock<std::mutex> lock(s_orphanMutex, std::try_to_lock);
+    if(!lock.owns_lock() || s_orphans.empty()) {
+        return 0;
+    }
+    std::vector<Retired> ready;
+    size_t keep = 0;
+    for(auto& i : s_orphans) {
+        if(i.epoch + 2 <= global) {
+            ready.push_back(i);
+        } else {
+            s_orphans[keep++] = i;
+        }
+    }
+    s_orphans.resize(keep);
+    lock.unlock();
+    for(auto& i : ready) {
+        i.deleter(i.ptr);
+    }
+    return ready.size();
+}
+
+}
+
+void Epoch::Enter() {
+    EpochRecord& rec = t_record;
+    if(rec.nest++ == 0) {
+        EpochSlot* slot = rec.getSlot();
+        uint64_t e = s_epoch.value.load(std::memory_order_relaxed);
+        //release: 上一个作用域内的读取先于这次登记, 推进纪元的线程读到登记即可确认
+        slot->state.store((e << 1) | 1, std::memory_order_release);
+        //登记对推进纪元的线程可见之后才能读取共享节点
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+}
+
+void Epoch::Exit() {
+    EpochRecord& rec = t_record;
+    if(--rec.nest == 0) {
+        rec.slot->state.store(0, std::memory_order_release);
+    }
+}
+
+void Epoch::Retire(void* p, void (*deleter)(void*)) {
+    EpochRecord& rec = t_record;
+    //节点摘除对读者可见之后才读取纪元
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    Retired r;
+    r.ptr = p;
+    r.deleter = deleter;
+    r.epoch = s_epoch.value.load(std::memory_order_seq_cst);
+    rec.pending.push_back(r);
+    if(++rec.retires % 64 == 0) {
+        Collect();
+    }
+}
+
+size_t Epoch::Collect() {
+    EpochRecord& rec = t_record;
+    TryAdvance();
+    uint64_t global = s_epoch.value.load(std::memory_order_seq_cst);
+    size_t count = 0;
+    while(!rec.pending.empty() && rec.pending.front().epoch + 2 <= global) {
+        Retired r = rec.pending.front();
+        rec.pending.pop_front();
+        r.deleter(r.ptr);
+        ++count;
+    }
+    return count + CollectOrphans(global);
+}
+
+void Epoch::Synchronize() {
+    EpochRecord& rec = t_record;
+    if(rec.nest) {
+        return;
+    }
+    while(true) {
+        Collect();
+        if(rec.pending.empty()) {
+            break;
+        }
+        sched_yield();
+    }
+}
+
+uint64_t Epoch::GetEpoch() {
+    return s_epoch.value.load(std::memory_order_relaxed);
+}
+
+size_t Epoch::GetPending() {
+    return t_record.pending.size();
+}
+
+}
+}
@@ -0,0 +1,86 @@
+/**
+ * @file epoch.hpp
+ * @brief 基于纪元的内存回收(EBR)
+ */
+#ifndef __KONG_CONCURRENT_EPOCH_H__
+#define __KONG_CONCURRENT_EPOCH_H__
+
+#include <cstddef>
+#include <cstdint>
+
+namespace kong {
+namespace concurrent {
+
+/**
+ * @brief 基于纪元的内存回收
+ * @details 读者在Epoch::Guard作用域内访问共享节点, 进入时在自己的槽位登记当前纪元.
+ *          写者摘除节点后调用Retire(), 节点记在当前纪元上; 所有活跃读者都登记到全局纪元后
+ *          全局纪元才能加1, 纪元前进两次后此前退休的节点不可能再被读者持有, 才真正释放.
+ *          进入/退出作用域只写本线程的槽位, 槽位按缓存行隔开.
+ *          读者在作用域内长时间不退出会阻止回收, 作用域应尽量短
+ *
+ *          {
+ *              kong::concurrent::Epoch::Guard guard;
+ *              Node* n = head.load(std::memory_order_acquire);
+ *              ...
+ *          }
+ *          kong::concurrent::Epoch::Retire(old);
+ */
+class Epoch {
+public:
+    /**
+     * @brief 读者作用域, 可以嵌套
+     */
+    class Guard {
+    public:
+        Guard() { Enter();}
+        ~Guard() { Exit();}
+    private:
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    /**
+     * @brief 推迟释放p, 到没有读者可能持有它时调用deleter(p)
+     */
+    static void Retire(void* p, void (*deleter)(void*));
+
+    template<class T>
+    static void Retire(T* p) {
+        Retire(p, &DeleteObject<T>);
+    }
+
+    /**
+     * @brief 尝试推进全局纪元, 释放当前线程和已退出线程中可以释放的节点
+     * @return 释放的节点数
+     */
+    static size_t Collect();
+
+    /**
+     * @brief 等到当前线程退休的节点全部释放, 不能在Guard作用域内调用
+     */
+    static void Synchronize();
+
+    /**
+     * @brief 当前全局纪元
+     */
+    static uint64_t GetEpoch();
+
+    /**
+     * @brief 当前线程等待释放的节点数
+     */
+    static size_t GetPending();
+
+    static void Enter();
+    static void Exit();
+private:
+    template<class T>
+    static void DeleteObject(void* p) {
+        delete (T*)p;
+    }
+};
+
+}
+}
+
+#endif
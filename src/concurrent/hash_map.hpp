@@ -0,0 +1,289 @@
+/**
+ * @file hash_map.hpp
+ * @brief 读无锁的并发哈希表
+ */
+#ifndef __KONG_CONCURRENT_HASH_MAP_H__
+#define __KONG_CONCURRENT_HASH_MAP_H__
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "epoch.hpp"
+
+namespace kong {
+namespace concurrent {
+
+/**
+ * @brief 并发哈希表
+ * @details 读操作不加锁: 在Epoch::Guard内沿链表查找, 节点发布后不再修改.
+ *          写操作按 hash & (分段数-1) 加分段锁, 修改值时用新节点替换旧节点, 摘下的节点交给Epoch回收;
+ *          桶数是分段数的倍数, 同一个桶总在同一个分段里.
+ *          负载因子超过2时加所有分段锁, 把节点复制到两倍大的新表后整体替换, 旧表上的读者不受影响.
+ *          适合读多写少的注册表、配置和指标查找
+ */
+template<class K, class V, class Hash = std::hash<K>, class KeyEqual = std::equal_to<K> >
+class ConcurrentHashMap {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] buckets 初始桶数
+     * @param[in] stripes 写锁分段数
+     * @details 都向上取整为2的幂, 桶数不小于分段数
+     */
+    ConcurrentHashMap(size_t buckets = 64, size_t stripes = 16) {
+        size_t s = 1;
+        while(s < stripes) {
+            s <<= 1;
+        }
+        size_t b = s;
+        while(b < buckets) {
+            b <<= 1;
+        }
+        m_stripes.reset(new Stripe[s]);
+        m_stripeMask = s - 1;
+        m_table.store(new Table(b), std::memory_order_release);
+    }
+
+    /**
+     * @brief 析构函数, 调用时不能有其它线程在访问
+     */
+    ~ConcurrentHashMap() {
+        Table* t = m_table.load(std::memory_order_relaxed);
+        for(size_t i = 0; i <= t->mask; ++i) {
+            Node* n = t->buckets[i].load(std::memory_order_relaxed);
+            while(n) {
+                Node* next = n->next.load(std::memory_order_relaxed);
+                delete n;
+                n = next;
+            }
+        }
+        delete t;
+    }
+
+    /**
+     * @brief 查找key, 找到时复制值到val
+     */
+    bool find(const K& key, V& val) const {
+        return visit(key, [&val](const V& v) { val = v;});
+    }
+
+    bool contains(const K& key) const {
+        return visit(key, [](const V&) {});
+    }
+
+    /**
+     * @brief 找到key时在读者作用域内调用f(const V&), 避免复制大对象
+     * @details f中不能保存值的引用, 也不能修改本表
+     */
+    template<class F>
+    bool visit(const K& key, const F& f) const {
+        size_t h = m_hash(key);
+        Epoch::Guard guard;
+        Table* t = m_table.load(std::memory_order_acquire);
+        Node* n = t->buckets[h & t->mask].load(std::memory_order_acquire);
+        while(n) {
+            if(n->hash == h && m_equal(n->key, key)) {
+                f(n->value);
+                return true;
+            }
+            n = n->next.load(std::memory_order_acquire);
+        }
+        return false;
+    }
+
+    /**
+     * @brief key不存在时插入
+     * @return 已存在时返回false, 不修改
+     */
+    bool insert(const K& key, const V& val) {
+        return update(key, val, false);
+    }
+
+    /**
+     * @brief 插入或替换
+     * @return 新插入返回true, 替换返回false
+     */
+    bool assign(const K& key, const V& val) {
+        return update(key, val, true);
+    }
+
+    /**
+     * @brief 删除key
+     * @return 不存在时返回false
+     */
+    bool erase(const K& key) {
+        size_t h = m_hash(key);
+        Stripe& s = m_stripes[h & m_stripeMask];
+        std::lock_guard<std::mutex> lock(s.mutex);
+        Table* t = m_table.load(std::memory_order_relaxed);
+        std::atomic<Node*>* link = &t->buckets[h & t->mask];
+        Node* n = link->load(std::memory_order_relaxed);
+        while(n) {
+            if(n->hash == h && m_equal(n->key, key)) {
+                link->store(n->next.load(std::memory_order_relaxed), std::memory_order_release);
+                s.count.store(s.count.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+                Epoch::Retire(n);
+                return true;
+            }
+            link = &n->next;
+            n = link->load(std::memory_order_relaxed);
+        }
+        return false;
+    }
+
+    /**
+     * @brief 元素个数(并发修改时为近似值)
+     */
+    size_t size() const {
+        size_t rt = 0;
+        for(size_t i = 0; i <= m_stripeMask; ++i) {
+            rt += m_stripes[i].count.load(std::memory_order_relaxed);
+        }
+        return rt;
+    }
+
+    size_t bucketCount() const {
+        Epoch::Guard guard;
+        return m_table.load(std::memory_order_acquire)->mask + 1;
+    }
+
+    /**
+     * @brief 遍历, 在读者作用域内对每个元素调用f(const K&, const V&)
+     * @details 不是快照: 遍历期间的修改可能看到也可能看不到
+     */
+    template<class F>
+    void forEach(const F& f) const {
+        Epoch::Guard guard;
+        Table* t = m_table.load(std::memory_order_acquire);
+        for(size_t i = 0; i <= t->mask; ++i) {
+            Node* n = t->buckets[i].load(std::memory_order_acquire);
+            while(n) {
+                f(n->key, n->value);
+                n = n->next.load(std::memory_order_acquire);
+            }
+        }
+    }
+private:
+    ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+    ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+    struct Node {
+        Node(const K& k, const V& v, size_t h, Node* n)
+            :key(k), value(v), hash(h), next(n) {
+        }
+        const K key;
+        const V value;
+        const size_t hash;
+        std::atomic<Node*> next;
+    };
+
+    struct Table {
+        Table(size_t n)
+            :mask(n - 1)
+            ,buckets(new std::atomic<Node*>[n]) {
+            for(size_t i = 0; i < n; ++i) {
+                buckets[i].store(nullptr, std::memory_order_relaxed);
+            }
+        }
+        size_t mask;
+        std::unique_ptr<std::atomic<Node*>[]> buckets;
+    };
+
+    /**
+     * @brief 写锁分段, 独占缓存行
+     */
+    struct Stripe {
+        std::mutex mutex;
+        /// 本段的元素数, 在锁内修改
+        std::atomic<size_t> count{0};
+        char pad[64];
+    };
+
+    bool update(const K& key, const V& val, bool replace) {
+        size_t h = m_hash(key);
+        size_t stripe = h & m_stripeMask;
+        Stripe& s = m_stripes[stripe];
+        size_t mask;
+        size_t count;
+        {
+            std::lock_guard<std::mutex> lock(s.mutex);
+            Table* t = m_table.load(std::memory_order_relaxed);
+            std::atomic<Node*>* head = &t->buckets[h & t->mask];
+            std::atomic<Node*>* link = head;
+            Node* n = link->load(std::memory_order_relaxed);
+            while(n) {
+                if(n->hash == h && m_equal(n->key, key)) {
+                    if(!replace) {
+                        return false;
+                    }
+                    link->store(new Node(key, val, h, n->next.load(std::memory_order_relaxed))
+                                ,std::memory_order_release);
+                    Epoch::Retire(n);
+                    return false;
+                }
+                link = &n->next;
+                n = link->load(std::memory_order_relaxed);
+            }
+            head->store(new Node(key, val, h, head->load(std::memory_order_relaxed)), std::memory_order_release);
+            count = s.count.load(std::memory_order_relaxed) + 1;
+            s.count.store(count, std::memory_order_relaxed);
+            mask = t->mask;
+        }
+        //按本段估算总数, 避免写者共享一个计数器
+        if(count * (m_stripeMask + 1) > (mask + 1) * 2) {
+            grow(mask);
+        }
+        return true;
+    }
+
+    /**
+     * @brief 桶数翻倍
+     * @param[in] mask 触发时的表, 已经被别的线程扩容时直接返回
+     */
+    void grow(size_t mask) {
+        size_t stripes = m_stripeMask + 1;
+        for(size_t i = 0; i < stripes; ++i) {
+            m_stripes[i].mutex.lock();
+        }
+        Table* old = m_table.load(std::memory_order_relaxed);
+        if(old->mask == mask) {
+            //旧表上的读者还在遍历旧节点, 不能改它们的next, 只能复制
+            Table* t = new Table((old->mask + 1) * 2);
+            std::vector<Node*> retired;
+            for(size_t i = 0; i <= old->mask; ++i) {
+                Node* n = old->buckets[i].load(std::memory_order_relaxed);
+                while(n) {
+                    std::atomic<Node*>& head = t->buckets[n->hash & t->mask];
+                    head.store(new Node(n->key, n->value, n->hash, head.load(std::memory_order_relaxed))
+                               ,std::memory_order_relaxed);
+                    retired.push_back(n);
+                    n = n->next.load(std::memory_order_relaxed);
+                }
+            }
+            m_table.store(t, std::memory_order_release);
+            //新表发布之后旧节点才算摘除
+            for(auto i : retired) {
+                Epoch::Retire(i);
+            }
+            Epoch::Retire(old);
+        }
+        for(size_t i = 0; i < stripes; ++i) {
+            m_stripes[i].mutex.unlock();
+        }
+    }
+private:
+    std::atomic<Table*> m_table;
+    size_t m_stripeMask;
+    std::unique_ptr<Stripe[]> m_stripes;
+    Hash m_hash;
+    KeyEqual m_equal;
+    char m_pad[64];
+};
+
+}
+}
+
+#endif
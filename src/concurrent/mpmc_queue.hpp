@@ -0,0 +1,135 @@
+/**
+ * @file mpmc_queue.hpp
+ * @brief 多生产者多消费者的定长无锁队列(Vyukov有界队列)
+ */
+#ifndef __KONG_CONCURRENT_MPMC_QUEUE_H__
+#define __KONG_CONCURRENT_MPMC_QUEUE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace kong {
+namespace concurrent {
+
+/**
+ * @brief 多生产者多消费者队列
+ * @details 每个单元带一个序号: 等于入队位置时可写, 等于入队位置+1时可读, 读完改为下一圈的位置.
+ *          生产者和消费者分别只对m_tail/m_head做CAS, 两者位于不同缓存行; 单元之间不填充.
+ *          队列不满不空时, 生产者和消费者只在各自访问的单元上交互
+ */
+template<class T>
+class MpmcQueue {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 容量, 向上取整为2的幂
+     */
+    MpmcQueue(size_t capacity) {
+        size_t cap = 2;
+        while(cap < capacity) {
+            cap <<= 1;
+        }
+        m_cells.reset(new Cell[cap]);
+        for(size_t i = 0; i < cap; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_mask = cap - 1;
+    }
+
+    /**
+     * @brief 入队
+     * @return 队列满时返回false, v不变
+     */
+    bool push(T&& v) {
+        size_t pos = m_tail.load(std::memory_order_relaxed);
+        Cell* cell;
+        while(true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if(dif == 0) {
+                if(m_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(dif < 0) {
+                return false;
+            } else {
+                pos = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = std::move(v);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool push(const T& v) {
+        T tmp(v);
+        return push(std::move(tmp));
+    }
+
+    /**
+     * @brief 出队
+     * @return 队列空时返回false
+     */
+    bool pop(T& v) {
+        size_t pos = m_head.load(std::memory_order_relaxed);
+        Cell* cell;
+        while(true) {
+            cell = &m_cells[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if(dif == 0) {
+                if(m_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if(dif < 0) {
+                return false;
+            } else {
+                pos = m_head.load(std::memory_order_relaxed);
+            }
+        }
+        v = std::move(cell->data);
+        cell->data = T();
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 元素个数(近似值)
+     */
+    size_t size() const {
+        size_t tail = m_tail.load(std::memory_order_acquire);
+        size_t head = m_head.load(std::memory_order_acquire);
+        return tail > head ? tail - head : 0;
+    }
+
+    bool empty() const { return size() == 0;}
+
+    size_t capacity() const { return m_mask + 1;}
+private:
+    MpmcQueue(const MpmcQueue&) = delete;
+    MpmcQueue& operator=(const MpmcQueue&) = delete;
+
+    struct Cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+private:
+    std::unique_ptr<Cell[]> m_cells;
+    size_t m_mask;
+    char m_pad0[64];
+    /// 消费者CAS
+    std::atomic<size_t> m_head{0};
+    char m_pad1[64];
+    /// 生产者CAS
+    std::atomic<size_t> m_tail{0};
+    char m_pad2[64];
+};
+
+}
+}
+
+#endif
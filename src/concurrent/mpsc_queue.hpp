@@ -0,0 +1,112 @@
+/**
+ * @file mpsc_queue.hpp
+ * @brief 多生产者单消费者的侵入式无锁队列(Vyukov侵入式队列)
+ */
+#ifndef __KONG_CONCURRENT_MPSC_QUEUE_H__
+#define __KONG_CONCURRENT_MPSC_QUEUE_H__
+
+#include <atomic>
+
+namespace kong {
+namespace concurrent {
+
+/**
+ * @brief 侵入式队列节点, 元素类型继承它
+ */
+struct MpscNode {
+    std::atomic<MpscNode*> mpscNext{nullptr};
+};
+
+/**
+ * @brief 多生产者单消费者队列
+ * @details 入队是一次原子交换加一次写, 无等待, 不分配内存; 节点的生命周期由使用者管理,
+ *          在队列中时不能释放或再次入队. 生产者交换m_back, 消费者只读写m_front,
+ *          两者位于不同缓存行. 生产者交换之后、链接之前被抢占时, 消费者暂时看不到后面的节点,
+ *          pop()返回nullptr, 稍后重试即可
+ *
+ *          struct Job : kong::concurrent::MpscNode { ... };
+ *          kong::concurrent::MpscQueue<Job> queue;
+ *          queue.push(job);       //任意线程
+ *          Job* j = queue.pop();  //单个消费者线程
+ */
+template<class T>
+class MpscQueue {
+public:
+    MpscQueue()
+        :m_back(&m_stub)
+        ,m_front(&m_stub) {
+    }
+
+    /**
+     * @brief 入队, 任意线程调用
+     * @return 入队前队列是否为空(近似值), 可用于决定是否唤醒消费者
+     */
+    bool push(T* item) {
+        return pushNode(static_cast<MpscNode*>(item));
+    }
+
+    /**
+     * @brief 出队, 只能由消费者线程调用
+     * @return 队列空时返回nullptr
+     */
+    T* pop() {
+        MpscNode* front = m_front;
+        MpscNode* next = front->mpscNext.load(std::memory_order_acquire);
+        if(front == &m_stub) {
+            if(!next) {
+                return nullptr;
+            }
+            m_front = next;
+            front = next;
+            next = next->mpscNext.load(std::memory_order_acquire);
+        }
+        if(next) {
+            m_front = next;
+            return static_cast<T*>(front);
+        }
+        if(front != m_back.load(std::memory_order_acquire)) {
+            //有生产者正在链接
+            return nullptr;
+        }
+        //只剩最后一个节点, 放回桩节点才能把它取出
+        pushNode(&m_stub);
+        next = front->mpscNext.load(std::memory_order_acquire);
+        if(next) {
+            m_front = next;
+            return static_cast<T*>(front);
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief 是否为空(近似值)
+     */
+    bool empty() const {
+        return m_back.load(std::memory_order_acquire) == &m_stub
+                && !m_stub.mpscNext.load(std::memory_order_acquire);
+    }
+private:
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    bool pushNode(MpscNode* node) {
+        node->mpscNext.store(nullptr, std::memory_order_relaxed);
+        MpscNode* prev = m_back.exchange(node, std::memory_order_acq_rel);
+        prev->mpscNext.store(node, std::memory_order_release);
+        return prev == &m_stub;
+    }
+private:
+    char m_pad0[64];
+    /// 生产者交换
+    std::atomic<MpscNode*> m_back;
+    char m_pad1[64];
+    /// 消费者独占
+    MpscNode* m_front;
+    MpscNode m_stub;
+    char m_pad2[64];
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,102 @@
+/**
+ * @file spsc_queue.hpp
+ * @brief 单生产者单消费者的定长无锁队列
+ */
+#ifndef __KONG_CONCURRENT_SPSC_QUEUE_H__
+#define __KONG_CONCURRENT_SPSC_QUEUE_H__
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <utility>
+
+namespace kong {
+namespace concurrent {
+
+/**
+ * @brief 单生产者单消费者队列
+ * @details 生产者只写m_tail, 消费者只写m_head, 两者位于不同缓存行;
+ *          各自缓存对方的位置, 队列不满/不空时不读取对方的缓存行
+ */
+template<class T>
+class SpscQueue {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 容量, 向上取整为2的幂
+     */
+    SpscQueue(size_t capacity) {
+        size_t cap = 2;
+        while(cap < capacity) {
+            cap <<= 1;
+        }
+        m_buf.resize(cap);
+        m_mask = cap - 1;
+    }
+
+    /**
+     * @brief 入队(仅生产者线程调用)
+     * @return 队列满时返回false, v不变
+     */
+    bool push(T&& v) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if(tail - m_cachedHead > m_mask) {
+            m_cachedHead = m_head.load(std::memory_order_acquire);
+            if(tail - m_cachedHead > m_mask) {
+                return false;
+            }
+        }
+        m_buf[tail & m_mask] = std::move(v);
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 出队(仅消费者线程调用)
+     * @return 队列空时返回false
+     */
+    bool pop(T& v) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if(head == m_cachedTail) {
+            m_cachedTail = m_tail.load(std::memory_order_acquire);
+            if(head == m_cachedTail) {
+                return false;
+            }
+        }
+        v = std::move(m_buf[head & m_mask]);
+        m_buf[head & m_mask] = T();
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /**
+     * @brief 队列是否为空(近似值)
+     */
+    bool empty() const {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief 容量
+     */
+    size_t capacity() const { return m_mask + 1;}
+private:
+    std::vector<T> m_buf;
+    size_t m_mask;
+    char m_pad0[64];
+    /// 消费者写
+    std::atomic<size_t> m_head{0};
+    /// 消费者缓存的m_tail
+    size_t m_cachedTail = 0;
+    char m_pad1[64];
+    /// 生产者写
+    std::atomic<size_t> m_tail{0};
+    /// 生产者缓存的m_head
+    size_t m_cachedHead = 0;
+    char m_pad2[64];
+};
+
+}
+}
+
+#endif
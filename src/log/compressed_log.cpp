@@ -0,0 +1,309 @@
+#include "compressed_log.hpp"
+#include <sys/uio.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stddef.h>
+#include <algorithm>
+#include <iostream>
+#include "utils/lz4.hpp"
+
+namespace kong {
+
+/// 重新打开文件的间隔, 配合外部的日志轮转
+static const uint64_t s_reopenNs = 3000000000ULL;
+
+uint32_t CompressedBlockHeader::calcChecksum() const {
+    //FNV-1a
+    const uint8_t* p = (const uint8_t*)this;
+    uint32_t h = 2166136261u;
+    for(size_t i = 0; i < offsetof(CompressedBlockHeader, checksum); ++i) {
+        h = (h ^ p[i]) * 16777619u;
+    }
+    return h;
+}
+
+uint32_t CompressedBlockHeader::CalcDataChecksum(const void* data, size_t len) {
+    //按8字节做FNV-1a, 块数据可能有1MB, 逐字节太慢
+    const uint8_t* p = (const uint8_t*)data;
+    uint64_t h = 14695981039346656037ULL;
+    for(; len >= 8; p += 8, len -= 8) {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w));
+        h = (h ^ w) * 1099511628211ULL;
+    }
+    for(; len; ++p, --len) {
+        h = (h ^ *p) * 1099511628211ULL;
+    }
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+bool CompressedBlockHeader::isValid() const {
+    return magic == KONG_CLOG_BLOCK_MAGIC && checksum == calcChecksum();
+}
+
+CompressedFileLogAppender::CompressedFileLogAppender(const std::string& filename
+                            ,uint32_t block_size, uint32_t flush_ms, uint32_t max_pending)
+    :m_filename(filename)
+    ,m_blockSize(block_size ? block_size : 1024 * 1024)
+    ,m_flushNs(flush_ms * 1000000ULL)
+    ,m_maxPending(max_pending ? max_pending : 1) {
+    m_cur.data.reserve(m_blockSize + m_blockSize / 8);
+    reopen();
+    m_thread.reset(new Thread(std::bind(&CompressedFileLogAppender::run, this), "log_compress"));
+}
+
+CompressedFileLogAppender::~CompressedFileLogAppender() {
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_one();
+    m_thread->join();
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+void CompressedFileLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) {
+    if(level < m_level) {
+        return;
+    }
+    //在锁外格式化
+    static thread_local std::string t_buf;
+    t_buf.clear();
+    m_formatter->render(t_buf, logger, level, event);
+    append(t_buf, event);
+}
+
+void CompressedFileLogAppender::logRendered(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event, const LogBuffer& buf) {
+    if(level >= m_level) {
+        append(*buf, event);
+    }
+}
+
+void CompressedFileLogAppender::append(const std::string& data, LogEvent::ptr event) {
+    uint64_t ns = event->getWallTimeNs();
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(m_cur.data.empty()) {
+        m_cur.firstNs = ns;
+        m_cur.createNs = Clock::NowNs();
+    }
+    m_cur.data.append(data);
+    m_cur.lastNs = ns;
+    ++m_cur.count;
+    if(m_cur.data.size() >= m_blockSize) {
+        while(m_queue.size() >= m_maxPending && !m_stop) {
+            m_doneCond.wait(lock);
+        }
+        seal();
+    }
+}
+
+void CompressedFileLogAppender::seal() {
+    m_queue.push_back(std::move(m_cur));
+    ++m_sealed;
+    m_cur = Block();
+    m_cur.data.reserve(m_blockSize + m_blockSize / 8);
+    m_cond.notify_one();
+}
+
+void CompressedFileLogAppender::flush() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    if(!m_cur.data.empty()) {
+        seal();
+    }
+    uint64_t target = m_sealed;
+    while(m_written < target) {
+        m_doneCond.wait(lock);
+    }
+}
+
+void CompressedFileLogAppender::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(true) {
+        if(m_queue.empty()) {
+            if(!m_cur.data.empty()
+                    && (m_stop || (m_flushNs && Clock::NowNs() - m_cur.createNs >= m_flushNs))) {
+                seal();
+                continue;
+            }
+            if(m_stop) {
+                break;
+            }
+            //flush_ms为0时不按时间写盘, 等块写满、flush()或析构
+            if(m_flushNs) {
+                m_cond.wait_for(lock, std::chrono::nanoseconds(m_flushNs));
+            } else {
+                m_cond.wait(lock);
+            }
+            continue;
+        }
+        Block block = std::move(m_queue.front());
+        m_queue.pop_front();
+        m_doneCond.notify_all();
+        lock.unlock();
+        writeBlock(block);
+        lock.lock();
+        ++m_written;
+        m_doneCond.notify_all();
+    }
+}
+
+void CompressedFileLogAppender::writeBlock(Block& block) {
+    uint64_t now = Clock::NowNs();
+    if(m_fd < 0 || now - m_lastReopen >= s_reopenNs) {
+        reopen();
+        m_lastReopen = now;
+    }
+
+    CompressedBlockHeader hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = KONG_CLOG_BLOCK_MAGIC;
+    hdr.rawSize = block.data.size();
+    hdr.firstNs = block.firstNs;
+    hdr.lastNs = block.lastNs;
+    hdr.count = block.count;
+
+    m_out.resize(Lz4::CompressBound(block.data.size()));
+    size_t n = Lz4::Compress(block.data.data(), block.data.size(), &m_out[0], m_out.size());
+    struct iovec iov[2];
+    iov[0].iov_base = &hdr;
+    iov[0].iov_len = sizeof(hdr);
+    if(n == 0 || n >= block.data.size()) {
+        hdr.flags = CompressedBlockHeader::STORED;
+        hdr.compressedSize = block.data.size();
+        iov[1].iov_base = &block.data[0];
+    } else {
+        hdr.compressedSize = n;
+        iov[1].iov_base = &m_out[0];
+    }
+    iov[1].iov_len = hdr.compressedSize;
+    hdr.dataChecksum = CompressedBlockHeader::CalcDataChecksum(iov[1].iov_base, iov[1].iov_len);
+    hdr.checksum = hdr.calcChecksum();
+
+    //块必须完整写入, 否则后面的块会错位
+    size_t total = sizeof(hdr) + hdr.compressedSize;
+    size_t done = 0;
+    while(m_fd >= 0 && done < total) {
+        ssize_t rt = writev(m_fd, iov, 2);
+        if(rt < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            std::cout << "CompressedFileLogAppender write " << m_filename
+                      << " failed: " << strerror(errno) << std::endl;
+            break;
+        }
+        done += rt;
+        for(int i = 0; i < 2; ++i) {
+            size_t k = std::min<size_t>(rt, iov[i].iov_len);
+            iov[i].iov_base = (char*)iov[i].iov_base + k;
+            iov[i].iov_len -= k;
+            rt -= k;
+        }
+    }
+    m_rawBytes.fetch_add(block.data.size(), std::memory_order_relaxed);
+    m_fileBytes.fetch_add(done, std::memory_order_relaxed);
+}
+
+bool CompressedFileLogAppender::reopen() {
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+    m_fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(m_fd < 0) {
+        std::cout << "CompressedFileLogAppender open " << m_filename
+                  << " failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    return true;
+}
+
+CompressedLogReader::CompressedLogReader(const std::string& filename) {
+    m_fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(m_fd >= 0) {
+        struct stat st;
+        fstat(m_fd, &st);
+        m_size = st.st_size;
+        posix_fadvise(m_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    }
+}
+
+CompressedLogReader::~CompressedLogReader() {
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool CompressedLogReader::sync(uint64_t offset) {
+    static const size_t s_chunk = 64 * 1024;
+    std::string buf;
+    buf.resize(s_chunk + sizeof(CompressedBlockHeader));
+    while(offset + sizeof(CompressedBlockHeader) <= m_size) {
+        ssize_t rt = pread(m_fd, &buf[0], buf.size(), offset);
+        if(rt < (ssize_t)sizeof(CompressedBlockHeader)) {
+            return false;
+        }
+        size_t limit = rt - sizeof(CompressedBlockHeader);
+        for(size_t i = 0; i <= limit; ++i) {
+            CompressedBlockHeader hdr;
+            memcpy(&hdr.magic, &buf[i], sizeof(hdr.magic));
+            if(hdr.magic != KONG_CLOG_BLOCK_MAGIC) {
+                continue;
+            }
+            memcpy(&hdr, &buf[i], sizeof(hdr));
+            if(hdr.isValid()) {
+                m_offset = offset + i;
+                return true;
+            }
+        }
+        offset += limit + 1;
+    }
+    return false;
+}
+
+bool CompressedLogReader::next(CompressedBlockHeader& hdr) {
+    while(m_offset + sizeof(hdr) <= m_size) {
+        if(pread(m_fd, &hdr, sizeof(hdr), m_offset) != (ssize_t)sizeof(hdr)) {
+            return false;
+        }
+        if(hdr.isValid()) {
+            //最后一个块可能没写完整
+            return m_offset + sizeof(hdr) + hdr.compressedSize <= m_size;
+        }
+        if(!sync(m_offset + 1)) {
+            return false;
+        }
+    }
+    return false;
+}
+
+bool CompressedLogReader::read(const CompressedBlockHeader& hdr, std::string& out) {
+    m_buf.resize(hdr.compressedSize);
+    uint64_t pos = m_offset + sizeof(hdr);
+    skip(hdr);
+    if(pread(m_fd, &m_buf[0], hdr.compressedSize, pos) != (ssize_t)hdr.compressedSize
+            || CompressedBlockHeader::CalcDataChecksum(m_buf.data(), m_buf.size()) != hdr.dataChecksum) {
+        return false;
+    }
+    if(hdr.flags & CompressedBlockHeader::STORED) {
+        out.append(m_buf);
+        return hdr.compressedSize == hdr.rawSize;
+    }
+    size_t old = out.size();
+    out.resize(old + hdr.rawSize);
+    int64_t n = Lz4::Decompress(m_buf.data(), m_buf.size(), &out[old], hdr.rawSize);
+    if(n != (int64_t)hdr.rawSize) {
+        out.resize(old);
+        return false;
+    }
+    return true;
+}
+
+void CompressedLogReader::skip(const CompressedBlockHeader& hdr) {
+    m_offset += sizeof(hdr) + hdr.compressedSize;
+}
+
+}
@@ -0,0 +1,211 @@
+/**
+ * @file compressed_log.hpp
+ * @brief 分块压缩的日志文件
+ * @details 文件由独立的块组成: CompressedBlockHeader + LZ4块数据。
+ *          每个块记录首尾日志的时间, 可以从任意块开始解压, 也可以按时间跳过块
+ */
+#ifndef __KONG_COMPRESSED_LOG_H__
+#define __KONG_COMPRESSED_LOG_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include "log.hpp"
+#include "utils/thread.hpp"
+
+namespace kong {
+
+/// 块魔数
+#define KONG_CLOG_BLOCK_MAGIC 0x4B4C5A42u
+
+/**
+ * @brief 块头
+ */
+struct CompressedBlockHeader {
+    uint32_t magic;
+    /// STORED 表示数据未压缩
+    uint32_t flags;
+    /// 块数据长度
+    uint32_t compressedSize;
+    /// 解压后长度
+    uint32_t rawSize;
+    /// 块内第一条日志的墙上时间(纳秒)
+    uint64_t firstNs;
+    /// 块内最后一条日志的墙上时间(纳秒)
+    uint64_t lastNs;
+    /// 日志条数
+    uint32_t count;
+    /// 块数据(写入文件的字节)的校验和
+    uint32_t dataChecksum;
+    /// 以上字段的校验和, 用于在损坏的数据中重新找到块边界
+    uint32_t checksum;
+    /// 保留, 写0
+    uint32_t reserved;
+
+    enum Flags {
+        /// 未压缩
+        STORED = 1
+    };
+
+    /**
+     * @brief 计算校验和
+     */
+    uint32_t calcChecksum() const;
+
+    /**
+     * @brief 块头是否有效
+     */
+    bool isValid() const;
+
+    /**
+     * @brief 计算块数据的校验和
+     */
+    static uint32_t CalcDataChecksum(const void* data, size_t len);
+};
+
+/**
+ * @brief 分块压缩的文件Appender
+ * @details 调用线程只负责格式化并追加到当前块, 块写满或超过flush间隔后
+ *          交给后台线程压缩写盘。待写的块超过上限时调用线程等待, 不丢日志
+ */
+class CompressedFileLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<CompressedFileLogAppender> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] filename 文件路径
+     * @param[in] block_size 块大小(解压后的字节数)
+     * @param[in] flush_ms 未写满的块最长等待时间(毫秒), 0表示只在块写满、flush()和析构时写盘
+     * @param[in] max_pending 最多等待写盘的块数
+     */
+    CompressedFileLogAppender(const std::string& filename
+                            ,uint32_t block_size = 1024 * 1024
+                            ,uint32_t flush_ms = 1000
+                            ,uint32_t max_pending = 16);
+
+    /**
+     * @brief 析构函数, 写完所有块后返回
+     */
+    ~CompressedFileLogAppender();
+
+    void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+    void logRendered(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event, const LogBuffer& buf) override;
+    bool acceptsRendered() const override { return true;}
+
+    /**
+     * @brief 把当前块写盘, 返回时已写入文件
+     */
+    void flush();
+
+    /**
+     * @brief 已写入的原始字节数
+     */
+    uint64_t getRawBytes() const { return m_rawBytes.load(std::memory_order_relaxed);}
+
+    /**
+     * @brief 已写入的文件字节数
+     */
+    uint64_t getFileBytes() const { return m_fileBytes.load(std::memory_order_relaxed);}
+private:
+    struct Block {
+        std::string data;
+        uint64_t firstNs = 0;
+        uint64_t lastNs = 0;
+        uint32_t count = 0;
+        /// 块创建时的单调时间
+        uint64_t createNs = 0;
+    };
+
+    /**
+     * @brief 后台线程
+     */
+    void run();
+
+    /**
+     * @brief 当前块放入写队列, 需持有m_mutex
+     */
+    void seal();
+
+    /**
+     * @brief 追加一条渲染好的日志到当前块
+     */
+    void append(const std::string& data, LogEvent::ptr event);
+
+    void writeBlock(Block& block);
+    bool reopen();
+private:
+    std::string m_filename;
+    uint32_t m_blockSize;
+    uint64_t m_flushNs;
+    uint32_t m_maxPending;
+    std::mutex m_mutex;
+    /// 通知后台线程
+    std::condition_variable m_cond;
+    /// 通知调用线程(队列有空位 / 写盘完成)
+    std::condition_variable m_doneCond;
+    Block m_cur;
+    std::deque<Block> m_queue;
+    /// 已入队和已写盘的块序号
+    uint64_t m_sealed = 0;
+    uint64_t m_written = 0;
+    bool m_stop = false;
+    /// 以下只由后台线程访问
+    int m_fd = -1;
+    uint64_t m_lastReopen = 0;
+    std::string m_out;
+    std::atomic<uint64_t> m_rawBytes{0};
+    std::atomic<uint64_t> m_fileBytes{0};
+    Thread::ptr m_thread;
+};
+
+/**
+ * @brief 分块压缩文件的读取器
+ */
+class CompressedLogReader {
+public:
+    CompressedLogReader(const std::string& filename);
+    ~CompressedLogReader();
+
+    bool isValid() const { return m_fd >= 0;}
+
+    /**
+     * @brief 从offset开始查找下一个有效的块头
+     * @return 找到时返回true, 之后调用next读取该块
+     */
+    bool sync(uint64_t offset);
+
+    /**
+     * @brief 读取当前位置的块头, 块头损坏时向后查找下一个块
+     * @return 到达文件末尾返回false
+     */
+    bool next(CompressedBlockHeader& hdr);
+
+    /**
+     * @brief 校验并解压next返回的块, 追加到out
+     * @return 块数据校验和不符或解压失败返回false
+     */
+    bool read(const CompressedBlockHeader& hdr, std::string& out);
+
+    /**
+     * @brief 跳过next返回的块
+     */
+    void skip(const CompressedBlockHeader& hdr);
+
+    /**
+     * @brief 当前块的文件偏移
+     */
+    uint64_t getOffset() const { return m_offset;}
+private:
+    int m_fd = -1;
+    uint64_t m_size = 0;
+    /// 当前块头的偏移
+    uint64_t m_offset = 0;
+    std::string m_buf;
+};
+
+}
+
+#endif
@@ -0,0 +1,532 @@
+#include "flight_recorder.hpp"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <algorithm>
+#include <iostream>
+#include "utils/clock.hpp"
+#include "utils/strutil.hpp"
+
+namespace kong {
+
+namespace {
+
+static const uint32_t s_version = 1;
+static const size_t s_align = 64;
+static const size_t s_maxSignalSegments = 16;
+
+inline size_t AlignUp(size_t v, size_t a) {
+    return (v + a - 1) / a * a;
+}
+
+inline size_t HeaderSize() {
+    return AlignUp(sizeof(FlightSegmentHeader), s_align);
+}
+
+inline size_t RingStride(uint32_t ring_size) {
+    return AlignUp(sizeof(FlightRingHeader), s_align) + ring_size;
+}
+
+/**
+ * @brief 单条记录上限, 读端据此跳过可能正被覆盖的最旧数据
+ */
+inline uint32_t MaxRecordSize(uint32_t ring_size) {
+    return std::min<uint32_t>(ring_size / 8, 16 * 1024);
+}
+
+inline char* RingData(FlightRingHeader* ring) {
+    return (char*)ring + AlignUp(sizeof(FlightRingHeader), s_align);
+}
+
+inline const char* RingData(const FlightRingHeader* ring) {
+    return (const char*)ring + AlignUp(sizeof(FlightRingHeader), s_align);
+}
+
+inline void RingWrite(char* data, uint32_t size, uint64_t pos, const void* src, size_t len) {
+    size_t off = pos % size;
+    size_t first = std::min<size_t>(len, size - off);
+    memcpy(data + off, src, first);
+    if(first < len) {
+        memcpy(data, (const char*)src + first, len - first);
+    }
+}
+
+inline void RingRead(const char* data, uint32_t size, uint64_t pos, void* dst, size_t len) {
+    size_t off = pos % size;
+    size_t first = std::min<size_t>(len, size - off);
+    memcpy(dst, data + off, first);
+    if(first < len) {
+        memcpy((char*)dst + first, data, len - first);
+    }
+}
+
+uint64_t SignalSafeNowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint32_t CurrentTid() {
+    return (uint32_t)syscall(SYS_gettid);
+}
+
+/// 需要在崩溃时冻结的段
+std::atomic<FlightSegmentHeader*> s_segments[s_maxSignalSegments];
+std::atomic<bool> s_signalInstalled{false};
+struct sigaction s_oldActions[3];
+const int s_signals[3] = {SIGSEGV, SIGABRT, SIGBUS};
+
+void FreezeAllSegments() {
+    uint64_t now = SignalSafeNowNs();
+    for(size_t i = 0; i < s_maxSignalSegments; ++i) {
+        FlightSegmentHeader* h = s_segments[i].load(std::memory_order_acquire);
+        if(h && !h->frozen.exchange(1)) {
+            h->freezeNs.store(now, std::memory_order_relaxed);
+        }
+    }
+}
+
+void CrashHandler(int sig) {
+    FreezeAllSegments();
+    for(size_t i = 0; i < 3; ++i) {
+        if(s_signals[i] == sig) {
+            sigaction(sig, &s_oldActions[i], nullptr);
+            break;
+        }
+    }
+    raise(sig);
+}
+
+void InstallSignalHandlers() {
+    bool expect = false;
+    if(!s_signalInstalled.compare_exchange_strong(expect, true)) {
+        return;
+    }
+    for(size_t i = 0; i < 3; ++i) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_handler = &CrashHandler;
+        sigemptyset(&sa.sa_mask);
+        sa.sa_flags = SA_RESETHAND | SA_NODEFER;
+        sigaction(s_signals[i], &sa, &s_oldActions[i]);
+    }
+}
+
+void RegisterSegment(FlightSegmentHeader* h) {
+    for(size_t i = 0; i < s_maxSignalSegments; ++i) {
+        FlightSegmentHeader* expect = nullptr;
+        if(s_segments[i].compare_exchange_strong(expect, h)) {
+            return;
+        }
+    }
+}
+
+void UnregisterSegment(FlightSegmentHeader* h) {
+    for(size_t i = 0; i < s_maxSignalSegments; ++i) {
+        FlightSegmentHeader* expect = h;
+        if(s_segments[i].compare_exchange_strong(expect, nullptr)) {
+            return;
+        }
+    }
+}
+
+std::atomic<uint64_t> s_recorderId{0};
+
+struct RingCache {
+    uint64_t id;
+    FlightRingHeader* ring;
+};
+
+/**
+ * @brief 打开共享内存段用于写入
+ * @details 先以O_EXCL创建; 同名段已存在时, 只有段属于当前用户且记录的进程已退出
+ *          (崩溃后留下的转储)才截断重用, 不会破坏另一个存活进程正在写的段
+ * @return 文件描述符, 失败返回-1
+ */
+int OpenSegment(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    if(fd >= 0 || errno != EEXIST) {
+        return fd;
+    }
+    fd = shm_open(name.c_str(), O_RDWR, 0);
+    if(fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    pid_t owner = 0;
+    if(fstat(fd, &st) == 0 && st.st_uid == geteuid()
+            && st.st_size >= (off_t)sizeof(FlightSegmentHeader)) {
+        void* addr = mmap(nullptr, sizeof(FlightSegmentHeader), PROT_READ, MAP_SHARED, fd, 0);
+        if(addr != MAP_FAILED) {
+            owner = ((FlightSegmentHeader*)addr)->pid;
+            munmap(addr, sizeof(FlightSegmentHeader));
+        }
+    }
+    //pid为0: 其它进程正在初始化, 或不是本格式的段
+    if(owner == 0 || kill(owner, 0) == 0 || errno != ESRCH) {
+        close(fd);
+        errno = EEXIST;
+        return -1;
+    }
+    if(ftruncate(fd, 0) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static const size_t s_ringCacheSize = 4;
+static thread_local RingCache t_rings[s_ringCacheSize];
+static thread_local uint32_t t_ringNext = 0;
+
+}
+
+FlightRecorderAppender::FlightRecorderAppender(const std::string& name
+                        ,uint32_t ring_size, uint32_t ring_count, bool install_signal)
+    :m_name(name)
+    ,m_id(++s_recorderId) {
+    if(m_name.empty()) {
+        m_name = "/kong-flight-" + std::to_string(getpid());
+    } else if(m_name[0] != '/') {
+        m_name = "/" + m_name;
+    }
+    ring_size = (uint32_t)AlignUp(std::max<uint32_t>(ring_size, 4096), s_align);
+    ring_count = std::max<uint32_t>(ring_count, 1);
+    m_maxRecord = MaxRecordSize(ring_size);
+    m_mapSize = HeaderSize() + RingStride(ring_size) * ring_count;
+
+    int fd = OpenSegment(m_name);
+    if(fd < 0) {
+        std::cout << "FlightRecorderAppender shm_open " << m_name << " failed: "
+                  << strerror(errno) << std::endl;
+        return;
+    }
+    if(ftruncate(fd, m_mapSize) != 0) {
+        std::cout << "FlightRecorderAppender ftruncate " << m_name << " failed: "
+                  << strerror(errno) << std::endl;
+        close(fd);
+        shm_unlink(m_name.c_str());
+        return;
+    }
+    void* addr = mmap(nullptr, m_mapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED) {
+        std::cout << "FlightRecorderAppender mmap " << m_name << " failed: "
+                  << strerror(errno) << std::endl;
+        shm_unlink(m_name.c_str());
+        return;
+    }
+    m_header = (FlightSegmentHeader*)addr;
+    m_header->version = s_version;
+    m_header->pid = getpid();
+    m_header->ringCount = ring_count;
+    m_header->ringSize = ring_size;
+    m_header->wallOffsetNs.store((int64_t)Clock::ToWallNs(0), std::memory_order_relaxed);
+    m_header->frozen.store(0, std::memory_order_relaxed);
+    m_header->freezeNs.store(0, std::memory_order_relaxed);
+    //魔数最后写入, 读端据此判断段已初始化
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(m_header->magic, KONG_FLIGHT_MAGIC, sizeof(m_header->magic));
+
+    RegisterSegment(m_header);
+    if(install_signal) {
+        InstallSignalHandlers();
+    }
+}
+
+FlightRecorderAppender::~FlightRecorderAppender() {
+    if(!m_header) {
+        return;
+    }
+    UnregisterSegment(m_header);
+    munmap(m_header, m_mapSize);
+    m_header = nullptr;
+    if(!m_keepOnExit) {
+        shm_unlink(m_name.c_str());
+    }
+}
+
+FlightRingHeader* FlightRecorderAppender::ringAt(uint32_t idx) const {
+    return (FlightRingHeader*)((char*)m_header + HeaderSize() + RingStride(m_header->ringSize) * idx);
+}
+
+FlightRingHeader* FlightRecorderAppender::claimRing() {
+    uint32_t tid = CurrentTid();
+    //本线程已有的环(线程缓存被挤出后重新查找), 或同tid的已退出线程留下的环
+    for(uint32_t i = 0; i < m_header->ringCount; ++i) {
+        FlightRingHeader* ring = ringAt(i);
+        if(ring->inUse.load(std::memory_order_acquire) == tid) {
+            return initRing(ring, tid);
+        }
+    }
+    bool retry = true;
+    while(retry) {
+        retry = false;
+        for(uint32_t i = 0; i < m_header->ringCount; ++i) {
+            FlightRingHeader* ring = ringAt(i);
+            uint32_t expect = 0;
+            if(ring->inUse.compare_exchange_strong(expect, tid, std::memory_order_acq_rel)) {
+                return initRing(ring, tid);
+            }
+        }
+        //没有空闲环时回收已退出线程的环, 以原tid为期望值CAS, 同一个环只有一个线程能认领
+        for(uint32_t i = 0; i < m_header->ringCount; ++i) {
+            FlightRingHeader* ring = ringAt(i);
+            uint32_t owner = ring->inUse.load(std::memory_order_acquire);
+            if(owner == 0) {
+                retry = true;
+                continue;
+            }
+            char path[64];
+            snprintf(path, sizeof(path), "/proc/self/task/%u", owner);
+            if(access(path, F_OK) == 0) {
+                continue;
+            }
+            if(ring->inUse.compare_exchange_strong(owner, tid, std::memory_order_acq_rel)) {
+                return initRing(ring, tid);
+            }
+            retry = true;
+        }
+    }
+    return nullptr;
+}
+
+FlightRingHeader* FlightRecorderAppender::initRing(FlightRingHeader* ring, uint32_t tid) {
+    ring->tid = tid;
+    memset(ring->threadName, 0, sizeof(ring->threadName));
+    pthread_getname_np(pthread_self(), ring->threadName, sizeof(ring->threadName));
+    return ring;
+}
+
+FlightRingHeader* FlightRecorderAppender::getRing() {
+    for(size_t i = 0; i < s_ringCacheSize; ++i) {
+        if(t_rings[i].id == m_id) {
+            return t_rings[i].ring;
+        }
+    }
+    FlightRingHeader* ring = claimRing();
+    if(ring) {
+        RingCache& c = t_rings[t_ringNext++ % s_ringCacheSize];
+        c.id = m_id;
+        c.ring = ring;
+    }
+    return ring;
+}
+
+void FlightRecorderAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) {
+    if(level < m_level || !m_header
+            || m_header->frozen.load(std::memory_order_relaxed)) {
+        return;
+    }
+    FlightRingHeader* ring = getRing();
+    if(!ring) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const char* file = event->getFile() ? event->getFile() : "";
+    const std::string& name = event->getLogger()->getName();
+    const std::string& msg = event->getContent();
+
+    FlightRecordHeader h;
+    h.magic = KONG_FLIGHT_RECORD_MAGIC;
+    h.timestamp = event->getTimestamp() ? event->getTimestamp() : Clock::NowNs();
+    h.threadId = event->getThreadId();
+    h.fiberId = event->getFiberId();
+    h.line = event->getLine();
+    h.level = (uint8_t)level;
+    h.reserved = 0;
+    h.reserved2 = 0;
+    size_t room = m_maxRecord - sizeof(h);
+    h.fileLen = (uint16_t)std::min<size_t>(strlen(file), std::min<size_t>(room / 4, 0xFFFF));
+    room -= h.fileLen;
+    h.loggerLen = (uint16_t)std::min<size_t>(name.size(), std::min<size_t>(room / 4, 0xFFFF));
+    room -= h.loggerLen;
+    h.msgLen = (uint32_t)std::min<size_t>(msg.size(), room);
+    h.size = (uint32_t)AlignUp(sizeof(h) + h.fileLen + h.loggerLen + h.msgLen, 8);
+
+    uint64_t pos = ring->writePos.load(std::memory_order_relaxed);
+    h.pos = pos;
+    char* data = RingData(ring);
+    uint32_t size = m_header->ringSize;
+    uint64_t p = pos;
+    RingWrite(data, size, p, &h, sizeof(h));
+    p += sizeof(h);
+    RingWrite(data, size, p, file, h.fileLen);
+    p += h.fileLen;
+    RingWrite(data, size, p, name.c_str(), h.loggerLen);
+    p += h.loggerLen;
+    RingWrite(data, size, p, msg.c_str(), h.msgLen);
+    ring->writePos.store(pos + h.size, std::memory_order_release);
+
+    if(level == LogLevel::FATAL) {
+        freeze();
+    }
+}
+
+void FlightRecorderAppender::freeze() {
+    if(m_header && !m_header->frozen.exchange(1)) {
+        m_header->freezeNs.store(Clock::NowNs(), std::memory_order_relaxed);
+        m_header->wallOffsetNs.store((int64_t)Clock::ToWallNs(0), std::memory_order_relaxed);
+    }
+}
+
+void FlightRecorderAppender::unfreeze() {
+    if(m_header) {
+        m_header->frozen.store(0);
+    }
+}
+
+bool FlightRecorderAppender::isFrozen() const {
+    return m_header && m_header->frozen.load(std::memory_order_relaxed);
+}
+
+FlightRecorderReader::FlightRecorderReader(const std::string& name) {
+    std::string n = name;
+    if(!n.empty() && n[0] != '/') {
+        n = "/" + n;
+    }
+    int fd = shm_open(n.c_str(), O_RDONLY, 0);
+    if(fd < 0) {
+        return;
+    }
+    struct stat st;
+    if(fstat(fd, &st) != 0 || (size_t)st.st_size < HeaderSize()) {
+        close(fd);
+        return;
+    }
+    void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED) {
+        return;
+    }
+    const FlightSegmentHeader* h = (const FlightSegmentHeader*)addr;
+    if(memcmp(h->magic, KONG_FLIGHT_MAGIC, sizeof(h->magic)) != 0
+            || h->version != s_version
+            || HeaderSize() + RingStride(h->ringSize) * h->ringCount > (size_t)st.st_size) {
+        munmap(addr, st.st_size);
+        return;
+    }
+    m_header = h;
+    m_mapSize = st.st_size;
+}
+
+FlightRecorderReader::~FlightRecorderReader() {
+    if(m_header) {
+        munmap((void*)m_header, m_mapSize);
+    }
+}
+
+void FlightRecorderReader::readRing(const FlightRingHeader* ring, std::vector<FlightRecord>& records) const {
+    uint32_t size = m_header->ringSize;
+    uint32_t margin = MaxRecordSize(size);
+    const char* data = RingData(ring);
+    uint64_t end = ring->writePos.load(std::memory_order_acquire);
+    uint64_t begin = end > size ? end - size + margin : 0;
+    begin = AlignUp(begin, 8);
+    size_t first = records.size();
+
+    uint64_t p = begin;
+    while(p + sizeof(FlightRecordHeader) <= end) {
+        FlightRecordHeader h;
+        RingRead(data, size, p, &h, sizeof(h));
+        if(h.magic != KONG_FLIGHT_RECORD_MAGIC || h.pos != p
+                || h.size < sizeof(h) || p + h.size > end
+                || sizeof(h) + h.fileLen + h.loggerLen + h.msgLen > h.size) {
+            //还没找到记录边界
+            p += 8;
+            continue;
+        }
+        FlightRecord r;
+        r.timestamp = h.timestamp;
+        r.threadId = h.threadId;
+        r.fiberId = h.fiberId;
+        r.line = h.line;
+        r.level = (LogLevel::Level)h.level;
+        r.threadName.assign(ring->threadName, strnlen(ring->threadName, sizeof(ring->threadName)));
+        uint64_t q = p + sizeof(h);
+        r.file.resize(h.fileLen);
+        RingRead(data, size, q, &r.file[0], h.fileLen);
+        q += h.fileLen;
+        r.logger.resize(h.loggerLen);
+        RingRead(data, size, q, &r.logger[0], h.loggerLen);
+        q += h.loggerLen;
+        r.msg.resize(h.msgLen);
+        RingRead(data, size, q, &r.msg[0], h.msgLen);
+        records.push_back(std::move(r));
+        p += h.size;
+    }
+
+    //读取期间写端继续前进时, 丢弃可能已被覆盖的记录
+    uint64_t now_end = ring->writePos.load(std::memory_order_acquire);
+    if(now_end != end && now_end > size) {
+        uint64_t safe = now_end - size + margin;
+        uint64_t q = begin;
+        size_t keep = first;
+        for(size_t i = first; i < records.size(); ++i) {
+            if(q >= safe) {
+                records[keep++] = std::move(records[i]);
+            }
+            q += AlignUp(sizeof(FlightRecordHeader) + records[i].file.size()
+                    + records[i].logger.size() + records[i].msg.size(), 8);
+        }
+        records.resize(keep);
+    }
+}
+
+void FlightRecorderReader::read(std::vector<FlightRecord>& records) const {
+    if(!m_header) {
+        return;
+    }
+    for(uint32_t i = 0; i < m_header->ringCount; ++i) {
+        const FlightRingHeader* ring = (const FlightRingHeader*)((const char*)m_header
+                + HeaderSize() + RingStride(m_header->ringSize) * i);
+        if(ring->writePos.load(std::memory_order_acquire) == 0) {
+            continue;
+        }
+        readRing(ring, records);
+    }
+    std::stable_sort(records.begin(), records.end()
+            ,[](const FlightRecord& a, const FlightRecord& b) {
+        return a.timestamp < b.timestamp;
+    });
+}
+
+std::string FlightRecorderReader::format(const FlightRecord& r) const {
+    uint64_t wall = r.timestamp + m_header->wallOffsetNs.load(std::memory_order_relaxed);
+    time_t sec = wall / 1000000000ULL;
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    char buf[64];
+    size_t n = strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    std::string out;
+    out.reserve(96 + r.msg.size());
+    out.append(buf, n);
+    snprintf(buf, sizeof(buf), ".%06u", (unsigned)(wall % 1000000000ULL / 1000));
+    out.append(buf);
+    out.append(1, '\t');
+    StrUtil::AppendUint64(out, r.threadId);
+    out.append(1, '\t');
+    out.append(r.threadName);
+    out.append(1, '\t');
+    StrUtil::AppendUint64(out, r.fiberId);
+    out.append("\t[");
+    out.append(LogLevel::ToString(r.level));
+    out.append("]\t[");
+    out.append(r.logger);
+    out.append("]\t");
+    out.append(r.file);
+    out.append(1, ':');
+    StrUtil::AppendInt64(out, r.line);
+    out.append(1, '\t');
+    out.append(r.msg);
+    return out;
+}
+
+}
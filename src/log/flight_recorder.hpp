@@ -0,0 +1,221 @@
+/**
+ * @file flight_recorder.hpp
+ * @brief 常驻内存的飞行记录仪日志(共享内存环形缓冲)
+ * @details 每个线程独占一个定长环, 记录只做memcpy不做格式化。
+ *          共享内存段在进程崩溃后仍然保留, 可用 kong-flightdump 读取
+ */
+#ifndef __KONG_FLIGHT_RECORDER_H__
+#define __KONG_FLIGHT_RECORDER_H__
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include "log.hpp"
+
+namespace kong {
+
+/// 段魔数
+#define KONG_FLIGHT_MAGIC "KONGFLT1"
+/// 记录魔数
+#define KONG_FLIGHT_RECORD_MAGIC 0x4B46524Cu
+
+/**
+ * @brief 共享内存段头
+ */
+struct FlightSegmentHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pid;
+    uint32_t ringCount;
+    uint32_t ringSize;
+    /// 单调时间与墙上时间的差(纳秒)
+    std::atomic<int64_t> wallOffsetNs;
+    /// 非0时停止写入
+    std::atomic<uint32_t> frozen;
+    uint32_t reserved;
+    /// 冻结时的单调时间
+    std::atomic<uint64_t> freezeNs;
+};
+
+/**
+ * @brief 每个线程的环头, 后面紧跟ringSize字节数据
+ */
+struct FlightRingHeader {
+    /// 累计写入字节数, 对ringSize取模即写位置
+    std::atomic<uint64_t> writePos;
+    /// 0 空闲, 否则为占用线程的tid, 认领时对它CAS
+    std::atomic<uint32_t> inUse;
+    /// 所属线程tid
+    uint32_t tid;
+    char threadName[16];
+};
+
+/**
+ * @brief 单条记录头, 8字节对齐, 之后依次是 file logger msg
+ */
+struct FlightRecordHeader {
+    uint32_t magic;
+    /// 含头部的总长度(8字节对齐)
+    uint32_t size;
+    /// 记录在环中的绝对位置, 用于在被覆盖的数据中重新找到记录边界
+    uint64_t pos;
+    /// 单调时间(纳秒)
+    uint64_t timestamp;
+    uint32_t threadId;
+    uint32_t fiberId;
+    int32_t line;
+    uint8_t level;
+    uint8_t reserved;
+    uint16_t fileLen;
+    uint16_t loggerLen;
+    uint16_t reserved2;
+    uint32_t msgLen;
+};
+
+/**
+ * @brief 飞行记录仪Appender
+ * @details 写入代价是固定字段加 file/logger/msg 的memcpy。
+ *          FATAL事件以及SIGSEGV/SIGABRT会冻结所有环, 保留崩溃前的现场
+ */
+class FlightRecorderAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<FlightRecorderAppender> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] name 共享内存名, 为空时使用 /kong-flight-<pid>;
+     *            段权限0600, 同名段属于存活进程时创建失败(isValid()为false), 属于已退出进程时重用
+     * @param[in] ring_size 每个线程环的字节数
+     * @param[in] ring_count 环的数量(可同时写入的线程数)
+     * @param[in] install_signal 是否安装SIGSEGV/SIGABRT处理函数
+     */
+    FlightRecorderAppender(const std::string& name = ""
+                        ,uint32_t ring_size = 256 * 1024
+                        ,uint32_t ring_count = 64
+                        ,bool install_signal = true);
+
+    /**
+     * @brief 析构函数, 正常退出时默认删除共享内存
+     */
+    ~FlightRecorderAppender();
+
+    void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+
+    /**
+     * @brief 冻结所有环
+     */
+    void freeze();
+
+    /**
+     * @brief 解除冻结
+     */
+    void unfreeze();
+
+    /**
+     * @brief 是否已冻结
+     */
+    bool isFrozen() const;
+
+    /**
+     * @brief 共享内存段是否可用
+     */
+    bool isValid() const { return m_header != nullptr;}
+
+    /**
+     * @brief 返回共享内存名
+     */
+    const std::string& getName() const { return m_name;}
+
+    /**
+     * @brief 设置析构时是否保留共享内存
+     */
+    void setKeepOnExit(bool v) { m_keepOnExit = v;}
+
+    /**
+     * @brief 因环耗尽而丢弃的事件数
+     */
+    uint64_t getDropped() const { return m_dropped.load(std::memory_order_relaxed);}
+private:
+    /**
+     * @brief 返回当前线程的环, 首次调用时认领
+     */
+    FlightRingHeader* getRing();
+    FlightRingHeader* claimRing();
+    /**
+     * @brief 记录环的所属线程和线程名
+     */
+    FlightRingHeader* initRing(FlightRingHeader* ring, uint32_t tid);
+    FlightRingHeader* ringAt(uint32_t idx) const;
+private:
+    /// 共享内存名
+    std::string m_name;
+    /// 映射的起始地址
+    FlightSegmentHeader* m_header = nullptr;
+    /// 映射长度
+    size_t m_mapSize = 0;
+    /// 单条记录最大长度
+    uint32_t m_maxRecord = 0;
+    /// 实例id, 用于线程缓存
+    uint64_t m_id = 0;
+    /// 析构时是否保留共享内存
+    bool m_keepOnExit = false;
+    /// 丢弃计数
+    std::atomic<uint64_t> m_dropped{0};
+};
+
+/**
+ * @brief 解析后的飞行记录
+ */
+struct FlightRecord {
+    uint64_t timestamp = 0;
+    uint32_t threadId = 0;
+    uint32_t fiberId = 0;
+    int32_t line = 0;
+    LogLevel::Level level = LogLevel::UNKNOW;
+    std::string threadName;
+    std::string file;
+    std::string logger;
+    std::string msg;
+};
+
+/**
+ * @brief 飞行记录读取器, 可读取运行中或已崩溃进程的共享内存
+ */
+class FlightRecorderReader {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] name 共享内存名(/kong-flight-<pid>)
+     */
+    FlightRecorderReader(const std::string& name);
+    ~FlightRecorderReader();
+
+    /**
+     * @brief 打开是否成功
+     */
+    bool isValid() const { return m_header != nullptr;}
+
+    /**
+     * @brief 读取全部记录, 按时间排序
+     */
+    void read(std::vector<FlightRecord>& records) const;
+
+    /**
+     * @brief 记录格式化为一行文本
+     */
+    std::string format(const FlightRecord& record) const;
+
+    /**
+     * @brief 段头
+     */
+    const FlightSegmentHeader* getHeader() const { return m_header;}
+private:
+    void readRing(const FlightRingHeader* ring, std::vector<FlightRecord>& records) const;
+private:
+    const FlightSegmentHeader* m_header = nullptr;
+    size_t m_mapSize = 0;
+};
+
+}
+
+#endif
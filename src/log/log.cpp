@@ -1,10 +1,14 @@
 #include "log.hpp"
+#include "log_coalescer.hpp"
 #include <map>
 #include <iostream>
 #include <functional>
 #include <time.h>
 #include <string.h>
+#include <cmath>
+#include <sys/stat.h>
 #include "utils/util.hpp"
+#include "utils/strutil.hpp"
 
 namespace kong {
 
@@ -63,15 +67,46 @@ void LogEvent::format(const char* fmt, ...) {
 }
 
 void LogEvent::format(const char* fmt, va_list al) {
-    char* buf = nullptr;
-    int len = vasprintf(&buf, fmt, al);
-    if(len != -1) {
-        m_ss << std::string(buf, len);
-        free(buf);
+    char buf[256];
+    va_list al2;
+    va_copy(al2, al);
+    int len = vsnprintf(buf, sizeof(buf), fmt, al);
+    if(len < 0) {
+        va_end(al2);
+        return;
+    }
+    if((size_t)len < sizeof(buf)) {
+        m_content.append(buf, len);
+    } else {
+        size_t old = m_content.size();
+        m_content.resize(old + len + 1);
+        vsnprintf(&m_content[old], len + 1, fmt, al2);
+        m_content.resize(old + len);
     }
+    va_end(al2);
+}
+
+LogEvent& LogEvent::kv(const std::string& key, const std::string& val) {
+    m_fields.push_back(LogField(key, val));
+    return *this;
+}
+
+LogEvent& LogEvent::kv(const std::string& key, const char* val) {
+    m_fields.push_back(LogField(key, std::string(val ? val : "")));
+    return *this;
+}
+
+LogEvent& LogEvent::kv(const std::string& key, bool val) {
+    m_fields.push_back(LogField(key, val));
+    return *this;
 }
 
-std::stringstream& LogEventWrap::getSS() {
+LogEvent& LogEvent::kv(const std::string& key, double val) {
+    m_fields.push_back(LogField(key, val));
+    return *this;
+}
+
+std::ostream& LogEventWrap::getSS() {
     return m_event->getSS();
 }
 
@@ -191,6 +226,80 @@ public:
 };
 
 
+static void AppendFieldValue(std::string& out, const LogField& field, bool json) {
+    switch(field.type) {
+        case LogField::INT:
+            StrUtil::AppendInt64(out, field.i);
+            break;
+        case LogField::UINT:
+            StrUtil::AppendUint64(out, field.u);
+            break;
+        case LogField::DOUBLE:
+            if(json && !std::isfinite(field.d)) {
+                //JSON没有nan/inf字面量
+                out.append(1, '"');
+                StrUtil::AppendDouble(out, field.d);
+                out.append(1, '"');
+            } else {
+                StrUtil::AppendDouble(out, field.d);
+            }
+            break;
+        case LogField::BOOL:
+            out.append(field.b ? "true" : "false");
+            break;
+        default:
+            if(json) {
+                out.append(1, '"');
+                StrUtil::AppendJsonEscaped(out, field.str.c_str(), field.str.size());
+                out.append(1, '"');
+            } else {
+                StrUtil::AppendLogfmtValue(out, field.str.c_str(), field.str.size());
+            }
+            break;
+    }
+}
+
+class FieldsFormatItem : public LogFormatter::FormatItem {
+public:
+    FieldsFormatItem(const std::string& str = "") {}
+    void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override {
+        auto& fields = event->getFields();
+        if(fields.empty()) {
+            return;
+        }
+        std::string buf;
+        for(auto& i : fields) {
+            buf.append(1, ' ');
+            StrUtil::AppendLogfmtKey(buf, i.key.c_str(), i.key.size());
+            buf.append(1, '=');
+            AppendFieldValue(buf, i, false);
+        }
+        os.write(buf.c_str(), buf.size());
+    }
+};
+
+class ContextFormatItem : public LogFormatter::FormatItem {
+public:
+    ContextFormatItem(const std::string& str = "")
+        :m_all(str.empty())
+        ,m_key(str.empty() ? 0 : LogContext::Key(str)) {
+    }
+    void format(std::ostream& os, Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override {
+        auto& ctx = event->getContext();
+        if(!ctx) {
+            return;
+        }
+        if(m_all) {
+            os.write(ctx->getLogfmt().c_str(), ctx->getLogfmt().size());
+        } else if(auto v = ctx->get(m_key)) {
+            os.write(v->c_str(), v->size());
+        }
+    }
+private:
+    bool m_all;
+    uint32_t m_key;
+};
+
 class StringFormatItem : public LogFormatter::FormatItem {
 public:
     StringFormatItem(const std::string& str)
@@ -225,13 +334,29 @@ LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level
     ,m_time(time)
     ,m_threadName(thread_name)
     ,m_logger(logger)
-    ,m_level(level) {
+    ,m_level(level)
+    ,m_context(LogContext::Current()) {
+}
+
+LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level
+            ,const char* file, int32_t line
+            ,uint32_t thread_id, uint32_t fiber_id, uint64_t timestamp
+            ,const std::string& thread_name)
+    :m_file(file)
+    ,m_line(line)
+    ,m_threadId(thread_id)
+    ,m_fiberId(fiber_id)
+    ,m_timestamp(timestamp)
+    ,m_threadName(thread_name)
+    ,m_logger(logger)
+    ,m_level(level)
+    ,m_context(LogContext::Current()) {
 }
 
 Logger::Logger(const std::string& name)
     :m_name(name)
     ,m_level(LogLevel::DEBUG) {
-    m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
+    m_formatter.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%X%K%n"));
 }
 
 void Logger::setFormatter(LogFormatter::ptr val) {
@@ -286,14 +411,48 @@ void Logger::clearAppenders() {
 
 void Logger::log(LogLevel::Level level, LogEvent::ptr event) {
     if(level >= m_level) {
-        auto self = shared_from_this();
-        if(!m_appenders.empty()) {
-            for(auto& i : m_appenders) {
+        if(m_coalescer) {
+            m_coalescer->process(getSelf(), level, event);
+        } else {
+            dispatch(level, event);
+        }
+    }
+}
+
+void Logger::dispatch(LogLevel::Level level, LogEvent::ptr event) {
+    Logger::ptr self = getSelf();
+    if(!m_appenders.empty()) {
+        //每个格式器只渲染一次, 结果由使用它的Appender共享
+        std::pair<LogFormatter*, LogBuffer> rendered[4];
+        size_t count = 0;
+        for(auto& i : m_appenders) {
+            LogFormatter* formatter = i->m_formatter.get();
+            if(!formatter || !i->acceptsRendered()) {
                 i->log(self, level, event);
+                continue;
+            }
+            if(level < i->m_level) {
+                continue;
+            }
+            LogBuffer buf;
+            for(size_t j = 0; j < count; ++j) {
+                if(rendered[j].first == formatter) {
+                    buf = rendered[j].second;
+                    break;
+                }
             }
-        } else if(m_root) {
-            m_root->log(level, event);
+            if(!buf) {
+                std::shared_ptr<std::string> str = MakePooled<std::string>();
+                formatter->render(*str, self, level, event);
+                buf = str;
+                if(count < sizeof(rendered) / sizeof(rendered[0])) {
+                    rendered[count++] = std::make_pair(formatter, buf);
+                }
+            }
+            i->logRendered(self, level, event, buf);
         }
+    } else if(m_root) {
+        m_root->log(level, event);
     }
 }
 
@@ -317,22 +476,41 @@ void Logger::fatal(LogEvent::ptr event) {
     log(LogLevel::FATAL, event);
 }
 
-FileLogAppender::FileLogAppender(const std::string& filename)
+FileLogAppender::FileLogAppender(const std::string& filename, uint32_t index_block)
     :m_filename(filename) {
+    if(index_block) {
+        m_index.reset(new LogIndexWriter(index_block));
+    }
     reopen();
 }
 
 void FileLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
     if(level >= m_level) {
-        uint64_t now = event->getTime();
-        if(now >= (m_lastTime + 3)) {
-            reopen();
-            m_lastTime = now;
-        }
-        //if(!(m_filestream << m_formatter->format(logger, level, event))) {
-        if(!m_formatter->format(m_filestream, logger, level, event)) {
-            std::cout << "error" << std::endl;
-        }
+        m_buf.clear();
+        m_formatter->render(m_buf, logger, level, event);
+        write(m_buf, level, event);
+    }
+}
+
+void FileLogAppender::logRendered(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event, const LogBuffer& buf) {
+    if(level >= m_level) {
+        write(*buf, level, event);
+    }
+}
+
+void FileLogAppender::write(const std::string& data, LogLevel::Level level, LogEvent::ptr event) {
+    uint64_t now = event->getTime();
+    if(now >= (m_lastTime + 3)) {
+        reopen();
+        m_lastTime = now;
+    }
+    if(!m_filestream.write(data.data(), data.size())) {
+        std::cout << "error" << std::endl;
+        return;
+    }
+    m_offset += data.size();
+    if(m_index) {
+        m_index->append(m_offset, level, event->getWallTimeNs());
     }
 }
 
@@ -340,8 +518,23 @@ bool FileLogAppender::reopen() {
     if(m_filestream) {
         m_filestream.close();
     }
-    m_filestream.open(m_filename.c_str());
-    return !!m_filestream;
+    m_filestream.open(m_filename.c_str(), std::ios::app);
+    if(!m_filestream) {
+        return false;
+    }
+    struct stat st;
+    if(stat(m_filename.c_str(), &st) == 0) {
+        uint64_t last = m_offset;
+        m_offset = st.st_size;
+        if(m_index) {
+            //文件被轮转或截断后重建索引(轮转文件的旧索引随之改名), 未写满的块查询时直接扫描
+            if(m_inode != (uint64_t)st.st_ino || m_offset < last) {
+                m_inode = st.st_ino;
+                m_index->open(m_filename, m_offset, m_inode);
+            }
+        }
+    }
+    return true;
 
     // return FSUtil::OpenForWrite(m_filestream, m_filename, std::ios::app);
 }
@@ -352,6 +545,12 @@ void StdoutLogAppender::log(std::shared_ptr<Logger> logger, LogLevel::Level leve
     }
 }
 
+void StdoutLogAppender::logRendered(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event, const LogBuffer& buf) {
+    if(level >= m_level) {
+        std::cout.write(buf->data(), buf->size());
+    }
+}
+
 LogFormatter::LogFormatter(const std::string& pattern)
     :m_pattern(pattern) {
     init();
@@ -372,6 +571,15 @@ std::ostream& LogFormatter::format(std::ostream& ofs, std::shared_ptr<Logger> lo
     return ofs;
 }
 
+void LogFormatter::render(std::string& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+    //流对象每个线程构造一次
+    static thread_local std::string t_dummy;
+    static thread_local LogStream t_ss(t_dummy);
+    t_ss.reset(out);
+    format(t_ss, logger, level, event);
+    t_ss.reset(t_dummy);
+}
+
 //%xxx %xxx{xxx} %%
 void LogFormatter::init() {
     //str, format, type
@@ -461,6 +669,8 @@ void LogFormatter::init() {
         XX(T, TabFormatItem),               //T:Tab
         XX(F, FiberIdFormatItem),           //F:协程id
         XX(N, ThreadNameFormatItem),        //N:线程名称
+        XX(K, FieldsFormatItem),            //K:结构化字段
+        XX(X, ContextFormatItem),           //X:诊断上下文, %X{key}为单个字段
 #undef XX
     };
 
@@ -482,9 +692,126 @@ void LogFormatter::init() {
     // std::cout << m_items.size() << std::endl;
 }
 
+StructuredLogFormatter::StructuredLogFormatter(Style style, const std::string& time_format)
+    :LogFormatter("")
+    ,m_style(style)
+    ,m_timeFormat(time_format) {
+    m_pattern = style == JSON ? "json" : "logfmt";
+    if(m_timeFormat.empty()) {
+        m_timeFormat = "%Y-%m-%d %H:%M:%S";
+    }
+}
+
+std::string StructuredLogFormatter::format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+    std::string out;
+    render(out, logger, level, event);
+    return out;
+}
+
+std::ostream& StructuredLogFormatter::format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+    std::string out;
+    render(out, logger, level, event);
+    return ofs.write(out.c_str(), out.size());
+}
+
+void StructuredLogFormatter::render(std::string& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+    if(m_style == JSON) {
+        renderJson(out, logger, level, event);
+    } else {
+        renderLogfmt(out, logger, level, event);
+    }
+}
+
+void StructuredLogFormatter::renderJson(std::string& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+    struct tm tm;
+    time_t t = event->getTime();
+    localtime_r(&t, &tm);
+    char tbuf[64];
+    size_t tlen = strftime(tbuf, sizeof(tbuf), m_timeFormat.c_str(), &tm);
+    const std::string& name = event->getLogger()->getName();
+    const std::string& thread_name = event->getThreadName();
+    const std::string& content = event->getContent();
+    const char* file = event->getFile() ? event->getFile() : "";
+
+    out.reserve(out.size() + 128 + content.size());
+    out.append("{\"time\":\"");
+    StrUtil::AppendJsonEscaped(out, tbuf, tlen);
+    out.append("\",\"level\":\"");
+    out.append(LogLevel::ToString(level));
+    out.append("\",\"logger\":\"");
+    StrUtil::AppendJsonEscaped(out, name.c_str(), name.size());
+    out.append("\",\"thread\":");
+    StrUtil::AppendUint64(out, event->getThreadId());
+    out.append(",\"thread_name\":\"");
+    StrUtil::AppendJsonEscaped(out, thread_name.c_str(), thread_name.size());
+    out.append("\",\"fiber\":");
+    StrUtil::AppendUint64(out, event->getFiberId());
+    out.append(",\"file\":\"");
+    StrUtil::AppendJsonEscaped(out, file, strlen(file));
+    out.append("\",\"line\":");
+    StrUtil::AppendInt64(out, event->getLine());
+    out.append(",\"msg\":\"");
+    StrUtil::AppendJsonEscaped(out, content.c_str(), content.size());
+    out.append(1, '"');
+    if(event->getContext()) {
+        out.append(event->getContext()->getJson());
+    }
+    for(auto& i : event->getFields()) {
+        out.append(",\"");
+        StrUtil::AppendJsonEscaped(out, i.key.c_str(), i.key.size());
+        out.append("\":");
+        AppendFieldValue(out, i, true);
+    }
+    out.append("}\n");
+}
+
+void StructuredLogFormatter::renderLogfmt(std::string& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+    struct tm tm;
+    time_t t = event->getTime();
+    localtime_r(&t, &tm);
+    char tbuf[64];
+    size_t tlen = strftime(tbuf, sizeof(tbuf), m_timeFormat.c_str(), &tm);
+    const std::string& name = event->getLogger()->getName();
+    const std::string& thread_name = event->getThreadName();
+    const std::string& content = event->getContent();
+    const char* file = event->getFile() ? event->getFile() : "";
+
+    out.reserve(out.size() + 128 + content.size());
+    out.append("time=");
+    StrUtil::AppendLogfmtValue(out, tbuf, tlen);
+    out.append(" level=");
+    out.append(LogLevel::ToString(level));
+    out.append(" logger=");
+    StrUtil::AppendLogfmtValue(out, name.c_str(), name.size());
+    out.append(" thread=");
+    StrUtil::AppendUint64(out, event->getThreadId());
+    out.append(" thread_name=");
+    StrUtil::AppendLogfmtValue(out, thread_name.c_str(), thread_name.size());
+    out.append(" fiber=");
+    StrUtil::AppendUint64(out, event->getFiberId());
+    out.append(" file=");
+    StrUtil::AppendLogfmtValue(out, file, strlen(file));
+    out.append(" line=");
+    StrUtil::AppendInt64(out, event->getLine());
+    out.append(" msg=");
+    StrUtil::AppendLogfmtValue(out, content.c_str(), content.size());
+    if(event->getContext()) {
+        out.append(event->getContext()->getLogfmt());
+    }
+    for(auto& i : event->getFields()) {
+        out.append(1, ' ');
+        StrUtil::AppendLogfmtKey(out, i.key.c_str(), i.key.size());
+        out.append(1, '=');
+        AppendFieldValue(out, i, false);
+    }
+    out.append(1, '\n');
+}
 
 LoggerManager::LoggerManager() {
     m_root.reset(new Logger);
+    //永不销毁: 额外持有一个不释放的引用, getSelf()返回的非持有指针在管理器析构后依然有效
+    new Logger::ptr(m_root);
+    m_root->m_immortal = true;
     m_root->addAppender(LogAppender::ptr(new StdoutLogAppender));
 
     m_loggers[m_root->m_name] = m_root;
@@ -493,17 +820,26 @@ LoggerManager::LoggerManager() {
 }
 
 Logger::ptr LoggerManager::getLogger(const std::string& name) {
+    std::lock_guard<std::mutex> lock(m_mutex);
     auto it = m_loggers.find(name);
     if(it != m_loggers.end()) {
         return it->second;
     }
 
     Logger::ptr logger(new Logger(name));
+    new Logger::ptr(logger);
+    logger->m_immortal = true;
     logger->m_root = m_root;
     m_loggers[name] = logger;
     return logger;
 }
 
+Logger* LoggerRef::resolve() const {
+    Logger* l = LoggerMgr::GetInstance()->getLogger(m_name).get();
+    m_logger.store(l, std::memory_order_release);
+    return l;
+}
+
 struct LogAppenderDefine {
     int type = 0; //1 File, 2 Stdout
     LogLevel::Level level = LogLevel::UNKNOW;
@@ -14,18 +14,33 @@
 #include <vector>
 #include <stdarg.h>
 #include <map>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
 
 #include "utils/util.hpp"
 #include "utils/singleton.hpp"
+#include "utils/format.hpp"
+#include "utils/clock.hpp"
+#include "utils/thread.hpp"
+#include "utils/object_pool.hpp"
+#include "log_index.hpp"
+#include "log_context.hpp"
+
+/**
+ * @brief 构造当前位置的日志事件包装器
+ */
+#define KONG_LOG_EVENT_WRAP(logger, level) \
+    kong::LogEventWrap(kong::MakePooled<kong::LogEvent>(logger, level, \
+                    __FILE__, __LINE__, kong::GetThreadId(), \
+                kong::GetFiberId(), kong::Clock::NowNs(), kong::Thread::GetName()))
 
 /**
  * @brief 使用流式方式将日志级别level的日志写入到logger
  */
 #define KONG_LOG_LEVEL(logger, level) \
     if(logger->getLevel() <= level) \
-        kong::LogEventWrap(kong::LogEvent::ptr(new kong::LogEvent(logger, level, \
-                        __FILE__, __LINE__, 0, kong::GetThreadId(),\
-                kong::GetFiberId(), time(0), "kong::Thread::GetName()"))).getSS()
+        KONG_LOG_EVENT_WRAP(logger, level)
 
 /**
  * @brief 使用流式方式将日志级别debug的日志写入到logger
@@ -54,12 +69,11 @@
 
 /**
  * @brief 使用格式化方式将日志级别level的日志写入到logger
+ * @details printf风格, 按参数实际类型格式化, 转换符写错也不会越界读取
  */
 #define KONG_LOG_FMT_LEVEL(logger, level, fmt, ...) \
     if(logger->getLevel() <= level) \
-        kong::LogEventWrap(kong::LogEvent::ptr(new kong::LogEvent(logger, level, \
-                        __FILE__, __LINE__, 0, kong::GetThreadId(),\
-                kong::GetFiberId(), time(0), "kong::Thread::GetName()"))).getEvent()->format(fmt, __VA_ARGS__)
+        KONG_LOG_EVENT_WRAP(logger, level).getEvent()->fmtPrintf(fmt, __VA_ARGS__)
 
 /**
  * @brief 使用格式化方式将日志级别debug的日志写入到logger
@@ -86,6 +100,40 @@
  */
 #define KONG_LOG_FMT_FATAL(logger, fmt, ...) KONG_LOG_FMT_LEVEL(logger, kong::LogLevel::FATAL, fmt, __VA_ARGS__)
 
+/**
+ * @brief 使用{}占位符将日志级别level的日志写入到logger
+ * @details KONG_LOG_FORMAT_INFO(logger, "user={} cost={:.3f}ms", id, cost);
+ *          格式串须为字面量, 占位符数量和类型在编译期校验
+ */
+#define KONG_LOG_FORMAT_LEVEL(logger, level, ...) \
+    if(KONG_FMT_CHECK(__VA_ARGS__) && logger->getLevel() <= level) \
+        KONG_LOG_EVENT_WRAP(logger, level).getEvent()->fmt(__VA_ARGS__)
+
+/**
+ * @brief 使用{}占位符将日志级别debug的日志写入到logger
+ */
+#define KONG_LOG_FORMAT_DEBUG(logger, ...) KONG_LOG_FORMAT_LEVEL(logger, kong::LogLevel::DEBUG, __VA_ARGS__)
+
+/**
+ * @brief 使用{}占位符将日志级别info的日志写入到logger
+ */
+#define KONG_LOG_FORMAT_INFO(logger, ...)  KONG_LOG_FORMAT_LEVEL(logger, kong::LogLevel::INFO, __VA_ARGS__)
+
+/**
+ * @brief 使用{}占位符将日志级别warn的日志写入到logger
+ */
+#define KONG_LOG_FORMAT_WARN(logger, ...)  KONG_LOG_FORMAT_LEVEL(logger, kong::LogLevel::WARN, __VA_ARGS__)
+
+/**
+ * @brief 使用{}占位符将日志级别error的日志写入到logger
+ */
+#define KONG_LOG_FORMAT_ERROR(logger, ...) KONG_LOG_FORMAT_LEVEL(logger, kong::LogLevel::ERROR, __VA_ARGS__)
+
+/**
+ * @brief 使用{}占位符将日志级别fatal的日志写入到logger
+ */
+#define KONG_LOG_FORMAT_FATAL(logger, ...) KONG_LOG_FORMAT_LEVEL(logger, kong::LogLevel::FATAL, __VA_ARGS__)
+
 /**
  * @brief 获取主日志器
  */
@@ -96,10 +144,30 @@
  */
 #define KONG_LOG_NAME(name) kong::LoggerMgr::GetInstance()->getLogger(name)
 
+/**
+ * @brief 当前调用点缓存的name日志器引用(kong::LoggerRef&), 只在第一次执行时查找
+ */
+#define KONG_LOG_NAMED_REF(name) \
+    ([]() -> kong::LoggerRef& { static kong::LoggerRef s_kong_logger_ref(name); return s_kong_logger_ref; }())
+
+/**
+ * @brief 使用流式方式将日志级别level的日志写入到name日志器, 日志器按调用点缓存
+ */
+#define KONG_LOG_NAMED_LEVEL(name, level) \
+    if(kong::Logger* kong_named_logger = KONG_LOG_NAMED_REF(name).enabled(level)) \
+        KONG_LOG_EVENT_WRAP(kong_named_logger->getSelf(), level)
+
+#define KONG_LOG_NAMED_DEBUG(name) KONG_LOG_NAMED_LEVEL(name, kong::LogLevel::DEBUG)
+#define KONG_LOG_NAMED_INFO(name) KONG_LOG_NAMED_LEVEL(name, kong::LogLevel::INFO)
+#define KONG_LOG_NAMED_WARN(name) KONG_LOG_NAMED_LEVEL(name, kong::LogLevel::WARN)
+#define KONG_LOG_NAMED_ERROR(name) KONG_LOG_NAMED_LEVEL(name, kong::LogLevel::ERROR)
+#define KONG_LOG_NAMED_FATAL(name) KONG_LOG_NAMED_LEVEL(name, kong::LogLevel::FATAL)
+
 namespace kong {
 
 class Logger;
 class LoggerManager;
+class LogCoalescer;
 
 /**
  * @brief 日志级别
@@ -137,6 +205,99 @@ public:
     static LogLevel::Level FromString(const std::string& str);
 };
 
+/**
+ * @brief 直接追加到std::string的流缓冲
+ */
+class LogStreamBuf : public std::streambuf {
+public:
+    LogStreamBuf(std::string& str)
+        :m_str(&str) {}
+
+    /**
+     * @brief 改为追加到str
+     */
+    void reset(std::string& str) { m_str = &str;}
+protected:
+    int_type overflow(int_type c) override {
+        if(c != traits_type::eof()) {
+            m_str->push_back((char)c);
+        }
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        m_str->append(s, n);
+        return n;
+    }
+private:
+    std::string* m_str;
+};
+
+/**
+ * @brief 写入日志内容缓冲的输出流
+ */
+class LogStream : public std::ostream {
+public:
+    LogStream(std::string& str)
+        :std::ostream(nullptr)
+        ,m_buf(str) {
+        rdbuf(&m_buf);
+    }
+
+    /**
+     * @brief 改为追加到str
+     */
+    void reset(std::string& str) { m_buf.reset(str);}
+private:
+    LogStreamBuf m_buf;
+};
+
+/**
+ * @brief 日志结构化字段
+ */
+struct LogField {
+    /**
+     * @brief 字段值类型
+     */
+    enum Type {
+        /// 字符串
+        STRING = 0,
+        /// 有符号整数
+        INT = 1,
+        /// 无符号整数
+        UINT = 2,
+        /// 浮点数
+        DOUBLE = 3,
+        /// 布尔值
+        BOOL = 4
+    };
+
+    LogField(const std::string& k, const std::string& v)
+        :key(k), type(STRING), i(0), str(v) {}
+    LogField(const std::string& k, int64_t v)
+        :key(k), type(INT), i(v) {}
+    LogField(const std::string& k, uint64_t v)
+        :key(k), type(UINT), u(v) {}
+    LogField(const std::string& k, double v)
+        :key(k), type(DOUBLE), d(v) {}
+    LogField(const std::string& k, bool v)
+        :key(k), type(BOOL), b(v) {}
+
+    /// 字段名
+    std::string key;
+    /// 值类型
+    Type type;
+    /// 数值
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        bool b;
+    };
+    /// 字符串值
+    std::string str;
+};
+
 /**
  * @brief 日志事件
  */
@@ -160,6 +321,22 @@ public:
             ,uint32_t thread_id, uint32_t fiber_id, uint64_t time
             ,const std::string& thread_name);
 
+    /**
+     * @brief 构造函数
+     * @param[in] logger 日志器
+     * @param[in] level 日志级别
+     * @param[in] file 文件名
+     * @param[in] line 文件行号
+     * @param[in] thread_id 线程id
+     * @param[in] fiber_id 协程id
+     * @param[in] timestamp 单调时间(纳秒, Clock::NowNs), 输出时才换算成墙上时间
+     * @param[in] thread_name 线程名称
+     */
+    LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level
+            ,const char* file, int32_t line
+            ,uint32_t thread_id, uint32_t fiber_id, uint64_t timestamp
+            ,const std::string& thread_name);
+
     /**
      * @brief 返回文件名
      */
@@ -171,9 +348,11 @@ public:
     int32_t getLine() const { return m_line;}
 
     /**
-     * @brief 返回耗时
+     * @brief 返回程序启动到事件发生的毫秒数
      */
-    uint32_t getElapse() const { return m_elapse;}
+    uint32_t getElapse() const {
+        return m_timestamp ? (uint32_t)Clock::ElapsedMs(m_timestamp) : m_elapse;
+    }
 
     /**
      * @brief 返回线程ID
@@ -186,9 +365,23 @@ public:
     uint32_t getFiberId() const { return m_fiberId;}
 
     /**
-     * @brief 返回时间
+     * @brief 返回时间(秒)
+     */
+    uint64_t getTime() const {
+        return m_timestamp ? Clock::ToWallSeconds(m_timestamp) : m_time;
+    }
+
+    /**
+     * @brief 返回单调时间戳(纳秒), 旧构造函数创建的事件返回0
      */
-    uint64_t getTime() const { return m_time;}
+    uint64_t getTimestamp() const { return m_timestamp;}
+
+    /**
+     * @brief 返回墙上时间(纳秒)
+     */
+    uint64_t getWallTimeNs() const {
+        return m_timestamp ? Clock::ToWallNs(m_timestamp) : m_time * 1000000000ULL;
+    }
 
     /**
      * @brief 返回线程名称
@@ -198,7 +391,7 @@ public:
     /**
      * @brief 返回日志内容
      */
-    std::string getContent() const { return m_ss.str();}
+    const std::string& getContent() const { return m_content;}
 
     /**
      * @brief 返回日志器
@@ -211,9 +404,14 @@ public:
     LogLevel::Level getLevel() const { return m_level;}
 
     /**
-     * @brief 返回日志内容字符串流
+     * @brief 返回日志内容流, 首次使用时创建
      */
-    std::stringstream& getSS() { return m_ss;}
+    std::ostream& getSS() {
+        if(!m_ss) {
+            m_ss.reset(new LogStream(m_content));
+        }
+        return *m_ss;
+    }
 
     /**
      * @brief 格式化写入日志内容
@@ -224,6 +422,69 @@ public:
      * @brief 格式化写入日志内容
      */
     void format(const char* fmt, va_list al);
+
+    /**
+     * @brief 按{}占位符格式化, 直接写入日志内容
+     */
+    template<class... Args>
+    void fmt(const char* fmt, const Args&... args) {
+        kong::fmt::FormatTo(m_content, fmt, args...);
+    }
+
+    /**
+     * @brief 按printf风格格式化, 参数类型安全, 直接写入日志内容
+     */
+    template<class... Args>
+    void fmtPrintf(const char* fmt, const Args&... args) {
+        kong::fmt::PrintfTo(m_content, fmt, args...);
+    }
+
+    /**
+     * @brief 附加结构化字段
+     * @param[in] key 字段名
+     * @param[in] val 字段值
+     */
+    LogEvent& kv(const std::string& key, const std::string& val);
+    LogEvent& kv(const std::string& key, const char* val);
+    LogEvent& kv(const std::string& key, bool val);
+    LogEvent& kv(const std::string& key, double val);
+
+    template<class T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value, LogEvent&>::type
+    kv(const std::string& key, T val) {
+        m_fields.push_back(LogField(key, (int64_t)val));
+        return *this;
+    }
+
+    template<class T>
+    typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value, LogEvent&>::type
+    kv(const std::string& key, T val) {
+        m_fields.push_back(LogField(key, (uint64_t)val));
+        return *this;
+    }
+
+    /**
+     * @brief 其它类型通过operator<<转成字符串
+     */
+    template<class T>
+    typename std::enable_if<!std::is_arithmetic<T>::value
+                && !std::is_convertible<T, std::string>::value, LogEvent&>::type
+    kv(const std::string& key, const T& val) {
+        std::stringstream ss;
+        ss << val;
+        m_fields.push_back(LogField(key, ss.str()));
+        return *this;
+    }
+
+    /**
+     * @brief 返回结构化字段
+     */
+    const std::vector<LogField>& getFields() const { return m_fields;}
+
+    /**
+     * @brief 返回事件创建时的诊断上下文, 没有时返回nullptr
+     */
+    const LogContext::ptr& getContext() const { return m_context;}
 private:
     /// 文件名
     const char* m_file = nullptr;
@@ -235,16 +496,24 @@ private:
     uint32_t m_threadId = 0;
     /// 协程ID
     uint32_t m_fiberId = 0;
-    /// 时间戳
+    /// 时间戳(秒)
     uint64_t m_time = 0;
+    /// 单调时间戳(纳秒)
+    uint64_t m_timestamp = 0;
     /// 线程名称
     std::string m_threadName;
+    /// 日志内容
+    std::string m_content;
     /// 日志内容流
-    std::stringstream m_ss;
+    std::unique_ptr<LogStream> m_ss;
     /// 日志器
     std::shared_ptr<Logger> m_logger;
     /// 日志等级
     LogLevel::Level m_level;
+    /// 结构化字段
+    std::vector<LogField> m_fields;
+    /// 诊断上下文
+    LogContext::ptr m_context;
 };
 
 /**
@@ -272,7 +541,36 @@ public:
     /**
      * @brief 获取日志内容流
      */
-    std::stringstream& getSS();
+    std::ostream& getSS();
+
+    /**
+     * @brief 写入日志内容
+     */
+    template<class T>
+    LogEventWrap& operator<<(const T& val) {
+        m_event->getSS() << val;
+        return *this;
+    }
+
+    LogEventWrap& operator<<(std::ostream& (*pf)(std::ostream&)) {
+        m_event->getSS() << pf;
+        return *this;
+    }
+
+    LogEventWrap& operator<<(std::ios_base& (*pf)(std::ios_base&)) {
+        m_event->getSS() << pf;
+        return *this;
+    }
+
+    /**
+     * @brief 附加结构化字段
+     * @details KONG_LOG_INFO(logger).kv("user", id) << "login";
+     */
+    template<class T>
+    LogEventWrap& kv(const std::string& key, const T& val) {
+        m_event->kv(key, val);
+        return *this;
+    }
 private:
     /**
      * @brief 日志事件
@@ -292,7 +590,7 @@ public:
      * @details 
      *  %m 消息
      *  %p 日志级别
-     *  %r 累计毫秒数
+     *  %r 程序启动后的毫秒数
      *  %c 日志名称
      *  %t 线程id
      *  %n 换行
@@ -302,19 +600,31 @@ public:
      *  %T 制表符
      *  %F 协程id
      *  %N 线程名称
+     *  %K 结构化字段(logfmt形式, 每个字段前带空格)
+     *  %X 诊断上下文(logfmt形式, 每个字段前带空格), %X{key} 单个上下文字段的值
      *
-     *  默认格式 "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"
+     *  默认格式 "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%X%K%n"
      */
     LogFormatter(const std::string& pattern);
 
+    /**
+     * @brief 析构函数
+     */
+    virtual ~LogFormatter() {}
+
     /**
      * @brief 返回格式化日志文本
      * @param[in] logger 日志器
      * @param[in] level 日志级别
      * @param[in] event 日志事件
      */
-    std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
-    std::ostream& format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+    virtual std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+    virtual std::ostream& format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+
+    /**
+     * @brief 追加格式化结果到out
+     */
+    virtual void render(std::string& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
 public:
 
     /**
@@ -351,7 +661,7 @@ public:
      * @brief 返回日志模板
      */
     const std::string getPattern() const { return m_pattern;}
-private:
+protected:
     /// 日志格式模板
     std::string m_pattern;
     /// 日志格式解析后格式
@@ -361,6 +671,59 @@ private:
 
 };
 
+/**
+ * @brief 结构化日志格式化(JSON行 / logfmt)
+ * @details 固定输出 time level logger thread thread_name fiber file line msg,
+ *          之后依次输出诊断上下文和事件上的结构化字段。字符串转义使用向量化扫描,
+ *          数字不经过iostream。
+ */
+class StructuredLogFormatter : public LogFormatter {
+public:
+    typedef std::shared_ptr<StructuredLogFormatter> ptr;
+
+    /**
+     * @brief 输出风格
+     */
+    enum Style {
+        /// 每行一个JSON对象
+        JSON = 0,
+        /// key=value 形式
+        LOGFMT = 1
+    };
+
+    /**
+     * @brief 构造函数
+     * @param[in] style 输出风格
+     * @param[in] time_format 时间字段的strftime格式
+     */
+    StructuredLogFormatter(Style style = JSON
+                        ,const std::string& time_format = "%Y-%m-%d %H:%M:%S");
+
+    std::string format(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+    std::ostream& format(std::ostream& ofs, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+
+    /**
+     * @brief 追加一行格式化结果到out
+     */
+    void render(std::string& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) override;
+
+    /**
+     * @brief 返回输出风格
+     */
+    Style getStyle() const { return m_style;}
+private:
+    void renderJson(std::string& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+    void renderLogfmt(std::string& out, std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+private:
+    /// 输出风格
+    Style m_style;
+    /// 时间格式
+    std::string m_timeFormat;
+};
+
+/// 渲染好的日志, 使用同一格式器的Appender共享, 不可修改
+typedef std::shared_ptr<const std::string> LogBuffer;
+
 /**
  * @brief 日志输出目标
  */
@@ -381,6 +744,21 @@ public:
      */
     virtual void log(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) = 0;
 
+    /**
+     * @brief 写入已由本Appender的格式器渲染好的日志
+     * @details acceptsRendered()返回true时Logger调用此接口代替log(),
+     *          同一事件只按每个格式器渲染一次。buf不可修改, 异步Appender可以直接持有
+     * @param[in] buf 渲染结果
+     */
+    virtual void logRendered(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event, const LogBuffer& buf) {
+        log(logger, level, event);
+    }
+
+    /**
+     * @brief 输出内容是否完全由格式器决定
+     */
+    virtual bool acceptsRendered() const { return false;}
+
     // /**
     //  * @brief 将日志输出目标的配置转成YAML String
     //  */
@@ -435,6 +813,11 @@ public:
      */
     void log(LogLevel::Level level, LogEvent::ptr event);
 
+    /**
+     * @brief 不经过合并器, 直接写入日志目标(没有日志目标时交给主日志器)
+     */
+    void dispatch(LogLevel::Level level, LogEvent::ptr event);
+
     /**
      * @brief 写debug级别日志
      * @param[in] event 日志事件
@@ -512,6 +895,26 @@ public:
      */
     LogFormatter::ptr getFormatter();
 
+    /**
+     * @brief 设置重复日志合并器, nullptr表示关闭(默认)
+     * @details 与日志目标一样应在启动时配置, 不能和写日志并发修改
+     */
+    void setCoalescer(std::shared_ptr<LogCoalescer> val) { m_coalescer = val;}
+
+    /**
+     * @brief 返回重复日志合并器
+     */
+    std::shared_ptr<LogCoalescer> getCoalescer() const { return m_coalescer;}
+
+    /**
+     * @brief 返回指向自己的智能指针
+     * @details LoggerManager创建的日志器永不销毁, 返回不共享控制块的指针, 复制和析构都没有原子操作;
+     *          其它日志器返回shared_from_this()
+     */
+    Logger::ptr getSelf() {
+        return m_immortal ? Logger::ptr(Logger::ptr(), this) : shared_from_this();
+    }
+
     // /**
     //  * @brief 将日志器的配置转成YAML String
     //  */
@@ -527,6 +930,10 @@ private:
     LogFormatter::ptr m_formatter;
     /// 主日志器
     Logger::ptr m_root;
+    /// 重复日志合并器
+    std::shared_ptr<LogCoalescer> m_coalescer;
+    /// 由LoggerManager创建, 永不销毁
+    bool m_immortal = false;
 };
 
 /**
@@ -536,6 +943,8 @@ class StdoutLogAppender : public LogAppender {
 public:
     typedef std::shared_ptr<StdoutLogAppender> ptr;
     void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+    void logRendered(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event, const LogBuffer& buf) override;
+    bool acceptsRendered() const override { return true;}
     // std::string toYamlString() override;
 };
 
@@ -545,15 +954,29 @@ public:
 class FileLogAppender : public LogAppender {
 public:
     typedef std::shared_ptr<FileLogAppender> ptr;
-    FileLogAppender(const std::string& filename);
+
+    /**
+     * @brief 构造函数
+     * @param[in] filename 文件路径
+     * @param[in] index_block 索引块大小(字节), 非0时在旁边维护 filename.idx 稀疏索引供kong-logq使用,
+     *                        一般取64*1024; 默认0不生成索引
+     */
+    FileLogAppender(const std::string& filename, uint32_t index_block = 0);
     void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+    void logRendered(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event, const LogBuffer& buf) override;
+    bool acceptsRendered() const override { return true;}
     // std::string toYamlString() override;
 
     /**
-     * @brief 重新打开日志文件
+     * @brief 重新打开日志文件(追加写入)
      * @return 成功返回true
      */
     bool reopen();
+private:
+    /**
+     * @brief 写入一条渲染好的日志并更新索引
+     */
+    void write(const std::string& data, LogLevel::Level level, LogEvent::ptr event);
 private:
     /// 文件路径
     std::string m_filename;
@@ -561,6 +984,14 @@ private:
     std::ofstream m_filestream;
     /// 上次重新打开时间
     uint64_t m_lastTime = 0;
+    /// 单条日志的格式化缓冲
+    std::string m_buf;
+    /// 当前文件长度
+    uint64_t m_offset = 0;
+    /// 当前文件inode
+    uint64_t m_inode = 0;
+    /// 稀疏索引
+    std::unique_ptr<LogIndexWriter> m_index;
 };
 
 /**
@@ -594,7 +1025,8 @@ public:
     //  */
     // std::string toYamlString();
 private:
-    /// 日志器容器
+    std::mutex m_mutex;
+    /// 日志器容器, 日志器创建后不会删除, 重新配置只修改日志器本身
     std::map<std::string, Logger::ptr> m_loggers;
     /// 主日志器
     Logger::ptr m_root;
@@ -603,6 +1035,52 @@ private:
 /// 日志器管理类单例模式
 typedef kong::Singleton<LoggerManager> LoggerMgr;
 
+/**
+ * @brief 按名称缓存的日志器引用
+ * @details 构造函数是constexpr, 静态对象在常量初始化阶段完成, 不存在初始化顺序问题;
+ *          第一次使用时才向LoggerMgr查找, 之后只是一次原子读。
+ *          日志器不会被LoggerManager删除, 缓存的指针在重新配置后依然有效
+ *          static kong::LoggerRef g_logger("net.http");
+ *          KONG_LOG_INFO(g_logger) << "...";
+ */
+class LoggerRef {
+public:
+    constexpr LoggerRef(const char* name)
+        :m_name(name)
+        ,m_logger(nullptr) {
+    }
+
+    /**
+     * @brief 返回日志器
+     */
+    Logger* get() const {
+        Logger* l = m_logger.load(std::memory_order_acquire);
+        return l ? l : resolve();
+    }
+
+    /**
+     * @brief level级别启用时返回日志器, 否则返回nullptr
+     */
+    Logger* enabled(LogLevel::Level level) const {
+        Logger* l = get();
+        return l->getLevel() <= level ? l : nullptr;
+    }
+
+    Logger* operator->() const { return get();}
+
+    /**
+     * @brief 转换为智能指针, 用于构造LogEvent; 日志器永不销毁, 指针不持有引用计数
+     */
+    operator Logger::ptr() const { return get()->getSelf();}
+
+    const char* getName() const { return m_name;}
+private:
+    Logger* resolve() const;
+private:
+    const char* m_name;
+    mutable std::atomic<Logger*> m_logger;
+};
+
 }
 
 #endif
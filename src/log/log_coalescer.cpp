@@ -0,0 +1,359 @@
+#include "log_coalescer.hpp"
+#include "utils/thread.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+namespace kong {
+
+namespace {
+
+/**
+ * @brief 一个日志器上最近写出的事件和其后被合并的次数
+ */
+struct CoalesceEntry {
+    LogCoalescer::ptr owner;
+    Logger::ptr logger;
+    /// 最近写出的事件
+    LogEvent::ptr last;
+    LogLevel::Level level;
+    size_t hash;
+    /// 所属合并器的窗口(纳秒)
+    uint64_t window;
+    /// 窗口开始时间(纳秒)
+    uint64_t start;
+    /// 最后一次重复的时间(纳秒)
+    uint64_t lastNs;
+    /// 窗口内未输出的重复次数
+    uint64_t repeats;
+    /// 最近使用序号, 用于淘汰
+    uint64_t used;
+};
+
+/**
+ * @brief 待输出的"重复N次"
+ */
+struct CoalesceSummary {
+    Logger::ptr logger;
+    LogLevel::Level level;
+    LogEvent::ptr event;
+};
+
+/**
+ * @brief 线程的合并状态
+ * @details 只有所属线程修改, 加锁是为了让刷新线程写出空闲线程到期的计数;
+ *          刷新线程只try_lock, 所属线程拿锁不会被它阻塞太久
+ */
+struct CoalesceThreadState {
+    std::mutex mutex;
+    std::vector<CoalesceEntry> entries;
+    uint64_t tick = 0;
+    /// 正在向Appender输出, Appender内部再写日志时直接输出, 不再合并(只由所属线程读写)
+    bool busy = false;
+    /// 有未输出的计数, 刷新线程跳过没有计数的线程
+    std::atomic<bool> pending{false};
+    /// process()在锁内收集、解锁后输出的"重复N次"(只由所属线程使用)
+    std::vector<CoalesceSummary> outbox;
+
+    /**
+     * @brief 生成"重复N次", 时间、调用点和线程信息取自被合并的事件
+     */
+    static CoalesceSummary Summary(CoalesceEntry& e) {
+        const LogEvent::ptr& last = e.last;
+        CoalesceSummary sum;
+        sum.logger = e.logger;
+        sum.level = e.level;
+        sum.event = MakePooled<LogEvent>(last->getLogger(), e.level
+                        ,last->getFile(), last->getLine(), last->getThreadId()
+                        ,last->getFiberId(), e.lastNs, last->getThreadName());
+        sum.event->fmt("last message repeated {} times", e.repeats);
+        sum.event->kv("repeated", e.repeats);
+        e.repeats = 0;
+        return sum;
+    }
+
+    /**
+     * @brief 取出全部(all)或窗口已到期的计数, 调用时持有mutex
+     */
+    void take(uint64_t now, bool all, std::vector<CoalesceSummary>& out) {
+        bool left = false;
+        for(auto& i : entries) {
+            if(!i.repeats) {
+                continue;
+            }
+            if(all || (now > i.start && now - i.start >= i.window)) {
+                out.push_back(Summary(i));
+            } else {
+                left = true;
+            }
+        }
+        pending.store(left, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @brief 所有线程的合并状态, 由刷新线程定期检查
+ */
+struct CoalesceRegistry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<CoalesceThreadState> > states;
+    /// 所有合并器中最小的窗口, 决定刷新周期
+    std::atomic<uint64_t> minWindowNs{UINT64_MAX};
+    /// 窗口变小时唤醒刷新线程重新计算周期
+    std::condition_variable cond;
+    std::unique_ptr<Thread> thread;
+};
+
+/// 不析构: 线程局部状态在进程退出时仍可能注销
+static CoalesceRegistry& GetRegistry() {
+    static CoalesceRegistry* s_registry = new CoalesceRegistry;
+    return *s_registry;
+}
+
+/**
+ * @brief 线程局部的持有者, 线程退出时写出剩余计数并注销
+ */
+struct CoalesceThreadHolder {
+    CoalesceThreadHolder()
+        :state(std::make_shared<CoalesceThreadState>()) {
+        CoalesceRegistry& reg = GetRegistry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.states.push_back(state);
+    }
+
+    ~CoalesceThreadHolder() {
+        state->busy = true;
+        std::vector<CoalesceSummary> sums;
+        {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->take(0, true, sums);
+            state->entries.clear();
+        }
+        for(auto& i : sums) {
+            i.logger->dispatch(i.level, i.event);
+        }
+        CoalesceRegistry& reg = GetRegistry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        for(auto it = reg.states.begin(); it != reg.states.end(); ++it) {
+            if(*it == state) {
+                reg.states.erase(it);
+                break;
+            }
+        }
+    }
+
+    std::shared_ptr<CoalesceThreadState> state;
+};
+
+static thread_local CoalesceThreadHolder t_state;
+
+/**
+ * @brief 刷新线程: 每半个最小窗口检查一次, 写出已到期但所属线程不再写日志的计数,
+ *        计数最晚在窗口开始后1.5个窗口内写出
+ */
+void FlushLoop() {
+    CoalesceRegistry& reg = GetRegistry();
+    //先创建本线程的状态, Appender在这里写日志时不会在持有reg.mutex时注册
+    t_state.state->busy = false;
+    std::unique_lock<std::mutex> lock(reg.mutex);
+    while(true) {
+        uint64_t period = reg.minWindowNs.load(std::memory_order_relaxed) / 2;
+        period = std::max<uint64_t>(std::min<uint64_t>(period, 1000000000ULL), 1000000ULL);
+        reg.cond.wait_for(lock, std::chrono::nanoseconds(period));
+        std::vector<std::shared_ptr<CoalesceThreadState> > states = reg.states;
+        lock.unlock();
+        uint64_t now = Clock::NowNs();
+        std::vector<CoalesceSummary> sums;
+        for(auto& i : states) {
+            if(!i->pending.load(std::memory_order_relaxed)) {
+                continue;
+            }
+            std::unique_lock<std::mutex> slock(i->mutex, std::try_to_lock);
+            if(slock.owns_lock()) {
+                i->take(now, false, sums);
+            }
+        }
+        //不持有任何锁时输出
+        for(auto& i : sums) {
+            i.logger->dispatch(i.level, i.event);
+        }
+        lock.lock();
+    }
+}
+
+inline size_t HashCombine(size_t seed, size_t v) {
+    return seed ^ (v + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+size_t HashEvent(LogLevel::Level level, const LogEvent::ptr& event) {
+    size_t h = std::hash<std::string>()(event->getContent());
+    h = HashCombine(h, (size_t)event->getFile());
+    h = HashCombine(h, (size_t)event->getLine());
+    h = HashCombine(h, (size_t)level);
+    h = HashCombine(h, (size_t)event->getContext().get());
+    for(auto& i : event->getFields()) {
+        h = HashCombine(h, std::hash<std::string>()(i.key));
+        if(i.type == LogField::STRING) {
+            h = HashCombine(h, std::hash<std::string>()(i.str));
+        } else if(i.type == LogField::BOOL) {
+            h = HashCombine(h, i.b);
+        } else {
+            h = HashCombine(h, (size_t)i.u);
+        }
+    }
+    return h;
+}
+
+bool SameField(const LogField& a, const LogField& b) {
+    if(a.type != b.type || a.key != b.key) {
+        return false;
+    }
+    switch(a.type) {
+        case LogField::STRING:
+            return a.str == b.str;
+        case LogField::BOOL:
+            return a.b == b.b;
+        default:
+            return a.u == b.u;
+    }
+}
+
+/**
+ * @brief 调用点、内容、字段和诊断上下文都相同
+ * @details 文件名是__FILE__字面量, 同一调用点指针相同; 诊断上下文创建后不再修改, 比较指针即可
+ */
+bool SameEvent(const LogEvent::ptr& a, const LogEvent::ptr& b) {
+    if(a->getLine() != b->getLine()
+            || a->getContext() != b->getContext()
+            || a->getContent() != b->getContent()
+            || (a->getFile() != b->getFile()
+                && (!a->getFile() || !b->getFile() || strcmp(a->getFile(), b->getFile())))) {
+        return false;
+    }
+    auto& fa = a->getFields();
+    auto& fb = b->getFields();
+    if(fa.size() != fb.size()) {
+        return false;
+    }
+    for(size_t i = 0; i < fa.size(); ++i) {
+        if(!SameField(fa[i], fb[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+LogCoalescer::LogCoalescer(uint32_t window_ms, uint32_t max_sites)
+    :m_windowNs(window_ms * 1000000ULL)
+    ,m_maxSites(max_sites ? max_sites : 1) {
+    CoalesceRegistry& reg = GetRegistry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if(m_windowNs < reg.minWindowNs.load(std::memory_order_relaxed)) {
+        reg.minWindowNs.store(m_windowNs, std::memory_order_relaxed);
+        reg.cond.notify_one();
+    }
+    if(!reg.thread) {
+        reg.thread.reset(new Thread(&FlushLoop, "log_coalesce"));
+    }
+}
+
+void LogCoalescer::FlushThread() {
+    CoalesceThreadState& st = *t_state.state;
+    if(st.busy) {
+        return;
+    }
+    st.busy = true;
+    std::vector<CoalesceSummary> sums;
+    {
+        std::lock_guard<std::mutex> lock(st.mutex);
+        st.take(0, true, sums);
+        st.entries.clear();
+    }
+    for(auto& i : sums) {
+        i.logger->dispatch(i.level, i.event);
+    }
+    st.busy = false;
+}
+
+void LogCoalescer::process(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event) {
+    CoalesceThreadState& st = *t_state.state;
+    if(st.busy) {
+        logger->dispatch(level, event);
+        return;
+    }
+    st.busy = true;
+    uint64_t now = event->getTimestamp() ? event->getTimestamp() : Clock::NowNs();
+    size_t hash = HashEvent(level, event);
+    bool repeated = false;
+    {
+        //锁内只更新状态, Appender输出放到解锁后, 不阻塞刷新线程
+        std::lock_guard<std::mutex> lock(st.mutex);
+        ++st.tick;
+        CoalesceEntry* cur = nullptr;
+        for(auto& i : st.entries) {
+            if(i.owner.get() == this && i.logger == logger) {
+                cur = &i;
+            } else if(i.repeats && now > i.start && now - i.start >= i.window) {
+                //其它日志器上窗口已到期的计数顺便写出
+                st.outbox.push_back(CoalesceThreadState::Summary(i));
+            }
+        }
+
+        if(cur && cur->hash == hash && cur->level == level && SameEvent(cur->last, event)
+                && now - cur->start < m_windowNs) {
+            if(cur->repeats++ == 0) {
+                st.pending.store(true, std::memory_order_relaxed);
+            }
+            cur->lastNs = now;
+            cur->used = st.tick;
+            repeated = true;
+        } else {
+            if(cur) {
+                if(cur->repeats) {
+                    st.outbox.push_back(CoalesceThreadState::Summary(*cur));
+                }
+            } else {
+                if(st.entries.size() >= m_maxSites) {
+                    auto lru = st.entries.begin();
+                    for(auto it = st.entries.begin(); it != st.entries.end(); ++it) {
+                        if(it->used < lru->used) {
+                            lru = it;
+                        }
+                    }
+                    if(lru->repeats) {
+                        st.outbox.push_back(CoalesceThreadState::Summary(*lru));
+                    }
+                    st.entries.erase(lru);
+                }
+                st.entries.push_back(CoalesceEntry());
+                cur = &st.entries.back();
+                cur->owner = shared_from_this();
+                cur->logger = logger;
+            }
+            cur->last = event;
+            cur->level = level;
+            cur->hash = hash;
+            cur->window = m_windowNs;
+            cur->start = now;
+            cur->lastNs = now;
+            cur->repeats = 0;
+            cur->used = st.tick;
+        }
+    }
+    for(auto& i : st.outbox) {
+        i.logger->dispatch(i.level, i.event);
+    }
+    st.outbox.clear();
+    if(!repeated) {
+        logger->dispatch(level, event);
+    }
+    st.busy = false;
+}
+
+}
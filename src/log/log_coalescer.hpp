@@ -0,0 +1,56 @@
+/**
+ * @file log_coalescer.hpp
+ * @brief 重复日志合并: 同一调用点连续输出相同内容时只写第一条和"重复N次"
+ */
+#ifndef __KONG_LOG_COALESCER_H__
+#define __KONG_LOG_COALESCER_H__
+
+#include <cstdint>
+#include <memory>
+#include "log.hpp"
+
+namespace kong {
+
+/**
+ * @brief 重复日志合并器, 挂在Logger上, 位于Logger::log()和Appender之间
+ * @details 事件按 调用点(文件+行号) + 级别 + 内容 + 结构化字段 + 诊断上下文 判断是否相同.
+ *          每个线程、每个日志器记住最近一条写出的事件, 之后窗口内相同的事件只计数不输出,
+ *          出现不同的事件或窗口到期时先写一条 "last message repeated N times"(字段repeated=N).
+ *          状态是线程局部的, 每个线程一把锁, 只和后台刷新线程竞争.
+ *          线程不再写日志时, 刷新线程(log_coalesce, 每半个最小窗口检查一次)写出已到期的计数,
+ *          计数最晚在窗口开始后1.5个窗口内出现; 线程退出或调用FlushThread()时立即写出
+ *
+ *          Logger::ptr logger = KONG_LOG_NAME("net");
+ *          logger->setCoalescer(kong::LogCoalescer::ptr(new kong::LogCoalescer(1000)));
+ */
+class LogCoalescer : public std::enable_shared_from_this<LogCoalescer> {
+public:
+    typedef std::shared_ptr<LogCoalescer> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] window_ms 合并窗口(毫秒), 从写出第一条开始计算
+     * @param[in] max_sites 每个线程同时跟踪的日志器数, 超出时最久未用的先写出计数
+     */
+    LogCoalescer(uint32_t window_ms = 1000, uint32_t max_sites = 16);
+
+    uint32_t getWindowMs() const { return m_windowNs / 1000000;}
+
+    /**
+     * @brief 写出当前线程所有未输出的重复计数
+     */
+    static void FlushThread();
+
+    /**
+     * @brief 由Logger::log()调用, 需要输出的事件交给logger->dispatch()
+     */
+    void process(std::shared_ptr<Logger> logger, LogLevel::Level level, LogEvent::ptr event);
+private:
+    /// 窗口(纳秒)
+    uint64_t m_windowNs;
+    uint32_t m_maxSites;
+};
+
+}
+
+#endif
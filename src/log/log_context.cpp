@@ -0,0 +1,86 @@
+#include "log_context.hpp"
+#include <mutex>
+#include <unordered_map>
+#include "utils/object_pool.hpp"
+#include "utils/strutil.hpp"
+
+namespace kong {
+
+static thread_local LogContext::ptr t_context;
+
+uint32_t LogContext::Key(const std::string& name) {
+    static std::mutex s_mutex;
+    static std::unordered_map<std::string, uint32_t> s_keys;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    auto it = s_keys.find(name);
+    if(it != s_keys.end()) {
+        return it->second;
+    }
+    uint32_t id = s_keys.size();
+    s_keys[name] = id;
+    return id;
+}
+
+LogContext::ptr LogContext::Current() {
+    return t_context;
+}
+
+const LogContext* LogContext::CurrentRaw() {
+    return t_context.get();
+}
+
+LogContext::ptr LogContext::Swap(ptr ctx) {
+    t_context.swap(ctx);
+    return ctx;
+}
+
+LogContext::ptr LogContext::With(const ptr& ctx, const std::string& name, const std::string& value) {
+    std::shared_ptr<LogContext> rt = MakePooled<LogContext>();
+    if(ctx) {
+        rt->m_entries = ctx->m_entries;
+    }
+    uint32_t key = Key(name);
+    bool found = false;
+    for(auto& i : rt->m_entries) {
+        if(i.key == key) {
+            i.value = value;
+            found = true;
+            break;
+        }
+    }
+    if(!found) {
+        Entry e;
+        e.key = key;
+        e.name = name;
+        e.value = value;
+        rt->m_entries.push_back(e);
+    }
+    rt->build();
+    return rt;
+}
+
+void LogContext::build() {
+    m_slots.clear();
+    m_logfmt.clear();
+    m_json.clear();
+    for(size_t i = 0; i < m_entries.size(); ++i) {
+        const Entry& e = m_entries[i];
+        if(e.key >= m_slots.size()) {
+            m_slots.resize(e.key + 1, 0);
+        }
+        m_slots[e.key] = i + 1;
+
+        m_logfmt.append(1, ' ');
+        StrUtil::AppendLogfmtKey(m_logfmt, e.name.c_str(), e.name.size());
+        m_logfmt.append(1, '=');
+        StrUtil::AppendLogfmtValue(m_logfmt, e.value.c_str(), e.value.size());
+
+        m_json.append(",\"");
+        StrUtil::AppendJsonEscaped(m_json, e.name.c_str(), e.name.size());
+        m_json.append("\":\"");
+        StrUtil::AppendJsonEscaped(m_json, e.value.c_str(), e.value.size());
+        m_json.append(1, '"');
+    }
+}
+
+}
@@ -0,0 +1,142 @@
+/**
+ * @file log_context.hpp
+ * @brief 日志诊断上下文(MDC)
+ */
+#ifndef __KONG_LOG_CONTEXT_H__
+#define __KONG_LOG_CONTEXT_H__
+
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief 在当前作用域内为日志附加上下文字段
+ * @details KONG_LOG_CONTEXT("trace_id", id); 作用域结束时恢复之前的上下文
+ */
+#define KONG_LOG_CONTEXT(key, value) \
+    kong::LogContextScope KONG_LOG_CONTEXT_NAME(__LINE__)(key, value)
+
+#define KONG_LOG_CONTEXT_NAME(line) KONG_LOG_CONTEXT_NAME2(line)
+#define KONG_LOG_CONTEXT_NAME2(line) kong_log_context_##line
+
+namespace kong {
+
+/**
+ * @brief 日志上下文快照
+ * @details 不可修改, 设置字段时生成新快照, 日志事件创建时只增加引用计数。
+ *          设置时即渲染好logfmt和JSON两种形式以及每个字段的值, 格式化日志时
+ *          只做拷贝。当前快照按线程保存, 协程调度器切换时用Swap保存/恢复
+ */
+class LogContext {
+public:
+    typedef std::shared_ptr<const LogContext> ptr;
+
+    /**
+     * @brief 返回字段名对应的编号, 首次使用时分配
+     */
+    static uint32_t Key(const std::string& name);
+
+    /**
+     * @brief 返回当前线程的上下文, 没有时返回nullptr
+     */
+    static ptr Current();
+
+    /**
+     * @brief 返回当前线程上下文的裸指针, 不增加引用计数
+     * @details 供信号处理函数使用: 被中断的线程持有引用, 处理函数返回前快照不会被释放
+     */
+    static const LogContext* CurrentRaw();
+
+    /**
+     * @brief 替换当前线程的上下文, 返回原来的上下文
+     */
+    static ptr Swap(ptr ctx);
+
+    /**
+     * @brief 在ctx基础上设置字段, 返回新快照
+     * @param[in] ctx 原快照, 可为nullptr
+     * @param[in] name 字段名
+     * @param[in] value 字段值
+     */
+    static ptr With(const ptr& ctx, const std::string& name, const std::string& value);
+
+    /**
+     * @brief 返回字段值, 不存在时返回nullptr
+     */
+    const std::string* get(uint32_t key) const {
+        if(key < m_slots.size() && m_slots[key]) {
+            return &m_entries[m_slots[key] - 1].value;
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief 返回" k1=v1 k2=v2"形式的全部字段
+     */
+    const std::string& getLogfmt() const { return m_logfmt;}
+
+    /**
+     * @brief 返回",\"k1\":\"v1\",\"k2\":\"v2\""形式的全部字段
+     */
+    const std::string& getJson() const { return m_json;}
+
+    /**
+     * @brief 字段数
+     */
+    size_t size() const { return m_entries.size();}
+private:
+    struct Entry {
+        uint32_t key;
+        std::string name;
+        std::string value;
+    };
+
+    void build();
+private:
+    std::vector<Entry> m_entries;
+    /// 字段编号 -> m_entries下标+1
+    std::vector<uint16_t> m_slots;
+    std::string m_logfmt;
+    std::string m_json;
+};
+
+/**
+ * @brief 上下文作用域, 构造时设置字段, 析构时恢复
+ */
+class LogContextScope {
+public:
+    LogContextScope(const std::string& key, const std::string& value) {
+        set(key, value);
+    }
+
+    LogContextScope(const std::string& key, const char* value) {
+        set(key, value ? value : "");
+    }
+
+    template<class T>
+    LogContextScope(const std::string& key, const T& value) {
+        std::stringstream ss;
+        ss << value;
+        set(key, ss.str());
+    }
+
+    ~LogContextScope() {
+        LogContext::Swap(m_prev);
+    }
+private:
+    LogContextScope(const LogContextScope&) = delete;
+    LogContextScope& operator=(const LogContextScope&) = delete;
+
+    void set(const std::string& key, const std::string& value) {
+        m_prev = LogContext::Current();
+        LogContext::Swap(LogContext::With(m_prev, key, value));
+    }
+private:
+    LogContext::ptr m_prev;
+};
+
+}
+
+#endif
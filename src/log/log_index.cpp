@@ -0,0 +1,197 @@
+#include "log_index.hpp"
+#include "utils/util.hpp"
+#include <dirent.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+
+namespace kong {
+
+static const uint32_t s_indexVersion = 1;
+
+LogIndexWriter::LogIndexWriter(uint32_t block_size)
+    :m_blockSize(block_size) {
+    reset(0);
+}
+
+LogIndexWriter::~LogIndexWriter() {
+    close();
+}
+
+void LogIndexWriter::reset(uint64_t offset) {
+    m_cur.offset = offset;
+    m_cur.length = 0;
+    m_cur.levelMask = 0;
+    m_cur.minNs = UINT64_MAX;
+    m_cur.maxNs = 0;
+    m_end = offset;
+}
+
+/**
+ * @brief 在日志所在目录中找inode为inode的轮转文件(如app.log.1)
+ */
+static bool FindRotated(const std::string& filename, uint64_t inode, std::string& rotated) {
+    std::string dir = FSUtil::Dirname(filename);
+    std::string prefix = FSUtil::Basename(filename) + ".";
+    DIR* dp = opendir(dir.c_str());
+    if(!dp) {
+        return false;
+    }
+    bool found = false;
+    struct dirent* dent;
+    while(!found && (dent = readdir(dp))) {
+        std::string name = dent->d_name;
+        if(name.compare(0, prefix.size(), prefix) != 0
+                || (name.size() >= 4 && name.compare(name.size() - 4, 4, ".idx") == 0)) {
+            continue;
+        }
+        struct stat st;
+        std::string path = dir + "/" + name;
+        if(stat(path.c_str(), &st) == 0 && (uint64_t)st.st_ino == inode) {
+            rotated = path;
+            found = true;
+        }
+    }
+    closedir(dp);
+    return found;
+}
+
+/**
+ * @brief 日志被外部轮转(app.log -> app.log.1)后, 把旧索引移到轮转文件旁边, 查询轮转文件时还能用
+ */
+static void KeepRotatedIndex(const std::string& filename, uint64_t inode) {
+    std::string idxname = filename + ".idx";
+    LogIndexHeader hdr;
+    int fd = ::open(idxname.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return;
+    }
+    bool other = pread(fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr)
+            && memcmp(hdr.magic, KONG_LOG_INDEX_MAGIC, sizeof(hdr.magic)) == 0
+            && hdr.inode != inode;
+    ::close(fd);
+    std::string rotated;
+    if(other && FindRotated(filename, hdr.inode, rotated)) {
+        rename(idxname.c_str(), (rotated + ".idx").c_str());
+    }
+}
+
+bool LogIndexWriter::open(const std::string& filename, uint64_t log_size, uint64_t inode) {
+    close();
+    KeepRotatedIndex(filename, inode);
+    std::string idxname = filename + ".idx";
+    m_fd = ::open(idxname.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(m_fd < 0) {
+        return false;
+    }
+
+    bool valid = false;
+    LogIndexHeader hdr;
+    struct stat st;
+    if(log_size > 0 && fstat(m_fd, &st) == 0
+            && pread(m_fd, &hdr, sizeof(hdr), 0) == (ssize_t)sizeof(hdr)
+            && memcmp(hdr.magic, KONG_LOG_INDEX_MAGIC, sizeof(hdr.magic)) == 0
+            && hdr.version == s_indexVersion
+            && hdr.blockSize == m_blockSize
+            && hdr.inode == inode) {
+        //丢弃写了一半的索引项
+        uint64_t count = (st.st_size - sizeof(hdr)) / sizeof(LogIndexEntry);
+        uint64_t size = sizeof(hdr) + count * sizeof(LogIndexEntry);
+        LogIndexEntry last;
+        valid = true;
+        if(count > 0) {
+            valid = pread(m_fd, &last, sizeof(last), size - sizeof(last)) == (ssize_t)sizeof(last)
+                    && last.offset + last.length <= log_size;
+        }
+        if(valid && (uint64_t)st.st_size != size) {
+            valid = ftruncate(m_fd, size) == 0;
+        }
+    }
+    if(!valid) {
+        memcpy(hdr.magic, KONG_LOG_INDEX_MAGIC, sizeof(hdr.magic));
+        hdr.version = s_indexVersion;
+        hdr.blockSize = m_blockSize;
+        hdr.inode = inode;
+        if(ftruncate(m_fd, 0) != 0
+                || write(m_fd, &hdr, sizeof(hdr)) != (ssize_t)sizeof(hdr)) {
+            ::close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+    }
+    reset(log_size);
+    return true;
+}
+
+void LogIndexWriter::append(uint64_t end_offset, int level, uint64_t wall_ns) {
+    if(m_fd < 0) {
+        return;
+    }
+    m_end = end_offset;
+    m_cur.levelMask |= 1u << level;
+    if(wall_ns < m_cur.minNs) {
+        m_cur.minNs = wall_ns;
+    }
+    if(wall_ns > m_cur.maxNs) {
+        m_cur.maxNs = wall_ns;
+    }
+    if(m_end - m_cur.offset >= m_blockSize) {
+        flush();
+    }
+}
+
+void LogIndexWriter::flush() {
+    if(m_fd < 0 || m_end == m_cur.offset) {
+        return;
+    }
+    m_cur.length = (uint32_t)(m_end - m_cur.offset);
+    if(write(m_fd, &m_cur, sizeof(m_cur)) != (ssize_t)sizeof(m_cur)) {
+        //索引写失败不影响日志, 之后的内容查询时全量扫描
+        ::close(m_fd);
+        m_fd = -1;
+        return;
+    }
+    reset(m_end);
+}
+
+void LogIndexWriter::close() {
+    if(m_fd >= 0) {
+        flush();
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+bool LogIndexReader::load(const std::string& filename) {
+    m_entries.clear();
+    struct stat st;
+    if(stat(filename.c_str(), &st) != 0) {
+        return false;
+    }
+    std::string idxname = filename + ".idx";
+    FILE* fp = fopen(idxname.c_str(), "rb");
+    if(!fp) {
+        return false;
+    }
+    if(fread(&m_header, sizeof(m_header), 1, fp) != 1
+            || memcmp(m_header.magic, KONG_LOG_INDEX_MAGIC, sizeof(m_header.magic)) != 0
+            || m_header.version != s_indexVersion
+            || m_header.inode != (uint64_t)st.st_ino) {
+        fclose(fp);
+        return false;
+    }
+    LogIndexEntry e;
+    while(fread(&e, sizeof(e), 1, fp) == 1) {
+        if(e.offset + e.length > (uint64_t)st.st_size
+                || (!m_entries.empty() && e.offset < m_entries.back().offset + m_entries.back().length)) {
+            break;
+        }
+        m_entries.push_back(e);
+    }
+    fclose(fp);
+    return true;
+}
+
+}
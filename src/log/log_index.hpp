@@ -0,0 +1,133 @@
+/**
+ * @file log_index.hpp
+ * @brief 日志文件的稀疏时间/级别索引
+ * @details FileLogAppender指定索引块大小时, 在日志文件 xxx.log 旁边维护 xxx.log.idx, 每写满一个块追加一条索引,
+ *          记录该块的字节范围、时间范围和出现过的级别。查询时只读取命中的块
+ */
+#ifndef __KONG_LOG_INDEX_H__
+#define __KONG_LOG_INDEX_H__
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace kong {
+
+/// 索引文件魔数
+#define KONG_LOG_INDEX_MAGIC "KONGIDX1"
+
+/**
+ * @brief 索引文件头
+ */
+struct LogIndexHeader {
+    char magic[8];
+    uint32_t version;
+    /// 块大小(字节)
+    uint32_t blockSize;
+    /// 日志文件的inode, 文件被轮转替换后索引作废
+    uint64_t inode;
+};
+
+/**
+ * @brief 单个块的索引
+ */
+struct LogIndexEntry {
+    /// 块在日志文件中的起始偏移
+    uint64_t offset;
+    /// 块长度
+    uint32_t length;
+    /// 块内出现过的级别, 第level位
+    uint32_t levelMask;
+    /// 块内最早的墙上时间(纳秒)
+    uint64_t minNs;
+    /// 块内最晚的墙上时间(纳秒)
+    uint64_t maxNs;
+};
+
+/**
+ * @brief 索引写入器, 由FileLogAppender在每条日志写入后调用
+ */
+class LogIndexWriter {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] block_size 块大小(字节)
+     */
+    LogIndexWriter(uint32_t block_size = 64 * 1024);
+
+    ~LogIndexWriter();
+
+    /**
+     * @brief 打开日志文件对应的索引
+     * @param[in] filename 日志文件路径
+     * @param[in] log_size 日志文件当前长度
+     * @param[in] inode 日志文件inode
+     * @details 索引与日志文件不匹配时重建(已有日志内容不再索引, 查询时全量扫描);
+     *          旧索引描述的文件被轮转到同目录下(如app.log.1)时, 先把旧索引改名为app.log.1.idx
+     */
+    bool open(const std::string& filename, uint64_t log_size, uint64_t inode);
+
+    /**
+     * @brief 记录一条已写入的日志
+     * @param[in] end_offset 写入后日志文件的长度
+     * @param[in] level 日志级别
+     * @param[in] wall_ns 日志的墙上时间(纳秒)
+     */
+    void append(uint64_t end_offset, int level, uint64_t wall_ns);
+
+    /**
+     * @brief 把未写满的当前块写入索引
+     */
+    void flush();
+
+    /**
+     * @brief 写入当前块并关闭索引文件
+     */
+    void close();
+
+    /**
+     * @brief 返回块大小
+     */
+    uint32_t getBlockSize() const { return m_blockSize;}
+private:
+    void reset(uint64_t offset);
+private:
+    /// 索引文件描述符
+    int m_fd = -1;
+    /// 块大小
+    uint32_t m_blockSize;
+    /// 当前块
+    LogIndexEntry m_cur;
+    /// 当前块的结束偏移
+    uint64_t m_end = 0;
+};
+
+/**
+ * @brief 索引读取器
+ */
+class LogIndexReader {
+public:
+    /**
+     * @brief 加载日志文件对应的索引
+     * @param[in] filename 日志文件路径
+     * @return 索引存在且与日志文件匹配时返回true
+     */
+    bool load(const std::string& filename);
+
+    /**
+     * @brief 返回按偏移升序的索引项
+     */
+    const std::vector<LogIndexEntry>& getEntries() const { return m_entries;}
+
+    /**
+     * @brief 返回块大小
+     */
+    uint32_t getBlockSize() const { return m_header.blockSize;}
+private:
+    LogIndexHeader m_header = {};
+    std::vector<LogIndexEntry> m_entries;
+};
+
+}
+
+#endif
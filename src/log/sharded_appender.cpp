@@ -0,0 +1,269 @@
+#include "sharded_appender.hpp"
+#include <algorithm>
+#include <deque>
+#include <sched.h>
+#include <unistd.h>
+
+namespace kong {
+
+namespace {
+
+std::atomic<uint64_t> s_shardedId{0};
+
+/**
+ * @brief 线程持有的分片, 线程退出时标记关闭, 收集线程取空后回收
+ */
+struct ThreadShards {
+    struct Entry {
+        uint64_t id;
+        std::weak_ptr<ShardedLogAppender::Shard> weak;
+        ShardedLogAppender::Shard* shard;
+    };
+
+    ~ThreadShards() {
+        for(auto& i : entries) {
+            auto s = i.weak.lock();
+            if(s) {
+                s->closed.store(true, std::memory_order_release);
+            }
+        }
+    }
+
+    std::vector<Entry> entries;
+};
+
+static thread_local ThreadShards t_shards;
+
+struct ItemLater {
+    bool operator()(const ShardedLogAppender::Item& a, const ShardedLogAppender::Item& b) const {
+        if(a.ts != b.ts) {
+            return a.ts > b.ts;
+        }
+        if(a.shard != b.shard) {
+            return a.shard > b.shard;
+        }
+        return a.seq > b.seq;
+    }
+};
+
+/**
+ * @brief 收集线程上一个分片的待输出日志, 保持写入顺序
+ */
+struct ShardRun {
+    std::shared_ptr<ShardedLogAppender::Shard> shard;
+    std::deque<ShardedLogAppender::Item> items;
+};
+
+/**
+ * @brief 按队首日志比较两个ShardRun, 用于多路归并的小顶堆
+ */
+struct ShardRunLater {
+    ShardRunLater(const std::vector<ShardRun>& runs_)
+        :runs(runs_) {
+    }
+    bool operator()(size_t a, size_t b) const {
+        return ItemLater()(runs[a].items.front(), runs[b].items.front());
+    }
+    const std::vector<ShardRun>& runs;
+};
+
+}
+
+ShardedLogAppender::ShardedLogAppender(LogAppender::ptr sink, uint32_t reorder_ms, uint32_t shard_capacity)
+    :m_state(new State)
+    ,m_capacity(shard_capacity ? shard_capacity : 8192)
+    ,m_id(++s_shardedId) {
+    m_state->sink = sink;
+    m_state->windowNs = reorder_ms * 1000000ULL;
+    m_thread.reset(new Thread(std::bind(&ShardedLogAppender::Run, m_state), "log_merge"));
+}
+
+ShardedLogAppender::~ShardedLogAppender() {
+    m_state->stop.store(true, std::memory_order_release);
+    //在收集线程上析构时不能join, 收集线程输出剩余日志后自行退出
+    if(Thread::GetThis() != m_thread.get()) {
+        m_thread->join();
+    }
+}
+
+ShardedLogAppender::Shard* ShardedLogAppender::getShard() {
+    auto& entries = t_shards.entries;
+    for(auto& i : entries) {
+        if(i.id == m_id) {
+            return i.shard;
+        }
+    }
+    //清理已销毁的Appender留下的项
+    entries.erase(std::remove_if(entries.begin(), entries.end()
+                ,[](const ThreadShards::Entry& e) { return e.weak.expired();})
+            ,entries.end());
+
+    std::shared_ptr<Shard> shard;
+    {
+        std::lock_guard<std::mutex> lock(m_state->mutex);
+        shard.reset(new Shard(m_state->nextShardId++, m_capacity));
+        m_state->shards.push_back(shard);
+        m_state->version.fetch_add(1, std::memory_order_release);
+    }
+    ThreadShards::Entry e;
+    e.id = m_id;
+    e.weak = shard;
+    e.shard = shard.get();
+    entries.push_back(e);
+    return e.shard;
+}
+
+void ShardedLogAppender::log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) {
+    if(level < m_level) {
+        return;
+    }
+    std::shared_ptr<std::string> buf = MakePooled<std::string>();
+    m_formatter->render(*buf, logger, level, event);
+    logRendered(logger, level, event, buf);
+}
+
+void ShardedLogAppender::logRendered(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event, const LogBuffer& buf) {
+    if(level < m_level) {
+        return;
+    }
+    Item item;
+    item.ts = event->getTimestamp() ? event->getTimestamp() : Clock::NowNs();
+    item.level = level;
+    item.logger = logger;
+    item.event = event;
+    item.buf = buf;
+    Shard* shard = getShard();
+    item.shard = shard->id;
+    item.seq = shard->seq++;
+    if(!shard->queue.push(std::move(item))) {
+        m_state->fullWaits.fetch_add(1, std::memory_order_relaxed);
+        while(!shard->queue.push(std::move(item))) {
+            sched_yield();
+        }
+    }
+}
+
+void ShardedLogAppender::flush() {
+    uint64_t req = m_state->flushReq.fetch_add(1, std::memory_order_acq_rel) + 1;
+    std::unique_lock<std::mutex> lock(m_state->flushMutex);
+    while(m_state->flushDone < req) {
+        m_state->flushCond.wait(lock);
+    }
+}
+
+size_t ShardedLogAppender::getShardCount() {
+    std::lock_guard<std::mutex> lock(m_state->mutex);
+    return m_state->shards.size();
+}
+
+void ShardedLogAppender::Run(std::shared_ptr<State> state) {
+    std::vector<ShardRun> runs;
+    uint32_t version = state->version.load(std::memory_order_acquire) - 1;
+    /// 有待输出日志的ShardRun下标, 按队首日志组成小顶堆
+    std::vector<size_t> heads;
+    uint64_t last_ts = 0;
+    //空闲时的轮询间隔
+    useconds_t idle_us = std::max<uint64_t>(50, std::min<uint64_t>(1000, state->windowNs / 4000));
+
+    while(true) {
+        if(version != state->version.load(std::memory_order_acquire)) {
+            std::vector<std::shared_ptr<Shard> > shards;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                shards = state->shards;
+                version = state->version.load(std::memory_order_relaxed);
+            }
+            //已回收的分片队列已取空, 它的ShardRun输出完后再丢弃
+            std::vector<ShardRun> next(shards.size());
+            for(size_t i = 0; i < shards.size(); ++i) {
+                next[i].shard = shards[i];
+            }
+            for(auto& r : runs) {
+                auto it = std::find(shards.begin(), shards.end(), r.shard);
+                if(it != shards.end()) {
+                    next[it - shards.begin()].items.swap(r.items);
+                } else if(!r.items.empty()) {
+                    next.push_back(std::move(r));
+                }
+            }
+            runs.swap(next);
+        }
+        bool stop = state->stop.load(std::memory_order_acquire);
+        uint64_t flush = state->flushReq.load(std::memory_order_acquire);
+
+        size_t got = 0;
+        bool has_closed = false;
+        Item item;
+        for(auto& r : runs) {
+            //先读closed再取空, 保证关闭前写入的日志都已取出
+            bool closed = r.shard->closed.load(std::memory_order_acquire);
+            while(r.shard->queue.pop(item)) {
+                r.items.push_back(std::move(item));
+                ++got;
+            }
+            has_closed = has_closed || closed;
+        }
+
+        bool all = stop || flush != state->flushDone;
+        uint64_t now = Clock::NowNs();
+        ShardRunLater later(runs);
+        heads.clear();
+        for(size_t i = 0; i < runs.size(); ++i) {
+            if(!runs[i].items.empty()) {
+                heads.push_back(i);
+            }
+        }
+        std::make_heap(heads.begin(), heads.end(), later);
+        while(!heads.empty()) {
+            std::deque<Item>& items = runs[heads.front()].items;
+            Item& top = items.front();
+            if(!all && top.ts + state->windowNs > now) {
+                break;
+            }
+            std::pop_heap(heads.begin(), heads.end(), later);
+            if(top.ts < last_ts) {
+                state->late.fetch_add(1, std::memory_order_relaxed);
+            } else {
+                last_ts = top.ts;
+            }
+            if(state->sink->acceptsRendered()) {
+                state->sink->logRendered(top.logger, top.level, top.event, top.buf);
+            } else {
+                state->sink->log(top.logger, top.level, top.event);
+            }
+            items.pop_front();
+            if(items.empty()) {
+                heads.pop_back();
+            } else {
+                std::push_heap(heads.begin(), heads.end(), later);
+            }
+        }
+
+        if(flush != state->flushDone) {
+            std::lock_guard<std::mutex> lock(state->flushMutex);
+            state->flushDone = flush;
+            state->flushCond.notify_all();
+        }
+
+        if(has_closed) {
+            std::lock_guard<std::mutex> lock(state->mutex);
+            auto it = std::remove_if(state->shards.begin(), state->shards.end()
+                    ,[](const std::shared_ptr<Shard>& s) {
+                return s->closed.load(std::memory_order_acquire) && s->queue.empty();
+            });
+            if(it != state->shards.end()) {
+                state->shards.erase(it, state->shards.end());
+                state->version.fetch_add(1, std::memory_order_release);
+            }
+        }
+
+        if(stop) {
+            break;
+        }
+        if(!got) {
+            usleep(idle_us);
+        }
+    }
+}
+
+}
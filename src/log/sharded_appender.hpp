@@ -0,0 +1,137 @@
+/**
+ * @file sharded_appender.hpp
+ * @brief 每线程一个缓冲的异步Appender, 后台线程按时间戳归并输出
+ */
+#ifndef __KONG_SHARDED_APPENDER_H__
+#define __KONG_SHARDED_APPENDER_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+#include "log.hpp"
+#include "utils/spsc_queue.hpp"
+#include "utils/thread.hpp"
+
+namespace kong {
+
+/**
+ * @brief 分片异步Appender
+ * @details 每个写日志的线程独占一个SPSC队列, 写入路径上没有共享的可写缓存行。
+ *          日志在调用线程上用本Appender的格式器渲染, 收集线程把每个队列取出的日志
+ *          按写入顺序接到该分片的待输出序列后面, 再按(时间戳, 分片id, 序号)多路归并各序列的队首,
+ *          每条日志的归并代价是O(log 分片数)。事件至少等待reorder_ms才输出, 因此在重排窗口内
+ *          整体有序; 迟于窗口到达的事件立即输出并计入getLate()。同一线程的日志严格按写入顺序输出。
+ *          输出交给sink, sink支持logRendered时直接写渲染结果。
+ *          写线程之间互不阻塞, 但所有日志仍由单个收集线程输出, 总吞吐受它限制
+ */
+class ShardedLogAppender : public LogAppender {
+public:
+    typedef std::shared_ptr<ShardedLogAppender> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] sink 实际输出的Appender, 只在收集线程调用
+     * @param[in] reorder_ms 重排窗口(毫秒)
+     * @param[in] shard_capacity 每个线程队列的容量, 队列满时写日志的线程让出CPU等待
+     */
+    ShardedLogAppender(LogAppender::ptr sink
+                    ,uint32_t reorder_ms = 10
+                    ,uint32_t shard_capacity = 8192);
+
+    /**
+     * @brief 析构函数, 输出所有剩余日志后返回
+     */
+    ~ShardedLogAppender();
+
+    void log(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event) override;
+    void logRendered(Logger::ptr logger, LogLevel::Level level, LogEvent::ptr event, const LogBuffer& buf) override;
+    bool acceptsRendered() const override { return true;}
+
+    /**
+     * @brief 忽略重排窗口, 输出调用前写入的所有日志后返回
+     */
+    void flush();
+
+    /**
+     * @brief 当前分片数
+     */
+    size_t getShardCount();
+
+    /**
+     * @brief 迟于重排窗口到达的日志数
+     */
+    uint64_t getLate() const { return m_state->late.load(std::memory_order_relaxed);}
+
+    /**
+     * @brief 因队列满而等待的次数
+     */
+    uint64_t getFullWaits() const { return m_state->fullWaits.load(std::memory_order_relaxed);}
+public:
+    struct Item {
+        uint64_t ts = 0;
+        /// 所属分片的id和分片内的序号, 时间戳相同时依次比较, 保证归并结果确定
+        uint64_t shard = 0;
+        uint64_t seq = 0;
+        LogLevel::Level level = LogLevel::UNKNOW;
+        Logger::ptr logger;
+        LogEvent::ptr event;
+        LogBuffer buf;
+    };
+
+    struct Shard {
+        Shard(uint64_t id_, size_t capacity)
+            :id(id_)
+            ,queue(capacity) {
+        }
+        const uint64_t id;
+        /// 下一条日志的序号, 只由所属线程读写
+        uint64_t seq = 0;
+        SpscQueue<Item> queue;
+        /// 所属线程已退出
+        std::atomic<bool> closed{false};
+    };
+private:
+    /**
+     * @brief 收集线程与写日志线程共享的状态
+     * @details 队列中的日志持有Logger, Logger又持有本Appender, 最后一个引用可能
+     *          在收集线程上释放, 因此收集线程单独持有这部分状态
+     */
+    struct State {
+        LogAppender::ptr sink;
+        uint64_t windowNs;
+        std::mutex mutex;
+        std::vector<std::shared_ptr<Shard> > shards;
+        /// 下一个分片的id
+        uint64_t nextShardId = 0;
+        /// 分片列表变化时递增
+        std::atomic<uint32_t> version{0};
+        std::atomic<bool> stop{false};
+        std::atomic<uint64_t> flushReq{0};
+        std::mutex flushMutex;
+        std::condition_variable flushCond;
+        uint64_t flushDone = 0;
+        std::atomic<uint64_t> late{0};
+        std::atomic<uint64_t> fullWaits{0};
+    };
+
+    /**
+     * @brief 返回当前线程的分片, 首次调用时创建
+     */
+    Shard* getShard();
+
+    /**
+     * @brief 收集线程
+     */
+    static void Run(std::shared_ptr<State> state);
+private:
+    std::shared_ptr<State> m_state;
+    uint32_t m_capacity;
+    /// 实例id, 用于线程缓存
+    uint64_t m_id;
+    Thread::ptr m_thread;
+};
+
+}
+
+#endif
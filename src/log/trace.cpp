@@ -0,0 +1,353 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <set>
+#include <string.h>
+#include <unistd.h>
+#include "utils/spsc_queue.hpp"
+#include "utils/strutil.hpp"
+
+namespace kong {
+
+namespace {
+
+struct TraceRecord {
+    const char* cat = nullptr;
+    const char* name = nullptr;
+    uint64_t ts = 0;
+    uint64_t dur = 0;
+    uint32_t fiber = 0;
+    char phase = 'X';
+};
+
+struct TraceShard {
+    TraceShard()
+        :queue(8192) {
+    }
+    SpscQueue<TraceRecord> queue;
+    /// 所属线程已退出
+    std::atomic<bool> closed{false};
+    uint32_t tid = 0;
+    std::string threadName;
+    /// 已输出线程名(只由后台线程访问)
+    bool announced = false;
+};
+
+/**
+ * @brief 全局状态, 永不析构
+ */
+struct TraceState {
+    std::mutex mutex;
+    std::vector<TraceSite*> sites;
+    std::set<std::string> enabled;
+    std::vector<std::shared_ptr<TraceShard> > shards;
+    /// 分片列表变化时递增
+    std::atomic<uint32_t> version{0};
+    std::atomic<bool> running{false};
+    std::atomic<uint64_t> dropped{0};
+
+    /// 以下由runMutex保护
+    std::mutex runMutex;
+    Thread::ptr thread;
+    std::atomic<bool> stop{false};
+
+    std::atomic<uint64_t> flushReq{0};
+    std::mutex flushMutex;
+    std::condition_variable flushCond;
+    uint64_t flushDone = 0;
+};
+
+static TraceState& GetState() {
+    static TraceState* s_state = new TraceState;
+    return *s_state;
+}
+
+struct TraceThread {
+    ~TraceThread() {
+        if(shard) {
+            shard->closed.store(true, std::memory_order_release);
+        }
+    }
+    std::shared_ptr<TraceShard> shard;
+};
+
+static thread_local TraceThread t_trace;
+
+static TraceShard* GetShard() {
+    TraceShard* s = t_trace.shard.get();
+    if(s) {
+        return s;
+    }
+    std::shared_ptr<TraceShard> shard(new TraceShard);
+    shard->tid = GetThreadId();
+    shard->threadName = Thread::GetName();
+    TraceState& state = GetState();
+    {
+        std::lock_guard<std::mutex> lock(state.mutex);
+        state.shards.push_back(shard);
+        state.version.fetch_add(1, std::memory_order_release);
+    }
+    t_trace.shard = shard;
+    return shard.get();
+}
+
+/**
+ * @brief 追加微秒值, 保留3位小数
+ */
+static void AppendMicros(std::string& out, uint64_t ns) {
+    StrUtil::AppendUint64(out, ns / 1000);
+    char frac[4] = {'.', (char)('0' + ns % 1000 / 100), (char)('0' + ns % 100 / 10), (char)('0' + ns % 10)};
+    out.append(frac, 4);
+}
+
+static void AppendThreadName(std::string& out, uint32_t pid, const TraceShard& shard) {
+    out.append(",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":");
+    StrUtil::AppendUint64(out, pid);
+    out.append(",\"tid\":");
+    StrUtil::AppendUint64(out, shard.tid);
+    out.append(",\"args\":{\"name\":\"");
+    StrUtil::AppendJsonEscaped(out, shard.threadName.c_str(), shard.threadName.size());
+    out.append("\"}}");
+}
+
+static void AppendRecord(std::string& out, uint32_t pid, uint32_t tid, const TraceRecord& r) {
+    out.append(",\n{\"name\":\"");
+    StrUtil::AppendJsonEscaped(out, r.name, strlen(r.name));
+    out.append("\",\"cat\":\"");
+    StrUtil::AppendJsonEscaped(out, r.cat, strlen(r.cat));
+    out.append("\",\"ph\":\"");
+    out.append(1, r.phase);
+    out.append("\",\"ts\":");
+    AppendMicros(out, r.ts);
+    if(r.phase == 'X') {
+        out.append(",\"dur\":");
+        AppendMicros(out, r.dur);
+    }
+    out.append(",\"pid\":");
+    StrUtil::AppendUint64(out, pid);
+    out.append(",\"tid\":");
+    StrUtil::AppendUint64(out, tid);
+    out.append(",\"args\":{\"fiber\":");
+    StrUtil::AppendUint64(out, r.fiber);
+    out.append("}}");
+}
+
+/**
+ * @brief 把一批JSON交给sink
+ */
+static void Emit(LogAppender::ptr sink, Logger::ptr logger, std::string& batch) {
+    LogEvent::ptr event = MakePooled<LogEvent>(logger, LogLevel::INFO
+            , __FILE__, __LINE__, GetThreadId(), GetFiberId(), Clock::NowNs(), Thread::GetName());
+    if(sink->acceptsRendered()) {
+        std::shared_ptr<std::string> buf = MakePooled<std::string>();
+        buf->swap(batch);
+        sink->logRendered(logger, LogLevel::INFO, event, buf);
+    } else {
+        //不接受渲染结果的sink需使用"%m"格式
+        event->getSS() << batch;
+        sink->log(logger, LogLevel::INFO, event);
+    }
+    batch.clear();
+}
+
+static void Run(LogAppender::ptr sink, uint32_t flush_ms) {
+    TraceState& state = GetState();
+    Logger::ptr logger(new Logger("trace"));
+    uint32_t pid = getpid();
+    std::vector<std::shared_ptr<TraceShard> > shards;
+    uint32_t version = state.version.load(std::memory_order_acquire) - 1;
+    std::string batch;
+    uint64_t flush_ns = flush_ms * 1000000ULL;
+    uint64_t last_emit = Clock::NowNs();
+
+    //数组的第一个元素是进程名, 之后每个事件以",\n"开头, 停止时补上"]"
+    batch.append("[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":");
+    StrUtil::AppendUint64(batch, pid);
+    batch.append(",\"tid\":0,\"args\":{\"name\":\"");
+    char exe[256];
+    ssize_t len = readlink("/proc/self/exe", exe, sizeof(exe));
+    if(len > 0) {
+        const char* base = (const char*)memrchr(exe, '/', len);
+        base = base ? base + 1 : exe;
+        StrUtil::AppendJsonEscaped(batch, base, exe + len - base);
+    }
+    batch.append("\"}}");
+
+    {
+        //新会话写到新的输出里, 上个会话已输出过名字的线程也要重新输出
+        std::lock_guard<std::mutex> lock(state.mutex);
+        for(auto& s : state.shards) {
+            s->announced = false;
+        }
+    }
+
+    while(true) {
+        if(version != state.version.load(std::memory_order_acquire)) {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            shards = state.shards;
+            version = state.version.load(std::memory_order_relaxed);
+        }
+        bool stop = state.stop.load(std::memory_order_acquire);
+        uint64_t flush = state.flushReq.load(std::memory_order_acquire);
+
+        size_t got = 0;
+        bool has_closed = false;
+        TraceRecord r;
+        for(auto& s : shards) {
+            //先读closed再取空, 保证关闭前写入的事件都已取出
+            bool closed = s->closed.load(std::memory_order_acquire);
+            while(s->queue.pop(r)) {
+                if(!s->announced) {
+                    AppendThreadName(batch, pid, *s);
+                    s->announced = true;
+                }
+                AppendRecord(batch, pid, s->tid, r);
+                ++got;
+            }
+            has_closed = has_closed || closed;
+        }
+
+        uint64_t now = Clock::NowNs();
+        if(stop) {
+            batch.append("\n]\n");
+        }
+        if(!batch.empty() && (stop || flush != state.flushDone
+                    || batch.size() >= 64 * 1024 || now - last_emit >= flush_ns)) {
+            Emit(sink, logger, batch);
+            last_emit = now;
+        }
+
+        if(flush != state.flushDone) {
+            std::lock_guard<std::mutex> lock(state.flushMutex);
+            state.flushDone = flush;
+            state.flushCond.notify_all();
+        }
+
+        if(has_closed) {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            auto it = std::remove_if(state.shards.begin(), state.shards.end()
+                    ,[](const std::shared_ptr<TraceShard>& s) {
+                return s->closed.load(std::memory_order_acquire) && s->queue.empty();
+            });
+            if(it != state.shards.end()) {
+                state.shards.erase(it, state.shards.end());
+                state.version.fetch_add(1, std::memory_order_release);
+            }
+        }
+
+        if(stop) {
+            break;
+        }
+        if(!got) {
+            usleep(1000);
+        }
+    }
+}
+
+}
+
+bool TraceSite::resolve() {
+    TraceState& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if(m_state.load(std::memory_order_relaxed) == UNRESOLVED) {
+        state.sites.push_back(this);
+        m_state.store(state.enabled.count(m_cat) ? ON : OFF, std::memory_order_relaxed);
+    }
+    return m_state.load(std::memory_order_relaxed) == ON;
+}
+
+void Tracer::SetEnabled(const std::string& cat, bool v) {
+    TraceState& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if(v) {
+        state.enabled.insert(cat);
+    } else {
+        state.enabled.erase(cat);
+    }
+    for(auto i : state.sites) {
+        if(cat == i->m_cat) {
+            i->m_state.store(v ? TraceSite::ON : TraceSite::OFF, std::memory_order_relaxed);
+        }
+    }
+}
+
+bool Tracer::IsEnabled(const std::string& cat) {
+    TraceState& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+    return state.enabled.count(cat) > 0;
+}
+
+bool Tracer::Start(LogAppender::ptr sink, uint32_t flush_ms) {
+    TraceState& state = GetState();
+    std::lock_guard<std::mutex> lock(state.runMutex);
+    if(state.thread || !sink) {
+        return false;
+    }
+    state.stop.store(false, std::memory_order_release);
+    state.thread.reset(new Thread(std::bind(&Run, sink, flush_ms ? flush_ms : 100), "trace_flush"));
+    state.running.store(true, std::memory_order_release);
+    return true;
+}
+
+bool Tracer::StartFile(const std::string& path, uint32_t flush_ms) {
+    {
+        std::ofstream ofs(path.c_str(), std::ios::trunc);
+        if(!ofs) {
+            return false;
+        }
+    }
+    return Start(LogAppender::ptr(new FileLogAppender(path, 0)), flush_ms);
+}
+
+void Tracer::Stop() {
+    TraceState& state = GetState();
+    std::lock_guard<std::mutex> lock(state.runMutex);
+    if(!state.thread) {
+        return;
+    }
+    state.running.store(false, std::memory_order_release);
+    state.stop.store(true, std::memory_order_release);
+    state.thread->join();
+    state.thread.reset();
+    //唤醒停止前调用Flush的线程
+    std::lock_guard<std::mutex> flock(state.flushMutex);
+    state.flushDone = state.flushReq.load(std::memory_order_acquire);
+    state.flushCond.notify_all();
+}
+
+void Tracer::Flush() {
+    TraceState& state = GetState();
+    if(!state.running.load(std::memory_order_acquire)) {
+        return;
+    }
+    uint64_t req = state.flushReq.fetch_add(1, std::memory_order_acq_rel) + 1;
+    std::unique_lock<std::mutex> lock(state.flushMutex);
+    while(state.flushDone < req && state.running.load(std::memory_order_acquire)) {
+        state.flushCond.wait(lock);
+    }
+}
+
+uint64_t Tracer::GetDropped() {
+    return GetState().dropped.load(std::memory_order_relaxed);
+}
+
+void Tracer::Record(const TraceSite& site, char phase, uint64_t ts, uint64_t dur) {
+    TraceState& state = GetState();
+    if(!state.running.load(std::memory_order_relaxed)) {
+        state.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    TraceRecord r;
+    r.cat = site.getCategory();
+    r.name = site.getName();
+    r.ts = ts;
+    r.dur = dur;
+    r.fiber = GetFiberId();
+    r.phase = phase;
+    if(!GetShard()->queue.push(std::move(r))) {
+        state.dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+}
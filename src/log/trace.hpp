@@ -0,0 +1,187 @@
+/**
+ * @file trace.hpp
+ * @brief 作用域追踪, 输出Chrome trace-event格式
+ */
+#ifndef __KONG_TRACE_H__
+#define __KONG_TRACE_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "log.hpp"
+
+#define KONG_TRACE_NAME(prefix, line) KONG_TRACE_NAME2(prefix, line)
+#define KONG_TRACE_NAME2(prefix, line) prefix##line
+
+/**
+ * @brief 追踪当前作用域, 记录为一个完整事件(ph=X)
+ * @details 分类未启用时只有一次原子读和一次分支
+ */
+#define KONG_TRACE_SCOPE_CAT(cat, name) \
+    static kong::TraceSite KONG_TRACE_NAME(kong_trace_site_, __LINE__)(cat, name); \
+    kong::TraceScope KONG_TRACE_NAME(kong_trace_scope_, __LINE__)(KONG_TRACE_NAME(kong_trace_site_, __LINE__))
+
+/**
+ * @brief 追踪当前作用域, 分类为default
+ */
+#define KONG_TRACE_SCOPE(name) KONG_TRACE_SCOPE_CAT("default", name)
+
+/**
+ * @brief 记录开始事件(ph=B), 与同一线程上同名的KONG_TRACE_END配对
+ */
+#define KONG_TRACE_BEGIN_CAT(cat, name) \
+    do { \
+        static kong::TraceSite kong_trace_site(cat, name); \
+        if(kong_trace_site.enabled()) { \
+            kong::Tracer::Record(kong_trace_site, 'B', kong::Clock::NowNs(), 0); \
+        } \
+    } while(0)
+
+/**
+ * @brief 记录结束事件(ph=E)
+ */
+#define KONG_TRACE_END_CAT(cat, name) \
+    do { \
+        static kong::TraceSite kong_trace_site(cat, name); \
+        if(kong_trace_site.enabled()) { \
+            kong::Tracer::Record(kong_trace_site, 'E', kong::Clock::NowNs(), 0); \
+        } \
+    } while(0)
+
+#define KONG_TRACE_BEGIN(name) KONG_TRACE_BEGIN_CAT("default", name)
+#define KONG_TRACE_END(name) KONG_TRACE_END_CAT("default", name)
+
+namespace kong {
+
+/**
+ * @brief 追踪点, 每个调用位置一个静态实例
+ * @details 常量初始化, 不需要静态局部变量的初始化检查。首次使用时向Tracer
+ *          注册, 之后分类的启用状态由Tracer直接写入m_state
+ */
+class TraceSite {
+friend class Tracer;
+public:
+    enum State {
+        /// 尚未注册
+        UNRESOLVED = 0,
+        OFF = 1,
+        ON = 2
+    };
+
+    /**
+     * @param[in] cat 分类, 须为字面量
+     * @param[in] name 名称, 须为字面量
+     */
+    constexpr TraceSite(const char* cat, const char* name)
+        :m_cat(cat)
+        ,m_name(name)
+        ,m_state(UNRESOLVED) {
+    }
+
+    /**
+     * @brief 所属分类是否启用
+     */
+    bool enabled() {
+        int s = m_state.load(std::memory_order_relaxed);
+        if(__builtin_expect(s == OFF, 1)) {
+            return false;
+        }
+        return s == ON || resolve();
+    }
+
+    const char* getCategory() const { return m_cat;}
+    const char* getName() const { return m_name;}
+private:
+    bool resolve();
+private:
+    const char* m_cat;
+    const char* m_name;
+    std::atomic<int> m_state;
+};
+
+/**
+ * @brief 作用域追踪, 析构时记录完整事件
+ */
+class TraceScope {
+public:
+    TraceScope(TraceSite& site) {
+        if(site.enabled()) {
+            m_site = &site;
+            m_begin = Clock::NowNs();
+        }
+    }
+
+    ~TraceScope();
+private:
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+private:
+    TraceSite* m_site = nullptr;
+    uint64_t m_begin = 0;
+};
+
+/**
+ * @brief 追踪管理
+ * @details 每个线程把事件写入自己的SPSC队列, 队列满时丢弃并计数。后台线程
+ *          定期取出事件, 转成Chrome trace-event JSON, 按批交给sink输出。
+ *          输出文件可直接在chrome://tracing或Perfetto中打开
+ */
+class Tracer {
+public:
+    /**
+     * @brief 启用或禁用分类, 对已注册和之后注册的追踪点都生效
+     */
+    static void SetEnabled(const std::string& cat, bool v);
+
+    /**
+     * @brief 分类是否启用
+     */
+    static bool IsEnabled(const std::string& cat);
+
+    /**
+     * @brief 开始输出
+     * @param[in] sink 输出目标, 只在后台线程调用, 应指向一个新文件
+     * @param[in] flush_ms 批量输出的最长间隔
+     * @return 已经在输出时返回false
+     */
+    static bool Start(LogAppender::ptr sink, uint32_t flush_ms = 100);
+
+    /**
+     * @brief 清空文件后开始输出到文件
+     */
+    static bool StartFile(const std::string& path, uint32_t flush_ms = 100);
+
+    /**
+     * @brief 输出剩余事件, 补全JSON数组后停止
+     */
+    static void Stop();
+
+    /**
+     * @brief 输出调用前记录的所有事件
+     */
+    static void Flush();
+
+    /**
+     * @brief 因队列满或未开始输出而丢弃的事件数
+     */
+    static uint64_t GetDropped();
+
+    /**
+     * @brief 记录一个事件
+     * @param[in] phase 事件类型, X/B/E
+     * @param[in] ts 开始时间(Clock::NowNs)
+     * @param[in] dur 持续时间(纳秒), 只用于X
+     */
+    static void Record(const TraceSite& site, char phase, uint64_t ts, uint64_t dur);
+};
+
+inline TraceScope::~TraceScope() {
+    if(m_site) {
+        uint64_t now = Clock::NowNs();
+        Tracer::Record(*m_site, 'X', m_begin, now - m_begin);
+    }
+}
+
+}
+
+#endif
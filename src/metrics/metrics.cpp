@@ -0,0 +1,381 @@
+#include "metrics.hpp"
+#include <algorithm>
+#include <sstream>
+#include "utils/strutil.hpp"
+
+namespace kong {
+namespace metrics {
+
+static std::atomic<uint32_t> s_metricId{0};
+
+thread_local ThreadCells Metric::t_cells;
+__thread Cell** Metric::t_slots = nullptr;
+__thread uint32_t Metric::t_slotCount = 0;
+
+ThreadCells::~ThreadCells() {
+    Metric::t_slots = nullptr;
+    Metric::t_slotCount = 0;
+    for(auto& i : cells) {
+        if(i.second) {
+            i.first->retire(i.second);
+        }
+    }
+}
+
+Metric::Metric(Type type, const std::string& name, const std::string& help, const std::string& labels)
+    :m_type(type)
+    ,m_id(s_metricId++)
+    ,m_name(name)
+    ,m_help(help)
+    ,m_labels(labels) {
+}
+
+Cell* Metric::newCell() {
+    auto& cells = t_cells.cells;
+    if(m_id >= cells.size()) {
+        cells.resize(m_id + 1, std::make_pair((Metric*)nullptr, (Cell*)nullptr));
+        t_cells.slots.resize(m_id + 1, nullptr);
+    }
+    Cell* c = createCell();
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_cells.push_back(c);
+    }
+    cells[m_id] = std::make_pair(this, c);
+    t_cells.slots[m_id] = c;
+    t_slots = &t_cells.slots[0];
+    t_slotCount = t_cells.slots.size();
+    return c;
+}
+
+void Metric::retire(Cell* c) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_cells.erase(std::remove(m_cells.begin(), m_cells.end(), c), m_cells.end());
+    retireCell(c);
+    delete c;
+}
+
+uint64_t Counter::value() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    uint64_t v = m_retired;
+    for(auto i : m_cells) {
+        v += static_cast<CounterCell*>(i)->value.load(std::memory_order_relaxed);
+    }
+    return v;
+}
+
+void Counter::retireCell(Cell* c) {
+    m_retired += static_cast<CounterCell*>(c)->value.load(std::memory_order_relaxed);
+}
+
+int64_t Gauge::sum() {
+    int64_t v = m_base;
+    for(auto i : m_cells) {
+        v += static_cast<GaugeCell*>(i)->value.load(std::memory_order_relaxed);
+    }
+    return v;
+}
+
+void Gauge::set(int64_t v) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_base += v - sum();
+}
+
+int64_t Gauge::value() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return sum();
+}
+
+void Gauge::retireCell(Cell* c) {
+    m_base += static_cast<GaugeCell*>(c)->value.load(std::memory_order_relaxed);
+}
+
+HistogramSnapshot::HistogramSnapshot()
+    :m_buckets(Histogram::kBuckets, 0) {
+}
+
+void HistogramSnapshot::merge(const HistogramSnapshot& o) {
+    for(size_t i = 0; i < m_buckets.size(); ++i) {
+        m_buckets[i] += o.m_buckets[i];
+    }
+    m_count += o.m_count;
+    m_sum += o.m_sum;
+}
+
+uint64_t HistogramSnapshot::percentile(double q) const {
+    if(!m_count) {
+        return 0;
+    }
+    q = std::max(0.0, std::min(1.0, q));
+    uint64_t rank = (uint64_t)(q * (m_count - 1)) + 1;
+    uint64_t seen = 0;
+    for(uint32_t i = 0; i < m_buckets.size(); ++i) {
+        seen += m_buckets[i];
+        if(seen >= rank) {
+            uint64_t lo = Histogram::BucketLower(i);
+            return lo + (Histogram::BucketUpper(i) - lo) / 2;
+        }
+    }
+    return getMax();
+}
+
+uint64_t HistogramSnapshot::getMin() const {
+    for(uint32_t i = 0; i < m_buckets.size(); ++i) {
+        if(m_buckets[i]) {
+            return Histogram::BucketLower(i);
+        }
+    }
+    return 0;
+}
+
+uint64_t HistogramSnapshot::getMax() const {
+    for(uint32_t i = m_buckets.size(); i > 0; --i) {
+        if(m_buckets[i - 1]) {
+            return Histogram::BucketUpper(i - 1);
+        }
+    }
+    return 0;
+}
+
+Histogram::HistogramCell::~HistogramCell() {
+    for(auto& i : groups) {
+        delete [] i.load(std::memory_order_relaxed);
+    }
+}
+
+std::atomic<uint64_t>* Histogram::HistogramCell::allocGroup(uint32_t g) {
+    std::atomic<uint64_t>* group = new std::atomic<uint64_t>[kSubCount]();
+    groups[g].store(group, std::memory_order_release);
+    return group;
+}
+
+void Histogram::addCell(HistogramSnapshot& s, HistogramCell* c) {
+    for(uint32_t g = 0; g < kGroups; ++g) {
+        std::atomic<uint64_t>* group = c->groups[g].load(std::memory_order_acquire);
+        if(!group) {
+            continue;
+        }
+        for(uint32_t i = 0; i < kSubCount; ++i) {
+            uint64_t n = group[i].load(std::memory_order_relaxed);
+            s.m_buckets[(g << kSubBits) + i] += n;
+            s.m_count += n;
+        }
+    }
+    s.m_sum += c->sum.load(std::memory_order_relaxed);
+}
+
+HistogramSnapshot Histogram::snapshot() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    HistogramSnapshot s = m_retired;
+    for(auto i : m_cells) {
+        addCell(s, static_cast<HistogramCell*>(i));
+    }
+    return s;
+}
+
+void Histogram::retireCell(Cell* c) {
+    addCell(m_retired, static_cast<HistogramCell*>(c));
+}
+
+/**
+ * @brief 是否为合法的Prometheus名称, colon表示是否允许':'(指标名允许, 标签名不允许)
+ */
+static bool IsValidName(const std::string& name, bool colon) {
+    if(name.empty() || (name[0] >= '0' && name[0] <= '9')) {
+        return false;
+    }
+    for(char c : name) {
+        if(!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+                    || c == '_' || (colon && c == ':'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 转义标签值或HELP文本: 反斜杠和换行, quote为true时还有双引号
+ */
+static void AppendEscaped(std::string& out, const std::string& str, bool quote) {
+    for(char c : str) {
+        if(c == '\\' || (quote && c == '"')) {
+            out.append(1, '\\');
+            out.append(1, c);
+        } else if(c == '\n') {
+            out.append("\\n");
+        } else {
+            out.append(1, c);
+        }
+    }
+}
+
+static std::string RenderLabels(const MetricRegistry::Labels& labels) {
+    std::string rt;
+    for(auto& i : labels) {
+        if(!rt.empty()) {
+            rt.append(1, ',');
+        }
+        rt.append(i.first);
+        rt.append("=\"");
+        AppendEscaped(rt, i.second, true);
+        rt.append(1, '"');
+    }
+    return rt;
+}
+
+Metric::ptr MetricRegistry::get(Metric::Type type, const std::string& name, const std::string& help, const Labels& labels) {
+    if(!IsValidName(name, true)) {
+        return nullptr;
+    }
+    for(auto& i : labels) {
+        //双下划线开头的标签名由Prometheus保留
+        if(!IsValidName(i.first, false) || i.first.compare(0, 2, "__") == 0) {
+            return nullptr;
+        }
+    }
+    std::string lstr = RenderLabels(labels);
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto key = std::make_pair(name, lstr);
+    auto it = m_metrics.find(key);
+    if(it != m_metrics.end()) {
+        return it->second->getType() == type ? it->second : nullptr;
+    }
+    //同名的其它标签组合必须是同一类型
+    auto same = m_metrics.lower_bound(std::make_pair(name, std::string()));
+    if(same != m_metrics.end() && same->first.first == name && same->second->getType() != type) {
+        return nullptr;
+    }
+    Metric::ptr m;
+    switch(type) {
+        case Metric::COUNTER:
+            m.reset(new Counter(name, help, lstr));
+            break;
+        case Metric::GAUGE:
+            m.reset(new Gauge(name, help, lstr));
+            break;
+        default:
+            m.reset(new Histogram(name, help, lstr));
+            break;
+    }
+    m_metrics[key] = m;
+    return m;
+}
+
+Counter::ptr MetricRegistry::getCounter(const std::string& name, const std::string& help, const Labels& labels) {
+    return std::static_pointer_cast<Counter>(get(Metric::COUNTER, name, help, labels));
+}
+
+Gauge::ptr MetricRegistry::getGauge(const std::string& name, const std::string& help, const Labels& labels) {
+    return std::static_pointer_cast<Gauge>(get(Metric::GAUGE, name, help, labels));
+}
+
+Histogram::ptr MetricRegistry::getHistogram(const std::string& name, const std::string& help, const Labels& labels) {
+    return std::static_pointer_cast<Histogram>(get(Metric::HISTOGRAM, name, help, labels));
+}
+
+std::vector<Metric::ptr> MetricRegistry::getAll() {
+    std::vector<Metric::ptr> rt;
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for(auto& i : m_metrics) {
+        rt.push_back(i.second);
+    }
+    return rt;
+}
+
+static void AppendSeries(std::string& out, const std::string& name, const std::string& labels, const std::string& extra) {
+    out.append(name);
+    if(!labels.empty() || !extra.empty()) {
+        out.append(1, '{');
+        out.append(labels);
+        if(!labels.empty() && !extra.empty()) {
+            out.append(1, ',');
+        }
+        out.append(extra);
+        out.append(1, '}');
+    }
+    out.append(1, ' ');
+}
+
+std::string MetricRegistry::toPrometheus() {
+    static const double s_quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    std::string out;
+    std::string last;
+    for(auto& m : getAll()) {
+        const std::string& name = m->getName();
+        if(name != last) {
+            if(!m->getHelp().empty()) {
+                out.append("# HELP ").append(name).append(1, ' ');
+                AppendEscaped(out, m->getHelp(), false);
+                out.append(1, '\n');
+            }
+            out.append("# TYPE ").append(name).append(1, ' ');
+            out.append(m->getType() == Metric::COUNTER ? "counter"
+                    : m->getType() == Metric::GAUGE ? "gauge" : "summary");
+            out.append(1, '\n');
+            last = name;
+        }
+        switch(m->getType()) {
+            case Metric::COUNTER:
+                AppendSeries(out, name, m->getLabels(), "");
+                StrUtil::AppendUint64(out, std::static_pointer_cast<Counter>(m)->value());
+                out.append(1, '\n');
+                break;
+            case Metric::GAUGE:
+                AppendSeries(out, name, m->getLabels(), "");
+                StrUtil::AppendInt64(out, std::static_pointer_cast<Gauge>(m)->value());
+                out.append(1, '\n');
+                break;
+            default: {
+                HistogramSnapshot s = std::static_pointer_cast<Histogram>(m)->snapshot();
+                for(double q : s_quantiles) {
+                    std::string extra = "quantile=\"";
+                    StrUtil::AppendDouble(extra, q);
+                    extra.append(1, '"');
+                    AppendSeries(out, name, m->getLabels(), extra);
+                    StrUtil::AppendUint64(out, s.percentile(q));
+                    out.append(1, '\n');
+                }
+                AppendSeries(out, name + "_sum", m->getLabels(), "");
+                StrUtil::AppendUint64(out, s.getSum());
+                out.append(1, '\n');
+                AppendSeries(out, name + "_count", m->getLabels(), "");
+                StrUtil::AppendUint64(out, s.getCount());
+                out.append(1, '\n');
+                break;
+            }
+        }
+    }
+    return out;
+}
+
+std::string MetricRegistry::toSummary() {
+    std::stringstream ss;
+    for(auto& m : getAll()) {
+        ss << m->getName();
+        if(!m->getLabels().empty()) {
+            ss << "{" << m->getLabels() << "}";
+        }
+        switch(m->getType()) {
+            case Metric::COUNTER:
+                ss << " " << std::static_pointer_cast<Counter>(m)->value();
+                break;
+            case Metric::GAUGE:
+                ss << " " << std::static_pointer_cast<Gauge>(m)->value();
+                break;
+            default: {
+                HistogramSnapshot s = std::static_pointer_cast<Histogram>(m)->snapshot();
+                ss << " count=" << s.getCount()
+                   << " mean=" << s.getMean()
+                   << " p50=" << s.percentile(0.5)
+                   << " p99=" << s.percentile(0.99)
+                   << " max=" << s.getMax();
+                break;
+            }
+        }
+        ss << std::endl;
+    }
+    return ss.str();
+}
+
+}
+}
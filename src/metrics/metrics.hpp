@@ -0,0 +1,356 @@
+/**
+ * @file metrics.hpp
+ * @brief 计数器/仪表/直方图指标
+ */
+#ifndef __KONG_METRICS_H__
+#define __KONG_METRICS_H__
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "utils/singleton.hpp"
+
+namespace kong {
+namespace metrics {
+
+class Metric;
+
+/**
+ * @brief 线程私有的指标单元
+ * @details 每个线程对每个指标有自己的单元, 只由所属线程写入(普通的读-改-写,
+ *          没有锁前缀指令), 读取方汇总所有单元。线程退出时单元并入指标
+ */
+struct Cell {
+    virtual ~Cell() {}
+    /// 避免与其它线程的单元共享缓存行
+    char pad[64];
+};
+
+/**
+ * @brief 线程持有的所有单元, 按指标编号索引
+ * @details 只在创建单元和线程退出时使用, 热路径读Metric::t_slots
+ */
+struct ThreadCells {
+    ~ThreadCells();
+    std::vector<std::pair<Metric*, Cell*> > cells;
+    /// 单元指针, t_slots指向这里
+    std::vector<Cell*> slots;
+};
+
+/**
+ * @brief 指标基类
+ * @details 指标只能通过MetricRegistry创建, 创建后不会销毁
+ */
+class Metric {
+friend struct ThreadCells;
+public:
+    typedef std::shared_ptr<Metric> ptr;
+
+    enum Type {
+        COUNTER = 0,
+        GAUGE = 1,
+        HISTOGRAM = 2
+    };
+
+    virtual ~Metric() {}
+
+    Type getType() const { return m_type;}
+    const std::string& getName() const { return m_name;}
+    const std::string& getHelp() const { return m_help;}
+
+    /**
+     * @brief 返回Prometheus形式的标签, 如 method="GET",code="200"
+     */
+    const std::string& getLabels() const { return m_labels;}
+protected:
+    Metric(Type type, const std::string& name, const std::string& help, const std::string& labels);
+
+    /**
+     * @brief 返回当前线程的单元, 首次调用时创建
+     * @details 只读两个静态初始化的__thread变量, 不经过thread_local对象的初始化检查
+     */
+    Cell* cell() {
+        if(__builtin_expect(m_id < t_slotCount, 1)) {
+            Cell* c = t_slots[m_id];
+            if(__builtin_expect(c != nullptr, 1)) {
+                return c;
+            }
+        }
+        return newCell();
+    }
+
+    /**
+     * @brief 创建单元
+     */
+    virtual Cell* createCell() = 0;
+
+    /**
+     * @brief 线程退出, 把单元的值并入指标(已持有m_mutex)
+     */
+    virtual void retireCell(Cell* c) = 0;
+private:
+    Cell* newCell();
+    void retire(Cell* c);
+protected:
+    std::mutex m_mutex;
+    /// 存活线程的单元
+    std::vector<Cell*> m_cells;
+private:
+    Type m_type;
+    uint32_t m_id;
+    std::string m_name;
+    std::string m_help;
+    std::string m_labels;
+    static thread_local ThreadCells t_cells;
+    /// 当前线程的单元指针数组(t_cells.slots), 按指标编号索引
+    static __thread Cell** t_slots;
+    static __thread uint32_t t_slotCount;
+};
+
+/**
+ * @brief 单调递增计数器
+ */
+class Counter : public Metric {
+friend class MetricRegistry;
+public:
+    typedef std::shared_ptr<Counter> ptr;
+
+    void inc(uint64_t v = 1) {
+        auto c = static_cast<CounterCell*>(cell());
+        c->value.store(c->value.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+
+    uint64_t value();
+private:
+    Counter(const std::string& name, const std::string& help, const std::string& labels)
+        :Metric(COUNTER, name, help, labels) {
+    }
+
+    struct CounterCell : public Cell {
+        std::atomic<uint64_t> value{0};
+        char pad2[56];
+    };
+
+    Cell* createCell() override { return new CounterCell;}
+    void retireCell(Cell* c) override;
+private:
+    uint64_t m_retired = 0;
+};
+
+/**
+ * @brief 可增可减的仪表
+ * @details add按线程分片; set持锁, 以调用时刻的汇总值为基准调整
+ */
+class Gauge : public Metric {
+friend class MetricRegistry;
+public:
+    typedef std::shared_ptr<Gauge> ptr;
+
+    void add(int64_t v) {
+        auto c = static_cast<GaugeCell*>(cell());
+        c->value.store(c->value.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+
+    void inc() { add(1);}
+    void dec() { add(-1);}
+
+    void set(int64_t v);
+
+    int64_t value();
+private:
+    Gauge(const std::string& name, const std::string& help, const std::string& labels)
+        :Metric(GAUGE, name, help, labels) {
+    }
+
+    struct GaugeCell : public Cell {
+        std::atomic<int64_t> value{0};
+        char pad2[56];
+    };
+
+    Cell* createCell() override { return new GaugeCell;}
+    void retireCell(Cell* c) override;
+    /// 持有m_mutex时调用
+    int64_t sum();
+private:
+    int64_t m_base = 0;
+};
+
+/**
+ * @brief 直方图快照, 可合并
+ */
+class HistogramSnapshot {
+public:
+    HistogramSnapshot();
+
+    /**
+     * @brief 合并另一个快照
+     */
+    void merge(const HistogramSnapshot& o);
+
+    /**
+     * @brief 返回分位数, q取值[0, 1], 误差不超过桶宽的一半
+     */
+    uint64_t percentile(double q) const;
+
+    uint64_t getCount() const { return m_count;}
+    uint64_t getSum() const { return m_sum;}
+    double getMean() const { return m_count ? (double)m_sum / m_count : 0;}
+    uint64_t getMin() const;
+    uint64_t getMax() const;
+
+    /**
+     * @brief 返回每个桶的计数
+     */
+    const std::vector<uint64_t>& getBuckets() const { return m_buckets;}
+private:
+    friend class Histogram;
+    std::vector<uint64_t> m_buckets;
+    uint64_t m_count = 0;
+    uint64_t m_sum = 0;
+};
+
+/**
+ * @brief 对数-线性分桶直方图
+ * @details 每个2的幂区间等分为32个桶, 相对误差不超过1/32;
+ *          小于32的值精确记录, 不小于2^44的值记入最后一个桶。
+ *          线程单元按32个桶一组按需分配
+ */
+class Histogram : public Metric {
+friend class MetricRegistry;
+public:
+    typedef std::shared_ptr<Histogram> ptr;
+
+    static const uint32_t kSubBits = 5;
+    static const uint32_t kSubCount = 1 << kSubBits;
+    static const uint32_t kMaxBits = 44;
+    static const uint32_t kGroups = kMaxBits - kSubBits + 1;
+    static const uint32_t kBuckets = kGroups * kSubCount;
+
+    /**
+     * @brief 记录一个值
+     */
+    void record(uint64_t v) {
+        auto c = static_cast<HistogramCell*>(cell());
+        uint32_t idx = BucketIndex(v);
+        std::atomic<uint64_t>* group = c->groups[idx >> kSubBits].load(std::memory_order_relaxed);
+        if(__builtin_expect(!group, 0)) {
+            group = c->allocGroup(idx >> kSubBits);
+        }
+        std::atomic<uint64_t>& b = group[idx & (kSubCount - 1)];
+        b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        c->sum.store(c->sum.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 汇总所有线程的记录
+     */
+    HistogramSnapshot snapshot();
+
+    /**
+     * @brief 值所在的桶
+     */
+    static uint32_t BucketIndex(uint64_t v) {
+        if(v < kSubCount) {
+            return v;
+        }
+        uint32_t e = 63 - __builtin_clzll(v);
+        if(e >= kMaxBits) {
+            return kBuckets - 1;
+        }
+        uint32_t shift = e - kSubBits;
+        return ((shift + 1) << kSubBits) + (uint32_t)(v >> shift) - kSubCount;
+    }
+
+    /**
+     * @brief 桶的最小值
+     */
+    static uint64_t BucketLower(uint32_t idx) {
+        if(idx < kSubCount) {
+            return idx;
+        }
+        uint32_t g = idx >> kSubBits;
+        return (uint64_t)(kSubCount + (idx & (kSubCount - 1))) << (g - 1);
+    }
+
+    /**
+     * @brief 桶的最大值
+     */
+    static uint64_t BucketUpper(uint32_t idx) {
+        if(idx < kSubCount) {
+            return idx;
+        }
+        return BucketLower(idx) + (1ULL << ((idx >> kSubBits) - 1)) - 1;
+    }
+private:
+    Histogram(const std::string& name, const std::string& help, const std::string& labels)
+        :Metric(HISTOGRAM, name, help, labels) {
+    }
+
+    struct HistogramCell : public Cell {
+        HistogramCell() {
+            for(auto& i : groups) {
+                i.store(nullptr, std::memory_order_relaxed);
+            }
+        }
+        ~HistogramCell();
+        std::atomic<uint64_t>* allocGroup(uint32_t g);
+
+        std::atomic<std::atomic<uint64_t>*> groups[kGroups];
+        std::atomic<uint64_t> sum{0};
+        char pad2[56];
+    };
+
+    Cell* createCell() override { return new HistogramCell;}
+    void retireCell(Cell* c) override;
+    /// 持有m_mutex时调用
+    void addCell(HistogramSnapshot& s, HistogramCell* c);
+private:
+    HistogramSnapshot m_retired;
+};
+
+/**
+ * @brief 指标注册表
+ * @details 同名同标签的指标只创建一次; 名称相同时类型必须一致。
+ *          指标名须匹配[a-zA-Z_:][a-zA-Z0-9_:]*, 标签名须匹配[a-zA-Z_][a-zA-Z0-9_]*,
+ *          类型冲突或名称不合法时返回nullptr
+ */
+class MetricRegistry {
+public:
+    typedef std::map<std::string, std::string> Labels;
+
+    Counter::ptr getCounter(const std::string& name, const std::string& help = "", const Labels& labels = Labels());
+    Gauge::ptr getGauge(const std::string& name, const std::string& help = "", const Labels& labels = Labels());
+    Histogram::ptr getHistogram(const std::string& name, const std::string& help = "", const Labels& labels = Labels());
+
+    /**
+     * @brief 返回所有指标, 按名称和标签排序
+     */
+    std::vector<Metric::ptr> getAll();
+
+    /**
+     * @brief 输出Prometheus文本格式, 直方图按summary输出分位数
+     */
+    std::string toPrometheus();
+
+    /**
+     * @brief 输出每个指标一行的摘要
+     */
+    std::string toSummary();
+private:
+    Metric::ptr get(Metric::Type type, const std::string& name, const std::string& help, const Labels& labels);
+private:
+    std::mutex m_mutex;
+    std::map<std::pair<std::string, std::string>, Metric::ptr> m_metrics;
+};
+
+/// 指标注册表单例
+typedef kong::Singleton<MetricRegistry> MetricsMgr;
+
+}
+}
+
+#endif
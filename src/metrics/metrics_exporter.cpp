@@ -0,0 +1,200 @@
+#include "metrics_exporter.hpp"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace kong {
+namespace metrics {
+
+static kong::Logger::ptr g_logger = KONG_LOG_NAME("system");
+
+MetricsExporter::MetricsExporter(uint32_t interval_ms, MetricRegistry* registry)
+    :m_interval(interval_ms ? interval_ms : 10000)
+    ,m_registry(registry ? registry : MetricsMgr::GetInstance()) {
+}
+
+MetricsExporter::~MetricsExporter() {
+    stop();
+}
+
+bool MetricsExporter::start() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_thread) {
+        return false;
+    }
+    m_stop = false;
+    m_thread.reset(new Thread(std::bind(&MetricsExporter::run, this), "metrics_export"));
+    return true;
+}
+
+void MetricsExporter::stop() {
+    Thread::ptr thread;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+        thread.swap(m_thread);
+    }
+    if(thread) {
+        m_cond.notify_all();
+        thread->join();
+    }
+}
+
+void MetricsExporter::exportOnce() {
+    if(!m_file.empty()) {
+        WritePrometheusFile(m_registry, m_file);
+    }
+    if(m_logger) {
+        std::string summary = m_registry->toSummary();
+        if(!summary.empty()) {
+            summary.pop_back();
+            KONG_LOG_INFO(m_logger) << "metrics\n" << summary;
+        }
+    }
+}
+
+void MetricsExporter::run() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while(!m_stop) {
+        m_cond.wait_for(lock, std::chrono::milliseconds(m_interval));
+        lock.unlock();
+        exportOnce();
+        lock.lock();
+    }
+}
+
+bool MetricsExporter::WritePrometheusFile(MetricRegistry* registry, const std::string& path) {
+    std::string text = registry->toPrometheus();
+    std::string tmp = path + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "w");
+    if(!fp) {
+        KONG_LOG_ERROR(g_logger) << "open " << tmp << " failed errno=" << errno
+                                 << " errstr=" << strerror(errno);
+        return false;
+    }
+    bool ok = fwrite(text.c_str(), 1, text.size(), fp) == text.size();
+    ok = (fclose(fp) == 0) && ok;
+    if(!ok || rename(tmp.c_str(), path.c_str())) {
+        KONG_LOG_ERROR(g_logger) << "write " << path << " failed errno=" << errno
+                                 << " errstr=" << strerror(errno);
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+PrometheusHttpServer::PrometheusHttpServer(uint16_t port, const std::string& addr, MetricRegistry* registry)
+    :m_port(port)
+    ,m_addr(addr)
+    ,m_registry(registry ? registry : MetricsMgr::GetInstance()) {
+}
+
+PrometheusHttpServer::~PrometheusHttpServer() {
+    stop();
+}
+
+bool PrometheusHttpServer::start() {
+    if(m_thread) {
+        return false;
+    }
+    m_sock = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(m_sock < 0) {
+        return false;
+    }
+    int val = 1;
+    setsockopt(m_sock, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(m_port);
+    if(inet_pton(AF_INET, m_addr.c_str(), &sa.sin_addr) != 1
+            || bind(m_sock, (sockaddr*)&sa, sizeof(sa))
+            || listen(m_sock, 16)) {
+        KONG_LOG_ERROR(g_logger) << "metrics http bind " << m_addr << ":" << m_port
+                                 << " failed errno=" << errno << " errstr=" << strerror(errno);
+        close(m_sock);
+        m_sock = -1;
+        return false;
+    }
+    socklen_t len = sizeof(sa);
+    getsockname(m_sock, (sockaddr*)&sa, &len);
+    m_port = ntohs(sa.sin_port);
+    m_stop = false;
+    m_thread.reset(new Thread(std::bind(&PrometheusHttpServer::run, this), "metrics_http"));
+    return true;
+}
+
+void PrometheusHttpServer::stop() {
+    if(!m_thread) {
+        return;
+    }
+    m_stop = true;
+    m_thread->join();
+    m_thread.reset();
+    close(m_sock);
+    m_sock = -1;
+}
+
+void PrometheusHttpServer::run() {
+    while(!m_stop) {
+        pollfd pfd;
+        pfd.fd = m_sock;
+        pfd.events = POLLIN;
+        //定期醒来检查是否停止
+        if(poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        int fd = accept4(m_sock, nullptr, nullptr, SOCK_CLOEXEC);
+        if(fd < 0) {
+            continue;
+        }
+        handle(fd);
+        close(fd);
+    }
+}
+
+void PrometheusHttpServer::handle(int fd) {
+    timeval tv = {1, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    std::string req;
+    char buf[1024];
+    while(req.find("\r\n\r\n") == std::string::npos && req.size() < 8192) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if(n <= 0) {
+            return;
+        }
+        req.append(buf, n);
+    }
+
+    std::string status = "200 OK";
+    std::string body;
+    if(req.size() > 12 && req.compare(0, 12, "GET /metrics") == 0
+            && (req[12] == ' ' || req[12] == '?')) {
+        body = m_registry->toPrometheus();
+    } else {
+        status = "404 Not Found";
+        body = "not found\n";
+    }
+    std::string rsp = "HTTP/1.1 " + status + "\r\n"
+                      "Content-Type: text/plain; version=0.0.4\r\n"
+                      "Connection: close\r\n"
+                      "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n";
+    rsp.append(body);
+    size_t off = 0;
+    while(off < rsp.size()) {
+        ssize_t n = send(fd, rsp.c_str() + off, rsp.size() - off, MSG_NOSIGNAL);
+        if(n <= 0) {
+            return;
+        }
+        off += n;
+    }
+}
+
+}
+}
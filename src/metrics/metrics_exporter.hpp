@@ -0,0 +1,124 @@
+/**
+ * @file metrics_exporter.hpp
+ * @brief 指标导出: Prometheus文件/HTTP端点, 定期写日志
+ */
+#ifndef __KONG_METRICS_EXPORTER_H__
+#define __KONG_METRICS_EXPORTER_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include "metrics.hpp"
+#include "log/log.hpp"
+
+namespace kong {
+namespace metrics {
+
+/**
+ * @brief 定期导出指标
+ * @details 后台线程每隔interval_ms把注册表写成Prometheus文本文件(先写临时文件
+ *          再rename, 读取方不会看到半个文件), 并把摘要写入日志器
+ */
+class MetricsExporter {
+public:
+    typedef std::shared_ptr<MetricsExporter> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] interval_ms 导出间隔(毫秒)
+     * @param[in] registry 注册表, 默认为MetricsMgr
+     */
+    MetricsExporter(uint32_t interval_ms = 10000, MetricRegistry* registry = nullptr);
+
+    ~MetricsExporter();
+
+    /**
+     * @brief 设置输出文件, 空字符串表示不输出
+     */
+    void setFile(const std::string& path) { m_file = path;}
+
+    /**
+     * @brief 设置摘要写入的日志器, nullptr表示不输出
+     */
+    void setLogger(Logger::ptr logger) { m_logger = logger;}
+
+    /**
+     * @brief 启动后台线程
+     */
+    bool start();
+
+    /**
+     * @brief 停止后台线程, 停止前导出一次
+     */
+    void stop();
+
+    /**
+     * @brief 立即导出一次
+     */
+    void exportOnce();
+
+    /**
+     * @brief 把注册表写成Prometheus文本文件
+     */
+    static bool WritePrometheusFile(MetricRegistry* registry, const std::string& path);
+private:
+    void run();
+private:
+    uint32_t m_interval;
+    MetricRegistry* m_registry;
+    std::string m_file;
+    Logger::ptr m_logger;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    bool m_stop = false;
+    Thread::ptr m_thread;
+};
+
+/**
+ * @brief 提供GET /metrics的HTTP端点
+ * @details 单线程阻塞处理, 只用于本机抓取, 默认绑定127.0.0.1
+ */
+class PrometheusHttpServer {
+public:
+    typedef std::shared_ptr<PrometheusHttpServer> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] port 端口, 0表示由系统分配
+     * @param[in] addr 绑定地址
+     * @param[in] registry 注册表, 默认为MetricsMgr
+     */
+    PrometheusHttpServer(uint16_t port, const std::string& addr = "127.0.0.1", MetricRegistry* registry = nullptr);
+
+    ~PrometheusHttpServer();
+
+    /**
+     * @brief 绑定端口并启动服务线程
+     */
+    bool start();
+
+    /**
+     * @brief 停止服务线程
+     */
+    void stop();
+
+    /**
+     * @brief 实际监听的端口
+     */
+    uint16_t getPort() const { return m_port;}
+private:
+    void run();
+    void handle(int fd);
+private:
+    uint16_t m_port;
+    std::string m_addr;
+    MetricRegistry* m_registry;
+    int m_sock = -1;
+    std::atomic<bool> m_stop{false};
+    Thread::ptr m_thread;
+};
+
+}
+}
+
+#endif
@@ -0,0 +1,329 @@
+#include "handoff.hpp"
+#include "log/log.hpp"
+#include <algorithm>
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace kong {
+
+static kong::Logger::ptr g_logger = KONG_LOG_NAME("system");
+
+/// 一条SCM_RIGHTS消息最多携带的fd数(内核SCM_MAX_FD)
+static const size_t kMaxFds = 253;
+/// 随fd发送的数据上限, 一次recvmsg收完
+static const size_t kMaxData = 16 * 1024;
+/// 协议版本, 交接消息的第一行
+static const char* kMagic = "KONG_HANDOFF_1";
+/// 新进程就绪 / 旧进程确认
+static const char kReady = 'R';
+static const char kBye = 'B';
+
+static socklen_t MakeUnixAddress(const std::string& path, sockaddr_un& addr) {
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    size_t len = std::min(path.size(), sizeof(addr.sun_path) - 1);
+    memcpy(addr.sun_path, path.data(), len);
+    if(path[0] == '@') {
+        //抽象命名空间: 首字节为0, 长度不含结尾的0
+        addr.sun_path[0] = '\0';
+        return offsetof(sockaddr_un, sun_path) + len;
+    }
+    return offsetof(sockaddr_un, sun_path) + len + 1;
+}
+
+/**
+ * @brief 等待fd可读
+ * @return 1可读, 0超时, -1出错
+ */
+static int WaitReadable(int fd, uint64_t timeout_ms) {
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    int rt;
+    do {
+        rt = ::poll(&pfd, 1, timeout_ms ? (int)timeout_ms : -1);
+    } while(rt < 0 && errno == EINTR);
+    return rt;
+}
+
+bool SendFds(int sock, const std::vector<int>& fds, const std::string& data) {
+    if(fds.size() > kMaxFds || data.empty() || data.size() > kMaxData) {
+        return false;
+    }
+    iovec iov;
+    iov.iov_base = (void*)data.data();
+    iov.iov_len = data.size();
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxFds));
+    if(!fds.empty()) {
+        msg.msg_control = &control[0];
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * fds.size());
+        cmsghdr* c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+        memcpy(CMSG_DATA(c), &fds[0], sizeof(int) * fds.size());
+    }
+    ssize_t n;
+    do {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL);
+    } while(n < 0 && errno == EINTR);
+    return n == (ssize_t)data.size();
+}
+
+bool RecvFds(int sock, std::vector<int>& fds, std::string& data, uint64_t timeout_ms) {
+    if(WaitReadable(sock, timeout_ms) <= 0) {
+        return false;
+    }
+    std::vector<char> buf(kMaxData);
+    iovec iov;
+    iov.iov_base = &buf[0];
+    iov.iov_len = buf.size();
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * kMaxFds));
+    msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = &control[0];
+    msg.msg_controllen = control.size();
+    ssize_t n;
+    do {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while(n < 0 && errno == EINTR);
+    if(n <= 0) {
+        return false;
+    }
+    fds.clear();
+    for(cmsghdr* c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if(c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+            size_t count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t old = fds.size();
+            fds.resize(old + count);
+            memcpy(&fds[old], CMSG_DATA(c), sizeof(int) * count);
+        }
+    }
+    if(msg.msg_flags & (MSG_CTRUNC | MSG_TRUNC)) {
+        KONG_LOG_ERROR(g_logger) << "recv fds truncated";
+        for(int fd : fds) {
+            close(fd);
+        }
+        fds.clear();
+        return false;
+    }
+    data.assign(&buf[0], n);
+    return true;
+}
+
+HandoffServer::HandoffServer(const std::string& path)
+    :m_path(path) {
+}
+
+HandoffServer::~HandoffServer() {
+    stop();
+}
+
+void HandoffServer::addListener(const std::string& name, int fd) {
+    m_listeners.push_back(std::make_pair(name, fd));
+}
+
+bool HandoffServer::start(Callback cb) {
+    if(m_thread || m_path.empty()) {
+        return false;
+    }
+    sockaddr_un addr;
+    socklen_t len = MakeUnixAddress(m_path, addr);
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(m_path[0] != '@') {
+        //上一个进程交接后不删除文件, 由接手的进程删除后重新绑定
+        unlink(m_path.c_str());
+    }
+    //文件系统地址在listen前改为0600, 此前connect会被拒绝, 其它用户始终连不上
+    if(bind(m_fd, (sockaddr*)&addr, len)
+            || (m_path[0] != '@' && chmod(m_path.c_str(), 0600))
+            || listen(m_fd, 4)) {
+        KONG_LOG_ERROR(g_logger) << "handoff server bind " << m_path << " failed errno="
+                                 << errno << " errstr=" << strerror(errno);
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_cb = cb;
+    m_stop = false;
+    m_thread.reset(new Thread(std::bind(&HandoffServer::run, this), "handoff"));
+    return true;
+}
+
+void HandoffServer::stop() {
+    if(!m_thread) {
+        return;
+    }
+    m_stop = true;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_fd >= 0) {
+            //唤醒accept, 这个socket只属于本进程
+            shutdown(m_fd, SHUT_RDWR);
+        }
+    }
+    m_thread->join();
+    m_thread.reset();
+    if(m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+        if(m_path[0] != '@') {
+            unlink(m_path.c_str());
+        }
+    }
+}
+
+void HandoffServer::run() {
+    while(!m_stop) {
+        int fd = accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            break;
+        }
+        //监听fd交给谁就等于把端口交给谁, 只交给同一用户的进程
+        ucred cred;
+        memset(&cred, 0, sizeof(cred));
+        socklen_t len = sizeof(cred);
+        if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) || cred.uid != geteuid()) {
+            KONG_LOG_WARN(g_logger) << "handoff reject peer pid=" << cred.pid << " uid=" << cred.uid
+                                    << " via " << m_path;
+            close(fd);
+            continue;
+        }
+        bool done = serve(fd);
+        if(done) {
+            {
+                //先释放地址, 新进程收到确认后就可以绑定同一地址
+                std::lock_guard<std::mutex> lock(m_mutex);
+                close(m_fd);
+                m_fd = -1;
+            }
+            m_handedOff = true;
+            KONG_LOG_INFO(g_logger) << "listeners handed off via " << m_path;
+            if(m_cb) {
+                m_cb();
+            }
+            ::send(fd, &kBye, 1, MSG_NOSIGNAL);
+        }
+        close(fd);
+        if(done) {
+            break;
+        }
+    }
+}
+
+bool HandoffServer::serve(int fd) {
+    std::string data = kMagic;
+    std::vector<int> fds;
+    for(auto& i : m_listeners) {
+        data += "\n" + i.first;
+        fds.push_back(i.second);
+    }
+    if(!SendFds(fd, fds, data)) {
+        KONG_LOG_WARN(g_logger) << "handoff send fds failed errno=" << errno;
+        return false;
+    }
+    //等待新进程就绪; 新进程退出则继续等待下一个
+    while(!m_stop) {
+        int rt = WaitReadable(fd, 100);
+        if(rt < 0) {
+            return false;
+        } else if(rt == 0) {
+            continue;
+        }
+        char c;
+        ssize_t n = ::recv(fd, &c, 1, 0);
+        if(n < 0 && errno == EINTR) {
+            continue;
+        }
+        return n == 1 && c == kReady;
+    }
+    return false;
+}
+
+HandoffClient::~HandoffClient() {
+    if(m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool HandoffClient::acquire(const std::string& path, uint64_t timeout_ms) {
+    if(m_fd >= 0 || path.empty()) {
+        return false;
+    }
+    sockaddr_un addr;
+    socklen_t len = MakeUnixAddress(path, addr);
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(connect(m_fd, (sockaddr*)&addr, len)) {
+        //没有旧进程在运行
+        KONG_LOG_INFO(g_logger) << "no handoff server at " << path << " errno=" << errno;
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    std::vector<int> fds;
+    std::string data;
+    if(!RecvFds(m_fd, fds, data, timeout_ms)) {
+        KONG_LOG_ERROR(g_logger) << "handoff recv fds from " << path << " failed";
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    std::vector<std::string> names;
+    size_t pos = 0;
+    while(pos <= data.size()) {
+        size_t end = data.find('\n', pos);
+        if(end == std::string::npos) {
+            end = data.size();
+        }
+        names.push_back(data.substr(pos, end - pos));
+        pos = end + 1;
+    }
+    if(names.empty() || names[0] != kMagic || names.size() != fds.size() + 1) {
+        KONG_LOG_ERROR(g_logger) << "handoff bad message from " << path;
+        for(int fd : fds) {
+            close(fd);
+        }
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    for(size_t i = 0; i < fds.size(); ++i) {
+        m_listeners[names[i + 1]] = fds[i];
+    }
+    return true;
+}
+
+int HandoffClient::getListener(const std::string& name) const {
+    auto it = m_listeners.find(name);
+    return it == m_listeners.end() ? -1 : it->second;
+}
+
+bool HandoffClient::ready(uint64_t timeout_ms) {
+    if(m_fd < 0) {
+        return false;
+    }
+    bool ok = ::send(m_fd, &kReady, 1, MSG_NOSIGNAL) == 1
+            && WaitReadable(m_fd, timeout_ms) > 0;
+    char c = 0;
+    ok = ok && ::recv(m_fd, &c, 1, 0) == 1 && c == kBye;
+    close(m_fd);
+    m_fd = -1;
+    return ok;
+}
+
+}
@@ -0,0 +1,124 @@
+/**
+ * @file handoff.hpp
+ * @brief 平滑升级: 旧进程经Unix socket用SCM_RIGHTS把监听fd交给新进程
+ */
+#ifndef __KONG_HANDOFF_H__
+#define __KONG_HANDOFF_H__
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "utils/thread.hpp"
+
+namespace kong {
+
+/**
+ * @brief 升级流程
+ * @details 1. 旧进程运行时启动HandoffServer, 在约定的Unix socket地址上等待新进程
+ *          2. 新进程启动后用HandoffClient::acquire连上旧进程, 收到监听fd(与旧进程
+ *             共享同一个监听socket和accept队列), 开始accept
+ *          3. 新进程调用ready(), 旧进程收到后执行回调: 停止accept, 处理完已有连接后退出
+ *          整个过程中监听socket一直打开, 连接请求不会被拒绝.
+ *          注意旧进程停止accept时只能close自己的fd, 不能对监听socket调用shutdown,
+ *          shutdown作用于共享的socket本身, 新进程也会无法accept.
+ *          地址应当是文件系统路径, socket文件权限为0600, 只有同一用户能连接;
+ *          以'@'开头时使用Linux抽象命名空间, 任何用户都能连接, 只靠下面的检查拒绝.
+ *          无论哪种地址, 对端uid(SO_PEERCRED)与本进程euid不同时都不交接
+ */
+class HandoffServer {
+public:
+    typedef std::shared_ptr<HandoffServer> ptr;
+    typedef std::function<void()> Callback;
+
+    explicit HandoffServer(const std::string& path);
+    ~HandoffServer();
+
+    /**
+     * @brief 登记一个要交接的监听fd, name供新进程识别
+     */
+    void addListener(const std::string& name, int fd);
+
+    /**
+     * @brief 开始在后台线程等待新进程
+     * @param[in] cb 新进程就绪后在后台线程中调用, 旧进程在这里停止accept并开始退出
+     */
+    bool start(Callback cb);
+
+    /**
+     * @brief 停止等待, 不交接
+     */
+    void stop();
+
+    /**
+     * @brief 是否已经交接给新进程
+     */
+    bool isHandedOff() const { return m_handedOff;}
+private:
+    void run();
+
+    /**
+     * @brief 与一个新进程完成交接, 新进程中途断开返回false
+     */
+    bool serve(int fd);
+private:
+    std::string m_path;
+    /// m_fd在交接时由后台线程关闭, 与stop互斥
+    std::mutex m_mutex;
+    int m_fd = -1;
+    std::vector<std::pair<std::string, int> > m_listeners;
+    Callback m_cb;
+    Thread::ptr m_thread;
+    std::atomic<bool> m_stop{false};
+    std::atomic<bool> m_handedOff{false};
+};
+
+/**
+ * @brief 新进程一侧
+ */
+class HandoffClient {
+public:
+    HandoffClient() {}
+    ~HandoffClient();
+
+    /**
+     * @brief 连接旧进程并接收监听fd
+     * @return 没有旧进程或超时返回false, 这时新进程应当自己创建监听socket
+     */
+    bool acquire(const std::string& path, uint64_t timeout_ms);
+
+    /**
+     * @brief 按名字取得继承的监听fd, 没有时返回-1. fd的所有权归调用者
+     */
+    int getListener(const std::string& name) const;
+
+    const std::map<std::string, int>& getListeners() const { return m_listeners;}
+
+    /**
+     * @brief 已经开始accept, 通知旧进程停止accept
+     * @return 收到旧进程确认时返回true, 此后可以在同一地址上启动自己的HandoffServer
+     */
+    bool ready(uint64_t timeout_ms);
+private:
+    int m_fd = -1;
+    std::map<std::string, int> m_listeners;
+};
+
+/**
+ * @brief 经Unix socket发送fd
+ * @param[in] data 随fd一起发送的数据, 不能为空
+ */
+bool SendFds(int sock, const std::vector<int>& fds, const std::string& data);
+
+/**
+ * @brief 接收SendFds发送的fd和数据
+ * @param[in] timeout_ms 等待时间, 0表示一直等待
+ */
+bool RecvFds(int sock, std::vector<int>& fds, std::string& data, uint64_t timeout_ms = 0);
+
+}
+
+#endif
@@ -0,0 +1,281 @@
+#include "io_engine.hpp"
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <unistd.h>
+
+namespace kong {
+
+IoEngine::ptr IoEngine::Create(Type type, uint32_t entries) {
+    if(type != EPOLL && UringSupported()) {
+        std::shared_ptr<UringIoEngine> engine = std::make_shared<UringIoEngine>(entries);
+        if(engine->isValid()) {
+            return engine;
+        }
+    }
+    if(type == URING) {
+        return nullptr;
+    }
+    return std::make_shared<EpollIoEngine>();
+}
+
+const char* IoEngine::ToString(Type type) {
+    switch(type) {
+        case AUTO:
+            return "auto";
+        case EPOLL:
+            return "epoll";
+        case URING:
+            return "io_uring";
+    }
+    return "unknown";
+}
+
+enum {
+    OP_READ,
+    OP_WRITE,
+    OP_ACCEPT,
+    OP_CONNECT,
+    OP_RECV
+};
+
+struct EpollIoEngine::Op {
+    int type;
+    void* buf = nullptr;
+    size_t len = 0;
+    sockaddr_storage addr;
+    socklen_t alen = 0;
+    bool multishot = false;
+    bool connecting = false;
+    bool cancelled = false;
+    Callback cb;
+    RecvCallback rcb;
+};
+
+EpollIoEngine::EpollIoEngine()
+    :m_epfd(epoll_create1(EPOLL_CLOEXEC))
+    ,m_recvBuf(64 * 1024) {
+}
+
+EpollIoEngine::~EpollIoEngine() {
+    for(auto& i : m_fds) {
+        for(Op* op : i.second.in) {
+            delete op;
+        }
+        for(Op* op : i.second.out) {
+            delete op;
+        }
+    }
+    for(Op* op : m_cancelled) {
+        delete op;
+    }
+    close(m_epfd);
+}
+
+void EpollIoEngine::read(int fd, void* buf, size_t len, Callback cb) {
+    Op* op = new Op;
+    op->type = OP_READ;
+    op->buf = buf;
+    op->len = len;
+    op->cb.swap(cb);
+    submit(fd, op, false);
+}
+
+void EpollIoEngine::write(int fd, const void* buf, size_t len, Callback cb) {
+    Op* op = new Op;
+    op->type = OP_WRITE;
+    op->buf = (void*)buf;
+    op->len = len;
+    op->cb.swap(cb);
+    submit(fd, op, true);
+}
+
+void EpollIoEngine::accept(int fd, Callback cb, bool multishot) {
+    Op* op = new Op;
+    op->type = OP_ACCEPT;
+    op->multishot = multishot;
+    op->cb.swap(cb);
+    submit(fd, op, false);
+}
+
+void EpollIoEngine::connect(int fd, const sockaddr* addr, socklen_t len, Callback cb) {
+    Op* op = new Op;
+    op->type = OP_CONNECT;
+    memcpy(&op->addr, addr, std::min((size_t)len, sizeof(op->addr)));
+    op->alen = len;
+    op->cb.swap(cb);
+    submit(fd, op, true);
+}
+
+void EpollIoEngine::recvMultishot(int fd, RecvCallback cb) {
+    Op* op = new Op;
+    op->type = OP_RECV;
+    op->multishot = true;
+    op->rcb.swap(cb);
+    submit(fd, op, false);
+}
+
+void EpollIoEngine::submit(int fd, Op* op, bool out) {
+    ++m_stats.submitted;
+    auto it = m_fds.find(fd);
+    if(it == m_fds.end()) {
+        it = m_fds.insert(std::make_pair(fd, FdCtx())).first;
+        epoll_event ev;
+        ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+        ev.data.fd = fd;
+        ++m_stats.syscalls;
+        if(epoll_ctl(m_epfd, EPOLL_CTL_ADD, fd, &ev) && errno == EPERM) {
+            it->second.file = true;
+        }
+    }
+    std::deque<Op*>& q = out ? it->second.out : it->second.in;
+    q.push_back(op);
+    if(q.size() == 1) {
+        m_kick.push_back(std::make_pair(fd, out));
+    }
+}
+
+bool EpollIoEngine::perform(int fd, Op* op, int& res) {
+    ssize_t rt;
+    do {
+        ++m_stats.syscalls;
+        switch(op->type) {
+            case OP_READ:
+                rt = ::read(fd, op->buf, op->len);
+                break;
+            case OP_WRITE:
+                rt = ::send(fd, op->buf, op->len, MSG_NOSIGNAL);
+                if(rt < 0 && errno == ENOTSOCK) {
+                    rt = ::write(fd, op->buf, op->len);
+                }
+                break;
+            case OP_ACCEPT:
+                rt = ::accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                break;
+            case OP_CONNECT:
+                if(op->connecting) {
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len);
+                    res = -err;
+                    return true;
+                }
+                rt = ::connect(fd, (sockaddr*)&op->addr, op->alen);
+                if(rt < 0 && errno == EINPROGRESS) {
+                    op->connecting = true;
+                    return false;
+                }
+                break;
+            case OP_RECV:
+                rt = ::recv(fd, &m_recvBuf[0], m_recvBuf.size(), 0);
+                break;
+            default:
+                rt = -1;
+                errno = EINVAL;
+                break;
+        }
+    } while(rt < 0 && errno == EINTR);
+    if(rt < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return false;
+    }
+    res = rt < 0 ? -errno : (int)rt;
+    return true;
+}
+
+int EpollIoEngine::drive(int fd, bool out) {
+    int count = 0;
+    while(true) {
+        auto it = m_fds.find(fd);
+        if(it == m_fds.end()) {
+            break;
+        }
+        std::deque<Op*>& q = out ? it->second.out : it->second.in;
+        if(q.empty()) {
+            break;
+        }
+        Op* op = q.front();
+        int res;
+        if(!perform(fd, op, res)) {
+            break;
+        }
+        //多次请求成功时留在队首, 回调里cancel会把它移到m_cancelled
+        bool keep = op->multishot && (op->type == OP_RECV ? res > 0 : res >= 0);
+        if(!keep) {
+            q.pop_front();
+        }
+        ++count;
+        ++m_stats.completed;
+        if(op->type == OP_RECV) {
+            op->rcb(res, res > 0 ? &m_recvBuf[0] : nullptr);
+        } else {
+            op->cb(res);
+        }
+        if(!keep) {
+            delete op;
+        }
+    }
+    return count;
+}
+
+void EpollIoEngine::cancel(int fd) {
+    auto it = m_fds.find(fd);
+    if(it == m_fds.end()) {
+        return;
+    }
+    for(Op* op : it->second.in) {
+        op->cancelled = true;
+        m_cancelled.push_back(op);
+    }
+    for(Op* op : it->second.out) {
+        op->cancelled = true;
+        m_cancelled.push_back(op);
+    }
+    if(!it->second.file) {
+        ++m_stats.syscalls;
+        epoll_ctl(m_epfd, EPOLL_CTL_DEL, fd, nullptr);
+    }
+    m_fds.erase(it);
+}
+
+int EpollIoEngine::poll(int timeout_ms) {
+    int count = 0;
+    while(!m_kick.empty()) {
+        std::vector<std::pair<int, bool> > kick;
+        kick.swap(m_kick);
+        for(auto& i : kick) {
+            count += drive(i.first, i.second);
+        }
+    }
+
+    epoll_event events[256];
+    ++m_stats.syscalls;
+    int n = epoll_wait(m_epfd, events, 256, count || !m_cancelled.empty() ? 0 : timeout_ms);
+    for(int i = 0; i < n; ++i) {
+        uint32_t ev = events[i].events;
+        int fd = events[i].data.fd;
+        if(ev & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+            count += drive(fd, false);
+        }
+        if(ev & (EPOLLOUT | EPOLLERR | EPOLLHUP)) {
+            count += drive(fd, true);
+        }
+    }
+
+    while(!m_cancelled.empty()) {
+        std::vector<Op*> cancelled;
+        cancelled.swap(m_cancelled);
+        for(Op* op : cancelled) {
+            ++count;
+            ++m_stats.completed;
+            if(op->type == OP_RECV) {
+                op->rcb(-ECANCELED, nullptr);
+            } else {
+                op->cb(-ECANCELED);
+            }
+            delete op;
+        }
+    }
+    return count;
+}
+
+}
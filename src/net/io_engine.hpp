@@ -0,0 +1,309 @@
+/**
+ * @file io_engine.hpp
+ * @brief 完成式异步IO引擎: io_uring后端和epoll后端
+ */
+#ifndef __KONG_IO_ENGINE_H__
+#define __KONG_IO_ENGINE_H__
+
+#include <deque>
+#include <functional>
+#include <memory>
+#include <stdint.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace kong {
+
+/**
+ * @brief 异步IO引擎
+ * @details 提交读/写/accept/connect请求, 在poll()里执行完成回调. 两种后端对上层
+ *          接口完全一致:
+ *          - io_uring: 请求只写入提交队列, 每次poll()用一次io_uring_enter同时提交
+ *            和收割; 支持注册文件/注册缓冲区, 多次accept/recv(内核不支持时自动退化
+ *            为每次完成后重新提交)
+ *          - epoll: 下次poll()时先直接尝试一次, EAGAIN时挂到fd上等边沿触发的就绪事件
+ *          回调只在poll()所在线程执行, 引擎本身不是线程安全的.
+ *          fd需设为非阻塞; 写socket可能触发SIGPIPE, 由调用者忽略
+ */
+class IoEngine {
+public:
+    typedef std::shared_ptr<IoEngine> ptr;
+
+    /**
+     * @brief 完成回调
+     * @param[in] res 对应系统调用的返回值, 出错时为-errno
+     */
+    typedef std::function<void(int res)> Callback;
+
+    /**
+     * @brief 多次接收回调
+     * @param[in] res 大于0时为数据长度, 0为对端关闭, 小于0为-errno; res<=0后不再回调
+     * @param[in] data 数据, 只在回调期间有效
+     */
+    typedef std::function<void(int res, const char* data)> RecvCallback;
+
+    enum Type {
+        /// 优先io_uring, 不支持时用epoll
+        AUTO = 0,
+        EPOLL = 1,
+        URING = 2
+    };
+
+    struct Stats {
+        /// 提交的请求数
+        uint64_t submitted = 0;
+        /// 执行的回调数
+        uint64_t completed = 0;
+        /// 引擎发起的系统调用数
+        uint64_t syscalls = 0;
+    };
+
+    /**
+     * @brief 创建引擎
+     * @param[in] type 后端类型, 指定URING但不支持时返回nullptr
+     * @param[in] entries io_uring队列深度
+     */
+    static IoEngine::ptr Create(Type type = AUTO, uint32_t entries = 256);
+
+    /**
+     * @brief 运行时检测内核是否支持引擎需要的io_uring特性
+     */
+    static bool UringSupported();
+
+    static const char* ToString(Type type);
+
+    virtual ~IoEngine() {}
+
+    virtual Type getType() const = 0;
+
+    /**
+     * @brief 读, buf在完成前必须有效; buf位于注册缓冲区内时使用固定缓冲区
+     */
+    virtual void read(int fd, void* buf, size_t len, Callback cb) = 0;
+
+    /**
+     * @brief 写, buf在完成前必须有效; buf位于注册缓冲区内时使用固定缓冲区
+     */
+    virtual void write(int fd, const void* buf, size_t len, Callback cb) = 0;
+
+    /**
+     * @brief 接受连接, res为新连接的fd(已设为非阻塞)
+     * @param[in] multishot 持续接受, 每个连接回调一次, 直到出错或cancel
+     */
+    virtual void accept(int fd, Callback cb, bool multishot = false) = 0;
+
+    /**
+     * @brief 发起连接, 成功时res为0
+     */
+    virtual void connect(int fd, const sockaddr* addr, socklen_t len, Callback cb) = 0;
+
+    /**
+     * @brief 持续接收, 数据放在引擎管理的缓冲区里, 直到对端关闭/出错/cancel
+     */
+    virtual void recvMultishot(int fd, RecvCallback cb) = 0;
+
+    /**
+     * @brief 取消fd上所有未完成的请求, 回调以-ECANCELED执行; 关闭fd前调用
+     */
+    virtual void cancel(int fd) = 0;
+
+    /**
+     * @brief 注册热点连接, 之后的请求使用固定文件, 省去每次查找fd表
+     * @return 后端不支持或注册表已满时返回false, 不影响使用
+     */
+    virtual bool registerFile(int fd) { return false;}
+
+    /**
+     * @brief 注销注册的fd, 关闭fd前调用
+     */
+    virtual void unregisterFile(int fd) {}
+
+    /**
+     * @brief 注册缓冲区, 只能注册一次; 位于其中的读写不再每次映射用户内存
+     */
+    virtual bool registerBuffers(const iovec* iov, size_t n) { return false;}
+
+    /**
+     * @brief 提交排队的请求并执行已完成请求的回调
+     * @param[in] timeout_ms 没有完成时最多等待的毫秒数, -1表示一直等
+     * @return 执行的回调数
+     */
+    virtual int poll(int timeout_ms) = 0;
+
+    const Stats& getStats() const { return m_stats;}
+protected:
+    Stats m_stats;
+};
+
+/**
+ * @brief epoll后端
+ */
+class EpollIoEngine : public IoEngine {
+public:
+    EpollIoEngine();
+    ~EpollIoEngine();
+
+    Type getType() const override { return EPOLL;}
+    void read(int fd, void* buf, size_t len, Callback cb) override;
+    void write(int fd, const void* buf, size_t len, Callback cb) override;
+    void accept(int fd, Callback cb, bool multishot = false) override;
+    void connect(int fd, const sockaddr* addr, socklen_t len, Callback cb) override;
+    void recvMultishot(int fd, RecvCallback cb) override;
+    void cancel(int fd) override;
+    int poll(int timeout_ms) override;
+private:
+    struct Op;
+    struct FdCtx {
+        std::deque<Op*> in;
+        std::deque<Op*> out;
+        /// 普通文件不能加入epoll, 总是直接执行
+        bool file = false;
+    };
+
+    void submit(int fd, Op* op, bool out);
+
+    /**
+     * @brief 执行一次, 返回false表示EAGAIN
+     */
+    bool perform(int fd, Op* op, int& res);
+
+    /**
+     * @brief 依次执行fd一个方向上的请求, 直到EAGAIN
+     */
+    int drive(int fd, bool out);
+private:
+    int m_epfd;
+    std::unordered_map<int, FdCtx> m_fds;
+    /// 队列由空变为非空的(fd, 是否写方向), 下次poll()时先直接尝试
+    std::vector<std::pair<int, bool> > m_kick;
+    /// 已取消的请求, 在poll()里以-ECANCELED回调
+    std::vector<Op*> m_cancelled;
+    std::vector<char> m_recvBuf;
+};
+
+/**
+ * @brief io_uring后端, 直接使用系统调用, 不依赖liburing
+ */
+class UringIoEngine : public IoEngine {
+public:
+    /**
+     * @brief 构造函数, 失败时isValid()返回false
+     */
+    UringIoEngine(uint32_t entries);
+    ~UringIoEngine();
+
+    bool isValid() const { return m_ringFd >= 0;}
+
+    Type getType() const override { return URING;}
+    void read(int fd, void* buf, size_t len, Callback cb) override;
+    void write(int fd, const void* buf, size_t len, Callback cb) override;
+    void accept(int fd, Callback cb, bool multishot = false) override;
+    void connect(int fd, const sockaddr* addr, socklen_t len, Callback cb) override;
+    void recvMultishot(int fd, RecvCallback cb) override;
+    void cancel(int fd) override;
+    bool registerFile(int fd) override;
+    void unregisterFile(int fd) override;
+    bool registerBuffers(const iovec* iov, size_t n) override;
+    int poll(int timeout_ms) override;
+private:
+    struct Op;
+
+    /**
+     * @brief 取一个提交队列位置
+     * @return 提交一批后仍然满(内核因完成队列溢出拒收)时返回nullptr
+     */
+    struct io_uring_sqe* getSqe();
+
+    /**
+     * @brief 填写请求并放入提交队列, 没有位置时在下次poll()里以-EBUSY回调
+     */
+    void prepare(Op* op);
+
+    /**
+     * @brief 提交对op的取消, 没有位置时留到下次poll()
+     */
+    void submitCancel(Op* op);
+
+    /**
+     * @brief 重试没取到提交队列位置的缓冲区归还和取消, 执行失败请求的回调
+     * @return 执行的回调数
+     */
+    int flushDeferred();
+
+    /**
+     * @brief 把fd换成固定文件下标
+     */
+    void setFile(struct io_uring_sqe* sqe, int fd);
+
+    /**
+     * @brief 返回buf所在的注册缓冲区下标, 不在其中时返回-1
+     */
+    int findBuffer(const void* buf, size_t len) const;
+
+    void provideBuffer(uint32_t bid, uint32_t count);
+
+    void destroy(Op* op);
+
+    int enter(uint32_t submit, uint32_t wait, int timeout_ms);
+
+    int reap();
+
+    void complete(Op* op, int res, uint32_t flags);
+
+    void track(Op* op);
+    void release(Op* op);
+private:
+    int m_ringFd = -1;
+    void* m_sqPtr = nullptr;
+    size_t m_sqSize = 0;
+    void* m_cqPtr = nullptr;
+    size_t m_cqSize = 0;
+    struct io_uring_sqe* m_sqes = nullptr;
+    size_t m_sqesSize = 0;
+
+    uint32_t* m_sqHead = nullptr;
+    uint32_t* m_sqTail = nullptr;
+    uint32_t m_sqMask = 0;
+    uint32_t m_sqEntries = 0;
+    uint32_t* m_sqArray = nullptr;
+    uint32_t* m_cqHead = nullptr;
+    uint32_t* m_cqTail = nullptr;
+    uint32_t m_cqMask = 0;
+    struct io_uring_cqe* m_cqes = nullptr;
+
+    /// 已写入提交队列但尚未提交的数量
+    uint32_t m_toSubmit = 0;
+    /// fd -> 该fd上未完成请求的链表, 用于cancel和析构时释放
+    std::unordered_map<int, Op*> m_ops;
+    /// 已完成但取消请求还在内核里的op, 收到取消的完成事件后才归还, 避免地址被复用后误取消
+    std::unordered_set<Op*> m_detached;
+    /// 没取到提交队列位置的请求
+    std::vector<Op*> m_failed;
+    /// 没取到提交队列位置的取消
+    std::vector<Op*> m_cancelRetry;
+    /// 没取到提交队列位置的缓冲区归还(起始编号, 个数)
+    std::vector<std::pair<uint32_t, uint32_t> > m_bufRetry;
+
+    bool m_multishotAccept = true;
+    bool m_multishotRecv = true;
+
+    /// fd -> 固定文件下标+1
+    std::vector<int> m_fixed;
+    std::vector<int> m_freeSlots;
+    bool m_filesRegistered = false;
+
+    std::vector<iovec> m_buffers;
+
+    /// 多次接收使用的提供缓冲区组
+    char* m_recvBufs = nullptr;
+};
+
+}
+
+#endif
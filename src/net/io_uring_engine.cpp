@@ -0,0 +1,622 @@
+#include "io_engine.hpp"
+#include "utils/object_pool.hpp"
+#include <errno.h>
+#include <linux/io_uring.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace kong {
+
+/// 多次接收的提供缓冲区: 组号, 个数, 单个大小
+static const uint16_t kBufGroup = 1;
+static const uint32_t kBufCount = 256;
+static const uint32_t kBufSize = 4096;
+/// 固定文件表大小
+static const int kMaxFixedFiles = 1024;
+/// 取消请求的user_data为op地址加此标记(op至少8字节对齐)
+static const uint64_t kCancelTag = 1;
+
+static int UringSetup(uint32_t entries, io_uring_params* p) {
+    return syscall(SYS_io_uring_setup, entries, p);
+}
+
+static int UringRegister(int fd, unsigned op, const void* arg, unsigned nr) {
+    return syscall(SYS_io_uring_register, fd, op, arg, nr);
+}
+
+bool IoEngine::UringSupported() {
+    static int s_supported = -1;
+    if(s_supported >= 0) {
+        return s_supported;
+    }
+    s_supported = 0;
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = UringSetup(4, &p);
+    if(fd < 0) {
+        return false;
+    }
+    //EXT_ARG用于带超时的等待, NODROP保证完成队列溢出时不丢事件
+    const uint32_t features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+    if((p.features & features) == features) {
+        size_t size = sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op);
+        io_uring_probe* probe = (io_uring_probe*)calloc(1, size);
+        if(UringRegister(fd, IORING_REGISTER_PROBE, probe, 256) == 0) {
+            static const uint8_t ops[] = {IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED,
+                    IORING_OP_WRITE_FIXED, IORING_OP_ACCEPT, IORING_OP_CONNECT, IORING_OP_RECV,
+                    IORING_OP_PROVIDE_BUFFERS, IORING_OP_ASYNC_CANCEL};
+            s_supported = 1;
+            for(uint8_t op : ops) {
+                if(op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED)) {
+                    s_supported = 0;
+                }
+            }
+        }
+        free(probe);
+    }
+    close(fd);
+    return s_supported;
+}
+
+struct UringIoEngine::Op {
+    uint8_t opcode;
+    int fd;
+    void* buf = nullptr;
+    uint32_t len = 0;
+    int bufIndex = -1;
+    sockaddr_storage addr;
+    socklen_t alen = 0;
+    /// 调用者要求持续accept/recv
+    bool multishot = false;
+    /// 本次提交是否使用了内核的multishot
+    bool armedMultishot = false;
+    bool cancelled = false;
+    /// 有引用本op地址的取消请求尚未完成
+    bool cancelPending = false;
+    /// 已经完成回调, 等取消请求完成后归还
+    bool released = false;
+    Callback cb;
+    RecvCallback rcb;
+    Op* prev = nullptr;
+    Op* next = nullptr;
+};
+
+UringIoEngine::UringIoEngine(uint32_t entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    //完成事件推迟到下次进入内核时处理, 不用打断正在运行的线程
+    p.flags = IORING_SETUP_COOP_TASKRUN;
+    int fd = UringSetup(entries, &p);
+    if(fd < 0 && errno == EINVAL) {
+        memset(&p, 0, sizeof(p));
+        fd = UringSetup(entries, &p);
+    }
+    if(fd < 0) {
+        return;
+    }
+
+    m_sqSize = p.sq_off.array + p.sq_entries * sizeof(uint32_t);
+    m_cqSize = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    m_sqSize = m_cqSize = std::max(m_sqSize, m_cqSize);
+    m_sqPtr = mmap(nullptr, m_sqSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    m_sqesSize = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if(m_sqPtr == MAP_FAILED || sqes == MAP_FAILED) {
+        if(m_sqPtr != MAP_FAILED) {
+            munmap(m_sqPtr, m_sqSize);
+        }
+        if(sqes != MAP_FAILED) {
+            munmap(sqes, m_sqesSize);
+        }
+        m_sqPtr = nullptr;
+        close(fd);
+        return;
+    }
+    //SINGLE_MMAP: 提交和完成队列共用一块映射
+    m_cqPtr = m_sqPtr;
+    m_sqes = (io_uring_sqe*)sqes;
+
+    char* sq = (char*)m_sqPtr;
+    m_sqHead = (uint32_t*)(sq + p.sq_off.head);
+    m_sqTail = (uint32_t*)(sq + p.sq_off.tail);
+    m_sqMask = *(uint32_t*)(sq + p.sq_off.ring_mask);
+    m_sqEntries = *(uint32_t*)(sq + p.sq_off.ring_entries);
+    m_sqArray = (uint32_t*)(sq + p.sq_off.array);
+    char* cq = (char*)m_cqPtr;
+    m_cqHead = (uint32_t*)(cq + p.cq_off.head);
+    m_cqTail = (uint32_t*)(cq + p.cq_off.tail);
+    m_cqMask = *(uint32_t*)(cq + p.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe*)(cq + p.cq_off.cqes);
+    m_ringFd = fd;
+}
+
+UringIoEngine::~UringIoEngine() {
+    if(m_ringFd < 0) {
+        return;
+    }
+    //关闭ring时内核取消所有未完成的请求
+    munmap(m_sqes, m_sqesSize);
+    munmap(m_sqPtr, m_sqSize);
+    close(m_ringFd);
+    for(auto& i : m_ops) {
+        Op* op = i.second;
+        while(op) {
+            Op* next = op->next;
+            ObjectPool<Op>::Destroy(op);
+            op = next;
+        }
+    }
+    for(auto op : m_detached) {
+        ObjectPool<Op>::Destroy(op);
+    }
+    free(m_recvBufs);
+}
+
+io_uring_sqe* UringIoEngine::getSqe() {
+    uint32_t tail = *m_sqTail;
+    if(tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+        //提交队列满, 先提交一批
+        while(enter(m_toSubmit, 0, 0) < 0 && errno == EINTR) {
+        }
+        //完成队列溢出时内核返回EBUSY, 一个也不收, 不能覆盖还没提交的位置
+        if(tail - __atomic_load_n(m_sqHead, __ATOMIC_ACQUIRE) >= m_sqEntries) {
+            return nullptr;
+        }
+    }
+    uint32_t idx = tail & m_sqMask;
+    m_sqArray[idx] = idx;
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    ++m_toSubmit;
+    io_uring_sqe* sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+void UringIoEngine::setFile(io_uring_sqe* sqe, int fd) {
+    if(fd >= 0 && fd < (int)m_fixed.size() && m_fixed[fd]) {
+        sqe->fd = m_fixed[fd] - 1;
+        sqe->flags |= IOSQE_FIXED_FILE;
+    } else {
+        sqe->fd = fd;
+    }
+}
+
+int UringIoEngine::findBuffer(const void* buf, size_t len) const {
+    for(size_t i = 0; i < m_buffers.size(); ++i) {
+        const char* base = (const char*)m_buffers[i].iov_base;
+        if((const char*)buf >= base && (const char*)buf + len <= base + m_buffers[i].iov_len) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void UringIoEngine::track(Op* op) {
+    Op*& head = m_ops[op->fd];
+    op->prev = nullptr;
+    op->next = head;
+    if(head) {
+        head->prev = op;
+    }
+    head = op;
+    ++m_stats.submitted;
+}
+
+void UringIoEngine::release(Op* op) {
+    if(op->prev) {
+        op->prev->next = op->next;
+    } else {
+        auto it = m_ops.find(op->fd);
+        if(op->next) {
+            it->second = op->next;
+        } else {
+            m_ops.erase(it);
+        }
+    }
+    if(op->next) {
+        op->next->prev = op->prev;
+    }
+    if(op->cancelPending) {
+        op->released = true;
+        m_detached.insert(op);
+        return;
+    }
+    ObjectPool<Op>::Destroy(op);
+}
+
+void UringIoEngine::destroy(Op* op) {
+    m_detached.erase(op);
+    ObjectPool<Op>::Destroy(op);
+}
+
+void UringIoEngine::prepare(Op* op) {
+    io_uring_sqe* sqe = getSqe();
+    if(!sqe) {
+        m_failed.push_back(op);
+        return;
+    }
+    setFile(sqe, op->fd);
+    sqe->user_data = (uint64_t)op;
+    switch(op->opcode) {
+        case IORING_OP_READ:
+        case IORING_OP_WRITE:
+            sqe->opcode = op->opcode;
+            if(op->bufIndex >= 0) {
+                sqe->opcode = op->opcode == IORING_OP_READ ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+                sqe->buf_index = op->bufIndex;
+            }
+            sqe->addr = (uint64_t)op->buf;
+            sqe->len = op->len;
+            //-1表示使用并推进文件当前位置, 对socket无影响
+            sqe->off = (uint64_t)-1;
+            break;
+        case IORING_OP_ACCEPT:
+            sqe->opcode = IORING_OP_ACCEPT;
+            sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+            op->armedMultishot = op->multishot && m_multishotAccept;
+            if(op->armedMultishot) {
+                sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            }
+            break;
+        case IORING_OP_CONNECT:
+            sqe->opcode = IORING_OP_CONNECT;
+            sqe->addr = (uint64_t)&op->addr;
+            sqe->off = op->alen;
+            break;
+        case IORING_OP_RECV:
+            sqe->opcode = IORING_OP_RECV;
+            sqe->flags |= IOSQE_BUFFER_SELECT;
+            sqe->buf_group = kBufGroup;
+            op->armedMultishot = m_multishotRecv;
+            if(op->armedMultishot) {
+                sqe->ioprio = IORING_RECV_MULTISHOT;
+            } else {
+                sqe->len = kBufSize;
+            }
+            break;
+    }
+}
+
+void UringIoEngine::read(int fd, void* buf, size_t len, Callback cb) {
+    Op* op = ObjectPool<Op>::Create();
+    op->opcode = IORING_OP_READ;
+    op->fd = fd;
+    op->buf = buf;
+    op->len = len;
+    op->bufIndex = findBuffer(buf, len);
+    op->cb.swap(cb);
+    track(op);
+    prepare(op);
+}
+
+void UringIoEngine::write(int fd, const void* buf, size_t len, Callback cb) {
+    Op* op = ObjectPool<Op>::Create();
+    op->opcode = IORING_OP_WRITE;
+    op->fd = fd;
+    op->buf = (void*)buf;
+    op->len = len;
+    op->bufIndex = findBuffer(buf, len);
+    op->cb.swap(cb);
+    track(op);
+    prepare(op);
+}
+
+void UringIoEngine::accept(int fd, Callback cb, bool multishot) {
+    Op* op = ObjectPool<Op>::Create();
+    op->opcode = IORING_OP_ACCEPT;
+    op->fd = fd;
+    op->multishot = multishot;
+    op->cb.swap(cb);
+    track(op);
+    prepare(op);
+}
+
+void UringIoEngine::connect(int fd, const sockaddr* addr, socklen_t len, Callback cb) {
+    Op* op = ObjectPool<Op>::Create();
+    op->opcode = IORING_OP_CONNECT;
+    op->fd = fd;
+    memcpy(&op->addr, addr, std::min((size_t)len, sizeof(op->addr)));
+    op->alen = len;
+    op->cb.swap(cb);
+    track(op);
+    prepare(op);
+}
+
+void UringIoEngine::recvMultishot(int fd, RecvCallback cb) {
+    if(!m_recvBufs) {
+        m_recvBufs = (char*)malloc(kBufCount * kBufSize);
+        provideBuffer(0, kBufCount);
+    }
+    Op* op = ObjectPool<Op>::Create();
+    op->opcode = IORING_OP_RECV;
+    op->fd = fd;
+    op->multishot = true;
+    op->rcb.swap(cb);
+    track(op);
+    prepare(op);
+}
+
+void UringIoEngine::provideBuffer(uint32_t bid, uint32_t count) {
+    io_uring_sqe* sqe = getSqe();
+    if(!sqe) {
+        m_bufRetry.push_back(std::make_pair(bid, count));
+        return;
+    }
+    sqe->opcode = IORING_OP_PROVIDE_BUFFERS;
+    sqe->fd = count;
+    sqe->addr = (uint64_t)(m_recvBufs + (size_t)bid * kBufSize);
+    sqe->len = kBufSize;
+    sqe->off = bid;
+    sqe->buf_group = kBufGroup;
+}
+
+void UringIoEngine::cancel(int fd) {
+    auto it = m_ops.find(fd);
+    if(it == m_ops.end()) {
+        return;
+    }
+    //按user_data逐个取消, 不依赖较新内核才有的按fd取消
+    for(Op* op = it->second; op; op = op->next) {
+        if(op->cancelled) {
+            continue;
+        }
+        op->cancelled = true;
+        //取消请求按地址匹配, 它完成之前op不能归还对象池, 否则地址被新请求复用后会误取消
+        op->cancelPending = true;
+        submitCancel(op);
+    }
+}
+
+void UringIoEngine::submitCancel(Op* op) {
+    io_uring_sqe* sqe = getSqe();
+    if(!sqe) {
+        m_cancelRetry.push_back(op);
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = (uint64_t)op;
+    sqe->user_data = (uint64_t)op | kCancelTag;
+}
+
+int UringIoEngine::flushDeferred() {
+    if(!m_bufRetry.empty()) {
+        std::vector<std::pair<uint32_t, uint32_t> > bufs;
+        bufs.swap(m_bufRetry);
+        for(auto& i : bufs) {
+            provideBuffer(i.first, i.second);
+        }
+    }
+    if(!m_cancelRetry.empty()) {
+        std::vector<Op*> ops;
+        ops.swap(m_cancelRetry);
+        for(auto op : ops) {
+            if(op->released) {
+                //等待期间已经完成, 不用再取消
+                destroy(op);
+            } else {
+                submitCancel(op);
+            }
+        }
+    }
+    int count = 0;
+    if(!m_failed.empty()) {
+        std::vector<Op*> ops;
+        ops.swap(m_failed);
+        for(auto op : ops) {
+            ++m_stats.completed;
+            ++count;
+            if(op->opcode == IORING_OP_RECV) {
+                op->rcb(-EBUSY, nullptr);
+            } else {
+                op->cb(-EBUSY);
+            }
+            release(op);
+        }
+    }
+    return count;
+}
+
+bool UringIoEngine::registerFile(int fd) {
+    if(fd < 0) {
+        return false;
+    }
+    if(fd < (int)m_fixed.size() && m_fixed[fd]) {
+        return true;
+    }
+    if(!m_filesRegistered) {
+        //先注册一张空表, 之后逐个更新
+        std::vector<int> fds(kMaxFixedFiles, -1);
+        ++m_stats.syscalls;
+        if(UringRegister(m_ringFd, IORING_REGISTER_FILES, &fds[0], fds.size())) {
+            return false;
+        }
+        m_filesRegistered = true;
+        for(int i = kMaxFixedFiles - 1; i >= 0; --i) {
+            m_freeSlots.push_back(i);
+        }
+    }
+    if(m_freeSlots.empty()) {
+        return false;
+    }
+    int slot = m_freeSlots.back();
+    io_uring_files_update up;
+    memset(&up, 0, sizeof(up));
+    up.offset = slot;
+    up.fds = (uint64_t)&fd;
+    ++m_stats.syscalls;
+    if(UringRegister(m_ringFd, IORING_REGISTER_FILES_UPDATE, &up, 1) != 1) {
+        return false;
+    }
+    m_freeSlots.pop_back();
+    if(fd >= (int)m_fixed.size()) {
+        m_fixed.resize(fd + 1, 0);
+    }
+    m_fixed[fd] = slot + 1;
+    return true;
+}
+
+void UringIoEngine::unregisterFile(int fd) {
+    if(fd < 0 || fd >= (int)m_fixed.size() || !m_fixed[fd]) {
+        return;
+    }
+    int slot = m_fixed[fd] - 1;
+    int none = -1;
+    io_uring_files_update up;
+    memset(&up, 0, sizeof(up));
+    up.offset = slot;
+    up.fds = (uint64_t)&none;
+    ++m_stats.syscalls;
+    UringRegister(m_ringFd, IORING_REGISTER_FILES_UPDATE, &up, 1);
+    m_fixed[fd] = 0;
+    m_freeSlots.push_back(slot);
+}
+
+bool UringIoEngine::registerBuffers(const iovec* iov, size_t n) {
+    if(!m_buffers.empty() || !n) {
+        return false;
+    }
+    ++m_stats.syscalls;
+    if(UringRegister(m_ringFd, IORING_REGISTER_BUFFERS, iov, n)) {
+        return false;
+    }
+    m_buffers.assign(iov, iov + n);
+    return true;
+}
+
+int UringIoEngine::enter(uint32_t submit, uint32_t wait, int timeout_ms) {
+    uint32_t flags = 0;
+    io_uring_getevents_arg arg;
+    timespec ts;
+    void* argp = nullptr;
+    size_t argsz = 0;
+    if(wait) {
+        flags |= IORING_ENTER_GETEVENTS;
+        if(timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            memset(&arg, 0, sizeof(arg));
+            arg.ts = (uint64_t)&ts;
+            flags |= IORING_ENTER_EXT_ARG;
+            argp = &arg;
+            argsz = sizeof(arg);
+        }
+    }
+    ++m_stats.syscalls;
+    int rt = syscall(SYS_io_uring_enter, m_ringFd, submit, wait, flags, argp, argsz);
+    if(rt > 0) {
+        m_toSubmit -= std::min((uint32_t)rt, m_toSubmit);
+    }
+    return rt;
+}
+
+int UringIoEngine::reap() {
+    int count = 0;
+    uint32_t head = *m_cqHead;
+    while(head != __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE)) {
+        io_uring_cqe* cqe = &m_cqes[head & m_cqMask];
+        uint64_t data = cqe->user_data;
+        int res = cqe->res;
+        uint32_t flags = cqe->flags;
+        //先归还完成队列位置, 回调里可能继续提交
+        __atomic_store_n(m_cqHead, ++head, __ATOMIC_RELEASE);
+        if(data & kCancelTag) {
+            Op* op = (Op*)(data & ~kCancelTag);
+            op->cancelPending = false;
+            if(op->released) {
+                destroy(op);
+            }
+        } else if(data) {
+            complete((Op*)data, res, flags);
+            ++count;
+        }
+        head = *m_cqHead;
+    }
+    return count;
+}
+
+void UringIoEngine::complete(Op* op, int res, uint32_t flags) {
+    bool more = flags & IORING_CQE_F_MORE;
+    switch(op->opcode) {
+        case IORING_OP_RECV: {
+            if(res == -EINVAL && op->armedMultishot && !op->cancelled) {
+                //内核不支持multishot recv, 退化为每次完成后重新提交
+                m_multishotRecv = false;
+                prepare(op);
+                return;
+            }
+            if(res == -ENOBUFS && !op->cancelled) {
+                //缓冲区暂时用完, 回调里归还的缓冲区排在重新提交之前
+                if(!more) {
+                    prepare(op);
+                }
+                return;
+            }
+            if(res > 0) {
+                uint32_t bid = flags >> IORING_CQE_BUFFER_SHIFT;
+                ++m_stats.completed;
+                op->rcb(res, m_recvBufs + (size_t)bid * kBufSize);
+                provideBuffer(bid, 1);
+                if(more) {
+                    return;
+                }
+                if(!op->cancelled) {
+                    prepare(op);
+                    return;
+                }
+                res = -ECANCELED;
+            } else if(flags & IORING_CQE_F_BUFFER) {
+                provideBuffer(flags >> IORING_CQE_BUFFER_SHIFT, 1);
+            }
+            ++m_stats.completed;
+            op->rcb(res, nullptr);
+            release(op);
+            return;
+        }
+        case IORING_OP_ACCEPT:
+            if(res == -EINVAL && op->armedMultishot && !op->cancelled) {
+                m_multishotAccept = false;
+                prepare(op);
+                return;
+            }
+            ++m_stats.completed;
+            op->cb(res);
+            if(res >= 0 && op->multishot) {
+                if(more) {
+                    return;
+                }
+                if(!op->cancelled) {
+                    prepare(op);
+                    return;
+                }
+                ++m_stats.completed;
+                op->cb(-ECANCELED);
+            }
+            release(op);
+            return;
+        default:
+            ++m_stats.completed;
+            op->cb(res);
+            release(op);
+            return;
+    }
+}
+
+int UringIoEngine::poll(int timeout_ms) {
+    int count = flushDeferred() + reap();
+    if(count) {
+        //回调里新提交的请求留到下次poll(), 与等待合并成一次系统调用
+        return count;
+    }
+    if(!m_toSubmit && !timeout_ms) {
+        return 0;
+    }
+    //超时(ETIME)和被信号打断(EINTR)都不是错误, 直接收割
+    enter(m_toSubmit, timeout_ms ? 1 : 0, timeout_ms);
+    return reap();
+}
+
+}
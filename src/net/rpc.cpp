@@ -0,0 +1,513 @@
+#include "rpc.hpp"
+#include "log/log.hpp"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/tcp.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace kong {
+
+static kong::Logger::ptr g_logger = KONG_LOG_NAME("system");
+
+/// 帧类型
+static const uint8_t kRequest = 0;
+static const uint8_t kResponse = 1;
+
+/// 一次sendmsg最多携带的帧数
+static const size_t kMaxIov = 64;
+/// 读缓冲初始大小
+static const size_t kReadBufferSize = 64 * 1024;
+
+const char* RpcStatus::ToString(int code) {
+    switch(code) {
+#define XX(name) \
+        case name: \
+            return #name;
+        XX(OK);
+        XX(TIMEOUT);
+        XX(CLOSED);
+        XX(NOT_FOUND);
+        XX(BAD_REQUEST);
+        XX(BAD_RESPONSE);
+        XX(HANDLER_ERROR);
+#undef XX
+        default:
+            return "UNKNOWN";
+    }
+}
+
+/**
+ * @brief 写入长度占位和帧头
+ */
+static void BeginFrame(ByteArray& ba, uint8_t type, uint64_t id) {
+    ba.writeFuint32(0);
+    ba.writeFuint8(type);
+    ba.writeUint64(id);
+}
+
+/**
+ * @brief 回填长度并取出整帧
+ */
+static std::string FinishFrame(ByteArray& ba) {
+    std::string frame = ba.release();
+    uint32_t len = frame.size() - 4;
+    for(int i = 0; i < 4; ++i) {
+        frame[i] = (char)(len >> (i * 8));
+    }
+    return frame;
+}
+
+static bool ParseAddress(const std::string& addr, uint16_t port, sockaddr_storage& ss, socklen_t& len) {
+    memset(&ss, 0, sizeof(ss));
+    sockaddr_in* sin = (sockaddr_in*)&ss;
+    sockaddr_in6* sin6 = (sockaddr_in6*)&ss;
+    if(inet_pton(AF_INET, addr.c_str(), &sin->sin_addr) == 1) {
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(port);
+        len = sizeof(sockaddr_in);
+    } else if(inet_pton(AF_INET6, addr.c_str(), &sin6->sin6_addr) == 1) {
+        sin6->sin6_family = AF_INET6;
+        sin6->sin6_port = htons(port);
+        len = sizeof(sockaddr_in6);
+    } else {
+        KONG_LOG_ERROR(g_logger) << "rpc invalid address " << addr;
+        return false;
+    }
+    return true;
+}
+
+RpcSession::RpcSession(int fd)
+    :m_stream(fd)
+    ,m_rbuf(kReadBufferSize) {
+    //请求都是小包, 不能被Nagle延迟
+    int val = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+}
+
+bool RpcSession::send(std::string frame) {
+    std::unique_lock<FiberMutex> lock(m_mutex);
+    if(m_broken.load(std::memory_order_relaxed)) {
+        return false;
+    }
+    m_outbox.push_back(std::move(frame));
+    if(m_flushing) {
+        //正在发送的线程会把这一帧一起带走
+        return true;
+    }
+    m_flushing = true;
+    std::vector<std::string> frames;
+    bool ok = true;
+    while(ok && !m_outbox.empty()) {
+        frames.swap(m_outbox);
+        lock.unlock();
+        ok = writeFrames(frames);
+        frames.clear();
+        lock.lock();
+    }
+    m_flushing = false;
+    if(!ok) {
+        m_outbox.clear();
+        m_broken = true;
+        lock.unlock();
+        //让读线程也退出, 由它结束未完成的调用
+        ::shutdown(m_stream.getFd(), SHUT_RDWR);
+    }
+    return ok;
+}
+
+bool RpcSession::writeFrames(std::vector<std::string>& frames) {
+    iovec iov[kMaxIov];
+    for(size_t i = 0; i < frames.size();) {
+        size_t cnt = 0;
+        for(; i < frames.size() && cnt < kMaxIov; ++i, ++cnt) {
+            iov[cnt].iov_base = &frames[i][0];
+            iov[cnt].iov_len = frames[i].size();
+        }
+        size_t k = 0;
+        while(k < cnt) {
+            msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = iov + k;
+            msg.msg_iovlen = cnt - k;
+            ssize_t n = ::sendmsg(m_stream.getFd(), &msg, MSG_NOSIGNAL);
+            if(n < 0) {
+                if(errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            m_sendCalls.fetch_add(1, std::memory_order_relaxed);
+            //跳过已经写完的帧, 部分写出的帧调整起点
+            while(k < cnt && (size_t)n >= iov[k].iov_len) {
+                n -= iov[k++].iov_len;
+            }
+            if(k < cnt) {
+                iov[k].iov_base = (char*)iov[k].iov_base + n;
+                iov[k].iov_len -= n;
+            }
+        }
+        m_framesSent.fetch_add(cnt, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+bool RpcSession::recv(std::string& frame) {
+    while(true) {
+        size_t avail = m_rend - m_rpos;
+        if(avail >= 4) {
+            const unsigned char* p = (const unsigned char*)&m_rbuf[m_rpos];
+            uint32_t len = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+            if(len > kMaxFrameSize) {
+                KONG_LOG_ERROR(g_logger) << "rpc frame too large len=" << len;
+                return false;
+            }
+            if(avail >= 4 + (size_t)len) {
+                frame.assign(&m_rbuf[m_rpos + 4], len);
+                m_rpos += 4 + len;
+                return true;
+            }
+            if(4 + (size_t)len > m_rbuf.size()) {
+                m_rbuf.resize(4 + len);
+            }
+        }
+        //未解析的数据移到缓冲区开头
+        if(m_rpos) {
+            memmove(&m_rbuf[0], &m_rbuf[m_rpos], avail);
+            m_rpos = 0;
+            m_rend = avail;
+        }
+        int n = m_stream.read(&m_rbuf[m_rend], m_rbuf.size() - m_rend);
+        if(n <= 0) {
+            m_broken = true;
+            return false;
+        }
+        m_rend += n;
+    }
+}
+
+void RpcSession::shutdown() {
+    m_broken = true;
+    ::shutdown(m_stream.getFd(), SHUT_RDWR);
+}
+
+RpcClient::~RpcClient() {
+    close();
+}
+
+bool RpcClient::connect(const std::string& addr, uint16_t port) {
+    if(m_session) {
+        return false;
+    }
+    sockaddr_storage ss;
+    socklen_t len;
+    if(!ParseAddress(addr, port, ss, len)) {
+        return false;
+    }
+    int fd = socket(ss.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(fd < 0 || ::connect(fd, (sockaddr*)&ss, len)) {
+        KONG_LOG_ERROR(g_logger) << "rpc connect " << addr << ":" << port
+                                 << " failed errno=" << errno << " errstr=" << strerror(errno);
+        if(fd >= 0) {
+            ::close(fd);
+        }
+        return false;
+    }
+    m_session.reset(new RpcSession(fd));
+    m_closed = false;
+    m_reader.reset(new Thread(std::bind(&RpcClient::readLoop, this), "rpc_client"));
+    return true;
+}
+
+void RpcClient::close() {
+    if(!m_session) {
+        return;
+    }
+    m_session->shutdown();
+    m_reader->join();
+    m_reader.reset();
+    m_session.reset();
+}
+
+void RpcClient::BeginRequest(ByteArray& ba, uint64_t id, const std::string& method) {
+    BeginFrame(ba, kRequest, id);
+    ba.writeStringVint(method);
+}
+
+int RpcClient::invoke(uint64_t id, ByteArray& request, ByteArray& response
+                      ,uint64_t timeout_ms, std::string& error) {
+    Call call;
+    {
+        std::lock_guard<FiberMutex> lock(m_mutex);
+        if(m_closed) {
+            error = "not connected";
+            return RpcStatus::CLOSED;
+        }
+        m_calls[id] = &call;
+    }
+    bool sent = m_session->send(FinishFrame(request));
+    if(!sent || !call.waiter.parkFor(timeout_ms)) {
+        std::unique_lock<FiberMutex> lock(m_mutex);
+        if(m_calls.erase(id)) {
+            error = sent ? "timeout" : "send failed";
+            return sent ? RpcStatus::TIMEOUT : RpcStatus::CLOSED;
+        }
+        lock.unlock();
+        //读线程已经取走了这个调用, 唤醒马上就到
+        call.waiter.park();
+    }
+    if(call.code != RpcStatus::OK) {
+        error = call.code == RpcStatus::CLOSED ? "connection closed" : call.response.toString();
+    } else {
+        response = std::move(call.response);
+    }
+    return call.code;
+}
+
+void RpcClient::readLoop() {
+    std::string frame;
+    while(m_session->recv(frame)) {
+        ByteArray ba(std::move(frame));
+        uint64_t id;
+        uint32_t code;
+        try {
+            if(ba.readFuint8() != kResponse) {
+                KONG_LOG_ERROR(g_logger) << "rpc client unexpected frame type";
+                break;
+            }
+            id = ba.readUint64();
+            code = ba.readUint32();
+        } catch(std::out_of_range& e) {
+            KONG_LOG_ERROR(g_logger) << "rpc client bad frame: " << e.what();
+            break;
+        }
+        Waiter* w = nullptr;
+        {
+            std::lock_guard<FiberMutex> lock(m_mutex);
+            auto it = m_calls.find(id);
+            //已超时的调用不在表中, 响应直接丢弃
+            if(it != m_calls.end()) {
+                Call* call = it->second;
+                m_calls.erase(it);
+                call->code = code;
+                call->response = std::move(ba);
+                w = &call->waiter;
+                w->claim();
+            }
+        }
+        if(w) {
+            w->notify();
+        }
+    }
+    m_session->shutdown();
+    failAll(RpcStatus::CLOSED);
+}
+
+void RpcClient::failAll(int code) {
+    std::vector<Waiter*> waiters;
+    {
+        std::lock_guard<FiberMutex> lock(m_mutex);
+        m_closed = true;
+        for(auto& i : m_calls) {
+            i.second->code = code;
+            i.second->waiter.claim();
+            waiters.push_back(&i.second->waiter);
+        }
+        m_calls.clear();
+    }
+    for(auto w : waiters) {
+        w->notify();
+    }
+}
+
+RpcServer::RpcServer(uint32_t workers, size_t queue_capacity)
+    :m_workerCount(workers ? workers : 1)
+    ,m_queueCapacity(queue_capacity) {
+}
+
+RpcServer::~RpcServer() {
+    stop();
+    if(m_listenFd >= 0) {
+        ::close(m_listenFd);
+    }
+}
+
+bool RpcServer::bind(const std::string& addr, uint16_t port) {
+    sockaddr_storage ss;
+    socklen_t len;
+    if(m_listenFd >= 0 || !ParseAddress(addr, port, ss, len)) {
+        return false;
+    }
+    m_listenFd = socket(ss.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    int val = 1;
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+    if(::bind(m_listenFd, (sockaddr*)&ss, len) || listen(m_listenFd, SOMAXCONN)) {
+        KONG_LOG_ERROR(g_logger) << "rpc server bind " << addr << ":" << port
+                                 << " failed errno=" << errno << " errstr=" << strerror(errno);
+        ::close(m_listenFd);
+        m_listenFd = -1;
+        return false;
+    }
+    len = sizeof(ss);
+    getsockname(m_listenFd, (sockaddr*)&ss, &len);
+    m_port = ntohs(ss.ss_family == AF_INET ? ((sockaddr_in*)&ss)->sin_port
+                                           : ((sockaddr_in6*)&ss)->sin6_port);
+    return true;
+}
+
+bool RpcServer::start() {
+    if(m_started || m_listenFd < 0) {
+        return false;
+    }
+    m_started = true;
+    m_stop = false;
+    m_tasks = std::make_shared<Channel<std::function<void()> > >(m_queueCapacity);
+    for(uint32_t i = 0; i < m_workerCount; ++i) {
+        Channel<std::function<void()> >::ptr tasks = m_tasks;
+        m_workers.push_back(std::make_shared<Thread>([tasks]() {
+            std::function<void()> task;
+            while(tasks->recv(task)) {
+                task();
+                task = nullptr;
+            }
+        }, "rpc_worker_" + std::to_string(i)));
+    }
+    m_acceptor.reset(new Thread(std::bind(&RpcServer::acceptLoop, this), "rpc_accept"));
+    return true;
+}
+
+void RpcServer::stop() {
+    if(!m_started) {
+        return;
+    }
+    m_stop = true;
+    //唤醒阻塞在accept上的线程
+    ::shutdown(m_listenFd, SHUT_RDWR);
+    m_acceptor->join();
+    m_acceptor.reset();
+    {
+        std::lock_guard<FiberMutex> lock(m_mutex);
+        for(auto& c : m_conns) {
+            c->session->shutdown();
+        }
+    }
+    //工作线程仍在运行, 阻塞在满队列上的读线程能发送完后退出
+    for(auto& c : m_conns) {
+        c->thread->join();
+    }
+    m_conns.clear();
+    //已排队的请求执行完, 响应发送失败被忽略
+    m_tasks->close();
+    for(auto& t : m_workers) {
+        t->join();
+    }
+    m_workers.clear();
+    ::close(m_listenFd);
+    m_listenFd = -1;
+    m_started = false;
+}
+
+void RpcServer::acceptLoop() {
+    while(!m_stop) {
+        int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if(!m_stop) {
+                KONG_LOG_ERROR(g_logger) << "rpc server accept failed errno=" << errno
+                                         << " errstr=" << strerror(errno);
+            }
+            break;
+        }
+        reap();
+        std::unique_ptr<Connection> conn(new Connection);
+        conn->session.reset(new RpcSession(fd));
+        Connection* c = conn.get();
+        {
+            std::lock_guard<FiberMutex> lock(m_mutex);
+            m_conns.push_back(std::move(conn));
+        }
+        c->thread.reset(new Thread(std::bind(&RpcServer::readLoop, this, c), "rpc_conn"));
+    }
+}
+
+void RpcServer::reap() {
+    std::lock_guard<FiberMutex> lock(m_mutex);
+    for(size_t i = 0; i < m_conns.size();) {
+        if(m_conns[i]->done) {
+            m_conns[i]->thread->join();
+            m_conns[i] = std::move(m_conns.back());
+            m_conns.pop_back();
+        } else {
+            ++i;
+        }
+    }
+}
+
+void RpcServer::readLoop(Connection* conn) {
+    RpcSession::ptr session = conn->session;
+    std::string frame;
+    while(session->recv(frame)) {
+        std::shared_ptr<ByteArray> request = std::make_shared<ByteArray>(std::move(frame));
+        //队列满时在这里阻塞, 不再读取这个连接
+        if(!m_tasks->send(std::bind(&RpcServer::handle, this, session, request))) {
+            break;
+        }
+    }
+    session->shutdown();
+    conn->done = true;
+}
+
+void RpcServer::handle(const RpcSession::ptr& session, const std::shared_ptr<ByteArray>& request) {
+    ByteArray& in = *request;
+    uint64_t id;
+    std::string name;
+    try {
+        if(in.readFuint8() != kRequest) {
+            KONG_LOG_ERROR(g_logger) << "rpc server unexpected frame type";
+            session->shutdown();
+            return;
+        }
+        id = in.readUint64();
+        name = in.readStringVint();
+    } catch(std::out_of_range& e) {
+        KONG_LOG_ERROR(g_logger) << "rpc server bad frame: " << e.what();
+        session->shutdown();
+        return;
+    }
+
+    ByteArray out;
+    BeginFrame(out, kResponse, id);
+    int code = RpcStatus::OK;
+    std::string error;
+    auto it = m_methods.find(name);
+    if(it == m_methods.end()) {
+        code = RpcStatus::NOT_FOUND;
+        error = "method not found: " + name;
+    } else {
+        out.writeUint32(RpcStatus::OK);
+        try {
+            it->second(in, out);
+        } catch(std::out_of_range& e) {
+            code = RpcStatus::BAD_REQUEST;
+            error = e.what();
+        } catch(std::exception& e) {
+            code = RpcStatus::HANDLER_ERROR;
+            error = e.what();
+        } catch(...) {
+            code = RpcStatus::HANDLER_ERROR;
+            error = "unknown exception";
+        }
+    }
+    if(code != RpcStatus::OK) {
+        out.clear();
+        BeginFrame(out, kResponse, id);
+        out.writeUint32(code);
+        out.write(error.data(), error.size());
+    }
+    session->send(FinishFrame(out));
+}
+
+}
@@ -0,0 +1,471 @@
+/**
+ * @file rpc.hpp
+ * @brief 多路复用的二进制RPC: 长度前缀帧, ByteArray序列化, 一条连接上并发多个请求
+ */
+#ifndef __KONG_RPC_H__
+#define __KONG_RPC_H__
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <tuple>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include "net/socket_stream.hpp"
+#include "utils/byte_array.hpp"
+#include "utils/channel.hpp"
+#include "utils/fiber_sync.hpp"
+#include "utils/thread.hpp"
+
+namespace kong {
+
+/**
+ * @brief 调用结果码
+ */
+class RpcStatus {
+public:
+    enum Code {
+        OK = 0,
+        /// 超时未收到响应
+        TIMEOUT = 1,
+        /// 连接已断开
+        CLOSED = 2,
+        /// 服务端没有注册该方法
+        NOT_FOUND = 3,
+        /// 服务端无法解析参数
+        BAD_REQUEST = 4,
+        /// 客户端无法解析返回值
+        BAD_RESPONSE = 5,
+        /// 处理函数抛出异常
+        HANDLER_ERROR = 6
+    };
+
+    static const char* ToString(int code);
+};
+
+/**
+ * @brief 类型T的序列化, 支持整数/bool/浮点/string/vector/map/pair,
+ *        其它类型特化RpcCodec即可作为参数和返回值
+ * @details 有符号整数用zigzag varint, 无符号整数用varint
+ */
+template<class T, class Enable = void>
+struct RpcCodec;
+
+template<class T>
+struct RpcCodec<T, typename std::enable_if<std::is_integral<T>::value
+        && std::is_signed<T>::value>::type> {
+    static void Encode(ByteArray& ba, const T& v) { ba.writeInt64(v);}
+    static void Decode(ByteArray& ba, T& v) { v = (T)ba.readInt64();}
+};
+
+template<class T>
+struct RpcCodec<T, typename std::enable_if<std::is_integral<T>::value
+        && std::is_unsigned<T>::value && !std::is_same<T, bool>::value>::type> {
+    static void Encode(ByteArray& ba, const T& v) { ba.writeUint64(v);}
+    static void Decode(ByteArray& ba, T& v) { v = (T)ba.readUint64();}
+};
+
+template<>
+struct RpcCodec<bool> {
+    static void Encode(ByteArray& ba, const bool& v) { ba.writeFuint8(v);}
+    static void Decode(ByteArray& ba, bool& v) { v = ba.readFuint8() != 0;}
+};
+
+template<>
+struct RpcCodec<float> {
+    static void Encode(ByteArray& ba, const float& v) { ba.writeFloat(v);}
+    static void Decode(ByteArray& ba, float& v) { v = ba.readFloat();}
+};
+
+template<>
+struct RpcCodec<double> {
+    static void Encode(ByteArray& ba, const double& v) { ba.writeDouble(v);}
+    static void Decode(ByteArray& ba, double& v) { v = ba.readDouble();}
+};
+
+template<>
+struct RpcCodec<std::string> {
+    static void Encode(ByteArray& ba, const std::string& v) { ba.writeStringVint(v);}
+    static void Decode(ByteArray& ba, std::string& v) { v = ba.readStringVint();}
+};
+
+template<class T>
+struct RpcCodec<std::vector<T> > {
+    static void Encode(ByteArray& ba, const std::vector<T>& v) {
+        ba.writeUint64(v.size());
+        for(auto& i : v) {
+            RpcCodec<T>::Encode(ba, i);
+        }
+    }
+
+    static void Decode(ByteArray& ba, std::vector<T>& v) {
+        uint64_t n = ba.readUint64();
+        //每个元素至少1字节, 防止恶意长度导致巨量分配
+        if(n > ba.getReadSize()) {
+            throw std::out_of_range("rpc vector size out of range");
+        }
+        v.resize(n);
+        for(auto& i : v) {
+            RpcCodec<T>::Decode(ba, i);
+        }
+    }
+};
+
+template<class A, class B>
+struct RpcCodec<std::pair<A, B> > {
+    static void Encode(ByteArray& ba, const std::pair<A, B>& v) {
+        RpcCodec<A>::Encode(ba, v.first);
+        RpcCodec<B>::Encode(ba, v.second);
+    }
+
+    static void Decode(ByteArray& ba, std::pair<A, B>& v) {
+        RpcCodec<A>::Decode(ba, v.first);
+        RpcCodec<B>::Decode(ba, v.second);
+    }
+};
+
+template<class K, class V>
+struct RpcCodec<std::map<K, V> > {
+    static void Encode(ByteArray& ba, const std::map<K, V>& v) {
+        ba.writeUint64(v.size());
+        for(auto& i : v) {
+            RpcCodec<K>::Encode(ba, i.first);
+            RpcCodec<V>::Encode(ba, i.second);
+        }
+    }
+
+    static void Decode(ByteArray& ba, std::map<K, V>& v) {
+        uint64_t n = ba.readUint64();
+        v.clear();
+        for(uint64_t i = 0; i < n; ++i) {
+            std::pair<K, V> kv;
+            RpcCodec<K>::Decode(ba, kv.first);
+            RpcCodec<V>::Decode(ba, kv.second);
+            v.insert(std::move(kv));
+        }
+    }
+};
+
+namespace detail {
+
+template<size_t... I>
+struct RpcIndexSeq {};
+
+template<size_t N, size_t... I>
+struct RpcMakeIndexSeq : RpcMakeIndexSeq<N - 1, N - 1, I...> {};
+
+template<size_t... I>
+struct RpcMakeIndexSeq<0, I...> {
+    typedef RpcIndexSeq<I...> type;
+};
+
+/**
+ * @brief 从函数/函数指针/lambda推导返回值和参数类型
+ */
+template<class F>
+struct RpcFunctionTraits : RpcFunctionTraits<decltype(&F::operator())> {};
+
+template<class R, class... Args>
+struct RpcFunctionTraits<R(*)(Args...)> {
+    typedef typename std::decay<R>::type Result;
+    typedef std::tuple<typename std::decay<Args>::type...> ArgsTuple;
+    typedef typename RpcMakeIndexSeq<sizeof...(Args)>::type Indexes;
+};
+
+template<class R, class... Args>
+struct RpcFunctionTraits<R(Args...)> : RpcFunctionTraits<R(*)(Args...)> {};
+
+template<class C, class R, class... Args>
+struct RpcFunctionTraits<R(C::*)(Args...)> : RpcFunctionTraits<R(*)(Args...)> {};
+
+template<class C, class R, class... Args>
+struct RpcFunctionTraits<R(C::*)(Args...) const> : RpcFunctionTraits<R(*)(Args...)> {};
+
+template<class... Args>
+void RpcEncodeArgs(ByteArray& ba, const Args&... args) {
+    //花括号初始化列表保证从左到右求值
+    int order[] = {0, (RpcCodec<Args>::Encode(ba, args), 0)...};
+    (void)order;
+}
+
+template<class Tuple, size_t... I>
+void RpcDecodeArgs(ByteArray& ba, Tuple& args, RpcIndexSeq<I...>) {
+    int order[] = {0, (RpcCodec<typename std::tuple_element<I, Tuple>::type>::Decode(
+            ba, std::get<I>(args)), 0)...};
+    (void)order;
+}
+
+template<class R>
+struct RpcInvoker {
+    template<class F, class Tuple, size_t... I>
+    static void Call(F& f, Tuple& args, RpcIndexSeq<I...>, ByteArray& out) {
+        RpcCodec<R>::Encode(out, f(std::get<I>(args)...));
+    }
+};
+
+template<>
+struct RpcInvoker<void> {
+    template<class F, class Tuple, size_t... I>
+    static void Call(F& f, Tuple& args, RpcIndexSeq<I...>, ByteArray& out) {
+        f(std::get<I>(args)...);
+    }
+};
+
+}
+
+/**
+ * @brief 调用结果
+ */
+template<class R>
+struct RpcResult {
+    int code = RpcStatus::OK;
+    /// 失败时的描述
+    std::string error;
+    R value = R();
+
+    bool ok() const { return code == RpcStatus::OK;}
+};
+
+template<>
+struct RpcResult<void> {
+    int code = RpcStatus::OK;
+    std::string error;
+
+    bool ok() const { return code == RpcStatus::OK;}
+};
+
+/**
+ * @brief 一条RPC连接, 客户端和服务端共用
+ * @details 帧格式: [uint32 长度(小端, 不含自身)][uint8 类型][varint 请求id][正文].
+ *          多个线程并发send时, 先到的线程负责发送, 其余线程只把帧放进发送队列
+ *          就返回; 发送者每轮把队列里积压的帧用一次sendmsg(带MSG_NOSIGNAL的
+ *          writev)发出, 并发的小请求因此自然合并
+ */
+class RpcSession {
+public:
+    typedef std::shared_ptr<RpcSession> ptr;
+
+    /// 单帧最大长度
+    static const uint32_t kMaxFrameSize = 64 * 1024 * 1024;
+
+    /**
+     * @brief 接管已连接的socket
+     */
+    explicit RpcSession(int fd);
+
+    /**
+     * @brief 发送一帧(含长度头)
+     * @return 连接已断开时返回false; 返回true只表示帧已进入发送队列
+     */
+    bool send(std::string frame);
+
+    /**
+     * @brief 阻塞读取下一帧, 不含长度头, 只能由一个线程调用
+     */
+    bool recv(std::string& frame);
+
+    /**
+     * @brief 关闭读写, 阻塞在recv上的线程会返回false
+     */
+    void shutdown();
+
+    bool isConnected() const { return !m_broken.load(std::memory_order_relaxed);}
+
+    /// 已发送的帧数
+    uint64_t getFramesSent() const { return m_framesSent.load(std::memory_order_relaxed);}
+    /// 发送帧用的系统调用次数
+    uint64_t getSendCalls() const { return m_sendCalls.load(std::memory_order_relaxed);}
+private:
+    bool writeFrames(std::vector<std::string>& frames);
+private:
+    SocketStream m_stream;
+    FiberMutex m_mutex;
+    /// 等待发送的帧
+    std::vector<std::string> m_outbox;
+    /// 是否有线程正在发送
+    bool m_flushing = false;
+    std::atomic<bool> m_broken{false};
+    /// 读缓冲, [m_rpos, m_rend)为未解析的数据
+    std::vector<char> m_rbuf;
+    size_t m_rpos = 0;
+    size_t m_rend = 0;
+    std::atomic<uint64_t> m_framesSent{0};
+    std::atomic<uint64_t> m_sendCalls{0};
+};
+
+/**
+ * @brief RPC客户端
+ * @details 一条连接上可以有任意多个并发调用, 响应按请求id匹配, 由后台读线程
+ *          唤醒对应的调用者. 调用者阻塞期间不占用CPU
+ */
+class RpcClient {
+public:
+    typedef std::shared_ptr<RpcClient> ptr;
+
+    RpcClient() {}
+    ~RpcClient();
+
+    bool connect(const std::string& addr, uint16_t port);
+
+    /**
+     * @brief 断开连接, 未完成的调用返回CLOSED
+     */
+    void close();
+
+    bool isConnected() const { return m_session && m_session->isConnected();}
+
+    /**
+     * @brief 同步调用
+     * @param[in] method 方法名
+     * @param[in] timeout_ms 超时时间(毫秒)
+     * @param[in] args 参数, 类型需与服务端注册的函数参数一致
+     */
+    template<class R, class... Args>
+    RpcResult<R> call(const std::string& method, uint64_t timeout_ms, const Args&... args) {
+        uint64_t id = m_nextId.fetch_add(1, std::memory_order_relaxed);
+        ByteArray request;
+        BeginRequest(request, id, method);
+        detail::RpcEncodeArgs(request, args...);
+        RpcResult<R> rt;
+        ByteArray response;
+        rt.code = invoke(id, request, response, timeout_ms, rt.error);
+        if(rt.code == RpcStatus::OK) {
+            decode(response, rt);
+        }
+        return rt;
+    }
+
+    RpcSession::ptr getSession() const { return m_session;}
+private:
+    struct Call {
+        Waiter waiter;
+        int code = RpcStatus::OK;
+        ByteArray response;
+    };
+
+    static void BeginRequest(ByteArray& ba, uint64_t id, const std::string& method);
+
+    int invoke(uint64_t id, ByteArray& request, ByteArray& response
+               ,uint64_t timeout_ms, std::string& error);
+
+    template<class R>
+    static void decode(ByteArray& ba, RpcResult<R>& rt) {
+        try {
+            RpcCodec<R>::Decode(ba, rt.value);
+        } catch(std::out_of_range& e) {
+            rt.code = RpcStatus::BAD_RESPONSE;
+            rt.error = e.what();
+        }
+    }
+
+    static void decode(ByteArray& ba, RpcResult<void>& rt) {}
+
+    void readLoop();
+
+    /**
+     * @brief 以code结束所有未完成的调用
+     */
+    void failAll(int code);
+private:
+    std::atomic<uint64_t> m_nextId{1};
+    RpcSession::ptr m_session;
+    Thread::ptr m_reader;
+    FiberMutex m_mutex;
+    /// 等待响应的调用, 由m_mutex保护
+    std::unordered_map<uint64_t, Call*> m_calls;
+    bool m_closed = true;
+};
+
+/**
+ * @brief RPC服务端
+ * @details 每个连接一个读线程负责拆帧, 请求交给工作线程池执行, 同一连接上的
+ *          请求可以并发执行、乱序返回。请求队列有界, 队列满时读线程阻塞,
+ *          不再读取连接上的数据, 压力经TCP窗口传回客户端
+ */
+class RpcServer {
+public:
+    typedef std::shared_ptr<RpcServer> ptr;
+    /// 从request解析参数, 把返回值写入response, 参数错误抛出std::out_of_range
+    typedef std::function<void(ByteArray& request, ByteArray& response)> Method;
+
+    /**
+     * @brief 构造函数
+     * @param[in] workers 执行处理函数的线程数
+     * @param[in] queue_capacity 等待工作线程执行的请求数上限
+     */
+    explicit RpcServer(uint32_t workers = 4, size_t queue_capacity = 1024);
+    ~RpcServer();
+
+    /**
+     * @brief 注册方法, 参数和返回值的序列化代码在编译期根据f的签名生成
+     * @details 必须在start之前注册
+     */
+    template<class F>
+    void registerMethod(const std::string& name, F f) {
+        typedef detail::RpcFunctionTraits<F> Traits;
+        m_methods[name] = [f](ByteArray& request, ByteArray& response) mutable {
+            typename Traits::ArgsTuple args;
+            detail::RpcDecodeArgs(request, args, typename Traits::Indexes());
+            try {
+                detail::RpcInvoker<typename Traits::Result>::Call(
+                        f, args, typename Traits::Indexes(), response);
+            } catch(std::out_of_range& e) {
+                //std::out_of_range只用来表示参数解析失败
+                throw std::runtime_error(e.what());
+            }
+        };
+    }
+
+    bool bind(const std::string& addr, uint16_t port);
+    bool start();
+
+    /**
+     * @brief 停止接受连接, 断开所有连接并等待线程退出
+     * @details 之后可以重新bind和start
+     */
+    void stop();
+
+    uint16_t getPort() const { return m_port;}
+
+    /**
+     * @brief 等待工作线程执行的请求数
+     */
+    size_t getPendingCount() const { return m_tasks ? m_tasks->size() : 0;}
+private:
+    struct Connection {
+        RpcSession::ptr session;
+        Thread::ptr thread;
+        std::atomic<bool> done{false};
+    };
+
+    void acceptLoop();
+    void readLoop(Connection* conn);
+    void handle(const RpcSession::ptr& session, const std::shared_ptr<ByteArray>& request);
+
+    /**
+     * @brief 回收已断开的连接
+     */
+    void reap();
+private:
+    uint32_t m_workerCount;
+    size_t m_queueCapacity;
+    std::unordered_map<std::string, Method> m_methods;
+    int m_listenFd = -1;
+    uint16_t m_port = 0;
+    /// 请求队列, stop时关闭, 每次start重新创建
+    Channel<std::function<void()> >::ptr m_tasks;
+    std::vector<Thread::ptr> m_workers;
+    Thread::ptr m_acceptor;
+    FiberMutex m_mutex;
+    std::vector<std::unique_ptr<Connection> > m_conns;
+    std::atomic<bool> m_stop{false};
+    bool m_started = false;
+};
+
+}
+
+#endif
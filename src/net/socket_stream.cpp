@@ -0,0 +1,176 @@
+#include "socket_stream.hpp"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace kong {
+
+/// 单次sendfile/splice的最大长度
+static const size_t kChunkSize = 1024 * 1024;
+
+SocketStream::SocketStream(int fd, bool owner)
+    :m_fd(fd)
+    ,m_owner(owner) {
+}
+
+SocketStream::~SocketStream() {
+    if(m_owner) {
+        close();
+    }
+    if(m_pipe[0] >= 0) {
+        ::close(m_pipe[0]);
+        ::close(m_pipe[1]);
+    }
+}
+
+bool SocketStream::WaitFd(int fd, short events) {
+    pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = events;
+    int rt;
+    do {
+        rt = ::poll(&pfd, 1, -1);
+    } while(rt < 0 && errno == EINTR);
+    return rt > 0;
+}
+
+int SocketStream::read(void* buffer, size_t length) {
+    if(!isConnected()) {
+        return -1;
+    }
+    while(true) {
+        ssize_t n = ::recv(m_fd, buffer, length, 0);
+        if(n >= 0) {
+            return n;
+        }
+        if(errno == EINTR) {
+            continue;
+        }
+        if(errno != EAGAIN || !WaitFd(m_fd, POLLIN)) {
+            return -1;
+        }
+    }
+}
+
+int SocketStream::write(const void* buffer, size_t length) {
+    if(!isConnected()) {
+        return -1;
+    }
+    while(true) {
+        ssize_t n = ::send(m_fd, buffer, length, MSG_NOSIGNAL);
+        if(n >= 0) {
+            return n;
+        }
+        if(errno == EINTR) {
+            continue;
+        }
+        if(errno != EAGAIN || !WaitFd(m_fd, POLLOUT)) {
+            return -1;
+        }
+    }
+}
+
+void SocketStream::close() {
+    if(m_fd >= 0) {
+        ::close(m_fd);
+        m_fd = -1;
+    }
+}
+
+int64_t SocketStream::sendFile(int fd, off_t offset, size_t length) {
+    if(!isConnected()) {
+        return -1;
+    }
+    size_t sent = 0;
+    while(sent < length) {
+        ssize_t n = ::sendfile(m_fd, fd, &offset, std::min(length - sent, kChunkSize));
+        if(n > 0) {
+            sent += n;
+        } else if(n == 0) {
+            //文件比length短
+            break;
+        } else if(errno == EINTR) {
+            continue;
+        } else if(errno != EAGAIN || !WaitFd(m_fd, POLLOUT)) {
+            return -1;
+        }
+    }
+    return sent;
+}
+
+int64_t SocketStream::sendFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return -1;
+    }
+    struct stat st;
+    int64_t rt = -1;
+    if(fstat(fd, &st) == 0) {
+        //提示内核顺序预读
+        posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
+        rt = sendFile(fd, 0, st.st_size);
+    }
+    ::close(fd);
+    return rt;
+}
+
+bool SocketStream::initPipe() {
+    if(m_pipe[0] >= 0) {
+        return true;
+    }
+    if(pipe2(m_pipe, O_CLOEXEC)) {
+        return false;
+    }
+    //管道越大每次splice搬运的页越多
+    fcntl(m_pipe[1], F_SETPIPE_SZ, (int)kChunkSize);
+    return true;
+}
+
+int64_t SocketStream::spliceFrom(SocketStream& from, size_t length) {
+    if(!isConnected() || !from.isConnected() || !initPipe()) {
+        return -1;
+    }
+    size_t total = 0;
+    while(!length || total < length) {
+        size_t want = length ? std::min(length - total, kChunkSize) : kChunkSize;
+        ssize_t n = ::splice(from.m_fd, nullptr, m_pipe[1], nullptr, want, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if(n == 0) {
+            break;
+        } else if(n < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            if(errno != EAGAIN || !WaitFd(from.m_fd, POLLIN)) {
+                return -1;
+            }
+            continue;
+        }
+        //把管道里的数据全部写出, 管道始终在这里清空
+        size_t left = n;
+        while(left) {
+            ssize_t m = ::splice(m_pipe[0], nullptr, m_fd, nullptr, left, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if(m > 0) {
+                left -= m;
+            } else if(m < 0 && errno == EINTR) {
+                continue;
+            } else if(m < 0 && errno == EAGAIN && WaitFd(m_fd, POLLOUT)) {
+                continue;
+            } else {
+                //管道里残留的数据已无法送出, 重建管道
+                ::close(m_pipe[0]);
+                ::close(m_pipe[1]);
+                m_pipe[0] = m_pipe[1] = -1;
+                return -1;
+            }
+        }
+        total += n;
+    }
+    return total;
+}
+
+}
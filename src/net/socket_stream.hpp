@@ -0,0 +1,76 @@
+/**
+ * @file socket_stream.hpp
+ * @brief socket流, 支持sendfile/splice零拷贝传输
+ */
+#ifndef __KONG_SOCKET_STREAM_H__
+#define __KONG_SOCKET_STREAM_H__
+
+#include <string>
+#include <sys/types.h>
+#include "stream.hpp"
+
+namespace kong {
+
+/**
+ * @brief socket流
+ * @details 非阻塞socket上遇到EAGAIN时用poll等待就绪, 阻塞和非阻塞socket都可使用.
+ *          sendFile/spliceFrom的数据只在内核中搬运, 不经过用户态内存
+ */
+class SocketStream : public Stream {
+public:
+    typedef std::shared_ptr<SocketStream> ptr;
+
+    /**
+     * @brief 构造函数
+     * @param[in] fd 已连接的socket
+     * @param[in] owner 是否由流负责关闭fd
+     */
+    SocketStream(int fd, bool owner = true);
+
+    ~SocketStream();
+
+    using Stream::read;
+    using Stream::write;
+    int read(void* buffer, size_t length) override;
+    int write(const void* buffer, size_t length) override;
+    void close() override;
+
+    /**
+     * @brief 用sendfile把文件的[offset, offset+length)发送出去
+     * @param[in] fd 文件描述符, 不改变其文件位置
+     * @return 实际发送的字节数, 出错时返回-1
+     */
+    int64_t sendFile(int fd, off_t offset, size_t length);
+
+    /**
+     * @brief 发送整个文件
+     * @return 实际发送的字节数, 文件打不开或出错时返回-1
+     */
+    int64_t sendFile(const std::string& path);
+
+    /**
+     * @brief 经管道用splice把from的数据转发到本流, 用于socket到socket的代理
+     * @param[in] length 最多转发的字节数, 0表示直到from关闭
+     * @return 实际转发的字节数, 出错时返回-1
+     */
+    int64_t spliceFrom(SocketStream& from, size_t length = 0);
+
+    int getFd() const { return m_fd;}
+    bool isConnected() const { return m_fd >= 0;}
+private:
+    /**
+     * @brief 等待fd可读/可写
+     */
+    static bool WaitFd(int fd, short events);
+
+    bool initPipe();
+private:
+    int m_fd;
+    bool m_owner;
+    /// spliceFrom使用的管道, 首次使用时创建
+    int m_pipe[2] = {-1, -1};
+};
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+#include "stream.hpp"
+
+namespace kong {
+
+int Stream::readFixSize(void* buffer, size_t length) {
+    size_t offset = 0;
+    while(offset < length) {
+        int len = read((char*)buffer + offset, length - offset);
+        if(len <= 0) {
+            return len;
+        }
+        offset += len;
+    }
+    return length;
+}
+
+int Stream::writeFixSize(const void* buffer, size_t length) {
+    size_t offset = 0;
+    while(offset < length) {
+        int len = write((const char*)buffer + offset, length - offset);
+        if(len <= 0) {
+            return len;
+        }
+        offset += len;
+    }
+    return length;
+}
+
+int Stream::read(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> iovs;
+    ba->getWriteBuffers(iovs, length);
+    if(iovs.empty()) {
+        return 0;
+    }
+    int rt = read(iovs[0].iov_base, iovs[0].iov_len);
+    ba->commitWrite(rt > 0 ? rt : 0);
+    return rt;
+}
+
+int Stream::readFixSize(ByteArray::ptr ba, size_t length) {
+    size_t offset = 0;
+    while(offset < length) {
+        int len = read(ba, length - offset);
+        if(len <= 0) {
+            return len;
+        }
+        offset += len;
+    }
+    return length;
+}
+
+int Stream::write(ByteArray::ptr ba, size_t length) {
+    std::vector<iovec> iovs;
+    ba->getReadBuffers(iovs, length);
+    if(iovs.empty()) {
+        return length ? -1 : 0;
+    }
+    int rt = write(iovs[0].iov_base, iovs[0].iov_len);
+    if(rt > 0) {
+        ba->setPosition(ba->getPosition() + rt);
+    }
+    return rt;
+}
+
+int Stream::writeFixSize(ByteArray::ptr ba, size_t length) {
+    if(ba->getReadSize() < length) {
+        return -1;
+    }
+    size_t offset = 0;
+    while(offset < length) {
+        int len = write(ba, length - offset);
+        if(len <= 0) {
+            return len;
+        }
+        offset += len;
+    }
+    return length;
+}
+
+}
@@ -0,0 +1,81 @@
+/**
+ * @file stream.hpp
+ * @brief 流接口
+ */
+#ifndef __KONG_STREAM_H__
+#define __KONG_STREAM_H__
+
+#include <memory>
+#include <stddef.h>
+#include "utils/byte_array.hpp"
+
+namespace kong {
+
+/**
+ * @brief 流接口
+ */
+class Stream {
+public:
+    typedef std::shared_ptr<Stream> ptr;
+
+    virtual ~Stream() {}
+
+    /**
+     * @brief 读数据
+     * @param[out] buffer 接收数据的内存
+     * @param[in] length 内存大小
+     * @return
+     *      @retval >0 实际读到的长度
+     *      @retval =0 对端关闭
+     *      @retval <0 出错
+     */
+    virtual int read(void* buffer, size_t length) = 0;
+
+    /**
+     * @brief 读固定长度的数据, 返回值同read
+     */
+    virtual int readFixSize(void* buffer, size_t length);
+
+    /**
+     * @brief 读最多length字节追加到ba末尾, 返回值同read
+     */
+    virtual int read(ByteArray::ptr ba, size_t length);
+
+    /**
+     * @brief 读length字节追加到ba末尾, 返回值同read
+     */
+    virtual int readFixSize(ByteArray::ptr ba, size_t length);
+
+    /**
+     * @brief 写数据
+     * @return
+     *      @retval >0 实际写入的长度
+     *      @retval =0 对端关闭
+     *      @retval <0 出错
+     */
+    virtual int write(const void* buffer, size_t length) = 0;
+
+    /**
+     * @brief 写固定长度的数据, 返回值同write
+     */
+    virtual int writeFixSize(const void* buffer, size_t length);
+
+    /**
+     * @brief 从ba的读位置开始写最多length字节, 读位置后移实际写入的长度, 返回值同write
+     */
+    virtual int write(ByteArray::ptr ba, size_t length);
+
+    /**
+     * @brief 从ba的读位置开始写length字节, 不足length时返回-1, 返回值同write
+     */
+    virtual int writeFixSize(ByteArray::ptr ba, size_t length);
+
+    /**
+     * @brief 关闭流
+     */
+    virtual void close() = 0;
+};
+
+}
+
+#endif
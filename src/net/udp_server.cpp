@@ -0,0 +1,358 @@
+#include "udp_server.hpp"
+#include "log/log.hpp"
+#include <algorithm>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+namespace kong {
+
+static kong::Logger::ptr g_logger = KONG_LOG_NAME("system");
+
+/// GSO单个超大包的上限: 段数和总长度
+static const uint32_t kMaxGsoSegments = 64;
+static const uint32_t kMaxGsoBytes = 65000;
+
+void UdpBatch::reply(const sockaddr* addr, socklen_t addrlen, const void* data, size_t len) {
+    Reply r;
+    memcpy(&r.addr, addr, std::min((size_t)addrlen, sizeof(r.addr)));
+    r.addrlen = addrlen;
+    r.offset = m_replyData.size();
+    r.len = len;
+    m_replyData.append((const char*)data, len);
+    m_replies.push_back(r);
+}
+
+struct UdpServer::Worker {
+    uint32_t id;
+    int fd = -1;
+    Thread::ptr thread;
+    /// 包缓冲区, batch个slotSize大小的槽
+    std::vector<char> arena;
+    std::vector<mmsghdr> msgs;
+    std::vector<iovec> iovs;
+    std::vector<sockaddr_storage> addrs;
+    /// 每个槽接收UDP_GRO控制消息的空间
+    std::vector<char> control;
+    UdpBatch batch;
+    /// flush复用的发送描述
+    std::vector<mmsghdr> sendMsgs;
+    std::vector<iovec> sendIovs;
+    std::vector<char> sendControl;
+
+    std::atomic<uint64_t> packets{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> recvCalls{0};
+    std::atomic<uint64_t> replies{0};
+    std::atomic<uint64_t> sendCalls{0};
+    std::atomic<uint64_t> sendErrors{0};
+};
+
+/// 只由工作线程写的计数器, 读写都用relaxed
+static inline void Add(std::atomic<uint64_t>& v, uint64_t n) {
+    v.store(v.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+static const size_t kControlSize = CMSG_SPACE(sizeof(int));
+
+UdpServer::UdpServer()
+    :UdpServer(Options()) {
+}
+
+UdpServer::UdpServer(const Options& options)
+    :m_options(options) {
+    if(!m_options.workers) {
+        m_options.workers = 1;
+    }
+    if(!m_options.batch) {
+        m_options.batch = 1;
+    }
+}
+
+UdpServer::~UdpServer() {
+    stop();
+    for(auto& w : m_workers) {
+        if(w->fd >= 0) {
+            close(w->fd);
+        }
+    }
+}
+
+bool UdpServer::bind(const std::string& addr, uint16_t port) {
+    sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    socklen_t sslen;
+    sockaddr_in* sin = (sockaddr_in*)&ss;
+    sockaddr_in6* sin6 = (sockaddr_in6*)&ss;
+    if(inet_pton(AF_INET, addr.c_str(), &sin->sin_addr) == 1) {
+        sin->sin_family = AF_INET;
+        sslen = sizeof(sockaddr_in);
+    } else if(inet_pton(AF_INET6, addr.c_str(), &sin6->sin6_addr) == 1) {
+        sin6->sin6_family = AF_INET6;
+        sslen = sizeof(sockaddr_in6);
+    } else {
+        KONG_LOG_ERROR(g_logger) << "udp server invalid address " << addr;
+        return false;
+    }
+
+    for(uint32_t i = 0; i < m_options.workers; ++i) {
+        std::unique_ptr<Worker> w(new Worker);
+        w->id = i;
+        w->fd = socket(ss.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        int val = 1;
+        setsockopt(w->fd, SOL_SOCKET, SO_REUSEPORT, &val, sizeof(val));
+        if(m_options.rcvbuf) {
+            setsockopt(w->fd, SOL_SOCKET, SO_RCVBUF, &m_options.rcvbuf, sizeof(int));
+        }
+        if(m_options.sndbuf) {
+            setsockopt(w->fd, SOL_SOCKET, SO_SNDBUF, &m_options.sndbuf, sizeof(int));
+        }
+        if(m_options.gro && setsockopt(w->fd, SOL_UDP, UDP_GRO, &val, sizeof(val))) {
+            KONG_LOG_WARN(g_logger) << "udp server UDP_GRO not supported, disabled";
+            m_options.gro = false;
+        }
+        if(m_options.gso) {
+            //探测内核是否支持UDP_SEGMENT, 0表示socket级别不分段
+            int seg = 0;
+            if(setsockopt(w->fd, SOL_UDP, UDP_SEGMENT, &seg, sizeof(seg))) {
+                KONG_LOG_WARN(g_logger) << "udp server UDP_SEGMENT not supported, disabled";
+                m_options.gso = false;
+            }
+        }
+        //端口0时第一个socket由系统分配, 其余绑定同一端口
+        uint16_t p = htons(m_port ? m_port : port);
+        if(ss.ss_family == AF_INET) {
+            sin->sin_port = p;
+        } else {
+            sin6->sin6_port = p;
+        }
+        if(::bind(w->fd, (sockaddr*)&ss, sslen)) {
+            KONG_LOG_ERROR(g_logger) << "udp server bind " << addr << ":" << ntohs(p)
+                                     << " failed errno=" << errno << " errstr=" << strerror(errno);
+            close(w->fd);
+            return false;
+        }
+        sockaddr_storage bound;
+        socklen_t len = sizeof(bound);
+        getsockname(w->fd, (sockaddr*)&bound, &len);
+        m_port = ntohs(bound.ss_family == AF_INET ? ((sockaddr_in*)&bound)->sin_port
+                                                  : ((sockaddr_in6*)&bound)->sin6_port);
+        m_workers.push_back(std::move(w));
+    }
+    //GRO可用时内核交付最大64KB的合并包, 槽要能放下; 不可用时保留原来的槽大小
+    if(m_options.gro) {
+        m_options.slotSize = std::max<uint32_t>(m_options.slotSize, 65536);
+    }
+    return true;
+}
+
+bool UdpServer::start(Handler handler) {
+    if(m_started || m_workers.empty()) {
+        return false;
+    }
+    m_handler = handler;
+    m_stop = false;
+    uint32_t batch = m_options.batch;
+    for(auto& w : m_workers) {
+        w->batch.m_worker = w->id;
+        w->arena.resize((size_t)batch * m_options.slotSize);
+        w->msgs.resize(batch);
+        w->iovs.resize(batch);
+        w->addrs.resize(batch);
+        w->control.resize(batch * kControlSize);
+        w->batch.m_packets.reserve(batch);
+        Worker* worker = w.get();
+        w->thread.reset(new Thread([this, worker]() { run(worker);}, "udp_" + std::to_string(w->id)));
+    }
+    m_started = true;
+    return true;
+}
+
+void UdpServer::stop() {
+    if(!m_started) {
+        return;
+    }
+    m_stop = true;
+    for(auto& w : m_workers) {
+        w->thread->join();
+        w->thread.reset();
+    }
+    m_started = false;
+}
+
+UdpServer::Stats UdpServer::getStats() const {
+    Stats s;
+    for(auto& w : m_workers) {
+        s.packets += w->packets.load(std::memory_order_relaxed);
+        s.batches += w->batches.load(std::memory_order_relaxed);
+        s.recvCalls += w->recvCalls.load(std::memory_order_relaxed);
+        s.replies += w->replies.load(std::memory_order_relaxed);
+        s.sendCalls += w->sendCalls.load(std::memory_order_relaxed);
+        s.sendErrors += w->sendErrors.load(std::memory_order_relaxed);
+    }
+    return s;
+}
+
+void UdpServer::run(Worker* w) {
+    const uint32_t batch = m_options.batch;
+    const uint32_t slot = m_options.slotSize;
+    for(uint32_t i = 0; i < batch; ++i) {
+        w->iovs[i].iov_base = &w->arena[(size_t)i * slot];
+        w->iovs[i].iov_len = slot;
+        msghdr& h = w->msgs[i].msg_hdr;
+        memset(&h, 0, sizeof(h));
+        h.msg_iov = &w->iovs[i];
+        h.msg_iovlen = 1;
+        h.msg_name = &w->addrs[i];
+    }
+    UdpBatch& b = w->batch;
+    //上一次recvmmsg填充过的消息数, 只有它们的长度被内核改写过
+    uint32_t used = batch;
+    while(!m_stop.load(std::memory_order_relaxed)) {
+        for(uint32_t i = 0; i < used; ++i) {
+            msghdr& h = w->msgs[i].msg_hdr;
+            h.msg_namelen = sizeof(sockaddr_storage);
+            if(m_options.gro) {
+                h.msg_control = &w->control[i * kControlSize];
+                h.msg_controllen = kControlSize;
+            }
+        }
+        Add(w->recvCalls, 1);
+        int n = recvmmsg(w->fd, &w->msgs[0], batch, MSG_DONTWAIT, nullptr);
+        used = n > 0 ? n : 0;
+        if(n <= 0) {
+            if(n < 0 && (errno == EAGAIN || errno == EINTR)) {
+                //空闲时等待可读, 定期醒来检查是否停止
+                pollfd pfd;
+                pfd.fd = w->fd;
+                pfd.events = POLLIN;
+                ::poll(&pfd, 1, 100);
+            } else if(n < 0) {
+                KONG_LOG_ERROR(g_logger) << "udp server recvmmsg failed errno=" << errno
+                                         << " errstr=" << strerror(errno);
+                usleep(10000);
+            }
+            continue;
+        }
+
+        b.m_packets.clear();
+        for(int i = 0; i < n; ++i) {
+            msghdr& h = w->msgs[i].msg_hdr;
+            const char* data = (const char*)w->iovs[i].iov_base;
+            uint32_t len = w->msgs[i].msg_len;
+            uint32_t seg = len;
+            if(m_options.gro) {
+                for(cmsghdr* c = CMSG_FIRSTHDR(&h); c; c = CMSG_NXTHDR(&h, c)) {
+                    if(c->cmsg_level == SOL_UDP && c->cmsg_type == UDP_GRO) {
+                        int v;
+                        memcpy(&v, CMSG_DATA(c), sizeof(v));
+                        seg = v > 0 ? v : len;
+                    }
+                }
+            }
+            //GRO合并的包按段长拆开, 最后一段可能较短
+            for(uint32_t off = 0; off < len; off += seg) {
+                UdpPacket p;
+                p.data = data + off;
+                p.len = std::min(seg, len - off);
+                p.addr = (const sockaddr*)h.msg_name;
+                p.addrlen = h.msg_namelen;
+                b.m_packets.push_back(p);
+            }
+            if(!len) {
+                UdpPacket p = {data, 0, (const sockaddr*)h.msg_name, h.msg_namelen};
+                b.m_packets.push_back(p);
+            }
+        }
+        Add(w->packets, b.m_packets.size());
+        Add(w->batches, 1);
+        m_handler(b);
+        if(!b.m_replies.empty()) {
+            flush(w, b);
+        }
+    }
+}
+
+void UdpServer::flush(Worker* w, UdpBatch& b) {
+    std::vector<UdpBatch::Reply>& rs = b.m_replies;
+    size_t count = rs.size();
+    std::vector<mmsghdr>& msgs = w->sendMsgs;
+    std::vector<iovec>& iovs = w->sendIovs;
+    std::vector<char>& control = w->sendControl;
+    msgs.clear();
+    iovs.clear();
+    if(m_options.gso && control.size() < count * kControlSize) {
+        control.resize(count * kControlSize);
+    }
+
+    for(size_t i = 0; i < count;) {
+        //发往同一地址的连续等长回复合并成一个GSO包, 最后一段可以较短
+        size_t j = i + 1;
+        uint32_t total = rs[i].len;
+        if(m_options.gso && rs[i].len) {
+            while(j < count && j - i < kMaxGsoSegments
+                    && rs[j].addrlen == rs[i].addrlen
+                    && !memcmp(&rs[j].addr, &rs[i].addr, rs[i].addrlen)
+                    && rs[j].len && rs[j].len <= rs[i].len
+                    && total + rs[j].len <= kMaxGsoBytes) {
+                total += rs[j].len;
+                if(rs[j++].len < rs[i].len) {
+                    break;
+                }
+            }
+        }
+        iovec iov;
+        iov.iov_base = &b.m_replyData[rs[i].offset];
+        iov.iov_len = total;
+        iovs.push_back(iov);
+        mmsghdr m;
+        memset(&m, 0, sizeof(m));
+        m.msg_hdr.msg_name = &rs[i].addr;
+        m.msg_hdr.msg_namelen = rs[i].addrlen;
+        if(j - i > 1) {
+            char* ctrl = &control[msgs.size() * kControlSize];
+            m.msg_hdr.msg_control = ctrl;
+            m.msg_hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+            cmsghdr* c = CMSG_FIRSTHDR(&m.msg_hdr);
+            c->cmsg_level = SOL_UDP;
+            c->cmsg_type = UDP_SEGMENT;
+            c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+            uint16_t segSize = rs[i].len;
+            memcpy(CMSG_DATA(c), &segSize, sizeof(segSize));
+        }
+        msgs.push_back(m);
+        i = j;
+    }
+    for(size_t i = 0; i < msgs.size(); ++i) {
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    size_t sent = 0;
+    while(sent < msgs.size()) {
+        Add(w->sendCalls, 1);
+        int n = sendmmsg(w->fd, &msgs[sent], msgs.size() - sent, 0);
+        if(n > 0) {
+            sent += n;
+        } else if(n < 0 && errno == EINTR) {
+            continue;
+        } else if(n < 0 && errno == EAGAIN) {
+            pollfd pfd;
+            pfd.fd = w->fd;
+            pfd.events = POLLOUT;
+            ::poll(&pfd, 1, 100);
+        } else {
+            //跳过发不出去的这一个(例如目标不可达), 继续发送后面的
+            Add(w->sendErrors, 1);
+            ++sent;
+        }
+    }
+    Add(w->replies, count);
+    rs.clear();
+    b.m_replyData.clear();
+}
+
+}
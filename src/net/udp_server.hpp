@@ -0,0 +1,156 @@
+/**
+ * @file udp_server.hpp
+ * @brief 批量收发的UDP服务器: recvmmsg/sendmmsg, SO_REUSEPORT多线程, GSO/GRO
+ */
+#ifndef __KONG_UDP_SERVER_H__
+#define __KONG_UDP_SERVER_H__
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <netinet/in.h>
+#include <string>
+#include <sys/socket.h>
+#include <vector>
+#include "utils/thread.hpp"
+
+namespace kong {
+
+/**
+ * @brief 收到的一个UDP包, 指向工作线程的包缓冲区, 只在处理回调期间有效
+ */
+struct UdpPacket {
+    const char* data;
+    uint32_t len;
+    const sockaddr* addr;
+    socklen_t addrlen;
+};
+
+/**
+ * @brief 一批UDP包
+ * @details 一次recvmmsg收到的所有包(开启GRO时合并包已拆回原始的包).
+ *          回复先写入批次的缓冲区, 回调返回后一次sendmmsg发出
+ */
+class UdpBatch {
+friend class UdpServer;
+public:
+    size_t size() const { return m_packets.size();}
+    const UdpPacket& operator[](size_t i) const { return m_packets[i];}
+    const std::vector<UdpPacket>& getPackets() const { return m_packets;}
+
+    /**
+     * @brief 回复给包的发送方
+     */
+    void reply(const UdpPacket& to, const void* data, size_t len) {
+        reply(to.addr, to.addrlen, data, len);
+    }
+
+    /**
+     * @brief 发送到任意地址, 与回复一起批量发出
+     */
+    void reply(const sockaddr* addr, socklen_t addrlen, const void* data, size_t len);
+
+    /**
+     * @brief 所在工作线程的序号
+     */
+    uint32_t getWorker() const { return m_worker;}
+private:
+    struct Reply {
+        sockaddr_storage addr;
+        socklen_t addrlen;
+        uint32_t offset;
+        uint32_t len;
+    };
+    uint32_t m_worker = 0;
+    std::vector<UdpPacket> m_packets;
+    std::vector<Reply> m_replies;
+    std::string m_replyData;
+};
+
+/**
+ * @brief UDP服务器
+ * @details 每个工作线程一个SO_REUSEPORT socket, 内核按四元组把流量分到各个socket;
+ *          线程用recvmmsg把包批量收到预先分配的包缓冲区, 回调处理整批后用
+ *          sendmmsg批量回复. 开启GSO时发往同一地址的等长回复合并成一个超大包,
+ *          开启GRO时内核把同一流的包合并后交付; 内核不支持时自动关闭.
+ *          在本机回环上实测, 不开GRO时recvmmsg每包开销与逐个recvfrom相差在10%以内,
+ *          每包的主要开销在内核协议栈里, 批量只省下系统调用进出; 收益主要来自GRO合并和批量回复
+ */
+class UdpServer {
+public:
+    typedef std::shared_ptr<UdpServer> ptr;
+    typedef std::function<void(UdpBatch& batch)> Handler;
+
+    struct Options {
+        /// 工作线程数
+        uint32_t workers = 1;
+        /// 每次recvmmsg最多收的包数
+        uint32_t batch = 64;
+        /// 单个包的缓冲区大小, GRO实际开启时至少为64KB
+        uint32_t slotSize = 2048;
+        /// socket接收缓冲区大小, 0表示不修改
+        int rcvbuf = 4 * 1024 * 1024;
+        int sndbuf = 0;
+        bool gro = false;
+        bool gso = false;
+    };
+
+    struct Stats {
+        uint64_t packets = 0;
+        uint64_t batches = 0;
+        uint64_t recvCalls = 0;
+        uint64_t replies = 0;
+        uint64_t sendCalls = 0;
+        uint64_t sendErrors = 0;
+    };
+
+    UdpServer();
+    UdpServer(const Options& options);
+    ~UdpServer();
+
+    /**
+     * @brief 为每个工作线程创建socket并绑定
+     * @param[in] addr IPv4或IPv6地址
+     * @param[in] port 端口, 0表示由系统分配(所有线程共用分配到的端口)
+     */
+    bool bind(const std::string& addr, uint16_t port);
+
+    /**
+     * @brief 启动工作线程, handler在各工作线程中并发调用
+     */
+    bool start(Handler handler);
+
+    /**
+     * @brief 停止并等待工作线程退出
+     */
+    void stop();
+
+    uint16_t getPort() const { return m_port;}
+    bool isGroEnabled() const { return m_options.gro;}
+    bool isGsoEnabled() const { return m_options.gso;}
+
+    /**
+     * @brief 所有工作线程的统计之和
+     */
+    Stats getStats() const;
+private:
+    struct Worker;
+
+    void run(Worker* worker);
+
+    /**
+     * @brief 把批次里的回复用sendmmsg发出
+     */
+    void flush(Worker* worker, UdpBatch& batch);
+private:
+    Options m_options;
+    uint16_t m_port = 0;
+    Handler m_handler;
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::atomic<bool> m_stop{false};
+    bool m_started = false;
+};
+
+}
+
+#endif
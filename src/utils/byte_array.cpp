@@ -0,0 +1,211 @@
+#include "byte_array.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include <string.h>
+
+namespace kong {
+
+void ByteArray::writeFuint16(uint16_t v) {
+    char buf[2] = {(char)v, (char)(v >> 8)};
+    write(buf, sizeof(buf));
+}
+
+void ByteArray::writeFuint32(uint32_t v) {
+    char buf[4];
+    for(int i = 0; i < 4; ++i) {
+        buf[i] = (char)(v >> (i * 8));
+    }
+    write(buf, sizeof(buf));
+}
+
+void ByteArray::writeFuint64(uint64_t v) {
+    char buf[8];
+    for(int i = 0; i < 8; ++i) {
+        buf[i] = (char)(v >> (i * 8));
+    }
+    write(buf, sizeof(buf));
+}
+
+void ByteArray::writeUint32(uint32_t v) {
+    writeUint64(v);
+}
+
+void ByteArray::writeUint64(uint64_t v) {
+    char buf[10];
+    size_t i = 0;
+    while(v >= 0x80) {
+        buf[i++] = (char)((v & 0x7F) | 0x80);
+        v >>= 7;
+    }
+    buf[i++] = (char)v;
+    write(buf, i);
+}
+
+void ByteArray::writeFloat(float v) {
+    uint32_t u;
+    memcpy(&u, &v, sizeof(u));
+    writeFuint32(u);
+}
+
+void ByteArray::writeDouble(double v) {
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    writeFuint64(u);
+}
+
+void ByteArray::writeStringF32(const std::string& v) {
+    writeFuint32(v.size());
+    write(v.data(), v.size());
+}
+
+void ByteArray::writeStringVint(const std::string& v) {
+    writeUint64(v.size());
+    write(v.data(), v.size());
+}
+
+void ByteArray::check(size_t size) const {
+    if(getReadSize() < size) {
+        throw std::out_of_range("ByteArray not enough data");
+    }
+}
+
+uint8_t ByteArray::readFuint8() {
+    check(1);
+    return (uint8_t)m_data[m_position++];
+}
+
+uint16_t ByteArray::readFuint16() {
+    check(2);
+    const unsigned char* p = (const unsigned char*)&m_data[m_position];
+    m_position += 2;
+    return p[0] | (p[1] << 8);
+}
+
+uint32_t ByteArray::readFuint32() {
+    check(4);
+    const unsigned char* p = (const unsigned char*)&m_data[m_position];
+    uint32_t v = 0;
+    for(int i = 3; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    m_position += 4;
+    return v;
+}
+
+uint64_t ByteArray::readFuint64() {
+    check(8);
+    const unsigned char* p = (const unsigned char*)&m_data[m_position];
+    uint64_t v = 0;
+    for(int i = 7; i >= 0; --i) {
+        v = (v << 8) | p[i];
+    }
+    m_position += 8;
+    return v;
+}
+
+uint32_t ByteArray::readUint32() {
+    uint64_t v = readUint64();
+    if(v > 0xFFFFFFFFULL) {
+        throw std::out_of_range("ByteArray varint overflow");
+    }
+    return v;
+}
+
+uint64_t ByteArray::readUint64() {
+    uint64_t v = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        uint8_t b = readFuint8();
+        v |= (uint64_t)(b & 0x7F) << shift;
+        if(!(b & 0x80)) {
+            return v;
+        }
+    }
+    throw std::out_of_range("ByteArray varint too long");
+}
+
+float ByteArray::readFloat() {
+    uint32_t u = readFuint32();
+    float v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+double ByteArray::readDouble() {
+    uint64_t u = readFuint64();
+    double v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+std::string ByteArray::readStringF32() {
+    uint32_t len = readFuint32();
+    check(len);
+    std::string v = m_data.substr(m_position, len);
+    m_position += len;
+    return v;
+}
+
+std::string ByteArray::readStringVint() {
+    uint64_t len = readUint64();
+    check(len);
+    std::string v = m_data.substr(m_position, len);
+    m_position += len;
+    return v;
+}
+
+void ByteArray::read(void* buf, size_t size) {
+    check(size);
+    memcpy(buf, &m_data[m_position], size);
+    m_position += size;
+}
+
+void ByteArray::setPosition(size_t v) {
+    if(v > m_data.size()) {
+        throw std::out_of_range("ByteArray set position out of range");
+    }
+    m_position = v;
+}
+
+std::string ByteArray::release() {
+    std::string v;
+    v.swap(m_data);
+    m_position = 0;
+    m_reserved = 0;
+    return v;
+}
+
+uint64_t ByteArray::getReadBuffers(std::vector<iovec>& buffers, uint64_t len) const {
+    len = std::min<uint64_t>(len, getReadSize());
+    if(len) {
+        iovec iov;
+        iov.iov_base = (void*)(m_data.data() + m_position);
+        iov.iov_len = len;
+        buffers.push_back(iov);
+    }
+    return len;
+}
+
+uint64_t ByteArray::getWriteBuffers(std::vector<iovec>& buffers, uint64_t len) {
+    //上一次预留没有确认时作废
+    commitWrite(0);
+    if(len) {
+        size_t old = m_data.size();
+        m_data.resize(old + len);
+        m_reserved = len;
+        iovec iov;
+        iov.iov_base = &m_data[old];
+        iov.iov_len = len;
+        buffers.push_back(iov);
+    }
+    return len;
+}
+
+void ByteArray::commitWrite(uint64_t len) {
+    if(len > m_reserved) {
+        throw std::out_of_range("ByteArray commit more than reserved");
+    }
+    m_data.resize(m_data.size() - m_reserved + len);
+    m_reserved = 0;
+}
+
+}
@@ -0,0 +1,154 @@
+/**
+ * @file byte_array.hpp
+ * @brief 二进制序列化缓冲区: 定长整数/varint/zigzag/浮点/字符串
+ */
+#ifndef __KONG_BYTE_ARRAY_H__
+#define __KONG_BYTE_ARRAY_H__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <sys/uio.h>
+#include <vector>
+
+namespace kong {
+
+/**
+ * @brief 二进制数组
+ * @details 连续内存, 写入追加到末尾, 读取从读位置开始. 定长整数按小端存储;
+ *          writeUint32/writeUint64为varint, writeInt32/writeInt64先zigzag再varint.
+ *          读越界抛出std::out_of_range
+ */
+class ByteArray {
+public:
+    typedef std::shared_ptr<ByteArray> ptr;
+
+    ByteArray() {}
+
+    /**
+     * @brief 接管已有的数据用于读取
+     */
+    explicit ByteArray(std::string data)
+        :m_data(std::move(data)) {
+    }
+
+    void writeFint8(int8_t v) { write(&v, sizeof(v));}
+    void writeFuint8(uint8_t v) { write(&v, sizeof(v));}
+    void writeFint16(int16_t v) { writeFuint16(v);}
+    void writeFuint16(uint16_t v);
+    void writeFint32(int32_t v) { writeFuint32(v);}
+    void writeFuint32(uint32_t v);
+    void writeFint64(int64_t v) { writeFuint64(v);}
+    void writeFuint64(uint64_t v);
+
+    void writeInt32(int32_t v) { writeUint32(EncodeZigzag32(v));}
+    void writeUint32(uint32_t v);
+    void writeInt64(int64_t v) { writeUint64(EncodeZigzag64(v));}
+    void writeUint64(uint64_t v);
+
+    void writeFloat(float v);
+    void writeDouble(double v);
+
+    /**
+     * @brief 写入字符串, 长度用uint32定长
+     */
+    void writeStringF32(const std::string& v);
+
+    /**
+     * @brief 写入字符串, 长度用varint
+     */
+    void writeStringVint(const std::string& v);
+
+    void write(const void* buf, size_t size) { m_data.append((const char*)buf, size);}
+
+    int8_t readFint8() { return (int8_t)readFuint8();}
+    uint8_t readFuint8();
+    int16_t readFint16() { return (int16_t)readFuint16();}
+    uint16_t readFuint16();
+    int32_t readFint32() { return (int32_t)readFuint32();}
+    uint32_t readFuint32();
+    int64_t readFint64() { return (int64_t)readFuint64();}
+    uint64_t readFuint64();
+
+    int32_t readInt32() { return DecodeZigzag32(readUint32());}
+    uint32_t readUint32();
+    int64_t readInt64() { return DecodeZigzag64(readUint64());}
+    uint64_t readUint64();
+
+    float readFloat();
+    double readDouble();
+
+    std::string readStringF32();
+    std::string readStringVint();
+
+    void read(void* buf, size_t size);
+
+    /**
+     * @brief 全部数据(含已读部分)
+     */
+    const char* data() const { return m_data.data();}
+    size_t size() const { return m_data.size();}
+
+    /**
+     * @brief 读位置
+     */
+    size_t getPosition() const { return m_position;}
+    void setPosition(size_t v);
+
+    /**
+     * @brief 剩余可读字节数
+     */
+    size_t getReadSize() const { return m_data.size() - m_position;}
+
+    /**
+     * @brief 取得从读位置开始最多len字节可读数据的iovec, 不移动读位置
+     * @details 用于writev等直接发送, 发送n字节后调用setPosition(getPosition() + n)
+     * @return iovec覆盖的字节数
+     */
+    uint64_t getReadBuffers(std::vector<iovec>& buffers, uint64_t len) const;
+
+    /**
+     * @brief 在末尾预留len字节供外部直接写入(如readv), 返回描述这段内存的iovec
+     * @details 写完后调用commitWrite确认实际写入的字节数, 未写满的部分被丢弃;
+     *          确认之前不能调用其它写函数, size()包含预留的部分
+     * @return iovec覆盖的字节数
+     */
+    uint64_t getWriteBuffers(std::vector<iovec>& buffers, uint64_t len);
+
+    /**
+     * @brief 确认getWriteBuffers预留的内存中实际写入了len字节
+     */
+    void commitWrite(uint64_t len);
+
+    void clear() {
+        m_data.clear();
+        m_position = 0;
+        m_reserved = 0;
+    }
+
+    /**
+     * @brief 移出全部数据, 之后ByteArray为空
+     */
+    std::string release();
+
+    /**
+     * @brief 从读位置开始的数据
+     */
+    std::string toString() const { return m_data.substr(m_position);}
+
+    static uint32_t EncodeZigzag32(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31);}
+    static uint64_t EncodeZigzag64(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);}
+    static int32_t DecodeZigzag32(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);}
+    static int64_t DecodeZigzag64(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);}
+private:
+    void check(size_t size) const;
+private:
+    std::string m_data;
+    size_t m_position = 0;
+    /// getWriteBuffers预留、尚未确认的字节数, 位于m_data末尾
+    size_t m_reserved = 0;
+};
+
+}
+
+#endif
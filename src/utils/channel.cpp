@@ -0,0 +1,138 @@
+#include "channel.hpp"
+
+namespace kong {
+
+void ChannelBase::close() {
+    std::lock_guard<FiberMutex> lock(m_mutex);
+    m_closed = true;
+    m_recvq.wakeAll();
+    m_sendq.wakeAll();
+}
+
+bool ChannelBase::isClosed() {
+    std::lock_guard<FiberMutex> lock(m_mutex);
+    return m_closed;
+}
+
+bool ChannelBase::blockingOp(bool recv, void* slot) {
+    Waiter w;
+    WaitNode node;
+    node.waiter = &w;
+    while(true) {
+        Waiter* peer = nullptr;
+        int rt;
+        {
+            std::lock_guard<FiberMutex> lock(m_mutex);
+            rt = opLocked(recv, slot, peer);
+            if(!rt) {
+                w.reset();
+                (recv ? m_recvq : m_sendq).push(&node);
+            }
+        }
+        if(rt) {
+            if(peer) {
+                peer->notify();
+            }
+            return rt > 0;
+        }
+        //唤醒者已把节点移出队列; 醒来后条件可能又被别人抢走, 重试
+        w.park();
+    }
+}
+
+int ChannelBase::tryOp(bool recv, void* slot) {
+    Waiter* peer = nullptr;
+    int rt;
+    {
+        std::lock_guard<FiberMutex> lock(m_mutex);
+        rt = opLocked(recv, slot, peer);
+    }
+    if(peer) {
+        peer->notify();
+    }
+    return rt;
+}
+
+bool ChannelBase::enqueueIfBlocked(bool recv, WaitNode* node) {
+    std::lock_guard<FiberMutex> lock(m_mutex);
+    if(readyLocked(recv)) {
+        return true;
+    }
+    (recv ? m_recvq : m_sendq).push(node);
+    return false;
+}
+
+bool ChannelBase::dequeue(bool recv, WaitNode* node) {
+    std::lock_guard<FiberMutex> lock(m_mutex);
+    return (recv ? m_recvq : m_sendq).remove(node);
+}
+
+void ChannelBase::poke(bool recv) {
+    std::lock_guard<FiberMutex> lock(m_mutex);
+    if(readyLocked(recv)) {
+        (recv ? m_recvq : m_sendq).wakeOne();
+    }
+}
+
+int Select::addCase(ChannelBase* ch, bool recv, void* slot, bool* ok) {
+    Case c = {ch, recv, slot, ok};
+    m_cases.push_back(c);
+    return m_cases.size() - 1;
+}
+
+int Select::tryOnce() {
+    size_t n = m_cases.size();
+    for(size_t k = 0; k < n; ++k) {
+        size_t i = (m_start + k) % n;
+        Case& c = m_cases[i];
+        int rt = c.ch->tryOp(c.recv, c.slot);
+        if(rt) {
+            if(c.ok) {
+                *c.ok = rt > 0;
+            }
+            m_start = i + 1;
+            return i;
+        }
+    }
+    return -1;
+}
+
+int Select::wait() {
+    size_t n = m_cases.size();
+    if(!n) {
+        return -1;
+    }
+    Waiter w;
+    std::vector<WaitNode> nodes(n);
+    //被哪些通道唤醒过, 选中其它分支时要把唤醒转交出去
+    std::vector<bool> woken(n, false);
+    int idx;
+    while((idx = tryOnce()) < 0) {
+        w.reset();
+        size_t reg = 0;
+        bool ready = false;
+        for(; reg < n; ++reg) {
+            nodes[reg].waiter = &w;
+            if(m_cases[reg].ch->enqueueIfBlocked(m_cases[reg].recv, &nodes[reg])) {
+                ready = true;
+                break;
+            }
+        }
+        if(!ready) {
+            w.park();
+        }
+        for(size_t i = 0; i < reg; ++i) {
+            if(!m_cases[i].ch->dequeue(m_cases[i].recv, &nodes[i])) {
+                woken[i] = true;
+            }
+        }
+    }
+    for(size_t i = 0; i < n; ++i) {
+        if(woken[i] && (int)i != idx) {
+            m_cases[i].ch->poke(m_cases[i].recv);
+        }
+    }
+    return idx;
+}
+
+}
@@ -0,0 +1,224 @@
+/**
+ * @file channel.hpp
+ * @brief Go风格的通道和多路选择
+ */
+#ifndef __KONG_CHANNEL_H__
+#define __KONG_CHANNEL_H__
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "fiber_sync.hpp"
+
+namespace kong {
+
+/**
+ * @brief 通道公共部分: 锁, 收发等待队列, 关闭状态
+ * @details 与元素类型无关的部分放在这里, Select只依赖这个基类
+ */
+class ChannelBase {
+friend class Select;
+public:
+    virtual ~ChannelBase() {}
+
+    /**
+     * @brief 关闭通道, 唤醒所有等待者; 关闭后不能再发送, 剩余元素仍可接收
+     */
+    void close();
+
+    bool isClosed();
+protected:
+    /**
+     * @brief 已加锁时尝试收发一次
+     * @param[in] recv 是否接收
+     * @param[in,out] slot 接收时为输出位置, 发送时为待发送的值(成功时被移走)
+     * @param[out] wake 完成后需要唤醒的对端等待者, 由调用者解锁后notify
+     * @return 1:完成 0:需要等待 -1:通道已关闭
+     */
+    virtual int opLocked(bool recv, void* slot, Waiter*& wake) = 0;
+
+    /**
+     * @brief 已加锁时判断操作是否无需等待
+     */
+    virtual bool readyLocked(bool recv) const = 0;
+
+    /**
+     * @brief 阻塞收发, 返回false表示通道已关闭
+     */
+    bool blockingOp(bool recv, void* slot);
+
+    /**
+     * @brief 尝试收发一次, 语义同opLocked
+     */
+    int tryOp(bool recv, void* slot);
+
+    /**
+     * @brief 需要等待时把节点加入等待队列并返回false, 否则返回true
+     */
+    bool enqueueIfBlocked(bool recv, WaitNode* node);
+
+    /**
+     * @brief 把节点移出等待队列, 节点已被唤醒者取出时返回false
+     */
+    bool dequeue(bool recv, WaitNode* node);
+
+    /**
+     * @brief 条件满足时再唤醒一个等待者
+     * @details select被某个通道唤醒后却选择了其它分支时, 把这次唤醒转交出去,
+     *          避免数据在缓冲区里而等待者一直挂起
+     */
+    void poke(bool recv);
+protected:
+    FiberMutex m_mutex;
+    WaitList m_recvq;
+    WaitList m_sendq;
+    bool m_closed = false;
+};
+
+/**
+ * @brief 通道
+ * @details 有界通道满时发送方挂起, 空时接收方挂起; 无界通道发送永不挂起.
+ *          不支持无缓冲的同步交接, 容量0按1处理
+ */
+template<class T>
+class Channel : public ChannelBase {
+public:
+    typedef std::shared_ptr<Channel> ptr;
+
+    /// 无界通道的容量
+    static const size_t kUnbounded = (size_t)-1;
+
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 缓冲容量
+     */
+    explicit Channel(size_t capacity = kUnbounded)
+        :m_capacity(capacity ? capacity : 1) {
+    }
+
+    /**
+     * @brief 发送, 通道满时挂起
+     * @return 通道已关闭时返回false
+     */
+    bool send(T value) {
+        return blockingOp(false, &value);
+    }
+
+    /**
+     * @brief 接收, 通道空时挂起
+     * @return 通道已关闭且没有剩余元素时返回false
+     */
+    bool recv(T& out) {
+        return blockingOp(true, &out);
+    }
+
+    /**
+     * @brief 非阻塞发送, 通道满或已关闭时返回false
+     */
+    bool trySend(T value) {
+        return tryOp(false, &value) > 0;
+    }
+
+    /**
+     * @brief 非阻塞接收, 通道空时返回false
+     */
+    bool tryRecv(T& out) {
+        return tryOp(true, &out) > 0;
+    }
+
+    size_t size() {
+        std::lock_guard<FiberMutex> lock(m_mutex);
+        return m_buffer.size();
+    }
+
+    size_t getCapacity() const { return m_capacity;}
+protected:
+    int opLocked(bool recv, void* slot, Waiter*& wake) override {
+        if(recv) {
+            if(!m_buffer.empty()) {
+                *(T*)slot = std::move(m_buffer.front());
+                m_buffer.pop_front();
+                wake = m_sendq.claimOne();
+                return 1;
+            }
+            return m_closed ? -1 : 0;
+        }
+        if(m_closed) {
+            return -1;
+        }
+        if(m_buffer.size() < m_capacity) {
+            m_buffer.push_back(std::move(*(T*)slot));
+            wake = m_recvq.claimOne();
+            return 1;
+        }
+        return 0;
+    }
+
+    bool readyLocked(bool recv) const override {
+        if(m_closed) {
+            return true;
+        }
+        return recv ? !m_buffer.empty() : m_buffer.size() < m_capacity;
+    }
+private:
+    size_t m_capacity;
+    std::deque<T> m_buffer;
+};
+
+/**
+ * @brief 在多个通道操作中等待任意一个完成
+ * @details 用法:
+ *          Select sel;
+ *          int a = sel.recv(ch1, v1);
+ *          int b = sel.send(ch2, v2);
+ *          int idx = sel.wait();
+ *          每次只完成一个分支; 多个分支同时就绪时轮流选择, 避免饿死后面的分支
+ */
+class Select {
+public:
+    /**
+     * @brief 添加接收分支
+     * @param[out] ok 完成时为true, 因通道关闭而返回时为false
+     * @return 分支序号
+     */
+    template<class T>
+    int recv(Channel<T>& ch, T& out, bool* ok = nullptr) {
+        return addCase(&ch, true, &out, ok);
+    }
+
+    /**
+     * @brief 添加发送分支, value在该分支被选中时才会被移走
+     */
+    template<class T>
+    int send(Channel<T>& ch, T& value, bool* ok = nullptr) {
+        return addCase(&ch, false, &value, ok);
+    }
+
+    /**
+     * @brief 挂起直到某个分支完成
+     * @return 完成的分支序号, 没有分支时返回-1
+     */
+    int wait();
+
+    /**
+     * @brief 不等待, 没有分支就绪时返回-1(相当于default分支)
+     */
+    int tryOnce();
+private:
+    struct Case {
+        ChannelBase* ch;
+        bool recv;
+        void* slot;
+        bool* ok;
+    };
+
+    int addCase(ChannelBase* ch, bool recv, void* slot, bool* ok);
+private:
+    std::vector<Case> m_cases;
+    size_t m_start = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,235 @@
+#include "clock.hpp"
+#include <atomic>
+#include <time.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#define KONG_HAVE_TSC 1
+#endif
+
+namespace kong {
+
+namespace {
+
+/// 重新校准间隔
+static const uint64_t s_resyncIntervalNs = 1000000000ULL;
+/// 初始校准时长
+static const uint64_t s_calibrateNs = 2000000ULL;
+
+uint64_t MonotonicNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+uint64_t RealtimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+inline uint64_t ReadTsc() {
+#ifdef KONG_HAVE_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+bool TscUsable() {
+#ifdef KONG_HAVE_TSC
+    if(getenv("KONG_CLOCK_NO_TSC")) {
+        return false;
+    }
+    unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+    if(!__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) || eax < 0x80000007) {
+        return false;
+    }
+    __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx);
+    //invariant TSC
+    if(!(edx & (1u << 8))) {
+        return false;
+    }
+    //内核判定TSC不稳定时会切换时钟源
+    FILE* fp = fopen("/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+    if(fp) {
+        char buf[32] = {0};
+        bool ok = fgets(buf, sizeof(buf), fp) && strncmp(buf, "tsc", 3) == 0;
+        fclose(fp);
+        return ok;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+/**
+ * @brief 时钟状态
+ * @details 换算参数由seqlock保护, 读端无锁
+ */
+struct ClockState {
+    ClockState() {
+        startMono = MonotonicNs();
+        wallOffset = (int64_t)(RealtimeNs() - startMono);
+    }
+
+    /**
+     * @brief 检测并校准TSC(忙等约2ms), 只在第一次取时间时调用一次
+     */
+    ClockState* calibrate() {
+        useTsc = TscUsable();
+        if(!useTsc) {
+            return this;
+        }
+        //初始校准
+        uint64_t t0 = ReadTsc();
+        uint64_t m0 = MonotonicNs();
+        uint64_t t1 = t0, m1 = m0;
+        while(m1 - m0 < s_calibrateNs) {
+            t1 = ReadTsc();
+            m1 = MonotonicNs();
+        }
+        if(t1 <= t0) {
+            useTsc = false;
+            return this;
+        }
+        startTsc = t0;
+        startTscMono = m0;
+        store(t1, m1, ((unsigned __int128)(m1 - m0) << 32) / (t1 - t0));
+        return this;
+    }
+
+    void store(uint64_t tsc, uint64_t ns, uint64_t m) {
+        seq.fetch_add(1, std::memory_order_acq_rel);
+        std::atomic_thread_fence(std::memory_order_release);
+        baseTsc.store(tsc, std::memory_order_relaxed);
+        baseNs.store(ns, std::memory_order_relaxed);
+        mult.store(m, std::memory_order_relaxed);
+        nextSyncTsc.store(tsc + (uint64_t)(((unsigned __int128)s_resyncIntervalNs << 32) / m)
+                    ,std::memory_order_relaxed);
+        seq.fetch_add(1, std::memory_order_release);
+    }
+
+    uint64_t convert(uint64_t tsc) const {
+        uint64_t s, btsc, bns, m;
+        do {
+            s = seq.load(std::memory_order_acquire);
+            btsc = baseTsc.load(std::memory_order_relaxed);
+            bns = baseNs.load(std::memory_order_relaxed);
+            m = mult.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while((s & 1) || s != seq.load(std::memory_order_relaxed));
+        if(tsc < btsc) {
+            return bns - (uint64_t)(((unsigned __int128)(btsc - tsc) * m) >> 32);
+        }
+        return bns + (uint64_t)(((unsigned __int128)(tsc - btsc) * m) >> 32);
+    }
+
+    void resync() {
+        bool expect = false;
+        if(!syncing.compare_exchange_strong(expect, true, std::memory_order_acquire)) {
+            return;
+        }
+        uint64_t now_mono = MonotonicNs();
+        uint64_t now_tsc = ReadTsc();
+        wallOffset.store((int64_t)(RealtimeNs() - now_mono), std::memory_order_relaxed);
+        if(useTsc && now_tsc > startTsc) {
+            //以启动时刻为基线, 基线越长频率越准
+            uint64_t m = ((unsigned __int128)(now_mono - startTscMono) << 32) / (now_tsc - startTsc);
+            //不回退
+            uint64_t cur = convert(now_tsc);
+            store(now_tsc, now_mono > cur ? now_mono : cur, m);
+        }
+        syncing.store(false, std::memory_order_release);
+    }
+
+    uint64_t startMono = 0;
+    uint64_t startTsc = 0;
+    uint64_t startTscMono = 0;
+    bool useTsc = false;
+    std::atomic<int64_t> wallOffset{0};
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint64_t> baseTsc{0};
+    std::atomic<uint64_t> baseNs{0};
+    /// 每个tick的纳秒数, 32.32定点
+    std::atomic<uint64_t> mult{0};
+    /// 下次校准的TSC值(未启用TSC时为单调纳秒)
+    std::atomic<uint64_t> nextSyncTsc{0};
+    std::atomic<bool> syncing{false};
+};
+
+ClockState& GetState() {
+    static ClockState s_state;
+    return s_state;
+}
+
+/// TSC校准推迟到第一次取时间, 只链接本库而不取时间的进程不付出校准的忙等
+ClockState& GetCalibrated() {
+    static ClockState* s_state = GetState().calibrate();
+    return *s_state;
+}
+
+/// 保证启动时刻在main之前记录, 使StartNs接近进程启动时刻(不校准)
+struct ClockIniter {
+    ClockIniter() {
+        GetState();
+    }
+};
+
+static ClockIniter s_clock_initer;
+
+}
+
+uint64_t Clock::NowNs() {
+    ClockState& st = GetCalibrated();
+    if(!st.useTsc) {
+        uint64_t now = MonotonicNs();
+        if(now >= st.nextSyncTsc.load(std::memory_order_relaxed)) {
+            st.nextSyncTsc.store(now + s_resyncIntervalNs, std::memory_order_relaxed);
+            st.resync();
+        }
+        return now;
+    }
+    uint64_t tsc = ReadTsc();
+    if(tsc >= st.nextSyncTsc.load(std::memory_order_relaxed)) {
+        st.resync();
+    }
+    return st.convert(tsc);
+}
+
+uint64_t Clock::ToWallNs(uint64_t mono_ns) {
+    return mono_ns + GetState().wallOffset.load(std::memory_order_relaxed);
+}
+
+uint64_t Clock::StartNs() {
+    return GetState().startMono;
+}
+
+uint64_t Clock::ElapsedMs(uint64_t mono_ns) {
+    uint64_t start = StartNs();
+    return mono_ns > start ? (mono_ns - start) / 1000000ULL : 0;
+}
+
+bool Clock::IsTscEnabled() {
+    return GetCalibrated().useTsc;
+}
+
+uint64_t Clock::TscHz() {
+    ClockState& st = GetCalibrated();
+    if(!st.useTsc) {
+        return 0;
+    }
+    uint64_t m = st.mult.load(std::memory_order_relaxed);
+    return m ? (uint64_t)(((unsigned __int128)1000000000ULL << 32) / m) : 0;
+}
+
+void Clock::Resync() {
+    GetCalibrated().resync();
+}
+
+}
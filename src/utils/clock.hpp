@@ -0,0 +1,69 @@
+/**
+ * @file clock.hpp
+ * @brief 低开销单调时钟(校准后的TSC, 不可靠时退回clock_gettime)
+ * @details 供日志、定时器、链路追踪共用
+ */
+#ifndef __KONG_CLOCK_H__
+#define __KONG_CLOCK_H__
+
+#include <cstdint>
+
+namespace kong {
+
+/**
+ * @brief 单调时钟
+ * @details 第一次取时间时用CLOCK_MONOTONIC校准TSC频率(忙等约2ms), 之后每秒以校准时刻为基线
+ *          重新校准一次。CPU不支持invariant TSC、内核未使用tsc时钟源、或设置了
+ *          环境变量 KONG_CLOCK_NO_TSC 时退回clock_gettime(CLOCK_MONOTONIC)
+ */
+class Clock {
+public:
+    /**
+     * @brief 返回单调时间(纳秒), 与CLOCK_MONOTONIC同基准
+     */
+    static uint64_t NowNs();
+
+    /**
+     * @brief 单调纳秒转换为墙上时间(纳秒, 自1970-01-01)
+     */
+    static uint64_t ToWallNs(uint64_t mono_ns);
+
+    /**
+     * @brief 单调纳秒转换为墙上时间(秒)
+     */
+    static uint64_t ToWallSeconds(uint64_t mono_ns) { return ToWallNs(mono_ns) / 1000000000ULL;}
+
+    /**
+     * @brief 返回进程启动(时钟初始化)时的单调纳秒
+     */
+    static uint64_t StartNs();
+
+    /**
+     * @brief 返回mono_ns距进程启动的毫秒数
+     */
+    static uint64_t ElapsedMs(uint64_t mono_ns);
+
+    /**
+     * @brief 返回当前墙上时间(毫秒)
+     */
+    static uint64_t NowWallMs() { return ToWallNs(NowNs()) / 1000000ULL;}
+
+    /**
+     * @brief 是否使用TSC
+     */
+    static bool IsTscEnabled();
+
+    /**
+     * @brief TSC频率(Hz), 未启用TSC时返回0
+     */
+    static uint64_t TscHz();
+
+    /**
+     * @brief 立即重新校准
+     */
+    static void Resync();
+};
+
+}
+
+#endif
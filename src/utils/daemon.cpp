@@ -0,0 +1,232 @@
+#include "daemon.hpp"
+#include "log/log.hpp"
+#include "utils/util.hpp"
+#include <algorithm>
+#include <errno.h>
+#include <fcntl.h>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <signal.h>
+#include <stdio.h>
+#include <sstream>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+
+namespace kong {
+
+static kong::Logger::ptr g_logger = KONG_LOG_NAME("system");
+
+/// 转发给工作进程的信号
+static const int s_forward_signals[] = {SIGTERM, SIGINT, SIGHUP, SIGUSR1, SIGUSR2};
+
+static volatile sig_atomic_t s_child = 0;
+static volatile sig_atomic_t s_stopping = 0;
+
+static uint64_t NowMs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+static void ForwardSignal(int sig) {
+    if(sig == SIGTERM || sig == SIGINT) {
+        s_stopping = 1;
+    }
+    pid_t child = s_child;
+    if(child > 0) {
+        kill(child, sig);
+    }
+}
+
+static void SetForwardHandlers(bool install) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = install ? ForwardSignal : SIG_DFL;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    for(int sig : s_forward_signals) {
+        sigaction(sig, &sa, nullptr);
+    }
+}
+
+std::string ProcessInfo::toString() const {
+    std::stringstream ss;
+    ss << "[ProcessInfo parent_id=" << parent_id
+       << " main_id=" << main_id
+       << " parent_start_time=" << Time2Str(parent_start_time)
+       << " main_start_time=" << Time2Str(main_start_time)
+       << " restart_count=" << restart_count << "]";
+    return ss.str();
+}
+
+int RunWatchdog(int argc, char** argv, std::function<int(int argc, char** argv)> main_cb
+                ,const DaemonOptions& options) {
+    ProcessInfo* info = ProcessInfoMgr::GetInstance();
+    info->parent_id = getpid();
+    info->parent_start_time = time(0);
+    s_stopping = 0;
+    SetForwardHandlers(true);
+    //fork到记下s_child之间屏蔽转发的信号, 否则这段时间收到的SIGTERM没有转发给工作进程
+    sigset_t block, old;
+    sigemptyset(&block);
+    for(int sig : s_forward_signals) {
+        sigaddset(&block, sig);
+    }
+    uint32_t delay = options.restart_delay_ms;
+    int code = 0;
+    while(true) {
+        sigprocmask(SIG_BLOCK, &block, &old);
+        if(s_stopping) {
+            //重启等待期间收到了停止信号
+            sigprocmask(SIG_SETMASK, &old, nullptr);
+            SetForwardHandlers(false);
+            return code;
+        }
+        pid_t pid = fork();
+        if(pid == 0) {
+            //工作进程, 先恢复默认处理再解除屏蔽
+            SetForwardHandlers(false);
+            s_child = 0;
+            sigprocmask(SIG_SETMASK, &old, nullptr);
+            info->main_id = getpid();
+            info->main_start_time = time(0);
+            KONG_LOG_INFO(g_logger) << "process start pid=" << getpid();
+            return main_cb(argc, argv);
+        } else if(pid < 0) {
+            sigprocmask(SIG_SETMASK, &old, nullptr);
+            KONG_LOG_ERROR(g_logger) << "fork fail return=" << pid
+                                     << " errno=" << errno << " errstr=" << strerror(errno);
+            SetForwardHandlers(false);
+            return -1;
+        }
+
+        s_child = pid;
+        sigprocmask(SIG_SETMASK, &old, nullptr);
+        uint64_t start = NowMs();
+        int status = 0;
+        while(waitpid(pid, &status, 0) < 0 && errno == EINTR);
+        s_child = 0;
+        if(WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+            KONG_LOG_INFO(g_logger) << "child finished pid=" << pid;
+            SetForwardHandlers(false);
+            return 0;
+        }
+        code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+        if(s_stopping) {
+            KONG_LOG_INFO(g_logger) << "child stopped pid=" << pid << " code=" << code;
+            SetForwardHandlers(false);
+            return code;
+        }
+        if(options.max_restarts && info->restart_count >= options.max_restarts) {
+            KONG_LOG_ERROR(g_logger) << "child crashed pid=" << pid << " code=" << code
+                                     << ", restart limit " << options.max_restarts << " reached";
+            SetForwardHandlers(false);
+            return code;
+        }
+        //运行了足够久才崩溃, 不算连续崩溃
+        if(NowMs() - start >= options.stable_ms) {
+            delay = options.restart_delay_ms;
+        }
+        KONG_LOG_ERROR(g_logger) << "child crashed pid=" << pid << " code=" << code
+                                 << ", restart in " << delay << "ms";
+        if(delay) {
+            usleep(delay * 1000);
+        }
+        delay = std::min(std::max(delay * 2, 1u), options.max_restart_delay_ms);
+        ++info->restart_count;
+    }
+}
+
+int StartDaemon(int argc, char** argv, std::function<int(int argc, char** argv)> main_cb
+                ,bool is_daemon, const DaemonOptions& options) {
+    if(!is_daemon) {
+        ProcessInfo* info = ProcessInfoMgr::GetInstance();
+        info->parent_id = info->main_id = getpid();
+        info->parent_start_time = info->main_start_time = time(0);
+        return main_cb(argc, argv);
+    }
+    if(daemon(1, 0)) {
+        KONG_LOG_ERROR(g_logger) << "daemon fail errno=" << errno << " errstr=" << strerror(errno);
+        return -1;
+    }
+    return RunWatchdog(argc, argv, main_cb, options);
+}
+
+/// 持有锁的pidfile, fd保持打开直到Remove或进程退出; fork出的子进程继承的记录不算自己的
+struct PidfileLock {
+    int fd;
+    pid_t pid;
+};
+static std::mutex s_pidfileMutex;
+static std::map<std::string, PidfileLock> s_pidfiles;
+
+bool Pidfile::Write(const std::string& path) {
+    std::lock_guard<std::mutex> lock(s_pidfileMutex);
+    auto it = s_pidfiles.find(path);
+    int fd = it != s_pidfiles.end() && it->second.pid == getpid() ? it->second.fd : -1;
+    while(fd < 0) {
+        size_t pos = path.rfind('/');
+        if(pos != std::string::npos && pos && !FSUtil::Mkdir(path.substr(0, pos))) {
+            KONG_LOG_ERROR(g_logger) << "create pidfile dir for " << path << " failed";
+            return false;
+        }
+        fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+        if(fd < 0) {
+            KONG_LOG_ERROR(g_logger) << "open pidfile " << path << " failed errno=" << errno
+                                     << " errstr=" << strerror(errno);
+            return false;
+        }
+        //锁跟随打开的文件, 进程退出(包括崩溃)时由内核释放; 检查和占用是同一个原子操作
+        //IsRunningPidfile检查时会短暂持有共享锁, 失败后稍等重试几次再判定被占用
+        int busy = 0;
+        for(int i = 0; i < 3 && (busy = flock(fd, LOCK_EX | LOCK_NB)); ++i) {
+            usleep(1000);
+        }
+        if(busy) {
+            std::ifstream ifs(path);
+            pid_t pid = 0;
+            ifs >> pid;
+            KONG_LOG_ERROR(g_logger) << "pidfile " << path << " locked by running pid=" << pid;
+            close(fd);
+            return false;
+        }
+        //加锁前文件可能被持有者删除, 锁住的不是当前路径上的文件时重试
+        struct stat fst, pst;
+        if(fstat(fd, &fst) || stat(path.c_str(), &pst)
+                || fst.st_ino != pst.st_ino || fst.st_dev != pst.st_dev) {
+            close(fd);
+            fd = -1;
+            continue;
+        }
+        PidfileLock& l = s_pidfiles[path];
+        l.fd = fd;
+        l.pid = getpid();
+    }
+    //不能rename替换文件, 否则锁留在旧inode上; 先写再截断, 长度不变时读者看不到空文件
+    std::string data = std::to_string(getpid()) + "\n";
+    if(pwrite(fd, data.c_str(), data.size(), 0) != (ssize_t)data.size()
+            || ftruncate(fd, data.size())) {
+        KONG_LOG_ERROR(g_logger) << "write pidfile " << path << " failed errno=" << errno;
+        return false;
+    }
+    return true;
+}
+
+bool Pidfile::Remove(const std::string& path) {
+    std::lock_guard<std::mutex> lock(s_pidfileMutex);
+    auto it = s_pidfiles.find(path);
+    if(it == s_pidfiles.end() || it->second.pid != getpid()) {
+        return false;
+    }
+    //先删除再解锁, 等锁的进程加锁后会发现文件已不在原路径上
+    bool rt = FSUtil::Unlink(path);
+    close(it->second.fd);
+    s_pidfiles.erase(it);
+    return rt;
+}
+
+}
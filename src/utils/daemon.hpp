@@ -0,0 +1,87 @@
+/**
+ * @file daemon.hpp
+ * @brief 守护进程: 后台化, pidfile, 崩溃自动重启的看门狗
+ */
+#ifndef __KONG_DAEMON_H__
+#define __KONG_DAEMON_H__
+
+#include <functional>
+#include <string>
+#include <unistd.h>
+#include "utils/singleton.hpp"
+
+namespace kong {
+
+/**
+ * @brief 进程信息
+ */
+struct ProcessInfo {
+    /// 看门狗(父)进程id
+    pid_t parent_id = 0;
+    /// 工作(子)进程id
+    pid_t main_id = 0;
+    /// 看门狗进程启动时间(秒)
+    uint64_t parent_start_time = 0;
+    /// 工作进程启动时间(秒)
+    uint64_t main_start_time = 0;
+    /// 工作进程被重启的次数
+    uint32_t restart_count = 0;
+
+    std::string toString() const;
+};
+
+typedef kong::Singleton<ProcessInfo> ProcessInfoMgr;
+
+/**
+ * @brief 看门狗配置
+ */
+struct DaemonOptions {
+    /// 工作进程异常退出后的首次重启延迟(毫秒)
+    uint32_t restart_delay_ms = 10;
+    /// 连续崩溃时延迟逐次翻倍, 最大值(毫秒)
+    uint32_t max_restart_delay_ms = 5000;
+    /// 工作进程运行超过这个时间(毫秒)后崩溃, 重启延迟回到初始值
+    uint32_t stable_ms = 10000;
+    /// 最多重启次数, 0表示不限
+    uint32_t max_restarts = 0;
+};
+
+/**
+ * @brief 以看门狗方式运行main_cb
+ * @details 当前进程成为看门狗, fork出工作进程执行main_cb. 工作进程正常退出(返回0)时
+ *          看门狗随之返回; 异常退出(非0或被信号杀死)时按退避延迟重新fork.
+ *          看门狗收到的SIGTERM/SIGINT/SIGHUP/SIGUSR1/SIGUSR2转发给工作进程,
+ *          SIGTERM/SIGINT之后工作进程退出不再重启
+ * @return 工作进程最后一次的退出码
+ */
+int RunWatchdog(int argc, char** argv, std::function<int(int argc, char** argv)> main_cb
+                ,const DaemonOptions& options = DaemonOptions());
+
+/**
+ * @brief 启动程序
+ * @param[in] is_daemon 是否以守护进程运行: 是则先daemon()脱离终端, 再以看门狗方式运行;
+ *                      否则直接调用main_cb
+ */
+int StartDaemon(int argc, char** argv, std::function<int(int argc, char** argv)> main_cb
+                ,bool is_daemon, const DaemonOptions& options = DaemonOptions());
+
+/**
+ * @brief pidfile
+ */
+class Pidfile {
+public:
+    /**
+     * @brief 对pidfile加flock并写入当前进程id, 锁一直持有到Remove或进程退出
+     * @return 其它进程持有锁时返回false; 检查和占用是同一个原子操作, 多个实例同时启动只有一个成功
+     */
+    static bool Write(const std::string& path);
+
+    /**
+     * @brief 删除pidfile并释放锁, 只删除当前进程持有锁的文件
+     */
+    static bool Remove(const std::string& path);
+};
+
+}
+
+#endif
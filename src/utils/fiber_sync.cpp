@@ -0,0 +1,228 @@
+#include "fiber_sync.hpp"
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <mutex>
+
+namespace kong {
+
+void SpinLock::pause(int spins) {
+    if(spins < 64) {
+        __builtin_ia32_pause();
+    } else {
+        //持有者可能被抢占, 让出CPU
+        sched_yield();
+    }
+}
+
+void Waiter::park() {
+    while(m_state.load(std::memory_order_acquire) == 0) {
+        syscall(SYS_futex, &m_state, FUTEX_WAIT_PRIVATE, 0, nullptr, nullptr, 0);
+    }
+}
+
+bool Waiter::parkFor(uint64_t timeout_ms) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t deadline = now.tv_sec * 1000000000ULL + now.tv_nsec + timeout_ms * 1000000ULL;
+    while(m_state.load(std::memory_order_acquire) == 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+        if(ns >= deadline) {
+            return false;
+        }
+        //FUTEX_WAIT的超时是相对时间
+        struct timespec ts;
+        ts.tv_sec = (deadline - ns) / 1000000000ULL;
+        ts.tv_nsec = (deadline - ns) % 1000000000ULL;
+        syscall(SYS_futex, &m_state, FUTEX_WAIT_PRIVATE, 0, &ts, nullptr, 0);
+    }
+    return true;
+}
+
+void Waiter::notify() {
+    syscall(SYS_futex, &m_state, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+void WaitList::push(WaitNode* n) {
+    n->prev = m_tail;
+    n->next = nullptr;
+    if(m_tail) {
+        m_tail->next = n;
+    } else {
+        m_head = n;
+    }
+    m_tail = n;
+    n->linked = true;
+}
+
+bool WaitList::remove(WaitNode* n) {
+    if(!n->linked) {
+        return false;
+    }
+    if(n->prev) {
+        n->prev->next = n->next;
+    } else {
+        m_head = n->next;
+    }
+    if(n->next) {
+        n->next->prev = n->prev;
+    } else {
+        m_tail = n->prev;
+    }
+    n->prev = n->next = nullptr;
+    n->linked = false;
+    return true;
+}
+
+WaitNode* WaitList::pop() {
+    WaitNode* n = m_head;
+    if(n) {
+        remove(n);
+    }
+    return n;
+}
+
+bool WaitList::wakeOne() {
+    Waiter* w = claimOne();
+    if(w) {
+        w->notify();
+    }
+    return w != nullptr;
+}
+
+Waiter* WaitList::claimOne() {
+    while(WaitNode* n = pop()) {
+        //select的等待者可能已被其它队列唤醒
+        if(n->waiter->claim()) {
+            return n->waiter;
+        }
+    }
+    return nullptr;
+}
+
+void WaitList::wakeAll() {
+    while(WaitNode* n = pop()) {
+        n->waiter->wake();
+    }
+}
+
+void FiberMutex::lockSlow() {
+    while(true) {
+        Waiter w;
+        WaitNode node;
+        node.waiter = &w;
+        {
+            std::lock_guard<SpinLock> lock(m_lock);
+            //标记为有等待者; 若恰好已释放则直接获得
+            if(m_state.exchange(2, std::memory_order_acquire) == 0) {
+                return;
+            }
+            m_waiters.push(&node);
+        }
+        w.park();
+    }
+}
+
+void FiberMutex::unlockSlow() {
+    Waiter* w;
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        w = m_waiters.claimOne();
+    }
+    if(w) {
+        w->notify();
+    }
+}
+
+void FiberCondition::wait(FiberMutex& mutex) {
+    Waiter w;
+    WaitNode node;
+    node.waiter = &w;
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        m_waiters.push(&node);
+    }
+    mutex.unlock();
+    w.park();
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        m_waiters.remove(&node);
+    }
+    mutex.lock();
+}
+
+void FiberCondition::notify_one() {
+    Waiter* w;
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        w = m_waiters.claimOne();
+    }
+    if(w) {
+        w->notify();
+    }
+}
+
+void FiberCondition::notify_all() {
+    std::lock_guard<SpinLock> lock(m_lock);
+    m_waiters.wakeAll();
+}
+
+bool FiberSemaphore::tryWait() {
+    int64_t c = m_count.load(std::memory_order_relaxed);
+    while(c > 0) {
+        if(m_count.compare_exchange_weak(c, c - 1, std::memory_order_acquire)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void FiberSemaphore::waitSlow() {
+    Waiter w;
+    WaitNode node;
+    node.waiter = &w;
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        if(m_pending) {
+            --m_pending;
+            return;
+        }
+        m_waiters.push(&node);
+    }
+    w.park();
+}
+
+void FiberSemaphore::notifySlow() {
+    std::lock_guard<SpinLock> lock(m_lock);
+    if(!m_waiters.wakeOne()) {
+        //等待者已减计数但还没入队, 留给它自己取
+        ++m_pending;
+    }
+}
+
+void WaitGroup::wait() {
+    if(m_count.load(std::memory_order_acquire) == 0) {
+        return;
+    }
+    Waiter w;
+    WaitNode node;
+    node.waiter = &w;
+    {
+        std::lock_guard<SpinLock> lock(m_lock);
+        if(m_count.load(std::memory_order_acquire) == 0) {
+            return;
+        }
+        m_waiters.push(&node);
+    }
+    w.park();
+}
+
+void WaitGroup::wakeAll() {
+    std::lock_guard<SpinLock> lock(m_lock);
+    m_waiters.wakeAll();
+}
+
+}
@@ -0,0 +1,270 @@
+/**
+ * @file fiber_sync.hpp
+ * @brief 挂起等待者的同步原语: 互斥量/条件变量/信号量/WaitGroup
+ */
+#ifndef __KONG_FIBER_SYNC_H__
+#define __KONG_FIBER_SYNC_H__
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+namespace kong {
+
+/**
+ * @brief 自旋锁, 只用于保护很短的临界区(等待队列的增删)
+ */
+class SpinLock {
+public:
+    void lock() {
+        int spins = 0;
+        while(m_flag.exchange(true, std::memory_order_acquire)) {
+            while(m_flag.load(std::memory_order_relaxed)) {
+                pause(++spins);
+            }
+        }
+    }
+
+    bool try_lock() {
+        return !m_flag.load(std::memory_order_relaxed)
+                && !m_flag.exchange(true, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        m_flag.store(false, std::memory_order_release);
+    }
+private:
+    static void pause(int spins);
+private:
+    std::atomic<bool> m_flag{false};
+};
+
+/**
+ * @brief 等待者
+ * @details 所有原语都通过park()/wake()挂起和唤醒等待者, 这是唯一与执行体相关的
+ *          地方: 目前挂起的是调用线程(futex), 协程调度器接入后在这里挂起当前
+ *          协程并把它重新放回调度队列, 原语本身不需要改动
+ */
+class Waiter {
+public:
+    /**
+     * @brief 挂起直到被唤醒
+     */
+    void park();
+
+    /**
+     * @brief 挂起直到被唤醒或超时
+     * @return 被唤醒返回true, 超时返回false
+     */
+    bool parkFor(uint64_t timeout_ms);
+
+    /**
+     * @brief 唤醒, 已经被唤醒过时返回false
+     */
+    bool wake() {
+        if(!claim()) {
+            return false;
+        }
+        notify();
+        return true;
+    }
+
+    /**
+     * @brief 标记为已唤醒但暂不唤醒执行体, 已经被唤醒过时返回false
+     * @details 在锁内claim, 解锁后再notify, 被唤醒者不会一醒来就撞上唤醒者还持有的锁
+     */
+    bool claim() {
+        uint32_t expect = 0;
+        return m_state.compare_exchange_strong(expect, 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief 唤醒已claim的执行体
+     * @details 被唤醒者可能已经看到状态变化自行返回, 这时唤醒的是一个失效地址,
+     *          futex对此是无害的
+     */
+    void notify();
+
+    /**
+     * @brief 是否已被唤醒
+     */
+    bool isWoken() const { return m_state.load(std::memory_order_acquire) != 0;}
+
+    /**
+     * @brief 重新进入等待状态
+     */
+    void reset() { m_state.store(0, std::memory_order_relaxed);}
+private:
+    std::atomic<uint32_t> m_state{0};
+};
+
+/**
+ * @brief 等待队列节点, 同一个等待者可以通过多个节点同时挂在多个队列上(select)
+ */
+struct WaitNode {
+    Waiter* waiter = nullptr;
+    WaitNode* prev = nullptr;
+    WaitNode* next = nullptr;
+    bool linked = false;
+};
+
+/**
+ * @brief 侵入式FIFO等待队列, 不加锁, 由使用者保护
+ */
+class WaitList {
+public:
+    bool empty() const { return !m_head;}
+
+    void push(WaitNode* n);
+
+    /**
+     * @brief 移除节点, 节点已不在队列中(已被唤醒者取出)时返回false
+     */
+    bool remove(WaitNode* n);
+
+    /**
+     * @brief 从队首唤醒一个尚未被唤醒的等待者
+     * @return 没有可唤醒的等待者时返回false
+     */
+    bool wakeOne();
+
+    /**
+     * @brief 从队首claim一个尚未被唤醒的等待者, 由调用者解锁后notify
+     */
+    Waiter* claimOne();
+
+    /**
+     * @brief 唤醒所有等待者
+     */
+    void wakeAll();
+private:
+    WaitNode* pop();
+private:
+    WaitNode* m_head = nullptr;
+    WaitNode* m_tail = nullptr;
+};
+
+/**
+ * @brief 互斥量
+ * @details 无竞争时加解锁各一次原子操作, 竞争时等待者挂起, 不占用执行线程
+ */
+class FiberMutex {
+public:
+    FiberMutex() {}
+
+    void lock() {
+        uint32_t expect = 0;
+        if(!m_state.compare_exchange_strong(expect, 1, std::memory_order_acquire)) {
+            lockSlow();
+        }
+    }
+
+    bool try_lock() {
+        uint32_t expect = 0;
+        return m_state.compare_exchange_strong(expect, 1, std::memory_order_acquire);
+    }
+
+    void unlock() {
+        if(m_state.exchange(0, std::memory_order_release) == 2) {
+            unlockSlow();
+        }
+    }
+private:
+    FiberMutex(const FiberMutex&) = delete;
+    FiberMutex& operator=(const FiberMutex&) = delete;
+
+    void lockSlow();
+    void unlockSlow();
+private:
+    /// 0:未加锁 1:已加锁 2:已加锁且可能有等待者
+    std::atomic<uint32_t> m_state{0};
+    SpinLock m_lock;
+    WaitList m_waiters;
+};
+
+/**
+ * @brief 条件变量, 与FiberMutex配合使用
+ */
+class FiberCondition {
+public:
+    /**
+     * @brief 释放mutex并挂起, 被唤醒后重新加锁; 可能虚假唤醒
+     */
+    void wait(FiberMutex& mutex);
+
+    template<class Pred>
+    void wait(FiberMutex& mutex, Pred pred) {
+        while(!pred()) {
+            wait(mutex);
+        }
+    }
+
+    void notify_one();
+    void notify_all();
+private:
+    SpinLock m_lock;
+    WaitList m_waiters;
+};
+
+/**
+ * @brief 计数信号量
+ * @details 计数为正时wait只做一次原子减; 为负时表示等待者数量
+ */
+class FiberSemaphore {
+public:
+    FiberSemaphore(uint32_t count = 0)
+        :m_count(count) {
+    }
+
+    void wait() {
+        if(m_count.fetch_sub(1, std::memory_order_acquire) <= 0) {
+            waitSlow();
+        }
+    }
+
+    bool tryWait();
+
+    void notify() {
+        if(m_count.fetch_add(1, std::memory_order_release) < 0) {
+            notifySlow();
+        }
+    }
+private:
+    void waitSlow();
+    void notifySlow();
+private:
+    std::atomic<int64_t> m_count;
+    SpinLock m_lock;
+    WaitList m_waiters;
+    /// 已发出但等待者尚未入队的唤醒
+    uint64_t m_pending = 0;
+};
+
+/**
+ * @brief 等待一组任务完成
+ */
+class WaitGroup {
+public:
+    void add(int64_t n = 1) {
+        if(m_count.fetch_add(n, std::memory_order_acq_rel) + n == 0) {
+            wakeAll();
+        }
+    }
+
+    void done() { add(-1);}
+
+    /**
+     * @brief 挂起直到计数归零
+     */
+    void wait();
+private:
+    void wakeAll();
+private:
+    std::atomic<int64_t> m_count{0};
+    SpinLock m_lock;
+    WaitList m_waiters;
+};
+
+}
+
+#endif
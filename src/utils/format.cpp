@@ -0,0 +1,577 @@
+#include "format.hpp"
+#include "strutil.hpp"
+#include <algorithm>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+namespace kong {
+namespace fmt {
+
+namespace {
+
+/**
+ * @brief 解析后的格式说明
+ */
+struct Spec {
+    char fill = ' ';
+    /// 0 默认, '<' '>' '^'
+    char align = 0;
+    bool plus = false;
+    bool space = false;
+    bool alt = false;
+    bool zero = false;
+    int width = 0;
+    int precision = -1;
+    char type = 0;
+};
+
+const char s_hexLower[] = "0123456789abcdef";
+const char s_hexUpper[] = "0123456789ABCDEF";
+
+void AppendPadded(std::string& out, const char* data, size_t len, const Spec& spec, char default_align) {
+    if(spec.width <= 0 || (size_t)spec.width <= len) {
+        out.append(data, len);
+        return;
+    }
+    size_t pad = spec.width - len;
+    char align = spec.align ? spec.align : default_align;
+    if(align == '>') {
+        out.append(pad, spec.fill);
+        out.append(data, len);
+    } else if(align == '^') {
+        out.append(pad / 2, spec.fill);
+        out.append(data, len);
+        out.append(pad - pad / 2, spec.fill);
+    } else {
+        out.append(data, len);
+        out.append(pad, spec.fill);
+    }
+}
+
+/**
+ * @brief 整数按进制输出, 处理符号、前缀和补零
+ */
+void AppendInteger(std::string& out, uint64_t abs, bool negative, const Spec& spec) {
+    char buf[80];
+    char* end = buf + sizeof(buf);
+    char* p = end;
+    const char* prefix = "";
+    switch(spec.type) {
+        case 'x':
+        case 'X': {
+            const char* digits = spec.type == 'x' ? s_hexLower : s_hexUpper;
+            do {
+                *--p = digits[abs & 0xF];
+                abs >>= 4;
+            } while(abs);
+            if(spec.alt) {
+                prefix = spec.type == 'x' ? "0x" : "0X";
+            }
+            break;
+        }
+        case 'o':
+            do {
+                *--p = (char)('0' + (abs & 7));
+                abs >>= 3;
+            } while(abs);
+            if(spec.alt) {
+                prefix = "0";
+            }
+            break;
+        case 'b':
+            do {
+                *--p = (char)('0' + (abs & 1));
+                abs >>= 1;
+            } while(abs);
+            if(spec.alt) {
+                prefix = "0b";
+            }
+            break;
+        default: {
+            char tmp[20];
+            size_t n = StrUtil::Uint64ToChars(tmp, abs);
+            p -= n;
+            memcpy(p, tmp, n);
+            break;
+        }
+    }
+    char sign[2] = {0, 0};
+    if(negative) {
+        sign[0] = '-';
+    } else if(spec.plus) {
+        sign[0] = '+';
+    } else if(spec.space) {
+        sign[0] = ' ';
+    }
+    size_t digits = end - p;
+    //精度为最少位数, 不足时补零; 精度为0时数值0不输出数字
+    size_t zeros = 0;
+    if(spec.precision >= 0) {
+        if(spec.precision == 0 && digits == 1 && *p == '0') {
+            digits = 0;
+        }
+        if((size_t)spec.precision > digits) {
+            zeros = spec.precision - digits;
+        }
+    }
+    size_t head = strlen(sign) + strlen(prefix);
+    if(spec.zero && spec.precision < 0 && !spec.align && spec.width > 0
+            && head + digits < (size_t)spec.width) {
+        out.append(sign);
+        out.append(prefix);
+        out.append(spec.width - head - digits, '0');
+        out.append(p, digits);
+        return;
+    }
+    if(spec.width <= 0) {
+        out.append(sign);
+        out.append(prefix);
+        out.append(zeros, '0');
+        out.append(p, digits);
+        return;
+    }
+    std::string tmp;
+    tmp.append(sign);
+    tmp.append(prefix);
+    tmp.append(zeros, '0');
+    tmp.append(p, digits);
+    AppendPadded(out, tmp.c_str(), tmp.size(), spec, '>');
+}
+
+void AppendDoubleSpec(std::string& out, double v, const Spec& spec) {
+    char buf[512];
+    int len = 0;
+    if(!spec.type && spec.precision < 0) {
+        size_t n = 0;
+        if(v >= 0 && (spec.plus || spec.space)) {
+            buf[n++] = spec.plus ? '+' : ' ';
+        }
+        len = n + StrUtil::DoubleToChars(buf + n, v);
+    } else {
+        char f[16];
+        char* p = f;
+        *p++ = '%';
+        if(spec.plus) *p++ = '+';
+        if(spec.space) *p++ = ' ';
+        if(spec.alt) *p++ = '#';
+        *p++ = '.';
+        *p++ = '*';
+        *p++ = spec.type ? spec.type : 'g';
+        *p = 0;
+        len = snprintf(buf, sizeof(buf), f, spec.precision < 0 ? 6 : spec.precision, v);
+        if(len < 0) {
+            return;
+        }
+        if((size_t)len >= sizeof(buf)) {
+            len = sizeof(buf) - 1;
+        }
+    }
+    if(spec.zero && !spec.align && spec.width > len) {
+        size_t sign = (buf[0] == '-' || buf[0] == '+' || buf[0] == ' ') ? 1 : 0;
+        out.append(buf, sign);
+        out.append(spec.width - len, '0');
+        out.append(buf + sign, len - sign);
+        return;
+    }
+    AppendPadded(out, buf, len, spec, '>');
+}
+
+void AppendString(std::string& out, const char* data, size_t len, const Spec& spec) {
+    if(spec.precision >= 0 && (size_t)spec.precision < len) {
+        len = spec.precision;
+    }
+    AppendPadded(out, data, len, spec, '<');
+}
+
+void AppendPointer(std::string& out, const void* p, const Spec& spec) {
+    if(!p) {
+        AppendPadded(out, "(nil)", 5, spec, '>');
+        return;
+    }
+    Spec s = spec;
+    s.type = 'x';
+    s.alt = true;
+    AppendInteger(out, (uint64_t)(uintptr_t)p, false, s);
+}
+
+const char* CStr(const Arg& arg, size_t& len) {
+    if(!arg.s.data) {
+        len = 6;
+        return "(null)";
+    }
+    len = arg.type == STRING ? arg.s.size : strlen(arg.s.data);
+    return arg.s.data;
+}
+
+/**
+ * @brief 按参数类型和说明输出
+ */
+void AppendWithSpec(std::string& out, const Arg& arg, const Spec& spec) {
+    switch(arg.type) {
+        case INT:
+            if(spec.type == 'c') {
+                char c = (char)arg.i;
+                AppendPadded(out, &c, 1, spec, '<');
+            } else if(spec.type && strchr("fFeEgG", spec.type)) {
+                AppendDoubleSpec(out, (double)arg.i, spec);
+            } else {
+                AppendInteger(out, arg.i < 0 ? 0 - (uint64_t)arg.i : (uint64_t)arg.i, arg.i < 0, spec);
+            }
+            break;
+        case UINT:
+            if(spec.type == 'c') {
+                char c = (char)arg.u;
+                AppendPadded(out, &c, 1, spec, '<');
+            } else if(spec.type && strchr("fFeEgG", spec.type)) {
+                AppendDoubleSpec(out, (double)arg.u, spec);
+            } else {
+                AppendInteger(out, arg.u, false, spec);
+            }
+            break;
+        case DOUBLE:
+            if(spec.type && strchr("fFeEgG", spec.type)) {
+                AppendDoubleSpec(out, arg.d, spec);
+            } else {
+                Spec s = spec;
+                s.type = 0;
+                AppendDoubleSpec(out, arg.d, s);
+            }
+            break;
+        case BOOL:
+            if(spec.type && strchr("dxXob", spec.type)) {
+                AppendInteger(out, arg.b ? 1 : 0, false, spec);
+            } else {
+                AppendString(out, arg.b ? "true" : "false", arg.b ? 4 : 5, spec);
+            }
+            break;
+        case CHAR:
+            if(spec.type && strchr("dxXob", spec.type)) {
+                AppendInteger(out, arg.c < 0 ? 0 - (uint64_t)(int64_t)arg.c : (uint64_t)arg.c
+                              ,arg.c < 0, spec);
+            } else {
+                AppendPadded(out, &arg.c, 1, spec, '<');
+            }
+            break;
+        case CSTRING:
+        case STRING: {
+            if(spec.type == 'p') {
+                AppendPointer(out, arg.s.data, spec);
+                break;
+            }
+            size_t len = 0;
+            const char* str = CStr(arg, len);
+            AppendString(out, str, len, spec);
+            break;
+        }
+        case POINTER:
+            AppendPointer(out, arg.p, spec);
+            break;
+        case CUSTOM: {
+            std::string tmp;
+            arg.custom.func(tmp, arg.custom.obj);
+            AppendString(out, tmp.c_str(), tmp.size(), spec);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+/**
+ * @brief 解析 {} 内 ':' 之后的说明, [begin, end)
+ */
+void ParseBraceSpec(const char* begin, const char* end, Spec& spec) {
+    const char* p = begin;
+    if(end - p >= 2 && (p[1] == '<' || p[1] == '>' || p[1] == '^')) {
+        spec.fill = p[0];
+        spec.align = p[1];
+        p += 2;
+    } else if(p < end && (*p == '<' || *p == '>' || *p == '^')) {
+        spec.align = *p++;
+    }
+    if(p < end && (*p == '+' || *p == ' ')) {
+        spec.plus = *p == '+';
+        spec.space = *p == ' ';
+        ++p;
+    }
+    if(p < end && *p == '#') {
+        spec.alt = true;
+        ++p;
+    }
+    if(p < end && *p == '0') {
+        spec.zero = true;
+        ++p;
+    }
+    while(p < end && *p >= '0' && *p <= '9') {
+        spec.width = spec.width * 10 + (*p++ - '0');
+    }
+    if(p < end && *p == '.') {
+        ++p;
+        spec.precision = 0;
+        while(p < end && *p >= '0' && *p <= '9') {
+            spec.precision = spec.precision * 10 + (*p++ - '0');
+        }
+    }
+    if(p < end) {
+        spec.type = *p;
+    }
+}
+
+}
+
+void AppendArg(std::string& out, const Arg& arg) {
+    switch(arg.type) {
+        case INT:
+            StrUtil::AppendInt64(out, arg.i);
+            break;
+        case UINT:
+            StrUtil::AppendUint64(out, arg.u);
+            break;
+        case DOUBLE:
+            StrUtil::AppendDouble(out, arg.d);
+            break;
+        case CSTRING:
+        case STRING: {
+            size_t len = 0;
+            const char* str = CStr(arg, len);
+            out.append(str, len);
+            break;
+        }
+        case CUSTOM:
+            arg.custom.func(out, arg.custom.obj);
+            break;
+        default:
+            AppendWithSpec(out, arg, Spec());
+            break;
+    }
+}
+
+void VFormatTo(std::string& out, const char* fmt, const Arg* args, size_t size) {
+    size_t idx = 0;
+    const char* p = fmt;
+    const char* lit = p;
+    while(*p) {
+        if(*p == '}') {
+            out.append(lit, p - lit);
+            //'}}' 或孤立的 '}' 都输出一个 '}'
+            p += p[1] == '}' ? 2 : 1;
+            out.append(1, '}');
+            lit = p;
+            continue;
+        }
+        if(*p != '{') {
+            ++p;
+            continue;
+        }
+        out.append(lit, p - lit);
+        if(p[1] == '{') {
+            out.append(1, '{');
+            p += 2;
+            lit = p;
+            continue;
+        }
+        const char* close = strchr(p + 1, '}');
+        if(!close) {
+            //不完整的占位符按原样输出
+            lit = p;
+            break;
+        }
+        if(idx >= size) {
+            out.append(p, close - p + 1);
+        } else if(close == p + 1) {
+            AppendArg(out, args[idx++]);
+        } else {
+            Spec spec;
+            const char* begin = p + 1;
+            if(*begin == ':') {
+                ++begin;
+            }
+            ParseBraceSpec(begin, close, spec);
+            AppendWithSpec(out, args[idx++], spec);
+        }
+        p = close + 1;
+        lit = p;
+    }
+    out.append(lit);
+}
+
+/**
+ * @brief 适配两种strerror_r: GNU版返回字符串指针(不一定指向buf), XSI版返回错误码并写入buf
+ */
+static const char* StrerrorResult(char* rt, const char* buf) {
+    return rt;
+}
+
+static const char* StrerrorResult(int rt, const char* buf) {
+    return rt ? "Unknown error" : buf;
+}
+
+/**
+ * @brief 整数参数按printf的规则转换: 小于int的参数先提升为int, 有长度修饰符时截断到对应宽度;
+ *        %u %x %o把负数解释为同宽度的无符号数, %d %i把截断后的值解释为有符号数
+ */
+static void ToPrintfInteger(Arg& arg, char conv, int length) {
+    int64_t v = arg.type == INT ? arg.i : (arg.type == CHAR ? (int64_t)arg.c : (int64_t)arg.u);
+    int bytes = length ? length : std::max<int>(arg.size, sizeof(int));
+    if(bytes < 8) {
+        uint64_t mask = (1ULL << (bytes * 8)) - 1;
+        uint64_t u = (uint64_t)v & mask;
+        //符号扩展
+        v = (int64_t)((u ^ (1ULL << (bytes * 8 - 1))) - (1ULL << (bytes * 8 - 1)));
+    }
+    if(conv == 'd' || conv == 'i') {
+        if(arg.type == UINT && !length) {
+            //无符号参数用%d输出时保留原值
+            return;
+        }
+        arg.type = INT;
+        arg.i = v;
+    } else {
+        arg.type = UINT;
+        arg.u = bytes < 8 ? (uint64_t)v & ((1ULL << (bytes * 8)) - 1) : (uint64_t)v;
+    }
+}
+
+void VPrintfTo(std::string& out, const char* fmt, const Arg* args, size_t size) {
+    size_t idx = 0;
+    const char* p = fmt;
+    const char* lit = p;
+    while(*p) {
+        if(*p != '%') {
+            ++p;
+            continue;
+        }
+        out.append(lit, p - lit);
+        const char* start = p++;
+        if(*p == '%') {
+            out.append(1, '%');
+            lit = ++p;
+            continue;
+        }
+        Spec spec;
+        for(;; ++p) {
+            if(*p == '-') {
+                spec.align = '<';
+            } else if(*p == '+') {
+                spec.plus = true;
+            } else if(*p == ' ') {
+                spec.space = true;
+            } else if(*p == '#') {
+                spec.alt = true;
+            } else if(*p == '0') {
+                spec.zero = true;
+            } else {
+                break;
+            }
+        }
+        if(*p == '*') {
+            ++p;
+            if(idx < size && (args[idx].type == INT || args[idx].type == UINT)) {
+                int64_t w = args[idx].type == INT ? args[idx].i : (int64_t)args[idx].u;
+                if(w < 0) {
+                    spec.align = '<';
+                    w = -w;
+                }
+                spec.width = (int)w;
+            }
+            ++idx;
+        } else {
+            while(*p >= '0' && *p <= '9') {
+                spec.width = spec.width * 10 + (*p++ - '0');
+            }
+        }
+        if(*p == '.') {
+            ++p;
+            spec.precision = 0;
+            if(*p == '*') {
+                ++p;
+                if(idx < size && (args[idx].type == INT || args[idx].type == UINT)) {
+                    int64_t v = args[idx].type == INT ? args[idx].i : (int64_t)args[idx].u;
+                    spec.precision = v < 0 ? -1 : (int)v;
+                }
+                ++idx;
+            } else {
+                while(*p >= '0' && *p <= '9') {
+                    spec.precision = spec.precision * 10 + (*p++ - '0');
+                }
+            }
+        }
+        //参数类型已知, 长度修饰符只用于按printf的规则截断: hh为1字节, h为2字节, 其余不截断
+        int length = 0;
+        while(*p && strchr("hlLqjzt", *p)) {
+            length = *p == 'h' ? (length == 2 ? 1 : 2) : 8;
+            ++p;
+        }
+        if(!*p) {
+            lit = start;
+            break;
+        }
+        char conv = *p++;
+        lit = p;
+        if(conv == 'm') {
+            //strerror的未知错误码会写共享的静态缓冲区, 多线程写日志时不安全
+            char buf[128];
+            out.append(StrerrorResult(strerror_r(errno, buf, sizeof(buf)), buf));
+            continue;
+        }
+        if(conv == 'n') {
+            continue;
+        }
+        if(idx >= size) {
+            out.append(start, p - start);
+            continue;
+        }
+        Arg arg = args[idx++];
+        if(strchr("diuxXo", conv) && (arg.type == INT || arg.type == UINT || arg.type == CHAR)) {
+            ToPrintfInteger(arg, conv, length);
+        }
+        switch(conv) {
+            case 'd':
+            case 'i':
+            case 'u':
+                spec.type = 'd';
+                break;
+            case 'x':
+            case 'X':
+            case 'o':
+            case 'c':
+            case 'f':
+            case 'F':
+            case 'e':
+            case 'E':
+            case 'g':
+            case 'G':
+            case 'p':
+                spec.type = conv;
+                break;
+            case 'a':
+            case 'A':
+                spec.type = conv == 'a' ? 'e' : 'E';
+                break;
+            default:
+                spec.type = 0;
+                break;
+        }
+        //printf 的 %e %f %g 默认精度是6
+        if(spec.type && strchr("fFeEgG", spec.type) && spec.precision < 0) {
+            spec.precision = 6;
+        }
+        if(spec.align) {
+            spec.zero = false;
+        } else if(spec.type && strchr("sc", spec.type)) {
+            spec.align = '>';
+        } else if(!spec.type || spec.type == 's') {
+            spec.align = '>';
+        }
+        if(!spec.type && spec.width <= 0 && spec.precision < 0) {
+            AppendArg(out, arg);
+        } else {
+            AppendWithSpec(out, arg, spec);
+        }
+    }
+    out.append(lit);
+}
+
+}
+}
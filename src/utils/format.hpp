@@ -0,0 +1,374 @@
+/**
+ * @file format.hpp
+ * @brief 类型安全的格式化({}占位符 / printf兼容)
+ * @details
+ *  {} 风格: "user={} cost={:.3f}ms hex={:#x}"
+ *      占位符 {[:[[填充]对齐][+][#][0][宽度][.精度][类型]]}
+ *      对齐 < > ^, 类型 d x X o b c f F e E g G s p
+ *      {{ 和 }} 输出字面量花括号
+ *  格式串为字面量时, KONG_FMT_CHECK 在编译期校验占位符数量和类型
+ *  printf 风格: 按参数的实际类型格式化, 类型与转换符不一致时按参数类型输出, 不会越界读取
+ */
+#ifndef __KONG_FORMAT_H__
+#define __KONG_FORMAT_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <sstream>
+#include <type_traits>
+
+/**
+ * @brief 取可变参数的第一个
+ */
+#define KONG_FMT_FIRST(...) KONG_FMT_FIRST_(__VA_ARGS__, 0)
+#define KONG_FMT_FIRST_(first, ...) first
+
+/**
+ * @brief 编译期校验 (fmt, args...) 的占位符数量和类型, 通过时值为true
+ * @details fmt 必须是字符串字面量
+ */
+#define KONG_FMT_CHECK(...) \
+    kong::fmt::FormatCheck< \
+        decltype(kong::fmt::ArgTypes(__VA_ARGS__))::CountOk(KONG_FMT_FIRST(__VA_ARGS__)), \
+        decltype(kong::fmt::ArgTypes(__VA_ARGS__))::TypesOk(KONG_FMT_FIRST(__VA_ARGS__))>::value
+
+namespace kong {
+namespace fmt {
+
+/**
+ * @brief 参数类型
+ */
+enum ArgType {
+    NONE = 0,
+    INT,
+    UINT,
+    DOUBLE,
+    BOOL,
+    CHAR,
+    CSTRING,
+    STRING,
+    POINTER,
+    CUSTOM
+};
+
+/**
+ * @brief 参数类型萃取
+ */
+template<class T, class Enable = void>
+struct ArgTraits {
+    static const ArgType value = CUSTOM;
+};
+
+template<class T>
+struct ArgTraits<T, typename std::enable_if<std::is_integral<T>::value
+                && std::is_signed<T>::value>::type> {
+    static const ArgType value = INT;
+};
+
+template<class T>
+struct ArgTraits<T, typename std::enable_if<std::is_integral<T>::value
+                && std::is_unsigned<T>::value>::type> {
+    static const ArgType value = UINT;
+};
+
+template<class T>
+struct ArgTraits<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static const ArgType value = DOUBLE;
+};
+
+template<class T>
+struct ArgTraits<T, typename std::enable_if<std::is_enum<T>::value>::type> {
+    static const ArgType value = INT;
+};
+
+template<class T>
+struct ArgTraits<T*, void> {
+    static const ArgType value = POINTER;
+};
+
+template<> struct ArgTraits<bool, void> { static const ArgType value = BOOL; };
+template<> struct ArgTraits<char, void> { static const ArgType value = CHAR; };
+template<> struct ArgTraits<char*, void> { static const ArgType value = CSTRING; };
+template<> struct ArgTraits<const char*, void> { static const ArgType value = CSTRING; };
+template<> struct ArgTraits<std::string, void> { static const ArgType value = STRING; };
+template<> struct ArgTraits<std::nullptr_t, void> { static const ArgType value = POINTER; };
+
+/**
+ * @brief 类型擦除后的参数
+ */
+struct Arg {
+    struct StrVal {
+        const char* data;
+        size_t size;
+    };
+    struct CustomVal {
+        const void* obj;
+        void (*func)(std::string& out, const void* obj);
+    };
+
+    Arg() :type(NONE), size(8), u(0) {}
+
+    ArgType type;
+    /// 整数参数原来的字节数, printf的%u %x %o按这个宽度把负数转成无符号
+    uint8_t size;
+    union {
+        int64_t i;
+        uint64_t u;
+        double d;
+        bool b;
+        char c;
+        StrVal s;
+        const void* p;
+        CustomVal custom;
+    };
+};
+
+template<class T>
+void FormatCustom(std::string& out, const void* obj) {
+    std::ostringstream ss;
+    ss << *static_cast<const T*>(obj);
+    out.append(ss.str());
+}
+
+template<class T>
+Arg MakeArgImpl(const T& v, std::integral_constant<ArgType, INT>) {
+    Arg a; a.type = INT; a.size = sizeof(T); a.i = (int64_t)v; return a;
+}
+
+template<class T>
+Arg MakeArgImpl(const T& v, std::integral_constant<ArgType, UINT>) {
+    Arg a; a.type = UINT; a.size = sizeof(T); a.u = (uint64_t)v; return a;
+}
+
+template<class T>
+Arg MakeArgImpl(const T& v, std::integral_constant<ArgType, DOUBLE>) {
+    Arg a; a.type = DOUBLE; a.d = (double)v; return a;
+}
+
+template<class T>
+Arg MakeArgImpl(const T& v, std::integral_constant<ArgType, BOOL>) {
+    Arg a; a.type = BOOL; a.b = v; return a;
+}
+
+template<class T>
+Arg MakeArgImpl(const T& v, std::integral_constant<ArgType, CHAR>) {
+    Arg a; a.type = CHAR; a.size = 1; a.c = v; return a;
+}
+
+template<class T>
+Arg MakeArgImpl(const T& v, std::integral_constant<ArgType, CSTRING>) {
+    Arg a; a.type = CSTRING; a.s.data = v; a.s.size = 0; return a;
+}
+
+template<class T>
+Arg MakeArgImpl(const T& v, std::integral_constant<ArgType, STRING>) {
+    Arg a; a.type = STRING; a.s.data = v.data(); a.s.size = v.size(); return a;
+}
+
+template<class T>
+Arg MakeArgImpl(const T& v, std::integral_constant<ArgType, POINTER>) {
+    Arg a; a.type = POINTER; a.p = (const void*)v; return a;
+}
+
+template<class T>
+Arg MakeArgImpl(const T& v, std::integral_constant<ArgType, CUSTOM>) {
+    Arg a; a.type = CUSTOM; a.custom.obj = &v; a.custom.func = &FormatCustom<T>; return a;
+}
+
+/**
+ * @brief 构造类型擦除参数, 参数的生命周期须覆盖格式化过程
+ */
+template<class T>
+Arg MakeArg(const T& v) {
+    typedef typename std::decay<T>::type D;
+    return MakeArgImpl(v, std::integral_constant<ArgType, ArgTraits<D>::value>());
+}
+
+/**
+ * @brief 按{}风格格式化, 追加到out
+ */
+void VFormatTo(std::string& out, const char* fmt, const Arg* args, size_t size);
+
+/**
+ * @brief 按printf风格格式化, 追加到out
+ */
+void VPrintfTo(std::string& out, const char* fmt, const Arg* args, size_t size);
+
+/**
+ * @brief 不带参数的自然格式输出(等价于 "{}")
+ */
+void AppendArg(std::string& out, const Arg& arg);
+
+template<class... Args>
+void FormatTo(std::string& out, const char* fmt, const Args&... args) {
+    Arg arr[sizeof...(Args) + 1] = {MakeArg(args)...};
+    VFormatTo(out, fmt, arr, sizeof...(Args));
+}
+
+template<class... Args>
+std::string Format(const char* fmt, const Args&... args) {
+    std::string out;
+    FormatTo(out, fmt, args...);
+    return out;
+}
+
+template<class... Args>
+void PrintfTo(std::string& out, const char* fmt, const Args&... args) {
+    Arg arr[sizeof...(Args) + 1] = {MakeArg(args)...};
+    VPrintfTo(out, fmt, arr, sizeof...(Args));
+}
+
+template<class... Args>
+std::string Printf(const char* fmt, const Args&... args) {
+    std::string out;
+    PrintfTo(out, fmt, args...);
+    return out;
+}
+
+/*
+ * 编译期校验(C++11 constexpr, 单表达式递归)
+ * 字面量文本用二分查找跳过, 递归深度约为 log2(长度) + 3 * 占位符数,
+ * 与格式串长度基本无关, 不会在长格式串上超出编译器的constexpr递归深度限制
+ */
+
+constexpr bool IsAlpha(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+constexpr const char* FindBrace(const char* s, const char* end);
+
+constexpr const char* FindBraceRight(const char* left, const char* mid, const char* end) {
+    return left != mid ? left : FindBrace(mid, end);
+}
+
+/// 返回[s, end)中第一个'{'或'}', 没有时返回end
+constexpr const char* FindBrace(const char* s, const char* end) {
+    return end - s <= 0 ? end
+        : end - s == 1 ? (*s == '{' || *s == '}' ? s : end)
+        : FindBraceRight(FindBrace(s, s + (end - s) / 2), s + (end - s) / 2, end);
+}
+
+/// 返回与'{'匹配的'}'位置, s指向'{'之后; 没有匹配时返回nullptr
+constexpr const char* FindCloseAt(const char* p, const char* end) {
+    return p != end && *p == '}' ? p : nullptr;
+}
+
+constexpr const char* FindClose(const char* s, const char* end) {
+    return FindCloseAt(FindBrace(s, end), end);
+}
+
+/// 占位符只支持 {} 和 {:spec}
+constexpr bool ValidPlaceholder(const char* open, const char* close) {
+    return close != nullptr && (close == open + 1 || open[1] == ':');
+}
+
+constexpr int CountFrom(const char* s, const char* end, int n);
+
+/// p指向花括号或end
+constexpr int CountAt(const char* p, const char* end, int n) {
+    return p == end ? n
+        : *p == '{' ? (p[1] == '{' ? CountFrom(p + 2, end, n)
+                : ValidPlaceholder(p, FindClose(p + 1, end)) ? CountFrom(FindClose(p + 1, end) + 1, end, n + 1)
+                : -1)
+        : (p[1] == '}' ? CountFrom(p + 2, end, n) : -1);
+}
+
+constexpr int CountFrom(const char* s, const char* end, int n) {
+    return CountAt(FindBrace(s, end), end, n);
+}
+
+/**
+ * @brief 返回占位符数量, 格式串非法返回-1
+ */
+template<size_t N>
+constexpr int CountPlaceholders(const char (&fmt)[N]) {
+    return CountFrom(fmt, fmt + N - 1, 0);
+}
+
+constexpr char TypeChar(const char* open, const char* close) {
+    return (close - open > 2 && IsAlpha(close[-1])) ? close[-1] : 0;
+}
+
+constexpr char SpecTypeAt(const char* s, const char* end, int idx);
+
+/// p指向花括号或end
+constexpr char SpecTypeAtBrace(const char* p, const char* end, int idx) {
+    return p == end ? 0
+        : *p == '{' ? (p[1] == '{' ? SpecTypeAt(p + 2, end, idx)
+                : idx == 0 ? TypeChar(p, FindClose(p + 1, end))
+                : SpecTypeAt(FindClose(p + 1, end) + 1, end, idx - 1))
+        : SpecTypeAt(p + 2, end, idx);
+}
+
+/**
+ * @brief 返回第idx个占位符的类型字符, 无类型返回0 (须已通过CountPlaceholders校验)
+ */
+constexpr char SpecTypeAt(const char* s, const char* end, int idx) {
+    return SpecTypeAtBrace(FindBrace(s, end), end, idx);
+}
+
+constexpr bool IsIntType(ArgType t) {
+    return t == INT || t == UINT || t == CHAR || t == BOOL;
+}
+
+/**
+ * @brief 类型字符是否接受该参数类型
+ */
+constexpr bool Accepts(ArgType t, char c) {
+    return c == 0 ? true
+        : (c == 'd' || c == 'x' || c == 'X' || c == 'o' || c == 'b' || c == 'c') ? IsIntType(t)
+        : (c == 'f' || c == 'F' || c == 'e' || c == 'E' || c == 'g' || c == 'G') ? t == DOUBLE
+        : c == 's' ? (t == CSTRING || t == STRING || t == BOOL || t == CHAR || t == CUSTOM)
+        : c == 'p' ? (t == POINTER || t == CSTRING)
+        : false;
+}
+
+template<class... Args>
+struct Checker;
+
+template<>
+struct Checker<> {
+    static constexpr bool Types(const char* fmt, const char* end, int idx) {
+        return true;
+    }
+};
+
+template<class T, class... Rest>
+struct Checker<T, Rest...> {
+    static constexpr bool Types(const char* fmt, const char* end, int idx) {
+        return Accepts(ArgTraits<typename std::decay<T>::type>::value, SpecTypeAt(fmt, end, idx))
+            && Checker<Rest...>::Types(fmt, end, idx + 1);
+    }
+};
+
+template<class... Args>
+struct TypeList {
+    template<size_t N>
+    static constexpr bool CountOk(const char (&fmt)[N]) {
+        return CountPlaceholders(fmt) == (int)sizeof...(Args);
+    }
+
+    template<size_t N>
+    static constexpr bool TypesOk(const char (&fmt)[N]) {
+        return !CountOk(fmt) || Checker<Args...>::Types(fmt, fmt + N - 1, 0);
+    }
+};
+
+/**
+ * @brief 只用于decltype, 得到除格式串外的参数类型列表
+ */
+template<class F, class... Args>
+TypeList<Args...> ArgTypes(const F& fmt, const Args&... args);
+
+template<bool CountOk, bool TypesOk>
+struct FormatCheck {
+    static_assert(CountOk, "kong::fmt: placeholder count does not match argument count (or malformed format string)");
+    static_assert(TypesOk, "kong::fmt: placeholder type does not match argument type");
+    static const bool value = true;
+};
+
+}
+}
+
+#endif
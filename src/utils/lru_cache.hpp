@@ -0,0 +1,517 @@
+/**
+ * @file lru_cache.hpp
+ * @brief 分片的并发缓存: LruCache(容量淘汰)和TimedCache(容量淘汰+过期)
+ */
+#ifndef __KONG_LRU_CACHE_H__
+#define __KONG_LRU_CACHE_H__
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "utils/clock.hpp"
+#include "utils/thread.hpp"
+
+namespace kong {
+
+/**
+ * @brief 淘汰策略
+ */
+class CachePolicy {
+public:
+    enum Type {
+        /// 精确LRU, 命中时移到链表头, 需要加写锁
+        LRU = 0,
+        /// CLOCK近似LRU, 命中只设置访问位, 加读锁
+        CLOCK = 1
+    };
+
+    static const char* ToString(Type type) {
+        return type == CLOCK ? "CLOCK" : "LRU";
+    }
+};
+
+/**
+ * @brief 缓存统计
+ */
+struct CacheStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t sets = 0;
+    /// 因容量被淘汰的条目数
+    uint64_t evictions = 0;
+    /// 因过期被删除的条目数
+    uint64_t expirations = 0;
+    /// 当前条目数
+    uint64_t size = 0;
+    /// 当前总权重
+    uint64_t weight = 0;
+
+    double hitRate() const {
+        return hits + misses ? (double)hits / (hits + misses) : 0;
+    }
+};
+
+/**
+ * @brief 分片缓存的实现, 通过LruCache/TimedCache使用
+ * @details key按哈希分到N个分片, 每个分片一把读写锁、一个哈希表和一条侵入式链表,
+ *          条目只在插入时分配一次, 命中不分配内存. 容量按权重计算, 默认每个
+ *          条目权重为1(即按条目数), 也可以传入weigher按字节数计算. 容量平均分给
+ *          各个分片. 过期的条目在读取时视为不存在, 由checkTimeout集中删除
+ */
+template<class K, class V, class Hash = std::hash<K> >
+class ShardedCache {
+public:
+    /// 计算条目的权重
+    typedef std::function<size_t(const K& key, const V& value)> Weigher;
+
+    /**
+     * @brief 构造函数
+     * @param[in] capacity 总容量(权重之和)
+     * @param[in] shards 分片数, 向上取整为2的幂
+     * @param[in] policy 淘汰策略
+     * @param[in] weigher 权重函数, 为空时每个条目权重为1
+     */
+    ShardedCache(size_t capacity, uint32_t shards, CachePolicy::Type policy, Weigher weigher)
+        :m_policy(policy)
+        ,m_weigher(weigher) {
+        uint32_t n = 1;
+        while(n < shards) {
+            n <<= 1;
+        }
+        m_mask = n - 1;
+        m_shards.reset(new Shard[n]);
+        for(uint32_t i = 0; i < n; ++i) {
+            m_shards[i].capacity = (capacity + n - 1) / n;
+        }
+    }
+
+    ~ShardedCache() {
+        clear();
+    }
+
+    /**
+     * @brief 查找, 命中时拷贝到value
+     */
+    bool get(const K& key, V& value) {
+        Shard& s = shard(key);
+        if(m_policy == CachePolicy::CLOCK) {
+            RWMutex::ReadLock lock(s.mutex);
+            auto it = s.map.find(key);
+            if(it == s.map.end() || IsExpired(it->second)) {
+                Add(s.misses);
+                return false;
+            }
+            //访问位只在为0时写, 热点条目不反复写同一缓存行
+            if(!it->second.referenced.load(std::memory_order_relaxed)) {
+                it->second.referenced.store(true, std::memory_order_relaxed);
+            }
+            value = it->second.value;
+            Add(s.hits);
+            return true;
+        }
+        RWMutex::WriteLock lock(s.mutex);
+        auto it = s.map.find(key);
+        if(it == s.map.end()) {
+            Add(s.misses);
+            return false;
+        }
+        Entry* e = &it->second;
+        if(IsExpired(*e)) {
+            remove(s, e);
+            Add(s.expirations);
+            Add(s.misses);
+            return false;
+        }
+        s.unlink(e);
+        s.pushFront(e);
+        value = e->value;
+        Add(s.hits);
+        return true;
+    }
+
+    /**
+     * @brief 是否存在且未过期, 不影响淘汰顺序和命中统计
+     */
+    bool exists(const K& key) {
+        Shard& s = shard(key);
+        RWMutex::ReadLock lock(s.mutex);
+        auto it = s.map.find(key);
+        return it != s.map.end() && !IsExpired(it->second);
+    }
+
+    /**
+     * @brief 删除
+     */
+    bool del(const K& key) {
+        Shard& s = shard(key);
+        RWMutex::WriteLock lock(s.mutex);
+        auto it = s.map.find(key);
+        if(it == s.map.end()) {
+            return false;
+        }
+        remove(s, &it->second);
+        return true;
+    }
+
+    /**
+     * @brief 删除所有已过期的条目
+     * @param[in] now_ms 当前时间(Clock的毫秒), 0表示取当前时间
+     * @return 删除的条目数
+     */
+    size_t checkTimeout(uint64_t now_ms = 0) {
+        if(!now_ms) {
+            now_ms = NowMs();
+        }
+        size_t count = 0;
+        for(uint32_t i = 0; i <= m_mask; ++i) {
+            Shard& s = m_shards[i];
+            RWMutex::WriteLock lock(s.mutex);
+            while(!s.expires.empty() && s.expires.begin()->first <= now_ms) {
+                remove(s, s.expires.begin()->second);
+                Add(s.expirations);
+                ++count;
+            }
+        }
+        return count;
+    }
+
+    void clear() {
+        for(uint32_t i = 0; i <= m_mask; ++i) {
+            Shard& s = m_shards[i];
+            RWMutex::WriteLock lock(s.mutex);
+            s.map.clear();
+            s.expires.clear();
+            s.head = s.tail = s.hand = nullptr;
+            s.weight = 0;
+        }
+    }
+
+    size_t size() {
+        size_t n = 0;
+        for(uint32_t i = 0; i <= m_mask; ++i) {
+            RWMutex::ReadLock lock(m_shards[i].mutex);
+            n += m_shards[i].map.size();
+        }
+        return n;
+    }
+
+    CacheStats getStats() {
+        CacheStats st;
+        for(uint32_t i = 0; i <= m_mask; ++i) {
+            Shard& s = m_shards[i];
+            st.hits += s.hits.load(std::memory_order_relaxed);
+            st.misses += s.misses.load(std::memory_order_relaxed);
+            st.sets += s.sets.load(std::memory_order_relaxed);
+            st.evictions += s.evictions.load(std::memory_order_relaxed);
+            st.expirations += s.expirations.load(std::memory_order_relaxed);
+            RWMutex::ReadLock lock(s.mutex);
+            st.size += s.map.size();
+            st.weight += s.weight;
+        }
+        return st;
+    }
+
+    /**
+     * @brief 统计信息, 用于输出到日志
+     */
+    std::string toStatusString() {
+        CacheStats st = getStats();
+        std::stringstream ss;
+        ss << "policy=" << CachePolicy::ToString(m_policy)
+           << " shards=" << (m_mask + 1)
+           << " size=" << st.size
+           << " weight=" << st.weight
+           << " hits=" << st.hits
+           << " misses=" << st.misses
+           << " hit_rate=" << st.hitRate()
+           << " sets=" << st.sets
+           << " evictions=" << st.evictions
+           << " expirations=" << st.expirations;
+        return ss.str();
+    }
+
+    CachePolicy::Type getPolicy() const { return m_policy;}
+protected:
+    /**
+     * @brief 插入或覆盖
+     * @param[in] expire 过期时间(Clock的毫秒), 0表示不过期
+     */
+    void setImpl(const K& key, const V& value, uint64_t expire) {
+        Shard& s = shard(key);
+        size_t weight = m_weigher ? m_weigher(key, value) : 1;
+        RWMutex::WriteLock lock(s.mutex);
+        Add(s.sets);
+        auto it = s.map.find(key);
+        Entry* e;
+        if(it != s.map.end()) {
+            e = &it->second;
+            e->value = value;
+            s.weight -= e->weight;
+            if(e->expire) {
+                s.expires.erase(e->expireIt);
+            }
+            if(m_policy == CachePolicy::LRU) {
+                s.unlink(e);
+                s.pushFront(e);
+            } else {
+                e->referenced.store(true, std::memory_order_relaxed);
+            }
+        } else {
+            it = s.map.emplace(std::piecewise_construct, std::forward_as_tuple(key)
+                               ,std::forward_as_tuple(value)).first;
+            e = &it->second;
+            e->key = &it->first;
+            if(m_policy == CachePolicy::LRU) {
+                s.pushFront(e);
+            } else if(s.hand) {
+                //CLOCK: 新条目放在指针之前, 一圈之后才会被检查
+                s.insertBefore(s.hand, e);
+            } else {
+                s.pushBack(e);
+            }
+        }
+        e->weight = weight;
+        s.weight += weight;
+        e->expire = expire;
+        if(expire) {
+            e->expireIt = s.expires.insert(std::make_pair(expire, e));
+        }
+        evict(s, e);
+    }
+
+    /**
+     * @brief 修改过期时间
+     */
+    bool expireImpl(const K& key, uint64_t expire) {
+        Shard& s = shard(key);
+        RWMutex::WriteLock lock(s.mutex);
+        auto it = s.map.find(key);
+        if(it == s.map.end()) {
+            return false;
+        }
+        Entry* e = &it->second;
+        if(e->expire) {
+            s.expires.erase(e->expireIt);
+        }
+        e->expire = expire;
+        if(expire) {
+            e->expireIt = s.expires.insert(std::make_pair(expire, e));
+        }
+        return true;
+    }
+
+    static uint64_t NowMs() {
+        return Clock::NowNs() / 1000000ULL;
+    }
+private:
+    struct Entry {
+        Entry(const V& v)
+            :value(v) {
+        }
+
+        V value;
+        const K* key = nullptr;
+        /// LRU: 链表头最近使用; CLOCK: 首尾相接视为环, 从指针处按插入顺序排列
+        Entry* prev = nullptr;
+        Entry* next = nullptr;
+        size_t weight = 1;
+        /// 过期时间(毫秒), 0表示不过期
+        uint64_t expire = 0;
+        typename std::multimap<uint64_t, Entry*>::iterator expireIt;
+        /// CLOCK访问位
+        std::atomic<bool> referenced{false};
+    };
+
+    struct Shard {
+        RWMutex mutex;
+        /// unordered_map的节点地址不随rehash变化, 链表直接链接节点里的Entry
+        std::unordered_map<K, Entry, Hash> map;
+        Entry* head = nullptr;
+        Entry* tail = nullptr;
+        /// CLOCK指针
+        Entry* hand = nullptr;
+        /// 按过期时间排序, 只包含有过期时间的条目
+        std::multimap<uint64_t, Entry*> expires;
+        size_t weight = 0;
+        size_t capacity = 0;
+        std::atomic<uint64_t> hits{0};
+        std::atomic<uint64_t> misses{0};
+        std::atomic<uint64_t> sets{0};
+        std::atomic<uint64_t> evictions{0};
+        std::atomic<uint64_t> expirations{0};
+        /// 避免相邻分片的伪共享
+        char padding[64];
+
+        void pushFront(Entry* e) {
+            e->prev = nullptr;
+            e->next = head;
+            if(head) {
+                head->prev = e;
+            } else {
+                tail = e;
+            }
+            head = e;
+        }
+
+        void pushBack(Entry* e) {
+            e->next = nullptr;
+            e->prev = tail;
+            if(tail) {
+                tail->next = e;
+            } else {
+                head = e;
+            }
+            tail = e;
+        }
+
+        void insertBefore(Entry* pos, Entry* e) {
+            e->next = pos;
+            e->prev = pos->prev;
+            if(pos->prev) {
+                pos->prev->next = e;
+            } else {
+                head = e;
+            }
+            pos->prev = e;
+        }
+
+        void unlink(Entry* e) {
+            if(hand == e) {
+                hand = e->next ? e->next : (head != e ? head : nullptr);
+            }
+            if(e->prev) {
+                e->prev->next = e->next;
+            } else {
+                head = e->next;
+            }
+            if(e->next) {
+                e->next->prev = e->prev;
+            } else {
+                tail = e->prev;
+            }
+            e->prev = e->next = nullptr;
+        }
+    };
+
+    Shard& shard(const K& key) {
+        //哈希的高位再混合一次, 避免std::hash对整数是恒等映射时分片不均
+        size_t h = m_hash(key);
+        h ^= h >> 17;
+        h *= 0x9E3779B97F4A7C15ULL;
+        return m_shards[(h >> 32) & m_mask];
+    }
+
+    static bool IsExpired(const Entry& e) {
+        return e.expire && e.expire <= NowMs();
+    }
+
+    static void Add(std::atomic<uint64_t>& v) {
+        v.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void remove(Shard& s, Entry* e) {
+        s.unlink(e);
+        if(e->expire) {
+            s.expires.erase(e->expireIt);
+        }
+        s.weight -= e->weight;
+        //按迭代器删除, e->key指向节点自身, 不能作为erase的参数
+        s.map.erase(s.map.find(*e->key));
+    }
+
+    /**
+     * @brief 超出容量时淘汰, 不淘汰刚写入的条目keep
+     */
+    void evict(Shard& s, Entry* keep) {
+        while(s.weight > s.capacity && s.map.size() > 1) {
+            Entry* victim;
+            if(m_policy == CachePolicy::LRU) {
+                victim = s.tail == keep ? keep->prev : s.tail;
+            } else {
+                //CLOCK: 跳过访问位为1的条目并清零
+                if(!s.hand) {
+                    s.hand = s.head;
+                }
+                while(true) {
+                    Entry* e = s.hand;
+                    s.hand = e->next ? e->next : s.head;
+                    if(e != keep && !e->referenced.exchange(false, std::memory_order_relaxed)) {
+                        victim = e;
+                        break;
+                    }
+                }
+            }
+            remove(s, victim);
+            Add(s.evictions);
+        }
+    }
+private:
+    CachePolicy::Type m_policy;
+    Weigher m_weigher;
+    Hash m_hash;
+    uint32_t m_mask;
+    std::unique_ptr<Shard[]> m_shards;
+};
+
+/**
+ * @brief 分片LRU缓存
+ */
+template<class K, class V, class Hash = std::hash<K> >
+class LruCache : public ShardedCache<K, V, Hash> {
+public:
+    typedef std::shared_ptr<LruCache> ptr;
+    typedef typename ShardedCache<K, V, Hash>::Weigher Weigher;
+
+    LruCache(size_t capacity, uint32_t shards = 16
+             ,CachePolicy::Type policy = CachePolicy::LRU, Weigher weigher = nullptr)
+        :ShardedCache<K, V, Hash>(capacity, shards, policy, weigher) {
+    }
+
+    /**
+     * @brief 插入或覆盖, 超出容量时淘汰
+     */
+    void set(const K& key, const V& value) {
+        this->setImpl(key, value, 0);
+    }
+};
+
+/**
+ * @brief 带过期时间的分片缓存
+ * @details 读取时已过期的条目视为不存在; 过期条目占用的容量由定期调用
+ *          checkTimeout释放, 容量不足时也会被正常淘汰
+ */
+template<class K, class V, class Hash = std::hash<K> >
+class TimedCache : public ShardedCache<K, V, Hash> {
+public:
+    typedef std::shared_ptr<TimedCache> ptr;
+    typedef typename ShardedCache<K, V, Hash>::Weigher Weigher;
+
+    TimedCache(size_t capacity, uint32_t shards = 16
+               ,CachePolicy::Type policy = CachePolicy::LRU, Weigher weigher = nullptr)
+        :ShardedCache<K, V, Hash>(capacity, shards, policy, weigher) {
+    }
+
+    /**
+     * @brief 插入或覆盖
+     * @param[in] ttl_ms 存活时间(毫秒), 0表示不过期
+     */
+    void set(const K& key, const V& value, uint64_t ttl_ms) {
+        this->setImpl(key, value, ttl_ms ? this->NowMs() + ttl_ms : 0);
+    }
+
+    /**
+     * @brief 重新设置存活时间
+     */
+    bool expired(const K& key, uint64_t ttl_ms) {
+        return this->expireImpl(key, ttl_ms ? this->NowMs() + ttl_ms : 0);
+    }
+};
+
+}
+
+#endif
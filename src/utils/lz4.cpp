@@ -0,0 +1,212 @@
+#include "lz4.hpp"
+#include <string.h>
+#include <algorithm>
+
+namespace kong {
+
+namespace {
+
+/// 最短匹配
+static const size_t s_minMatch = 4;
+/// 块末尾必须是字面量的字节数
+static const size_t s_lastLiterals = 5;
+/// 最后一个匹配的起点距块末尾至少的字节数
+static const size_t s_mfLimit = 12;
+static const size_t s_maxOffset = 65535;
+static const int s_hashLog = 14;
+
+inline uint32_t Read32(const char* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t Read64(const char* p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint32_t Hash(uint32_t v) {
+    return (v * 2654435761u) >> (32 - s_hashLog);
+}
+
+/// 长度扩展字节, 调用方已检查输出空间
+inline void WriteLength(char*& op, size_t len) {
+    while(len >= 255) {
+        *op++ = (char)255;
+        len -= 255;
+    }
+    *op++ = (char)len;
+}
+
+inline bool ReadLength(const uint8_t*& ip, const uint8_t* iend, size_t& len) {
+    uint8_t s;
+    do {
+        if(ip >= iend) {
+            return false;
+        }
+        s = *ip++;
+        len += s;
+    } while(s == 255);
+    return true;
+}
+
+/// 一个序列最多需要的输出字节数
+inline size_t SequenceBound(size_t litlen, size_t mlen) {
+    return 1 + litlen / 255 + 1 + litlen + 2 + mlen / 255 + 1;
+}
+
+}
+
+size_t Lz4::Compress(const char* src, size_t len, char* dst, size_t cap) {
+    const char* ip = src;
+    const char* anchor = src;
+    const char* iend = src + len;
+    char* op = dst;
+    char* oend = dst + cap;
+
+    if(len > s_mfLimit) {
+        const char* mflimit = iend - s_mfLimit;
+        const char* matchlimit = iend - s_lastLiterals;
+        uint32_t table[1 << s_hashLog];
+        memset(table, 0, sizeof(table));
+
+        while(ip < mflimit) {
+            uint32_t seq = Read32(ip);
+            uint32_t h = Hash(seq);
+            const char* ref = src + table[h];
+            table[h] = (uint32_t)(ip - src);
+            if(ref >= ip || (size_t)(ip - ref) > s_maxOffset || Read32(ref) != seq) {
+                //距上一个匹配越远步长越大, 不可压缩的数据很快跳过
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+
+            while(ip > anchor && ref > src && ip[-1] == ref[-1]) {
+                --ip;
+                --ref;
+            }
+
+            const char* p = ip + s_minMatch;
+            const char* r = ref + s_minMatch;
+            while(p + 8 <= matchlimit) {
+                uint64_t diff = Read64(p) ^ Read64(r);
+                if(diff) {
+                    p += __builtin_ctzll(diff) >> 3;
+                    goto found;
+                }
+                p += 8;
+                r += 8;
+            }
+            while(p < matchlimit && *p == *r) {
+                ++p;
+                ++r;
+            }
+found:
+            size_t litlen = ip - anchor;
+            size_t mlen = p - ip - s_minMatch;
+            if(SequenceBound(litlen, mlen) > (size_t)(oend - op)) {
+                return 0;
+            }
+            char* token = op++;
+            if(litlen >= 15) {
+                *token = (char)(15 << 4);
+                WriteLength(op, litlen - 15);
+            } else {
+                *token = (char)(litlen << 4);
+            }
+            memcpy(op, anchor, litlen);
+            op += litlen;
+            size_t offset = ip - ref;
+            *op++ = (char)(offset & 0xff);
+            *op++ = (char)(offset >> 8);
+            if(mlen >= 15) {
+                *token |= 15;
+                WriteLength(op, mlen - 15);
+            } else {
+                *token |= (char)mlen;
+            }
+
+            ip = p;
+            anchor = ip;
+            if(ip < mflimit) {
+                table[Hash(Read32(ip - 2))] = (uint32_t)(ip - 2 - src);
+            }
+        }
+    }
+
+    size_t litlen = iend - anchor;
+    if(1 + litlen / 255 + 1 + litlen > (size_t)(oend - op)) {
+        return 0;
+    }
+    char* token = op++;
+    if(litlen >= 15) {
+        *token = (char)(15 << 4);
+        WriteLength(op, litlen - 15);
+    } else {
+        *token = (char)(litlen << 4);
+    }
+    memcpy(op, anchor, litlen);
+    op += litlen;
+    return op - dst;
+}
+
+int64_t Lz4::Decompress(const char* src, size_t len, char* dst, size_t cap) {
+    const uint8_t* ip = (const uint8_t*)src;
+    const uint8_t* iend = ip + len;
+    char* op = dst;
+    char* oend = dst + cap;
+
+    while(ip < iend) {
+        uint8_t token = *ip++;
+        size_t litlen = token >> 4;
+        if(litlen == 15 && !ReadLength(ip, iend, litlen)) {
+            return -1;
+        }
+        if(litlen > (size_t)(iend - ip) || litlen > (size_t)(oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, litlen);
+        op += litlen;
+        ip += litlen;
+        //最后一个序列只有字面量
+        if(ip == iend) {
+            break;
+        }
+
+        if(iend - ip < 2) {
+            return -1;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if(offset == 0 || offset > (size_t)(op - dst)) {
+            return -1;
+        }
+        size_t mlen = token & 15;
+        if(mlen == 15 && !ReadLength(ip, iend, mlen)) {
+            return -1;
+        }
+        mlen += s_minMatch;
+        if(mlen > (size_t)(oend - op)) {
+            return -1;
+        }
+        const char* m = op - offset;
+        if(offset >= mlen) {
+            memcpy(op, m, mlen);
+        } else if(offset >= 8) {
+            //重叠拷贝, 每次拷贝的源已经写完
+            for(size_t i = 0; i < mlen; i += 8) {
+                memcpy(op + i, m + i, std::min<size_t>(8, mlen - i));
+            }
+        } else {
+            for(size_t i = 0; i < mlen; ++i) {
+                op[i] = m[i];
+            }
+        }
+        op += mlen;
+    }
+    return op - dst;
+}
+
+}
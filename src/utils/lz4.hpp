@@ -0,0 +1,47 @@
+/**
+ * @file lz4.hpp
+ * @brief LZ4块格式的压缩/解压(无外部依赖)
+ * @details 输出与LZ4 block format兼容, 每个块独立, 窗口64KB
+ */
+#ifndef __KONG_LZ4_H__
+#define __KONG_LZ4_H__
+
+#include <cstdint>
+#include <cstddef>
+
+namespace kong {
+
+/**
+ * @brief LZ4块编解码
+ */
+class Lz4 {
+public:
+    /**
+     * @brief 最坏情况下的压缩输出长度
+     */
+    static size_t CompressBound(size_t len) { return len + len / 255 + 16;}
+
+    /**
+     * @brief 压缩一个块
+     * @param[in] src 原始数据
+     * @param[in] len 原始长度
+     * @param[out] dst 输出缓冲
+     * @param[in] cap 输出缓冲长度, 不小于CompressBound(len)时一定成功
+     * @return 压缩后的长度, 输出缓冲不足返回0
+     */
+    static size_t Compress(const char* src, size_t len, char* dst, size_t cap);
+
+    /**
+     * @brief 解压一个块
+     * @param[in] src 压缩数据
+     * @param[in] len 压缩数据长度
+     * @param[out] dst 输出缓冲
+     * @param[in] cap 输出缓冲长度
+     * @return 解压后的长度, 数据损坏或缓冲不足返回-1
+     */
+    static int64_t Decompress(const char* src, size_t len, char* dst, size_t cap);
+};
+
+}
+
+#endif
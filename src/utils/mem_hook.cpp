@@ -0,0 +1,66 @@
+/**
+ * @file mem_hook.cpp
+ * @brief 替换全局operator new/delete, 把分配交给MemTracker统计
+ * @details 编译为单独的库sylar_memhook, 需要统计的程序链接它即可, sylar本身不替换
+ */
+#include "utils/mem_track.hpp"
+#include <new>
+
+namespace {
+
+//强制内联, 抽样记录的调用栈总是从operator new开始
+inline __attribute__((always_inline)) void* AllocOrThrow(size_t size) {
+    while(true) {
+        void* p = kong::MemTracker::Alloc(size);
+        if(p) {
+            return p;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if(!handler) {
+            throw std::bad_alloc();
+        }
+        handler();
+    }
+}
+
+void* AllocNothrow(size_t size) noexcept {
+    try {
+        return AllocOrThrow(size);
+    } catch(...) {
+        return nullptr;
+    }
+}
+
+}
+
+void* operator new(size_t size) {
+    return AllocOrThrow(size);
+}
+
+void* operator new[](size_t size) {
+    return AllocOrThrow(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return AllocNothrow(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return AllocNothrow(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    kong::MemTracker::Free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    kong::MemTracker::Free(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    kong::MemTracker::Free(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    kong::MemTracker::Free(ptr);
+}
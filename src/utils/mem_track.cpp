@@ -0,0 +1,427 @@
+#include "mem_track.hpp"
+#include "metrics/metrics.hpp"
+#include "utils/util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace kong {
+
+namespace {
+
+/// 线程表大小, 超出的线程共用最后一个槽位
+static const uint32_t kMaxThreads = 1024;
+static const uint32_t kMaxTags = 256;
+/// 抽样记录的栈帧数
+static const int kSampleFrames = 32;
+static const uint32_t kSampled = 1;
+
+/**
+ * @brief 分配头, 16字节保持operator new的对齐
+ */
+struct AllocHeader {
+    uint64_t size;
+    uint32_t tag;
+    uint32_t flags;
+};
+
+struct Counters {
+    std::atomic<uint64_t> alloc_count;
+    std::atomic<uint64_t> alloc_bytes;
+    std::atomic<uint64_t> free_count;
+    std::atomic<uint64_t> free_bytes;
+
+    MemStats load() const {
+        MemStats rt;
+        rt.alloc_count = alloc_count.load(std::memory_order_relaxed);
+        rt.alloc_bytes = alloc_bytes.load(std::memory_order_relaxed);
+        rt.free_count = free_count.load(std::memory_order_relaxed);
+        rt.free_bytes = free_bytes.load(std::memory_order_relaxed);
+        return rt;
+    }
+};
+
+struct alignas(64) ThreadSlot {
+    std::atomic<pid_t> tid;
+    Counters counters;
+};
+
+struct alignas(64) TagSlot {
+    std::atomic<const char*> name;
+    Counters counters;
+};
+
+struct SampleRecord {
+    uint64_t size;
+    uint64_t time_ns;
+    uint32_t tag;
+    int depth;
+    uintptr_t pcs[kSampleFrames];
+};
+
+typedef std::unordered_map<void*, SampleRecord> SampleMap;
+
+//这些全局变量都是常量初始化的, 其它模块静态初始化时分配内存也可以安全使用
+ThreadSlot s_threads[kMaxThreads + 1];
+TagSlot s_tags[kMaxTags];
+std::atomic<uint32_t> s_tagCount{1};
+std::atomic<bool> s_installed{false};
+std::atomic<uint32_t> s_sampleRate{0};
+std::mutex s_sampleMutex;
+SampleMap* s_samples = nullptr;
+
+__thread ThreadSlot* t_slot __attribute__((tls_model("initial-exec"))) = nullptr;
+__thread uint32_t t_tag __attribute__((tls_model("initial-exec"))) = 0;
+__thread int64_t t_countdown __attribute__((tls_model("initial-exec"))) = 0;
+__thread uint32_t t_rand __attribute__((tls_model("initial-exec"))) = 0;
+/// 统计自身的分配不再抽样, 避免递归
+__thread bool t_inHook __attribute__((tls_model("initial-exec"))) = false;
+
+/**
+ * @brief 只由所属线程写入, 不需要原子加
+ */
+inline void OwnerAdd(std::atomic<uint64_t>& c, uint64_t v) {
+    c.store(c.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+}
+
+ThreadSlot* CurrentSlot() {
+    if(t_slot) {
+        return t_slot;
+    }
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    for(uint32_t i = 0, idx = (uint32_t)tid % kMaxThreads; i < kMaxThreads; ++i, idx = (idx + 1) % kMaxThreads) {
+        pid_t cur = s_threads[idx].tid.load(std::memory_order_acquire);
+        //tid被已退出的线程用过时沿用它的槽位
+        if(cur == tid || (cur == 0 && s_threads[idx].tid.compare_exchange_strong(cur, tid))) {
+            t_slot = &s_threads[idx];
+            return t_slot;
+        }
+    }
+    t_slot = &s_threads[kMaxThreads];
+    return t_slot;
+}
+
+inline void Account(ThreadSlot* slot, bool alloc, uint64_t size, uint32_t tag) {
+    if(slot == &s_threads[kMaxThreads]) {
+        //共用的溢出槽位
+        (alloc ? slot->counters.alloc_count : slot->counters.free_count).fetch_add(1, std::memory_order_relaxed);
+        (alloc ? slot->counters.alloc_bytes : slot->counters.free_bytes).fetch_add(size, std::memory_order_relaxed);
+    } else {
+        OwnerAdd(alloc ? slot->counters.alloc_count : slot->counters.free_count, 1);
+        OwnerAdd(alloc ? slot->counters.alloc_bytes : slot->counters.free_bytes, size);
+    }
+    Counters& c = s_tags[tag].counters;
+    (alloc ? c.alloc_count : c.free_count).fetch_add(1, std::memory_order_relaxed);
+    (alloc ? c.alloc_bytes : c.free_bytes).fetch_add(size, std::memory_order_relaxed);
+}
+
+/**
+ * @brief 下一次抽样前的分配次数, 在[1, 2n)中均匀分布, 平均n次, 避免与分配模式同步
+ */
+int64_t NextCountdown(uint32_t n) {
+    if(n <= 1) {
+        return 1;
+    }
+    if(t_rand == 0) {
+        t_rand = (uint32_t)syscall(SYS_gettid) * 2654435761u | 1;
+    }
+    t_rand ^= t_rand << 13;
+    t_rand ^= t_rand >> 17;
+    t_rand ^= t_rand << 5;
+    return 1 + t_rand % (2 * (uint64_t)n - 1);
+}
+
+uint64_t NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+__attribute__((noinline)) void RecordSample(void* ptr, uint64_t size, uint32_t tag) {
+    SampleRecord r;
+    //跳过RecordSample和MemTracker::Alloc, 从operator new开始
+    r.depth = Backtrace(r.pcs, kSampleFrames, 2);
+    r.size = size;
+    r.tag = tag;
+    r.time_ns = NowNs();
+    t_inHook = true;
+    {
+        std::lock_guard<std::mutex> lock(s_sampleMutex);
+        if(!s_samples) {
+            s_samples = new SampleMap;
+        }
+        (*s_samples)[ptr] = r;
+    }
+    t_inHook = false;
+}
+
+void EraseSample(void* ptr) {
+    bool saved = t_inHook;
+    t_inHook = true;
+    {
+        std::lock_guard<std::mutex> lock(s_sampleMutex);
+        if(s_samples) {
+            s_samples->erase(ptr);
+        }
+    }
+    t_inHook = saved;
+}
+
+std::string TagName(uint32_t tag) {
+    const char* name = s_tags[tag].name.load(std::memory_order_acquire);
+    return name ? name : "untagged";
+}
+
+std::string ThreadName(pid_t tid) {
+    std::ifstream ifs("/proc/self/task/" + std::to_string(tid) + "/comm");
+    std::string name;
+    std::getline(ifs, name);
+    return name;
+}
+
+}
+
+MemStats MemStats::operator-(const MemStats& o) const {
+    MemStats rt;
+    rt.alloc_count = alloc_count - o.alloc_count;
+    rt.alloc_bytes = alloc_bytes - o.alloc_bytes;
+    rt.free_count = free_count - o.free_count;
+    rt.free_bytes = free_bytes - o.free_bytes;
+    return rt;
+}
+
+std::string MemStats::toString() const {
+    std::stringstream ss;
+    ss << "alloc=" << alloc_count << "/" << alloc_bytes << "B"
+       << " free=" << free_count << "/" << free_bytes << "B"
+       << " live=" << liveCount() << "/" << liveBytes() << "B";
+    return ss.str();
+}
+
+std::string MemSnapshot::toString() const {
+    std::stringstream ss;
+    ss << "[MemSnapshot installed=" << installed
+       << " sample_rate=" << sample_rate
+       << " sampled_live=" << sampled_live << "]" << std::endl;
+    ss << "  total " << total.toString() << std::endl;
+    for(auto& i : tags) {
+        ss << "  tag " << i.name << " " << i.stats.toString() << std::endl;
+    }
+    for(auto& i : threads) {
+        ss << "  thread " << i.tid << "(" << (i.name.empty() ? "exited" : i.name) << ") "
+           << i.stats.toString() << std::endl;
+    }
+    return ss.str();
+}
+
+bool MemTracker::IsInstalled() {
+    return s_installed.load(std::memory_order_relaxed);
+}
+
+uint32_t MemTracker::RegisterTag(const std::string& name) {
+    static std::mutex s_mutex;
+    std::lock_guard<std::mutex> lock(s_mutex);
+    uint32_t count = s_tagCount.load(std::memory_order_relaxed);
+    for(uint32_t i = 1; i < count; ++i) {
+        if(name == s_tags[i].name.load(std::memory_order_relaxed)) {
+            return i;
+        }
+    }
+    if(count >= kMaxTags) {
+        return 0;
+    }
+    //strdup走malloc, 不经过operator new
+    s_tags[count].name.store(strdup(name.c_str()), std::memory_order_release);
+    s_tagCount.store(count + 1, std::memory_order_release);
+    return count;
+}
+
+uint32_t MemTracker::SwapTag(uint32_t tag) {
+    uint32_t old = t_tag;
+    t_tag = tag < kMaxTags ? tag : 0;
+    return old;
+}
+
+void MemTracker::SetSampleRate(uint32_t n) {
+    s_sampleRate.store(n, std::memory_order_relaxed);
+}
+
+uint32_t MemTracker::GetSampleRate() {
+    return s_sampleRate.load(std::memory_order_relaxed);
+}
+
+MemStats MemTracker::GetThreadStats() {
+    return CurrentSlot()->counters.load();
+}
+
+void* MemTracker::Alloc(size_t size) {
+    AllocHeader* h = (AllocHeader*)malloc(size + sizeof(AllocHeader));
+    if(!h) {
+        return nullptr;
+    }
+    if(!s_installed.load(std::memory_order_relaxed)) {
+        s_installed.store(true, std::memory_order_relaxed);
+    }
+    uint32_t tag = t_tag;
+    h->size = size;
+    h->tag = tag;
+    h->flags = 0;
+    Account(CurrentSlot(), true, size, tag);
+    uint32_t rate = s_sampleRate.load(std::memory_order_relaxed);
+    if(rate && !t_inHook && --t_countdown <= 0) {
+        t_countdown = NextCountdown(rate);
+        h->flags = kSampled;
+        RecordSample(h + 1, size, tag);
+    }
+    return h + 1;
+}
+
+void MemTracker::Free(void* ptr) {
+    if(!ptr) {
+        return;
+    }
+    AllocHeader* h = (AllocHeader*)ptr - 1;
+    Account(CurrentSlot(), false, h->size, h->tag);
+    if(h->flags & kSampled) {
+        EraseSample(ptr);
+    }
+    free(h);
+}
+
+MemSnapshot MemTracker::Snapshot() {
+    MemSnapshot rt;
+    rt.installed = IsInstalled();
+    rt.sample_rate = GetSampleRate();
+    for(uint32_t i = 0; i <= kMaxThreads; ++i) {
+        pid_t tid = s_threads[i].tid.load(std::memory_order_acquire);
+        if(tid == 0 && i < kMaxThreads) {
+            continue;
+        }
+        MemSnapshot::Thread t;
+        t.tid = tid;
+        t.stats = s_threads[i].counters.load();
+        if(t.stats.alloc_count == 0 && t.stats.free_count == 0) {
+            continue;
+        }
+        t.name = i < kMaxThreads ? ThreadName(tid) : "overflow";
+        rt.total.alloc_count += t.stats.alloc_count;
+        rt.total.alloc_bytes += t.stats.alloc_bytes;
+        rt.total.free_count += t.stats.free_count;
+        rt.total.free_bytes += t.stats.free_bytes;
+        rt.threads.push_back(t);
+    }
+    uint32_t count = s_tagCount.load(std::memory_order_acquire);
+    for(uint32_t i = 0; i < count; ++i) {
+        MemSnapshot::Tag t;
+        t.name = TagName(i);
+        t.stats = s_tags[i].counters.load();
+        if(t.stats.alloc_count || t.stats.free_count) {
+            rt.tags.push_back(t);
+        }
+    }
+    std::sort(rt.tags.begin(), rt.tags.end(), [](const MemSnapshot::Tag& a, const MemSnapshot::Tag& b) {
+        return a.stats.liveBytes() > b.stats.liveBytes();
+    });
+    std::sort(rt.threads.begin(), rt.threads.end(), [](const MemSnapshot::Thread& a, const MemSnapshot::Thread& b) {
+        return a.stats.alloc_bytes > b.stats.alloc_bytes;
+    });
+    {
+        std::lock_guard<std::mutex> lock(s_sampleMutex);
+        rt.sampled_live = s_samples ? s_samples->size() : 0;
+    }
+    return rt;
+}
+
+std::string MemTracker::LiveSamplesReport(size_t top, uint64_t min_age_ms) {
+    std::vector<SampleRecord> records;
+    uint64_t now = NowNs();
+    {
+        //持锁期间的分配不能再抽样, 否则在同一把锁上死锁
+        bool saved = t_inHook;
+        t_inHook = true;
+        std::lock_guard<std::mutex> lock(s_sampleMutex);
+        if(s_samples) {
+            records.reserve(s_samples->size());
+            for(auto& i : *s_samples) {
+                if(now - i.second.time_ns >= min_age_ms * 1000000ULL) {
+                    records.push_back(i.second);
+                }
+            }
+        }
+        t_inHook = saved;
+    }
+
+    struct Group {
+        uint64_t count = 0;
+        uint64_t bytes = 0;
+        uint64_t oldest_ns = 0;
+        uint32_t tag = 0;
+        const SampleRecord* record = nullptr;
+    };
+    std::map<std::vector<uintptr_t>, Group> groups;
+    for(auto& r : records) {
+        Group& g = groups[std::vector<uintptr_t>(r.pcs, r.pcs + r.depth)];
+        ++g.count;
+        g.bytes += r.size;
+        g.oldest_ns = std::max(g.oldest_ns, now - r.time_ns);
+        g.tag = r.tag;
+        g.record = &r;
+    }
+    std::vector<const Group*> sorted;
+    for(auto& i : groups) {
+        sorted.push_back(&i.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const Group* a, const Group* b) {
+        return a->bytes > b->bytes;
+    });
+
+    uint32_t rate = std::max<uint32_t>(GetSampleRate(), 1);
+    std::stringstream ss;
+    ss << "live sampled allocations: " << records.size() << " in " << groups.size()
+       << " stacks, sample_rate=" << GetSampleRate() << " min_age_ms=" << min_age_ms << std::endl;
+    for(size_t i = 0; i < sorted.size() && i < top; ++i) {
+        const Group* g = sorted[i];
+        ss << "#" << i << " count=" << g->count << " bytes=" << g->bytes
+           << " estimated_bytes=" << g->bytes * rate
+           << " oldest_ms=" << g->oldest_ns / 1000000
+           << " tag=" << TagName(g->tag) << std::endl;
+        for(int j = 0; j < g->record->depth; ++j) {
+            ss << "    " << Symbolize(g->record->pcs[j] - 1) << std::endl;
+        }
+    }
+    return ss.str();
+}
+
+void MemTracker::UpdateMetrics(metrics::MetricRegistry* registry) {
+    if(!registry) {
+        registry = metrics::MetricsMgr::GetInstance();
+    }
+    MemSnapshot snap = Snapshot();
+    auto set = [registry](const std::string& tag, const MemStats& s) {
+        metrics::MetricRegistry::Labels labels;
+        labels["tag"] = tag;
+        registry->getGauge("kong_mem_live_bytes", "live heap bytes", labels)->set(s.liveBytes());
+        registry->getGauge("kong_mem_live_count", "live heap allocations", labels)->set(s.liveCount());
+        registry->getGauge("kong_mem_alloc_bytes", "allocated heap bytes", labels)->set(s.alloc_bytes);
+        registry->getGauge("kong_mem_alloc_count", "heap allocations", labels)->set(s.alloc_count);
+    };
+    set("all", snap.total);
+    for(auto& i : snap.tags) {
+        set(i.name, i.stats);
+    }
+}
+
+void MemTracker::LogSnapshot(Logger::ptr logger, LogLevel::Level level) {
+    KONG_LOG_LEVEL(logger, level) << Snapshot().toString();
+}
+
+}
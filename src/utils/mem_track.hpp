@@ -0,0 +1,177 @@
+/**
+ * @file mem_track.hpp
+ * @brief 堆分配统计: 按线程/按子系统标签计数, 抽样记录存活分配的调用栈
+ * @details 统计由替换全局operator new/delete的钩子驱动, 钩子在单独的库sylar_memhook中,
+ *          程序链接该库即启用(opt-in), 不链接时所有接口可用但统计为0.
+ *          只统计经operator new/delete的分配, malloc/free直接分配的内存不在其中
+ */
+#ifndef __KONG_MEM_TRACK_H__
+#define __KONG_MEM_TRACK_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include "log/log.hpp"
+
+/**
+ * @brief 把当前作用域内的分配记到子系统标签name上
+ * @details KONG_MEM_SCOPE("http.parser"); 标签在每个调用点只注册一次, 作用域结束时恢复之前的标签.
+ *          释放总是记在分配时的标签上, 与在哪个作用域释放无关
+ */
+#define KONG_MEM_SCOPE(name) \
+    static const uint32_t KONG_MEM_SCOPE_NAME(kong_mem_tag_, __LINE__) = kong::MemTracker::RegisterTag(name); \
+    kong::MemScope KONG_MEM_SCOPE_NAME(kong_mem_scope_, __LINE__)(KONG_MEM_SCOPE_NAME(kong_mem_tag_, __LINE__))
+
+#define KONG_MEM_SCOPE_NAME(prefix, line) KONG_MEM_SCOPE_NAME2(prefix, line)
+#define KONG_MEM_SCOPE_NAME2(prefix, line) prefix##line
+
+namespace kong {
+
+namespace metrics {
+class MetricRegistry;
+}
+
+/**
+ * @brief 分配计数
+ */
+struct MemStats {
+    uint64_t alloc_count = 0;
+    uint64_t alloc_bytes = 0;
+    uint64_t free_count = 0;
+    uint64_t free_bytes = 0;
+
+    /**
+     * @brief 存活字节数, 按线程统计时可以为负(在别的线程释放)
+     */
+    int64_t liveBytes() const { return (int64_t)(alloc_bytes - free_bytes);}
+    int64_t liveCount() const { return (int64_t)(alloc_count - free_count);}
+
+    MemStats operator-(const MemStats& o) const;
+    std::string toString() const;
+};
+
+/**
+ * @brief 统计快照
+ */
+struct MemSnapshot {
+    struct Thread {
+        pid_t tid;
+        /// 线程已退出时为空
+        std::string name;
+        MemStats stats;
+    };
+
+    struct Tag {
+        std::string name;
+        MemStats stats;
+    };
+
+    /// 是否链接了sylar_memhook
+    bool installed = false;
+    MemStats total;
+    /// 按存活字节数从大到小
+    std::vector<Tag> tags;
+    /// 按分配字节数从大到小
+    std::vector<Thread> threads;
+    /// 当前抽样率, 0表示不抽样
+    uint32_t sample_rate = 0;
+    /// 抽样记录中存活的分配数
+    uint64_t sampled_live = 0;
+
+    /**
+     * @brief 多行文本, 供写日志
+     */
+    std::string toString() const;
+};
+
+/**
+ * @brief 堆分配统计
+ * @details 每次分配在用户数据前加16字节头, 记录大小、标签和是否被抽样, 释放时据此记账.
+ *          线程计数只由所属线程写入, 标签计数用原子加. 抽样的分配记录调用栈,
+ *          保存在加锁的表中直到释放, 用于找出泄漏或持续增长的调用路径
+ */
+class MemTracker {
+public:
+    /**
+     * @brief 是否链接了operator new/delete钩子(有分配经过钩子后为true)
+     */
+    static bool IsInstalled();
+
+    /**
+     * @brief 注册子系统标签, 同名返回同一个编号. 0号标签为"untagged"
+     * @details 最多256个标签, 超出时返回0
+     */
+    static uint32_t RegisterTag(const std::string& name);
+
+    /**
+     * @brief 设置当前线程的标签, 返回原来的标签
+     */
+    static uint32_t SwapTag(uint32_t tag);
+
+    /**
+     * @brief 设置抽样率: 平均每n次分配记录一次调用栈, 0表示关闭
+     */
+    static void SetSampleRate(uint32_t n);
+    static uint32_t GetSampleRate();
+
+    /**
+     * @brief 当前线程的计数, 两次相减可得一段代码的分配次数和字节数
+     */
+    static MemStats GetThreadStats();
+
+    static MemSnapshot Snapshot();
+
+    /**
+     * @brief 按调用栈汇总存活的抽样分配
+     * @param[in] top 最多输出的调用栈数, 按字节数从大到小
+     * @param[in] min_age_ms 只统计存活超过这个时间的分配, 排除正在使用的短期对象
+     */
+    static std::string LiveSamplesReport(size_t top = 20, uint64_t min_age_ms = 0);
+
+    /**
+     * @brief 把总量和各标签的计数写入指标仪表
+     * @details kong_mem_live_bytes/kong_mem_live_count/kong_mem_alloc_bytes/kong_mem_alloc_count,
+     *          标签tag为子系统名, 总量的tag为"all"
+     */
+    static void UpdateMetrics(metrics::MetricRegistry* registry = nullptr);
+
+    /**
+     * @brief 把快照写入日志
+     */
+    static void LogSnapshot(Logger::ptr logger, LogLevel::Level level = LogLevel::INFO);
+
+    /**
+     * @brief 钩子调用: 分配size字节, 失败返回nullptr
+     */
+    static void* Alloc(size_t size);
+
+    /**
+     * @brief 钩子调用: 释放Alloc返回的内存
+     */
+    static void Free(void* ptr);
+};
+
+/**
+ * @brief 标签作用域
+ */
+class MemScope {
+public:
+    explicit MemScope(uint32_t tag)
+        :m_prev(MemTracker::SwapTag(tag)) {
+    }
+
+    ~MemScope() {
+        MemTracker::SwapTag(m_prev);
+    }
+private:
+    MemScope(const MemScope&) = delete;
+    MemScope& operator=(const MemScope&) = delete;
+private:
+    uint32_t m_prev;
+};
+
+}
+
+#endif
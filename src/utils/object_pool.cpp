@@ -0,0 +1,348 @@
+#include "object_pool.hpp"
+#include <atomic>
+#include <mutex>
+#include <sstream>
+#include <algorithm>
+
+namespace kong {
+
+namespace {
+
+/// 每个slab的大小
+static const size_t kSlabSize = 64 * 1024;
+/// 每个弹匣容纳的对象数
+static const uint32_t kMagazineSize = 32;
+
+static const size_t s_classSizes[] = {
+    16, 32, 48, 64, 80, 96, 112, 128,
+    160, 192, 224, 256, 320, 384, 448, 512,
+    640, 768, 896, 1024, 1280, 1536, 1792, 2048
+};
+static const size_t kClassCount = sizeof(s_classSizes) / sizeof(s_classSizes[0]);
+
+struct Magazine {
+    uint32_t count = 0;
+    void* objs[kMagazineSize];
+};
+
+/**
+ * @brief 单个大小等级的全局仓库
+ */
+struct Depot {
+    std::mutex mutex;
+    size_t size = 0;
+    /// 满弹匣
+    std::vector<Magazine*> full;
+    /// 空弹匣
+    std::vector<Magazine*> empty;
+    /// 不足一个弹匣的零散对象, 以对象首字存放下一个指针
+    void* loose = nullptr;
+    uint64_t looseCount = 0;
+    char* slabCur = nullptr;
+    char* slabEnd = nullptr;
+    uint64_t slabs = 0;
+    /// 已切分出的对象数
+    uint64_t capacity = 0;
+    uint64_t peak = 0;
+
+    uint64_t freeCount() const {
+        return full.size() * kMagazineSize + looseCount;
+    }
+
+    void updatePeak() {
+        uint64_t v = capacity - freeCount();
+        if(v > peak) {
+            peak = v;
+        }
+    }
+
+    void* takeOne() {
+        if(loose) {
+            void* p = loose;
+            loose = *(void**)p;
+            --looseCount;
+            return p;
+        }
+        if(slabCur + size > slabEnd) {
+            slabCur = (char*)::operator new(kSlabSize);
+            slabEnd = slabCur + kSlabSize;
+            ++slabs;
+        }
+        void* p = slabCur;
+        slabCur += size;
+        ++capacity;
+        return p;
+    }
+
+    void putOne(void* p) {
+        *(void**)p = loose;
+        loose = p;
+        ++looseCount;
+    }
+};
+
+struct ThreadCache;
+
+/**
+ * @brief 全局状态, 永不析构, 以便其它全局/线程局部对象析构时仍可释放
+ */
+struct Global {
+    Global() {
+        size_t cls = 0;
+        for(size_t i = 1; i <= SlabAllocator::kMaxSize / 16; ++i) {
+            while(s_classSizes[cls] < i * 16) {
+                ++cls;
+            }
+            classOf[i] = cls;
+        }
+        classOf[0] = 0;
+        for(size_t i = 0; i < kClassCount; ++i) {
+            depots[i].size = s_classSizes[i];
+        }
+    }
+
+    uint8_t classOf[SlabAllocator::kMaxSize / 16 + 1];
+    Depot depots[kClassCount];
+    std::mutex mutex;
+    std::vector<ThreadCache*> caches;
+};
+
+static Global& GetGlobal() {
+    static Global* s_global = new Global;
+    return *s_global;
+}
+
+/**
+ * @brief 线程缓存, 每个等级一个当前弹匣和一个备用弹匣
+ * @details 备用弹匣总是满的或空的
+ */
+struct ThreadCache {
+    Magazine* loaded[kClassCount] = {nullptr};
+    Magazine* previous[kClassCount] = {nullptr};
+    /// 两个弹匣中的对象数, 只由所属线程写
+    std::atomic<uint32_t> cached[kClassCount];
+
+    ThreadCache() {
+        for(size_t i = 0; i < kClassCount; ++i) {
+            cached[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void updateCached(size_t cls) {
+        cached[cls].store(loaded[cls]->count + previous[cls]->count, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief 线程退出时把弹匣还给仓库
+     */
+    void release() {
+        Global& g = GetGlobal();
+        std::lock_guard<std::mutex> glock(g.mutex);
+        g.caches.erase(std::remove(g.caches.begin(), g.caches.end(), this), g.caches.end());
+        for(size_t i = 0; i < kClassCount; ++i) {
+            if(!loaded[i]) {
+                continue;
+            }
+            Depot& d = g.depots[i];
+            std::lock_guard<std::mutex> lock(d.mutex);
+            Magazine* mags[2] = {loaded[i], previous[i]};
+            for(auto m : mags) {
+                if(m->count == kMagazineSize) {
+                    d.full.push_back(m);
+                    continue;
+                }
+                while(m->count) {
+                    d.putOne(m->objs[--m->count]);
+                }
+                d.empty.push_back(m);
+            }
+            cached[i].store(0, std::memory_order_relaxed);
+        }
+    }
+};
+
+static thread_local ThreadCache* t_cache = nullptr;
+/// 线程缓存已析构, 之后的分配释放直接走仓库
+static thread_local bool t_dead = false;
+
+struct CacheHolder {
+    void touch() {}
+    ~CacheHolder() {
+        if(t_cache) {
+            t_cache->release();
+            delete t_cache;
+            t_cache = nullptr;
+        }
+        t_dead = true;
+    }
+};
+
+static thread_local CacheHolder t_holder;
+
+static ThreadCache* CreateCache() {
+    if(t_dead) {
+        return nullptr;
+    }
+    t_holder.touch();
+    ThreadCache* c = new ThreadCache;
+    Global& g = GetGlobal();
+    {
+        std::lock_guard<std::mutex> lock(g.mutex);
+        g.caches.push_back(c);
+    }
+    t_cache = c;
+    return c;
+}
+
+static inline size_t ClassOf(size_t size) {
+    return GetGlobal().classOf[(size + 15) / 16];
+}
+
+static void EnsureMagazines(ThreadCache* c, size_t cls) {
+    if(!c->loaded[cls]) {
+        c->loaded[cls] = new Magazine;
+        c->previous[cls] = new Magazine;
+    }
+}
+
+static void* AllocSlow(ThreadCache* c, size_t cls) {
+    EnsureMagazines(c, cls);
+    Magazine*& loaded = c->loaded[cls];
+    Magazine*& previous = c->previous[cls];
+    if(previous->count) {
+        std::swap(loaded, previous);
+    } else {
+        Depot& d = GetGlobal().depots[cls];
+        std::lock_guard<std::mutex> lock(d.mutex);
+        if(!d.full.empty()) {
+            d.empty.push_back(previous);
+            previous = loaded;
+            loaded = d.full.back();
+            d.full.pop_back();
+        } else {
+            while(loaded->count < kMagazineSize) {
+                loaded->objs[loaded->count++] = d.takeOne();
+            }
+        }
+        d.updatePeak();
+    }
+    void* p = loaded->objs[--loaded->count];
+    c->updateCached(cls);
+    return p;
+}
+
+static void FreeSlow(ThreadCache* c, size_t cls, void* p) {
+    EnsureMagazines(c, cls);
+    Magazine*& loaded = c->loaded[cls];
+    Magazine*& previous = c->previous[cls];
+    if(previous->count == 0) {
+        std::swap(loaded, previous);
+    } else {
+        Depot& d = GetGlobal().depots[cls];
+        std::lock_guard<std::mutex> lock(d.mutex);
+        d.full.push_back(previous);
+        previous = loaded;
+        if(!d.empty.empty()) {
+            loaded = d.empty.back();
+            d.empty.pop_back();
+        } else {
+            loaded = new Magazine;
+        }
+    }
+    loaded->objs[loaded->count++] = p;
+    c->updateCached(cls);
+}
+
+}
+
+void* SlabAllocator::Alloc(size_t size) {
+    if(size > kMaxSize) {
+        return ::operator new(size);
+    }
+    size_t cls = ClassOf(size);
+    ThreadCache* c = t_cache;
+    if(!c && !(c = CreateCache())) {
+        Depot& d = GetGlobal().depots[cls];
+        std::lock_guard<std::mutex> lock(d.mutex);
+        void* p = d.takeOne();
+        d.updatePeak();
+        return p;
+    }
+    Magazine* m = c->loaded[cls];
+    if(m && m->count) {
+        void* p = m->objs[--m->count];
+        c->cached[cls].store(c->cached[cls].load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        return p;
+    }
+    return AllocSlow(c, cls);
+}
+
+void SlabAllocator::Free(void* p, size_t size) {
+    if(!p) {
+        return;
+    }
+    if(size > kMaxSize) {
+        ::operator delete(p);
+        return;
+    }
+    size_t cls = ClassOf(size);
+    ThreadCache* c = t_cache;
+    if(!c && !(c = CreateCache())) {
+        Depot& d = GetGlobal().depots[cls];
+        std::lock_guard<std::mutex> lock(d.mutex);
+        d.putOne(p);
+        return;
+    }
+    Magazine* m = c->loaded[cls];
+    if(m && m->count < kMagazineSize) {
+        m->objs[m->count++] = p;
+        c->cached[cls].store(c->cached[cls].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return;
+    }
+    FreeSlow(c, cls, p);
+}
+
+std::vector<PoolStats> SlabAllocator::GetStats() {
+    std::vector<PoolStats> rt;
+    Global& g = GetGlobal();
+    std::lock_guard<std::mutex> glock(g.mutex);
+    for(size_t i = 0; i < kClassCount; ++i) {
+        PoolStats s;
+        uint64_t cached = 0;
+        for(auto c : g.caches) {
+            cached += c->cached[i].load(std::memory_order_relaxed);
+        }
+        Depot& d = g.depots[i];
+        std::lock_guard<std::mutex> lock(d.mutex);
+        if(!d.slabs) {
+            continue;
+        }
+        s.objectSize = d.size;
+        s.slabs = d.slabs;
+        s.capacity = d.capacity;
+        s.depotFree = d.freeCount();
+        s.cached = cached;
+        s.peakOutstanding = d.peak;
+        uint64_t free = s.depotFree + cached;
+        s.inUse = s.capacity > free ? s.capacity - free : 0;
+        rt.push_back(s);
+    }
+    return rt;
+}
+
+std::string SlabAllocator::DumpStats() {
+    std::stringstream ss;
+    for(auto& i : GetStats()) {
+        ss << "size=" << i.objectSize
+           << " slabs=" << i.slabs
+           << " capacity=" << i.capacity
+           << " in_use=" << i.inUse
+           << " peak=" << i.peakOutstanding
+           << " depot=" << i.depotFree
+           << " cached=" << i.cached
+           << std::endl;
+    }
+    return ss.str();
+}
+
+}
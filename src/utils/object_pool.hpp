@@ -0,0 +1,169 @@
+/**
+ * @file object_pool.hpp
+ * @brief 按大小分级的线程缓存对象池
+ */
+#ifndef __KONG_OBJECT_POOL_H__
+#define __KONG_OBJECT_POOL_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace kong {
+
+/**
+ * @brief 单个大小等级的统计
+ */
+struct PoolStats {
+    /// 对象大小(字节)
+    size_t objectSize = 0;
+    /// 已申请的slab数
+    uint64_t slabs = 0;
+    /// slab切分出的对象总数
+    uint64_t capacity = 0;
+    /// 正在使用的对象数
+    uint64_t inUse = 0;
+    /// 不在全局仓库中的对象数峰值(含线程缓存, 精确到弹匣粒度)
+    uint64_t peakOutstanding = 0;
+    /// 全局仓库中的空闲对象数
+    uint64_t depotFree = 0;
+    /// 线程缓存中的空闲对象数
+    uint64_t cached = 0;
+};
+
+/**
+ * @brief slab分配器
+ * @details 请求按16字节向上分为若干大小等级, 每个等级从64KB的slab切分对象。
+ *          每个线程对每个等级缓存两个弹匣(magazine), 分配和释放在弹匣内完成,
+ *          不加锁; 弹匣取空或放满时才与全局仓库整体交换。跨线程释放的对象进入
+ *          释放线程的弹匣, 再经仓库流转回其它线程。slab不归还系统, 稳定运行后
+ *          内存占用不再增长。超过kMaxSize的请求直接使用operator new
+ */
+class SlabAllocator {
+public:
+    /// 池化的最大对象大小
+    static const size_t kMaxSize = 2048;
+
+    /**
+     * @brief 分配size字节, 按16字节对齐
+     */
+    static void* Alloc(size_t size);
+
+    /**
+     * @brief 释放Alloc分配的内存
+     * @param[in] size 与分配时相同的大小
+     */
+    static void Free(void* p, size_t size);
+
+    /**
+     * @brief 返回各大小等级的统计(只包含用到的等级)
+     */
+    static std::vector<PoolStats> GetStats();
+
+    /**
+     * @brief 以文本形式输出统计
+     */
+    static std::string DumpStats();
+};
+
+/**
+ * @brief 固定类型的对象池
+ */
+template<class T>
+class ObjectPool {
+public:
+    /**
+     * @brief 从池中分配并构造对象
+     */
+    template<class... Args>
+    static T* Create(Args&&... args) {
+        void* p = SlabAllocator::Alloc(sizeof(T));
+        try {
+            return new (p) T(std::forward<Args>(args)...);
+        } catch(...) {
+            SlabAllocator::Free(p, sizeof(T));
+            throw;
+        }
+    }
+
+    /**
+     * @brief 析构对象并归还到池中
+     */
+    static void Destroy(T* p) {
+        if(p) {
+            p->~T();
+            SlabAllocator::Free(p, sizeof(T));
+        }
+    }
+
+    /**
+     * @brief 用于std::unique_ptr的删除器
+     */
+    struct Deleter {
+        void operator()(T* p) const { ObjectPool<T>::Destroy(p);}
+    };
+
+    typedef std::unique_ptr<T, Deleter> unique_ptr;
+
+    /**
+     * @brief 创建由unique_ptr管理的对象
+     */
+    template<class... Args>
+    static unique_ptr MakeUnique(Args&&... args) {
+        return unique_ptr(Create(std::forward<Args>(args)...));
+    }
+};
+
+/**
+ * @brief 基于SlabAllocator的STL分配器, 可用于std::allocate_shared和容器
+ */
+template<class T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    PoolAllocator() noexcept {}
+    template<class U>
+    PoolAllocator(const PoolAllocator<U>&) noexcept {}
+
+    template<class U>
+    struct rebind {
+        typedef PoolAllocator<U> other;
+    };
+
+    T* allocate(size_t n) {
+        if(alignof(T) > 16) {
+            return static_cast<T*>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T*>(SlabAllocator::Alloc(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) noexcept {
+        if(alignof(T) > 16) {
+            ::operator delete(p);
+            return;
+        }
+        SlabAllocator::Free(p, n * sizeof(T));
+    }
+};
+
+template<class T, class U>
+bool operator==(const PoolAllocator<T>&, const PoolAllocator<U>&) { return true;}
+template<class T, class U>
+bool operator!=(const PoolAllocator<T>&, const PoolAllocator<U>&) { return false;}
+
+/**
+ * @brief 对象与shared_ptr控制块一起从池中分配
+ */
+template<class T, class... Args>
+std::shared_ptr<T> MakePooled(Args&&... args) {
+    return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<Args>(args)...);
+}
+
+}
+
+#endif
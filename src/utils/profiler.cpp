@@ -0,0 +1,555 @@
+#include "profiler.hpp"
+#include "log/log.hpp"
+#include "log/log_context.hpp"
+#include "utils/util.hpp"
+#include <dirent.h>
+#include <errno.h>
+#include <map>
+#include <signal.h>
+#include <sstream>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <unordered_map>
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace kong {
+
+static kong::Logger::ptr g_logger = KONG_LOG_NAME("system");
+
+/// 单个样本最多记录的栈帧数
+static const int kMaxFrames = 64;
+/// 处理函数自身及信号跳板占用的帧, 找不到被中断的pc时跳过
+static const int kSkipFrames = 3;
+/// 标签最大长度
+static const size_t kMaxTag = 64;
+/// 缓冲块大小
+static const size_t kChunkSize = 16 * 1024;
+
+struct Profiler::Chunk {
+    std::atomic<Chunk*> next;
+    /// 已写入并发布的字节数
+    std::atomic<uint32_t> used;
+    uint32_t reserved;
+    char data[kChunkSize - sizeof(void*) - 8];
+};
+
+struct Profiler::ThreadSlot {
+    std::atomic<pid_t> tid{0};
+    char name[16] = {0};
+    std::atomic<Chunk*> head{nullptr};
+    /// 只由所属线程在信号处理函数中访问
+    Chunk* tail = nullptr;
+    std::atomic<uint64_t> samples{0};
+};
+
+namespace {
+
+/**
+ * @brief 样本头, 之后是depth个pc(最内层在前)和tagLen字节标签, 总长度8字节对齐
+ */
+struct SampleHeader {
+    uint16_t depth;
+    uint16_t tagLen;
+    uint32_t fiber;
+};
+
+/// 当前在采样的Profiler, 同一时间只能有一个(SIGPROF是进程级的)
+std::atomic<Profiler*> s_active{nullptr};
+/// 正在执行的处理函数数, stop据此等待
+std::atomic<int> s_inHandler{0};
+std::atomic<bool> s_handlerInstalled{false};
+
+std::atomic<Profiler*> s_toggleProfiler{nullptr};
+struct sigaction s_toggleOld;
+
+uint64_t NowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+inline size_t AlignUp(size_t v) {
+    return (v + 7) & ~(size_t)7;
+}
+
+uintptr_t InterruptedPc(void* ucontext) {
+    if(!ucontext) {
+        return 0;
+    }
+    ucontext_t* uc = (ucontext_t*)ucontext;
+#if defined(__x86_64__)
+    return uc->uc_mcontext.gregs[REG_RIP];
+#elif defined(__i386__)
+    return uc->uc_mcontext.gregs[REG_EIP];
+#elif defined(__aarch64__)
+    return uc->uc_mcontext.pc;
+#else
+    (void)uc;
+    return 0;
+#endif
+}
+
+void SigprofHandler(int sig, siginfo_t* info, void* ucontext) {
+    ++s_inHandler;
+    Profiler* p = s_active.load(std::memory_order_acquire);
+    if(p) {
+        int saved = errno;
+        p->record(ucontext);
+        errno = saved;
+    }
+    --s_inHandler;
+}
+
+void ToggleHandler(int sig) {
+    int saved = errno;
+    Profiler* p = s_toggleProfiler.load(std::memory_order_acquire);
+    if(p) {
+        p->notifyToggle();
+    }
+    errno = saved;
+}
+
+bool InstallSigprof() {
+    bool expect = false;
+    if(!s_handlerInstalled.compare_exchange_strong(expect, true)) {
+        return true;
+    }
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = &SigprofHandler;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if(sigaction(SIGPROF, &sa, nullptr)) {
+        s_handlerInstalled = false;
+        return false;
+    }
+    return true;
+}
+
+}
+
+const char* ProfileMode::ToString(ProfileMode::Mode mode) {
+    switch(mode) {
+#define XX(name) \
+        case ProfileMode::name: \
+            return #name;
+        XX(PROCESS);
+        XX(THREAD);
+#undef XX
+        default:
+            return "UNKNOW";
+    }
+    return "UNKNOW";
+}
+
+std::string ProfileStats::toString() const {
+    std::stringstream ss;
+    ss << "[ProfileStats samples=" << samples
+       << " dropped=" << dropped
+       << " threads=" << threads
+       << " duration_ms=" << duration_ms
+       << " handler_ns=" << handler_ns << "]";
+    return ss.str();
+}
+
+Profiler::Profiler() {
+}
+
+Profiler::~Profiler() {
+    disableSignalToggle();
+    stop();
+}
+
+bool Profiler::start(const ProfileOptions& options) {
+    if(m_running || options.frequency == 0) {
+        return false;
+    }
+    Profiler* expect = nullptr;
+    if(!s_active.compare_exchange_strong(expect, this)) {
+        KONG_LOG_ERROR(g_logger) << "another profiler is running";
+        return false;
+    }
+    //上一个Profiler停止后可能还有处理函数在执行
+    while(s_inHandler) {
+        sched_yield();
+    }
+    m_options = options;
+    m_options.max_threads = std::max<uint32_t>(m_options.max_threads, 1);
+    m_chunkCount = std::max<size_t>(m_options.buffer_size / sizeof(Chunk), 1);
+    m_buffer.assign(m_chunkCount * sizeof(Chunk), 0);
+    m_nextChunk = 0;
+    m_slots.reset(new ThreadSlot[m_options.max_threads]);
+    m_contextKey = m_options.context_key.empty() ? 0 : LogContext::Key(m_options.context_key);
+    m_dropped = 0;
+    m_handlerNs = 0;
+
+    //预热: 第一次展开栈时libgcc会加载并缓存unwind信息, 不能发生在信号处理函数中
+    uintptr_t pcs[kMaxFrames];
+    Backtrace(pcs, kMaxFrames);
+
+    if(!InstallSigprof()) {
+        KONG_LOG_ERROR(g_logger) << "install SIGPROF handler failed errno=" << errno;
+        s_active = nullptr;
+        return false;
+    }
+    m_startNs = NowNs();
+    m_stopNs = 0;
+    m_running = true;
+
+    bool ok = true;
+    if(m_options.mode == ProfileMode::PROCESS) {
+        uint32_t interval = std::max<uint32_t>(1000000 / m_options.frequency, 1);
+        struct itimerval tv;
+        tv.it_interval.tv_sec = interval / 1000000;
+        tv.it_interval.tv_usec = interval % 1000000;
+        tv.it_value = tv.it_interval;
+        ok = setitimer(ITIMER_PROF, &tv, nullptr) == 0;
+    } else {
+        DIR* dir = opendir("/proc/self/task");
+        ok = dir != nullptr;
+        struct dirent* dp = nullptr;
+        while(dir && (dp = readdir(dir)) != nullptr) {
+            pid_t tid = atoi(dp->d_name);
+            if(tid > 0 && !createThreadTimer(tid)) {
+                //线程可能刚好退出, 只要有一个成功即可
+                KONG_LOG_WARN(g_logger) << "create profile timer for tid=" << tid << " failed";
+            }
+        }
+        if(dir) {
+            closedir(dir);
+        }
+        std::lock_guard<std::mutex> lock(m_timerMutex);
+        ok = ok && !m_timers.empty();
+    }
+    if(!ok) {
+        KONG_LOG_ERROR(g_logger) << "start profiler timer failed errno=" << errno
+                                 << " errstr=" << strerror(errno);
+        stop();
+        return false;
+    }
+    KONG_LOG_INFO(g_logger) << "profiler started mode=" << ProfileMode::ToString(m_options.mode)
+                            << " frequency=" << m_options.frequency;
+    return true;
+}
+
+void Profiler::stop() {
+    if(!m_running) {
+        return;
+    }
+    if(m_options.mode == ProfileMode::PROCESS) {
+        struct itimerval tv;
+        memset(&tv, 0, sizeof(tv));
+        setitimer(ITIMER_PROF, &tv, nullptr);
+    } else {
+        deleteTimers();
+    }
+    m_running = false;
+    m_stopNs = NowNs();
+    s_active = nullptr;
+    while(s_inHandler) {
+        sched_yield();
+    }
+    KONG_LOG_INFO(g_logger) << "profiler stopped " << getStats().toString();
+}
+
+bool Profiler::createThreadTimer(pid_t tid) {
+    struct sigevent sev;
+    memset(&sev, 0, sizeof(sev));
+    sev.sigev_notify = SIGEV_THREAD_ID;
+    sev.sigev_signo = SIGPROF;
+    sev.sigev_notify_thread_id = tid;
+    //内核线程CPU时钟编码: (~tid << 3) | CPUCLOCK_PERTHREAD_MASK | CPUCLOCK_SCHED
+    clockid_t clock = (clockid_t)((~(unsigned)tid) << 3) | 6;
+    timer_t timer;
+    if(timer_create(clock, &sev, &timer)) {
+        return false;
+    }
+    struct itimerspec its;
+    uint64_t interval = 1000000000ULL / m_options.frequency;
+    its.it_interval.tv_sec = interval / 1000000000ULL;
+    its.it_interval.tv_nsec = interval % 1000000000ULL;
+    its.it_value = its.it_interval;
+    if(timer_settime(timer, 0, &its, nullptr)) {
+        timer_delete(timer);
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(m_timerMutex);
+    m_timers.push_back(timer);
+    return true;
+}
+
+void Profiler::deleteTimers() {
+    std::lock_guard<std::mutex> lock(m_timerMutex);
+    for(auto& i : m_timers) {
+        timer_delete(i);
+    }
+    m_timers.clear();
+}
+
+bool Profiler::registerThread() {
+    if(!m_running || m_options.mode != ProfileMode::THREAD) {
+        return false;
+    }
+    return createThreadTimer((pid_t)syscall(SYS_gettid));
+}
+
+Profiler::Chunk* Profiler::allocChunk() {
+    uint32_t idx = m_nextChunk.fetch_add(1, std::memory_order_relaxed);
+    if(idx >= m_chunkCount) {
+        return nullptr;
+    }
+    Chunk* c = (Chunk*)&m_buffer[idx * sizeof(Chunk)];
+    c->next.store(nullptr, std::memory_order_relaxed);
+    c->used.store(0, std::memory_order_relaxed);
+    return c;
+}
+
+void Profiler::notifyToggle() {
+    //sem_post是异步信号安全的, 启停和写文件在后台线程中完成
+    m_toggleSem->notify();
+}
+
+void Profiler::record(void* ucontext) {
+    if(!m_running) {
+        return;
+    }
+    uint64_t begin = NowNs();
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    uint32_t n = m_options.max_threads;
+    ThreadSlot* slot = nullptr;
+    for(uint32_t i = 0, idx = (uint32_t)tid % n; i < n; ++i, idx = (idx + 1) % n) {
+        ThreadSlot& s = m_slots[idx];
+        pid_t cur = s.tid.load(std::memory_order_acquire);
+        if(cur == tid) {
+            slot = &s;
+            break;
+        }
+        if(cur == 0 && s.tid.compare_exchange_strong(cur, tid)) {
+            prctl(PR_GET_NAME, s.name, 0, 0, 0);
+            slot = &s;
+            break;
+        }
+    }
+    if(!slot) {
+        ++m_dropped;
+        return;
+    }
+
+    uintptr_t pcs[kMaxFrames + kSkipFrames + 8];
+    int frames = Backtrace(pcs, sizeof(pcs) / sizeof(pcs[0]));
+    //从被中断的指令开始, 丢掉处理函数和信号跳板的帧
+    int first = std::min(kSkipFrames, frames);
+    uintptr_t pc = InterruptedPc(ucontext);
+    for(int i = 0; pc && i < frames; ++i) {
+        if(pcs[i] == pc) {
+            first = i;
+            break;
+        }
+    }
+    int depth = std::min(frames - first, kMaxFrames);
+
+    const char* tag = nullptr;
+    size_t tagLen = 0;
+    if(!m_options.context_key.empty()) {
+        const LogContext* ctx = LogContext::CurrentRaw();
+        const std::string* v = ctx ? ctx->get(m_contextKey) : nullptr;
+        if(v) {
+            tag = v->data();
+            tagLen = std::min(v->size(), kMaxTag);
+        }
+    }
+
+    size_t size = AlignUp(sizeof(SampleHeader) + depth * sizeof(uintptr_t) + tagLen);
+    Chunk* c = slot->tail;
+    uint32_t used = c ? c->used.load(std::memory_order_relaxed) : 0;
+    if(!c || used + size > sizeof(c->data)) {
+        Chunk* nc = allocChunk();
+        if(!nc) {
+            ++m_dropped;
+            return;
+        }
+        if(c) {
+            c->next.store(nc, std::memory_order_release);
+        } else {
+            slot->head.store(nc, std::memory_order_release);
+        }
+        slot->tail = c = nc;
+        used = 0;
+    }
+    char* p = c->data + used;
+    SampleHeader h;
+    h.depth = depth;
+    h.tagLen = tagLen;
+    h.fiber = m_options.tag_fiber ? GetFiberId() : 0;
+    memcpy(p, &h, sizeof(h));
+    memcpy(p + sizeof(h), &pcs[first], depth * sizeof(uintptr_t));
+    if(tagLen) {
+        memcpy(p + sizeof(h) + depth * sizeof(uintptr_t), tag, tagLen);
+    }
+    c->used.store(used + size, std::memory_order_release);
+    slot->samples.fetch_add(1, std::memory_order_relaxed);
+    m_handlerNs.fetch_add(NowNs() - begin, std::memory_order_relaxed);
+}
+
+std::string Profiler::getFolded() {
+    if(!m_slots) {
+        return "";
+    }
+    //先按原始样本聚合, 每个不同的pc只解析一次
+    std::map<std::string, uint64_t> raw;
+    for(uint32_t i = 0; i < m_options.max_threads; ++i) {
+        ThreadSlot& s = m_slots[i];
+        std::string prefix(s.name, strnlen(s.name, sizeof(s.name)));
+        if(prefix.empty()) {
+            prefix = std::to_string(s.tid.load());
+        }
+        prefix.push_back('\0');
+        for(Chunk* c = s.head.load(std::memory_order_acquire); c; c = c->next.load(std::memory_order_acquire)) {
+            uint32_t used = c->used.load(std::memory_order_acquire);
+            for(uint32_t off = 0; off < used;) {
+                SampleHeader h;
+                memcpy(&h, c->data + off, sizeof(h));
+                size_t size = AlignUp(sizeof(h) + h.depth * sizeof(uintptr_t) + h.tagLen);
+                ++raw[prefix + std::string(c->data + off, sizeof(h) + h.depth * sizeof(uintptr_t) + h.tagLen)];
+                off += size;
+            }
+        }
+    }
+
+    std::unordered_map<uintptr_t, std::string> symbols;
+    std::map<std::string, uint64_t> folded;
+    for(auto& i : raw) {
+        const std::string& key = i.first;
+        size_t pos = key.find('\0');
+        std::string line = key.substr(0, pos);
+        const char* p = key.data() + pos + 1;
+        SampleHeader h;
+        memcpy(&h, p, sizeof(h));
+        const uintptr_t* frames = (const uintptr_t*)(p + sizeof(h));
+        if(m_options.tag_fiber) {
+            line += ";fiber_" + std::to_string(h.fiber);
+        }
+        if(!m_options.context_key.empty() && h.tagLen) {
+            line += ";" + m_options.context_key + "="
+                    + std::string((const char*)(frames + h.depth), h.tagLen);
+        }
+        for(int j = h.depth - 1; j >= 0; --j) {
+            uintptr_t pc;
+            memcpy(&pc, frames + j, sizeof(pc));
+            //除被中断的指令外都是返回地址, 减1落到call指令上
+            uintptr_t addr = j == 0 ? pc : pc - 1;
+            auto it = symbols.find(addr);
+            if(it == symbols.end()) {
+                it = symbols.insert(std::make_pair(addr, Symbolize(addr))).first;
+            }
+            line += ";" + it->second;
+        }
+        folded[line] += i.second;
+    }
+
+    std::stringstream ss;
+    for(auto& i : folded) {
+        ss << i.first << " " << i.second << "\n";
+    }
+    return ss.str();
+}
+
+bool Profiler::writeFolded(const std::string& path) {
+    std::string tmp = path + ".tmp";
+    std::ofstream ofs;
+    if(!FSUtil::OpenForWrite(ofs, tmp, std::ios::trunc)) {
+        KONG_LOG_ERROR(g_logger) << "open " << tmp << " failed";
+        return false;
+    }
+    ofs << getFolded();
+    ofs.close();
+    if(!ofs || rename(tmp.c_str(), path.c_str())) {
+        KONG_LOG_ERROR(g_logger) << "write " << path << " failed errno=" << errno;
+        return false;
+    }
+    return true;
+}
+
+ProfileStats Profiler::getStats() const {
+    ProfileStats rt;
+    if(!m_slots) {
+        return rt;
+    }
+    for(uint32_t i = 0; i < m_options.max_threads; ++i) {
+        uint64_t n = m_slots[i].samples.load(std::memory_order_relaxed);
+        rt.samples += n;
+        rt.threads += n ? 1 : 0;
+    }
+    rt.dropped = m_dropped;
+    rt.handler_ns = m_handlerNs;
+    uint64_t end = m_running ? NowNs() : m_stopNs;
+    rt.duration_ms = (end - m_startNs) / 1000000;
+    return rt;
+}
+
+bool Profiler::enableSignalToggle(int sig, const std::string& path, const ProfileOptions& options) {
+    if(m_toggleThread || sig == SIGPROF) {
+        return false;
+    }
+    Profiler* expect = nullptr;
+    if(!s_toggleProfiler.compare_exchange_strong(expect, this)) {
+        return false;
+    }
+    m_toggleSignal = sig;
+    m_togglePath = path;
+    m_toggleOptions = options;
+    m_toggleSem.reset(new Semaphore);
+    m_toggleStop = false;
+    m_toggleThread.reset(new Thread(std::bind(&Profiler::toggleLoop, this), "profiler"));
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = &ToggleHandler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if(sigaction(sig, &sa, &s_toggleOld)) {
+        KONG_LOG_ERROR(g_logger) << "install profiler toggle signal " << sig << " failed";
+        disableSignalToggle();
+        return false;
+    }
+    return true;
+}
+
+void Profiler::disableSignalToggle() {
+    if(!m_toggleThread) {
+        return;
+    }
+    sigaction(m_toggleSignal, &s_toggleOld, nullptr);
+    s_toggleProfiler = nullptr;
+    m_toggleStop = true;
+    m_toggleSem->notify();
+    m_toggleThread->join();
+    m_toggleThread.reset();
+}
+
+void Profiler::toggleLoop() {
+    while(true) {
+        m_toggleSem->wait();
+        if(m_toggleStop) {
+            break;
+        }
+        if(m_running) {
+            stop();
+            if(writeFolded(m_togglePath)) {
+                KONG_LOG_INFO(g_logger) << "profile written to " << m_togglePath;
+            }
+        } else {
+            start(m_toggleOptions);
+        }
+    }
+}
+
+}
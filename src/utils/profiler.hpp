@@ -0,0 +1,177 @@
+/**
+ * @file profiler.hpp
+ * @brief 进程内采样CPU分析器, 输出折叠栈(folded stacks)
+ */
+#ifndef __KONG_PROFILER_H__
+#define __KONG_PROFILER_H__
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <time.h>
+#include <vector>
+#include "utils/singleton.hpp"
+#include "utils/thread.hpp"
+
+namespace kong {
+
+/**
+ * @brief 计时方式
+ */
+class ProfileMode {
+public:
+    enum Mode {
+        /// setitimer(ITIMER_PROF), 按进程CPU时间计时, 信号投递给正在运行的线程, 自动覆盖新线程
+        PROCESS = 0,
+        /// 每个线程一个timer_create(线程CPU时钟)定时器, 各线程独立按自己的CPU时间采样.
+        /// 只覆盖start时已存在的线程, 之后创建的线程需要调用Profiler::registerThread
+        THREAD = 1
+    };
+
+    static const char* ToString(ProfileMode::Mode mode);
+};
+
+/**
+ * @brief 采样配置
+ */
+struct ProfileOptions {
+    /// 每秒采样次数(按CPU时间), 取质数避免与周期性任务同步.
+    /// CPU时间定时器在时钟中断中检查, 实际频率不超过内核HZ(通常250)
+    uint32_t frequency = 99;
+    ProfileMode::Mode mode = ProfileMode::PROCESS;
+    /// 样本缓冲总大小(字节), 用完后丢弃新样本并计数
+    size_t buffer_size = 32 * 1024 * 1024;
+    /// 最多记录的线程数
+    uint32_t max_threads = 256;
+    /// 在栈底加入"fiber_<id>"帧
+    bool tag_fiber = false;
+    /// 非空时在栈底加入"<key>=<value>"帧, value取自当前线程日志上下文(KONG_LOG_CONTEXT)
+    std::string context_key;
+};
+
+/**
+ * @brief 采样统计
+ */
+struct ProfileStats {
+    /// 记录的样本数
+    uint64_t samples = 0;
+    /// 缓冲或线程表已满而丢弃的样本数
+    uint64_t dropped = 0;
+    /// 被采样到的线程数
+    uint32_t threads = 0;
+    /// 已采样时长(毫秒)
+    uint64_t duration_ms = 0;
+    /// 信号处理函数累计耗时(纳秒), 除以duration即采样开销占CPU的比例
+    uint64_t handler_ns = 0;
+
+    std::string toString() const;
+};
+
+/**
+ * @brief 采样CPU分析器
+ * @details SIGPROF处理函数中用_Unwind_Backtrace取调用栈, 写入当前线程独占的缓冲,
+ *          不加锁不分配内存: 缓冲在start时一次分配, 按16KB块用原子计数分给各线程,
+ *          线程按tid在定长表中用CAS占位. 符号解析和聚合在getFolded中进行.
+ *          符号用dladdr解析, 只能得到动态符号表中的名字, 可执行文件需要用-rdynamic链接,
+ *          其余帧输出为"模块+0x偏移", 可以离线用addr2line解析.
+ *          SIGPROF处理函数安装后不再卸载(默认动作是终止进程, 停止后仍可能有未决信号),
+ *          停止后处理函数直接返回.
+ *          输出格式每行"线程名;[标签;]最外层帧;...;最内层帧 样本数", 可直接交给flamegraph.pl
+ */
+class Profiler {
+public:
+    typedef std::shared_ptr<Profiler> ptr;
+
+    Profiler();
+    ~Profiler();
+
+    /**
+     * @brief 开始采样, 丢弃上一次的样本
+     * @return 已在运行或定时器创建失败时返回false
+     */
+    bool start(const ProfileOptions& options = ProfileOptions());
+
+    /**
+     * @brief 停止采样, 等待正在执行的信号处理函数返回, 样本保留到下一次start
+     */
+    void stop();
+
+    bool isRunning() const { return m_running;}
+
+    /**
+     * @brief THREAD模式下为当前线程创建定时器, start之后创建的线程调用
+     */
+    bool registerThread();
+
+    /**
+     * @brief 返回折叠栈文本, 运行中也可以调用
+     */
+    std::string getFolded();
+
+    /**
+     * @brief 折叠栈写入文件(先写临时文件再rename)
+     */
+    bool writeFolded(const std::string& path);
+
+    ProfileStats getStats() const;
+
+    /**
+     * @brief 用信号控制采样: 第一次收到sig开始采样, 第二次停止并把结果写入path
+     * @details 信号处理函数只发信号量, 启停和写文件在后台线程中完成
+     */
+    bool enableSignalToggle(int sig, const std::string& path
+                            ,const ProfileOptions& options = ProfileOptions());
+
+    /**
+     * @brief 关闭信号控制, 恢复sig原来的处理方式
+     */
+    void disableSignalToggle();
+public:
+    struct Chunk;
+    struct ThreadSlot;
+
+    /**
+     * @brief 信号处理函数中调用, 记录一个样本(内部使用)
+     */
+    void record(void* ucontext);
+
+    /**
+     * @brief 控制信号的处理函数中调用(内部使用)
+     */
+    void notifyToggle();
+private:
+    Chunk* allocChunk();
+    bool createThreadTimer(pid_t tid);
+    void deleteTimers();
+    void toggleLoop();
+private:
+    ProfileOptions m_options;
+    std::atomic<bool> m_running{false};
+    std::vector<char> m_buffer;
+    std::atomic<uint32_t> m_nextChunk{0};
+    uint32_t m_chunkCount = 0;
+    std::unique_ptr<ThreadSlot[]> m_slots;
+    uint32_t m_contextKey = 0;
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<uint64_t> m_handlerNs{0};
+    uint64_t m_startNs = 0;
+    uint64_t m_stopNs = 0;
+
+    std::mutex m_timerMutex;
+    std::vector<timer_t> m_timers;
+
+    /// 信号控制
+    int m_toggleSignal = 0;
+    std::string m_togglePath;
+    ProfileOptions m_toggleOptions;
+    std::unique_ptr<Semaphore> m_toggleSem;
+    std::atomic<bool> m_toggleStop{false};
+    Thread::ptr m_toggleThread;
+};
+
+typedef kong::Singleton<Profiler> ProfilerMgr;
+
+}
+
+#endif
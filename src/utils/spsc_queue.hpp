@@ -0,0 +1,16 @@
+/**
+ * @file spsc_queue.hpp
+ * @brief 单生产者单消费者队列, 实现已移到concurrent/spsc_queue.hpp
+ */
+#ifndef __KONG_SPSC_QUEUE_H__
+#define __KONG_SPSC_QUEUE_H__
+
+#include "concurrent/spsc_queue.hpp"
+
+namespace kong {
+
+using concurrent::SpscQueue;
+
+}
+
+#endif
@@ -0,0 +1,615 @@
+#include "strutil.hpp"
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#define KONG_HAVE_SSE2 1
+#endif
+
+namespace kong {
+
+namespace {
+
+inline bool IsJsonEscape(unsigned char c) {
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+inline bool IsLogfmtQuote(unsigned char c) {
+    return c <= 0x20 || c == '"' || c == '\\' || c == '=';
+}
+
+size_t FindJsonEscapeScalar(const char* str, size_t len, size_t i) {
+    for(; i < len; ++i) {
+        if(IsJsonEscape(str[i])) {
+            return i;
+        }
+    }
+    return len;
+}
+
+size_t FindLogfmtQuoteScalar(const char* str, size_t len, size_t i) {
+    for(; i < len; ++i) {
+        if(IsLogfmtQuote(str[i])) {
+            return i;
+        }
+    }
+    return len;
+}
+
+#ifdef KONG_HAVE_SSE2
+size_t FindJsonEscapeSSE2(const char* str, size_t len) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i ctrl = _mm_set1_epi8(0x1F);
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash));
+        //无符号 v <= 0x1F
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(v, ctrl), ctrl));
+        int mask = _mm_movemask_epi8(m);
+        if(mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return FindJsonEscapeScalar(str, len, i);
+}
+
+size_t FindLogfmtQuoteSSE2(const char* str, size_t len) {
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    const __m128i equal = _mm_set1_epi8('=');
+    const __m128i space = _mm_set1_epi8(0x20);
+    size_t i = 0;
+    for(; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(str + i));
+        __m128i m = _mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, slash));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(v, equal));
+        m = _mm_or_si128(m, _mm_cmpeq_epi8(_mm_max_epu8(v, space), space));
+        int mask = _mm_movemask_epi8(m);
+        if(mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return FindLogfmtQuoteScalar(str, len, i);
+}
+
+__attribute__((target("avx2")))
+size_t FindJsonEscapeAVX2(const char* str, size_t len) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i slash = _mm256_set1_epi8('\\');
+    const __m256i ctrl = _mm256_set1_epi8(0x1F);
+    size_t i = 0;
+    for(; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, slash));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_max_epu8(v, ctrl), ctrl));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+        if(mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + FindJsonEscapeSSE2(str + i, len - i);
+}
+
+__attribute__((target("avx2")))
+size_t FindLogfmtQuoteAVX2(const char* str, size_t len) {
+    const __m256i quote = _mm256_set1_epi8('"');
+    const __m256i slash = _mm256_set1_epi8('\\');
+    const __m256i equal = _mm256_set1_epi8('=');
+    const __m256i space = _mm256_set1_epi8(0x20);
+    size_t i = 0;
+    for(; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(str + i));
+        __m256i m = _mm256_or_si256(_mm256_cmpeq_epi8(v, quote), _mm256_cmpeq_epi8(v, slash));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, equal));
+        m = _mm256_or_si256(m, _mm256_cmpeq_epi8(_mm256_max_epu8(v, space), space));
+        unsigned mask = (unsigned)_mm256_movemask_epi8(m);
+        if(mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+    return i + FindLogfmtQuoteSSE2(str + i, len - i);
+}
+#endif
+
+typedef size_t (*ScanFunc)(const char*, size_t);
+
+size_t FindJsonEscapeGeneric(const char* str, size_t len) {
+    return FindJsonEscapeScalar(str, len, 0);
+}
+
+size_t FindLogfmtQuoteGeneric(const char* str, size_t len) {
+    return FindLogfmtQuoteScalar(str, len, 0);
+}
+
+struct ScanDispatch {
+    ScanFunc json = &FindJsonEscapeGeneric;
+    ScanFunc logfmt = &FindLogfmtQuoteGeneric;
+
+    ScanDispatch() {
+#ifdef KONG_HAVE_SSE2
+        json = &FindJsonEscapeSSE2;
+        logfmt = &FindLogfmtQuoteSSE2;
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) {
+            json = &FindJsonEscapeAVX2;
+            logfmt = &FindLogfmtQuoteAVX2;
+        }
+#endif
+    }
+};
+
+const ScanDispatch& GetScanDispatch() {
+    static ScanDispatch s_dispatch;
+    return s_dispatch;
+}
+
+const char s_digits[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+const char s_hex[] = "0123456789abcdef";
+
+/**
+ * Grisu3 (Florian Loitsch, "Printing Floating-Point Numbers Quickly and
+ * Accurately with Integers"): 用整数运算生成最短表示, 并能识别误差导致无法确定的少数情况,
+ * 这些值改用printf逐个精度尝试, 因此结果总是能还原原值的最短表示
+ */
+struct DiyFp {
+    static const int kDiySignificandSize = 64;
+    static const int kDpSignificandSize = 52;
+    static const int kDpExponentBias = 0x3FF + kDpSignificandSize;
+    static const int kDpMinExponent = -kDpExponentBias;
+    static const uint64_t kDpExponentMask = 0x7FF0000000000000ULL;
+    static const uint64_t kDpSignificandMask = 0x000FFFFFFFFFFFFFULL;
+    static const uint64_t kDpHiddenBit = 0x0010000000000000ULL;
+
+    DiyFp(uint64_t fp, int exp) :f(fp), e(exp) {}
+
+    explicit DiyFp(double d) {
+        uint64_t u;
+        memcpy(&u, &d, sizeof(u));
+        int biased_e = (int)((u & kDpExponentMask) >> kDpSignificandSize);
+        uint64_t significand = u & kDpSignificandMask;
+        if(biased_e != 0) {
+            f = significand + kDpHiddenBit;
+            e = biased_e - kDpExponentBias;
+        } else {
+            f = significand;
+            e = kDpMinExponent + 1;
+        }
+    }
+
+    DiyFp operator-(const DiyFp& rhs) const {
+        return DiyFp(f - rhs.f, e);
+    }
+
+    DiyFp operator*(const DiyFp& rhs) const {
+        unsigned __int128 p = (unsigned __int128)f * rhs.f;
+        uint64_t h = (uint64_t)(p >> 64);
+        uint64_t l = (uint64_t)p;
+        //四舍五入
+        if(l & (1ULL << 63)) {
+            ++h;
+        }
+        return DiyFp(h, e + rhs.e + 64);
+    }
+
+    DiyFp normalize() const {
+        int s = __builtin_clzll(f);
+        return DiyFp(f << s, e - s);
+    }
+
+    DiyFp normalizeBoundary() const {
+        DiyFp res = *this;
+        while(!(res.f & (kDpHiddenBit << 1))) {
+            res.f <<= 1;
+            --res.e;
+        }
+        res.f <<= (kDiySignificandSize - kDpSignificandSize - 2);
+        res.e = res.e - (kDiySignificandSize - kDpSignificandSize - 2);
+        return res;
+    }
+
+    void normalizedBoundaries(DiyFp* minus, DiyFp* plus) const {
+        DiyFp pl = DiyFp((f << 1) + 1, e - 1).normalizeBoundary();
+        DiyFp mi = (f == kDpHiddenBit) ? DiyFp((f << 2) - 1, e - 2) : DiyFp((f << 1) - 1, e - 1);
+        mi.f <<= mi.e - pl.e;
+        mi.e = pl.e;
+        *plus = pl;
+        *minus = mi;
+    }
+
+    uint64_t f;
+    int e;
+};
+
+/// 10^-348, 10^-340, ..., 10^340 的归一化近似值
+const uint64_t s_cachedPowersF[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+    0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+    0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+    0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+    0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+    0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+    0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+    0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+    0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+    0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+    0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+    0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+    0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+    0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+    0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL,
+};
+
+const int16_t s_cachedPowersE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066,
+};
+
+DiyFp GetCachedPower(int e, int* K) {
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    if(dk - k > 0.0) {
+        ++k;
+    }
+    unsigned index = (unsigned)((k >> 3) + 1);
+    *K = -(-348 + (int)(index << 3));
+    return DiyFp(s_cachedPowersF[index], s_cachedPowersE[index]);
+}
+
+const uint64_t s_pow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL,
+    10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL,
+    100000000000ULL, 1000000000000ULL, 10000000000000ULL,
+    100000000000000ULL, 1000000000000000ULL, 10000000000000000ULL,
+    100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+/**
+ * 把最后一位向w靠拢, 并判断结果是否一定是最接近w的最短表示.
+ * 所有量都带有至多unit的误差, 无法确定时返回false
+ */
+bool RoundWeed(char* buffer, int len, uint64_t distance_too_high_w, uint64_t unsafe_interval
+                ,uint64_t rest, uint64_t ten_kappa, uint64_t unit) {
+    uint64_t small_distance = distance_too_high_w - unit;
+    uint64_t big_distance = distance_too_high_w + unit;
+    while(rest < small_distance && unsafe_interval - rest >= ten_kappa
+            && (rest + ten_kappa < small_distance
+                || small_distance - rest >= rest + ten_kappa - small_distance)) {
+        --buffer[len - 1];
+        rest += ten_kappa;
+    }
+    //按误差上限再靠拢一位仍然可行, 说明不能确定哪个更近
+    if(rest < big_distance && unsafe_interval - rest >= ten_kappa
+            && (rest + ten_kappa < big_distance
+                || big_distance - rest > rest + ten_kappa - big_distance)) {
+        return false;
+    }
+    return 2 * unit <= rest && rest <= unsafe_interval - 4 * unit;
+}
+
+int CountDecimalDigit32(uint32_t n) {
+    int c = 1;
+    while(n >= 10 && c < 10) {
+        n /= 10;
+        ++c;
+    }
+    return c;
+}
+
+/**
+ * 在(low, high)内生成尽量少的数字, 区间两端按误差各放宽unit, 结果不确定时返回false
+ */
+bool DigitGen(const DiyFp& low, const DiyFp& W, const DiyFp& high, char* buffer, int* len, int* K) {
+    uint64_t unit = 1;
+    const DiyFp too_low(low.f - unit, low.e);
+    const DiyFp too_high(high.f + unit, high.e);
+    DiyFp unsafe_interval = too_high - too_low;
+    const DiyFp one(1ULL << -W.e, W.e);
+    uint32_t p1 = (uint32_t)(too_high.f >> -one.e);
+    uint64_t p2 = too_high.f & (one.f - 1);
+    int kappa = CountDecimalDigit32(p1);
+    *len = 0;
+
+    while(kappa > 0) {
+        uint32_t div = (uint32_t)s_pow10[kappa - 1];
+        uint32_t d = p1 / div;
+        p1 %= div;
+        if(d || *len) {
+            buffer[(*len)++] = (char)('0' + d);
+        }
+        --kappa;
+        uint64_t rest = ((uint64_t)p1 << -one.e) + p2;
+        if(rest < unsafe_interval.f) {
+            *K += kappa;
+            return *len && RoundWeed(buffer, *len, (too_high - W).f, unsafe_interval.f, rest
+                        ,(uint64_t)div << -one.e, unit);
+        }
+    }
+
+    for(;;) {
+        p2 *= 10;
+        unit *= 10;
+        unsafe_interval.f *= 10;
+        char d = (char)(p2 >> -one.e);
+        if(d || *len) {
+            buffer[(*len)++] = (char)('0' + d);
+        }
+        p2 &= one.f - 1;
+        --kappa;
+        if(p2 < unsafe_interval.f) {
+            *K += kappa;
+            return *len && RoundWeed(buffer, *len, (too_high - W).f * unit, unsafe_interval.f, p2
+                        ,one.f, unit);
+        }
+    }
+}
+
+/**
+ * Grisu3: 成功时结果是能还原原值的最短表示, 约0.5%的值无法确定而返回false
+ */
+bool Grisu3(double value, char* buffer, int* length, int* K) {
+    const DiyFp v(value);
+    DiyFp w_m(0, 0), w_p(0, 0);
+    v.normalizedBoundaries(&w_m, &w_p);
+
+    const DiyFp c_mk = GetCachedPower(w_p.e, K);
+    const DiyFp W = v.normalize() * c_mk;
+    const DiyFp Wp = w_p * c_mk;
+    const DiyFp Wm = w_m * c_mk;
+    return DigitGen(Wm, W, Wp, buffer, length, K);
+}
+
+/**
+ * Grisu3无法确定时的后备: 从Grisu3已生成的位数开始逐个精度用printf舍入, 取第一个能还原原值的.
+ * Grisu3在放宽后的区间内第一次能停下时才停止生成, 最短表示不会比这更短
+ */
+void ShortestBySprintf(double value, char* buffer, int* length, int* K) {
+    char tmp[32];
+    for(int precision = std::max(*length, 1); precision <= 17; ++precision) {
+        snprintf(tmp, sizeof(tmp), "%.*e", precision - 1, value);
+        if(precision == 17 || strtod(tmp, nullptr) == value) {
+            break;
+        }
+    }
+    //tmp形如 "d.ddde+XX"
+    const char* p = tmp;
+    *length = 0;
+    for(; *p != 'e'; ++p) {
+        if(*p != '.') {
+            buffer[(*length)++] = *p;
+        }
+    }
+    *K = atoi(p + 1) - (*length - 1);
+}
+
+char* WriteExponent(int k, char* buffer) {
+    if(k < 0) {
+        *buffer++ = '-';
+        k = -k;
+    }
+    if(k >= 100) {
+        *buffer++ = (char)('0' + k / 100);
+        k %= 100;
+        *buffer++ = s_digits[k * 2];
+        *buffer++ = s_digits[k * 2 + 1];
+    } else if(k >= 10) {
+        *buffer++ = s_digits[k * 2];
+        *buffer++ = s_digits[k * 2 + 1];
+    } else {
+        *buffer++ = (char)('0' + k);
+    }
+    return buffer;
+}
+
+/**
+ * 将 digits x 10^k 排版成常规写法或科学计数法
+ */
+char* Prettify(char* buffer, int length, int k) {
+    const int kk = length + k; // 10^(kk-1) <= v < 10^kk
+    if(0 <= k && kk <= 17) {
+        // 1234e3 -> 1234000
+        for(int i = length; i < kk; ++i) {
+            buffer[i] = '0';
+        }
+        return &buffer[kk];
+    } else if(0 < kk && kk <= 17) {
+        // 1234e-2 -> 12.34
+        memmove(&buffer[kk + 1], &buffer[kk], length - kk);
+        buffer[kk] = '.';
+        return &buffer[length + 1];
+    } else if(-6 < kk && kk <= 0) {
+        // 1234e-6 -> 0.001234
+        const int offset = 2 - kk;
+        memmove(&buffer[offset], &buffer[0], length);
+        buffer[0] = '0';
+        buffer[1] = '.';
+        for(int i = 2; i < offset; ++i) {
+            buffer[i] = '0';
+        }
+        return &buffer[length + offset];
+    } else if(length == 1) {
+        // 1e30
+        buffer[1] = 'e';
+        return WriteExponent(kk - 1, &buffer[2]);
+    } else {
+        // 1234e30 -> 1.234e33
+        memmove(&buffer[2], &buffer[1], length - 1);
+        buffer[1] = '.';
+        buffer[length + 1] = 'e';
+        return WriteExponent(kk - 1, &buffer[length + 2]);
+    }
+}
+
+void AppendEscapedChar(std::string& out, unsigned char c) {
+    switch(c) {
+        case '"':  out.append("\\\"", 2); break;
+        case '\\': out.append("\\\\", 2); break;
+        case '\n': out.append("\\n", 2); break;
+        case '\r': out.append("\\r", 2); break;
+        case '\t': out.append("\\t", 2); break;
+        case '\b': out.append("\\b", 2); break;
+        case '\f': out.append("\\f", 2); break;
+        default: {
+            char buf[6] = {'\\', 'u', '0', '0', s_hex[c >> 4], s_hex[c & 0xF]};
+            out.append(buf, 6);
+        }
+    }
+}
+
+}
+
+size_t StrUtil::FindJsonEscape(const char* str, size_t len) {
+    return GetScanDispatch().json(str, len);
+}
+
+size_t StrUtil::FindLogfmtQuote(const char* str, size_t len) {
+    return GetScanDispatch().logfmt(str, len);
+}
+
+void StrUtil::AppendJsonEscaped(std::string& out, const char* str, size_t len) {
+    ScanFunc scan = GetScanDispatch().json;
+    size_t pos = 0;
+    while(pos < len) {
+        size_t n = scan(str + pos, len - pos);
+        out.append(str + pos, n);
+        pos += n;
+        if(pos < len) {
+            AppendEscapedChar(out, str[pos]);
+            ++pos;
+        }
+    }
+}
+
+void StrUtil::AppendLogfmtValue(std::string& out, const char* str, size_t len) {
+    if(len && GetScanDispatch().logfmt(str, len) == len) {
+        out.append(str, len);
+        return;
+    }
+    out.append(1, '"');
+    AppendJsonEscaped(out, str, len);
+    out.append(1, '"');
+}
+
+void StrUtil::AppendLogfmtKey(std::string& out, const char* str, size_t len) {
+    ScanFunc scan = GetScanDispatch().logfmt;
+    if(!len) {
+        out.append(1, '_');
+        return;
+    }
+    size_t pos = 0;
+    while(pos < len) {
+        size_t n = scan(str + pos, len - pos);
+        out.append(str + pos, n);
+        pos += n;
+        if(pos < len) {
+            out.append(1, '_');
+            ++pos;
+        }
+    }
+}
+
+size_t StrUtil::Uint64ToChars(char* buf, uint64_t v) {
+    char tmp[20];
+    char* p = tmp + sizeof(tmp);
+    while(v >= 100) {
+        unsigned idx = (unsigned)(v % 100) * 2;
+        v /= 100;
+        *--p = s_digits[idx + 1];
+        *--p = s_digits[idx];
+    }
+    if(v >= 10) {
+        unsigned idx = (unsigned)v * 2;
+        *--p = s_digits[idx + 1];
+        *--p = s_digits[idx];
+    } else {
+        *--p = (char)('0' + v);
+    }
+    size_t n = tmp + sizeof(tmp) - p;
+    memcpy(buf, p, n);
+    return n;
+}
+
+size_t StrUtil::Int64ToChars(char* buf, int64_t v) {
+    if(v < 0) {
+        buf[0] = '-';
+        return 1 + Uint64ToChars(buf + 1, 0 - (uint64_t)v);
+    }
+    return Uint64ToChars(buf, (uint64_t)v);
+}
+
+size_t StrUtil::DoubleToChars(char* buf, double v) {
+    if(isnan(v)) {
+        memcpy(buf, "nan", 3);
+        return 3;
+    }
+    if(isinf(v)) {
+        if(v < 0) {
+            memcpy(buf, "-inf", 4);
+            return 4;
+        }
+        memcpy(buf, "inf", 3);
+        return 3;
+    }
+    char* p = buf;
+    if(signbit(v)) {
+        *p++ = '-';
+        v = -v;
+    }
+    if(v == 0) {
+        *p++ = '0';
+        return p - buf;
+    }
+    int length = 0;
+    int K = 0;
+    if(!Grisu3(v, p, &length, &K)) {
+        ShortestBySprintf(v, p, &length, &K);
+    }
+    return Prettify(p, length, K) - buf;
+}
+
+void StrUtil::AppendUint64(std::string& out, uint64_t v) {
+    char buf[20];
+    out.append(buf, Uint64ToChars(buf, v));
+}
+
+void StrUtil::AppendInt64(std::string& out, int64_t v) {
+    char buf[21];
+    out.append(buf, Int64ToChars(buf, v));
+}
+
+void StrUtil::AppendDouble(std::string& out, double v) {
+    char buf[32];
+    out.append(buf, DoubleToChars(buf, v));
+}
+
+}
@@ -0,0 +1,72 @@
+/**
+ * @file strutil.hpp
+ * @brief 字符串转义与数字转换工具(不依赖iostream)
+ */
+#ifndef __KONG_STRUTIL_H__
+#define __KONG_STRUTIL_H__
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace kong {
+
+/**
+ * @brief 字符串工具
+ * @details 转义扫描按CPU能力选择 AVX2 / SSE2 / 标量实现
+ */
+class StrUtil {
+public:
+    /**
+     * @brief 返回第一个需要JSON转义的字节位置(引号、反斜杠、控制字符)
+     * @return 不存在时返回len
+     */
+    static size_t FindJsonEscape(const char* str, size_t len);
+
+    /**
+     * @brief 返回第一个需要logfmt加引号的字节位置(空格、等号、引号、反斜杠、控制字符)
+     * @return 不存在时返回len
+     */
+    static size_t FindLogfmtQuote(const char* str, size_t len);
+
+    /**
+     * @brief 按JSON规则转义后追加到out(不含两侧引号)
+     */
+    static void AppendJsonEscaped(std::string& out, const char* str, size_t len);
+
+    /**
+     * @brief 按logfmt规则追加值, 需要时加引号并转义
+     */
+    static void AppendLogfmtValue(std::string& out, const char* str, size_t len);
+
+    /**
+     * @brief 按logfmt规则追加键, 键不能加引号, 需要加引号的字节替换为'_', 空键写成"_"
+     */
+    static void AppendLogfmtKey(std::string& out, const char* str, size_t len);
+
+    /**
+     * @brief 写入十进制整数, buf至少20字节
+     * @return 写入的字节数
+     */
+    static size_t Uint64ToChars(char* buf, uint64_t v);
+
+    /**
+     * @brief 写入十进制有符号整数, buf至少21字节
+     * @return 写入的字节数
+     */
+    static size_t Int64ToChars(char* buf, int64_t v);
+
+    /**
+     * @brief 写入浮点数, buf至少32字节
+     * @return 写入的字节数
+     */
+    static size_t DoubleToChars(char* buf, double v);
+
+    static void AppendUint64(std::string& out, uint64_t v);
+    static void AppendInt64(std::string& out, int64_t v);
+    static void AppendDouble(std::string& out, double v);
+};
+
+}
+
+#endif
@@ -0,0 +1,133 @@
+#include "thread.hpp"
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <iostream>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+
+namespace kong {
+
+static thread_local Thread* t_thread = nullptr;
+static thread_local std::string t_thread_name = "UNKNOW";
+
+Semaphore::Semaphore(uint32_t count) {
+    if(sem_init(&m_semaphore, 0, count)) {
+        throw std::logic_error("sem_init error");
+    }
+}
+
+Semaphore::~Semaphore() {
+    sem_destroy(&m_semaphore);
+}
+
+void Semaphore::wait() {
+    while(sem_wait(&m_semaphore)) {
+        if(errno != EINTR) {
+            throw std::logic_error("sem_wait error");
+        }
+    }
+}
+
+void Semaphore::notify() {
+    if(sem_post(&m_semaphore)) {
+        throw std::logic_error("sem_post error");
+    }
+}
+
+Thread* Thread::GetThis() {
+    return t_thread;
+}
+
+const std::string& Thread::GetName() {
+    return t_thread_name;
+}
+
+void Thread::SetName(const std::string& name) {
+    if(name.empty()) {
+        return;
+    }
+    if(t_thread) {
+        t_thread->m_name = name;
+    }
+    t_thread_name = name;
+}
+
+bool Thread::SetAffinity(int cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+std::vector<int> Thread::GetAvailableCpus() {
+    std::vector<int> rt;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for(int i = 0; i < CPU_SETSIZE; ++i) {
+            if(CPU_ISSET(i, &set)) {
+                rt.push_back(i);
+            }
+        }
+    }
+    if(rt.empty()) {
+        long n = sysconf(_SC_NPROCESSORS_ONLN);
+        for(long i = 0; i < n; ++i) {
+            rt.push_back(i);
+        }
+    }
+    return rt;
+}
+
+Thread::Thread(std::function<void()> cb, const std::string& name)
+    :m_cb(cb)
+    ,m_name(name) {
+    if(name.empty()) {
+        m_name = "UNKNOW";
+    }
+    int rt = pthread_create(&m_thread, nullptr, &Thread::run, this);
+    if(rt) {
+        std::cout << "pthread_create thread fail, rt=" << rt
+                  << " name=" << name << std::endl;
+        throw std::logic_error("pthread_create error");
+    }
+    m_semaphore.wait();
+}
+
+Thread::~Thread() {
+    if(m_thread) {
+        pthread_detach(m_thread);
+    }
+}
+
+void Thread::join() {
+    if(m_thread) {
+        int rt = pthread_join(m_thread, nullptr);
+        if(rt) {
+            std::cout << "pthread_join thread fail, rt=" << rt
+                      << " name=" << m_name << std::endl;
+            throw std::logic_error("pthread_join error");
+        }
+        m_thread = 0;
+    }
+}
+
+void* Thread::run(void* arg) {
+    Thread* thread = (Thread*)arg;
+    t_thread = thread;
+    t_thread_name = thread->m_name;
+    thread->m_id = syscall(SYS_gettid);
+    pthread_setname_np(pthread_self(), thread->m_name.substr(0, 15).c_str());
+
+    std::function<void()> cb;
+    cb.swap(thread->m_cb);
+
+    thread->m_semaphore.notify();
+
+    cb();
+    return 0;
+}
+
+}
@@ -1,21 +1,230 @@
+/**
+ * @file thread.hpp
+ * @brief 线程相关的封装
+ */
 #ifndef __KONG_THREAD_H__
 #define __KONG_THREAD_H__
 
+#include <memory>
+#include <functional>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <semaphore.h>
+
 namespace kong {
 
-class Thread {
+/**
+ * @brief 信号量
+ */
+class Semaphore {
+public:
+    /**
+     * @brief 构造函数
+     * @param[in] count 信号量值的大小
+     */
+    Semaphore(uint32_t count = 0);
+
+    ~Semaphore();
+
+    /**
+     * @brief 获取信号量
+     */
+    void wait();
 
+    /**
+     * @brief 释放信号量
+     */
+    void notify();
+private:
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+private:
+    sem_t m_semaphore;
+};
+
+/**
+ * @brief 局部读锁, 构造时加读锁, 析构时解锁
+ */
+template<class T>
+struct ReadScopedLockImpl {
+public:
+    ReadScopedLockImpl(T& mutex)
+        :m_mutex(mutex) {
+        m_mutex.rdlock();
+        m_locked = true;
+    }
+
+    ~ReadScopedLockImpl() {
+        unlock();
+    }
+
+    void lock() {
+        if(!m_locked) {
+            m_mutex.rdlock();
+            m_locked = true;
+        }
+    }
+
+    void unlock() {
+        if(m_locked) {
+            m_mutex.unlock();
+            m_locked = false;
+        }
+    }
+private:
+    T& m_mutex;
+    bool m_locked;
+};
+
+/**
+ * @brief 局部写锁, 构造时加写锁, 析构时解锁
+ */
+template<class T>
+struct WriteScopedLockImpl {
+public:
+    WriteScopedLockImpl(T& mutex)
+        :m_mutex(mutex) {
+        m_mutex.wrlock();
+        m_locked = true;
+    }
+
+    ~WriteScopedLockImpl() {
+        unlock();
+    }
+
+    void lock() {
+        if(!m_locked) {
+            m_mutex.wrlock();
+            m_locked = true;
+        }
+    }
+
+    void unlock() {
+        if(m_locked) {
+            m_mutex.unlock();
+            m_locked = false;
+        }
+    }
+private:
+    T& m_mutex;
+    bool m_locked;
+};
+
+/**
+ * @brief 读写互斥量
+ */
+class RWMutex {
+public:
+    typedef ReadScopedLockImpl<RWMutex> ReadLock;
+    typedef WriteScopedLockImpl<RWMutex> WriteLock;
+
+    RWMutex() {
+        pthread_rwlock_init(&m_lock, nullptr);
+    }
+
+    ~RWMutex() {
+        pthread_rwlock_destroy(&m_lock);
+    }
+
+    void rdlock() {
+        pthread_rwlock_rdlock(&m_lock);
+    }
+
+    void wrlock() {
+        pthread_rwlock_wrlock(&m_lock);
+    }
+
+    void unlock() {
+        pthread_rwlock_unlock(&m_lock);
+    }
+private:
+    RWMutex(const RWMutex&) = delete;
+    RWMutex& operator=(const RWMutex&) = delete;
+private:
+    pthread_rwlock_t m_lock;
+};
+
+/**
+ * @brief 线程类
+ */
+class Thread {
 public:
     typedef std::shared_ptr<Thread> ptr;
     typedef std::weak_ptr<Thread> wptr;
 
-    
+    /**
+     * @brief 构造函数, 返回时线程已经开始运行
+     * @param[in] cb 线程执行函数
+     * @param[in] name 线程名称
+     */
+    Thread(std::function<void()> cb, const std::string& name);
 
-}
+    /**
+     * @brief 析构函数, 未join的线程被detach
+     */
+    ~Thread();
 
+    /**
+     * @brief 线程ID(内核tid)
+     */
+    pid_t getId() const { return m_id;}
 
+    /**
+     * @brief 线程名称
+     */
+    const std::string& getName() const { return m_name;}
 
-}
+    /**
+     * @brief 等待线程执行完成
+     */
+    void join();
+
+    /**
+     * @brief 获取当前的线程指针, 非Thread创建的线程返回nullptr
+     */
+    static Thread* GetThis();
+
+    /**
+     * @brief 获取当前的线程名称
+     */
+    static const std::string& GetName();
+
+    /**
+     * @brief 设置当前线程名称
+     */
+    static void SetName(const std::string& name);
 
+    /**
+     * @brief 把当前线程绑定到cpu
+     */
+    static bool SetAffinity(int cpu);
+
+    /**
+     * @brief 当前进程允许使用的CPU编号
+     */
+    static std::vector<int> GetAvailableCpus();
+private:
+    Thread(const Thread&) = delete;
+    Thread& operator=(const Thread&) = delete;
+
+    /**
+     * @brief 线程执行函数
+     */
+    static void* run(void* arg);
+private:
+    /// 线程id
+    pid_t m_id = -1;
+    /// 线程结构
+    pthread_t m_thread = 0;
+    /// 线程执行函数
+    std::function<void()> m_cb;
+    /// 线程名称
+    std::string m_name;
+    /// 等待线程启动
+    Semaphore m_semaphore;
+};
+
+}
 
-#endif
\ No newline at end of file
+#endif
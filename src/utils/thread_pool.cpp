@@ -0,0 +1,398 @@
+#include "thread_pool.hpp"
+#include <sched.h>
+#include <stdexcept>
+#include "log/log.hpp"
+#include "util.hpp"
+
+namespace kong {
+
+static kong::Logger::ptr g_logger = KONG_LOG_NAME("system");
+
+static thread_local ThreadPool* t_pool = nullptr;
+static thread_local int t_index = -1;
+static thread_local uint32_t t_rand = 0;
+
+/// 工作线程本地队列的容量, 满了以后放入全局队列
+static const int64_t s_dequeSize = 4096;
+
+/**
+ * @brief 工作线程: Chase-Lev双端队列和计数
+ * @details 下标只增不减, 队列定长, 所有者从bottom端push/pop, 窃取者对top做CAS.
+ *          top/bottom/计数分在不同的缓存行
+ */
+struct ThreadPool::Worker {
+    std::atomic<int64_t> top{0};
+    char pad1[64];
+    std::atomic<int64_t> bottom{0};
+    char pad2[64];
+    std::unique_ptr<std::atomic<Task*>[]> buf{new std::atomic<Task*>[s_dequeSize]};
+    /// 以下计数只由所属线程写入
+    std::atomic<uint64_t> tasks{0};
+    std::atomic<uint64_t> steals{0};
+    std::atomic<uint64_t> sleeps{0};
+    char pad3[64];
+
+    bool push(Task* task) {
+        int64_t b = bottom.load(std::memory_order_relaxed);
+        int64_t t = top.load(std::memory_order_acquire);
+        if(b - t >= s_dequeSize) {
+            return false;
+        }
+        buf[b & (s_dequeSize - 1)].store(task, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    Task* pop() {
+        int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t t = top.load(std::memory_order_relaxed);
+        if(t > b) {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        Task* task = buf[b & (s_dequeSize - 1)].load(std::memory_order_relaxed);
+        if(t == b) {
+            //只剩最后一个, 和窃取者竞争
+            if(!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst
+                                            ,std::memory_order_relaxed)) {
+                task = nullptr;
+            }
+            bottom.store(b + 1, std::memory_order_relaxed);
+        }
+        return task;
+    }
+
+    Task* steal() {
+        int64_t t = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t b = bottom.load(std::memory_order_acquire);
+        if(t >= b) {
+            return nullptr;
+        }
+        Task* task = buf[t & (s_dequeSize - 1)].load(std::memory_order_relaxed);
+        if(!top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst
+                                        ,std::memory_order_relaxed)) {
+            return nullptr;
+        }
+        return task;
+    }
+};
+
+TaskGroup::~TaskGroup() {
+    try {
+        wait();
+    } catch(...) {
+    }
+}
+
+void TaskGroup::run(std::function<void()> cb) {
+    m_count.fetch_add(1, std::memory_order_relaxed);
+    m_pool.push(new ThreadPool::Task([this, cb]() {
+        try {
+            cb();
+        } catch(...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if(!m_error) {
+                m_error = std::current_exception();
+            }
+        }
+        done();
+    }));
+}
+
+void TaskGroup::done() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if(m_count.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_cond.notify_all();
+    }
+}
+
+void TaskGroup::wait() {
+    int idle = 0;
+    while(m_count.load(std::memory_order_acquire)) {
+        if(m_pool.runOne()) {
+            idle = 0;
+            continue;
+        }
+        //剩下的任务正在别的线程执行, 它们派生的子任务仍可以窃取
+        if(++idle < 16) {
+            sched_yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait_for(lock, std::chrono::milliseconds(1), [this]() {
+            return m_count.load(std::memory_order_acquire) == 0;
+        });
+    }
+    std::exception_ptr error;
+    {
+        //完成方在锁内计数, 拿到锁后它已不再访问本对象
+        std::lock_guard<std::mutex> lock(m_mutex);
+        error = m_error;
+        m_error = nullptr;
+    }
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+ThreadPool::ThreadPool(size_t threads, const std::string& name, bool pin)
+    :m_name(name) {
+    std::vector<int> cpus = Thread::GetAvailableCpus();
+    if(!threads) {
+        threads = cpus.size();
+    }
+    if(pin) {
+        m_cpus = cpus;
+    }
+    for(size_t i = 0; i < threads; ++i) {
+        m_workers.push_back(std::unique_ptr<Worker>(new Worker));
+    }
+    for(size_t i = 0; i < threads; ++i) {
+        m_threads.push_back(Thread::ptr(new Thread(std::bind(&ThreadPool::run, this, i)
+                            ,m_name + "_" + std::to_string(i))));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+        ++m_epoch;
+    }
+    m_sleepCond.notify_all();
+    for(auto& i : m_threads) {
+        i->join();
+    }
+    //停止过程中从外部提交的任务
+    while(Task* task = take(-1)) {
+        runTask(task);
+    }
+}
+
+ThreadPool* ThreadPool::GetThis() {
+    return t_pool;
+}
+
+int ThreadPool::GetWorkerIndex() {
+    return t_index;
+}
+
+void ThreadPool::execute(std::function<void()> cb) {
+    push(new Task(std::move(cb)));
+}
+
+void ThreadPool::push(Task* task) {
+    if(t_pool != this || !m_workers[t_index]->push(task)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_global.push_back(task);
+        m_globalSize.fetch_add(1, std::memory_order_relaxed);
+    }
+    notify();
+}
+
+void ThreadPool::notify() {
+    //与run()中的m_sleeping.fetch_add配对: 要么这里看到有线程休眠, 要么它再次查找时看到任务
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(m_sleeping.load(std::memory_order_relaxed)) {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepMutex);
+            ++m_epoch;
+        }
+        m_sleepCond.notify_one();
+    }
+}
+
+ThreadPool::Task* ThreadPool::take(int self) {
+    if(self >= 0) {
+        if(Task* task = m_workers[self]->pop()) {
+            return task;
+        }
+    }
+    if(m_globalSize.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(!m_global.empty()) {
+            Task* task = m_global.front();
+            m_global.pop_front();
+            m_globalSize.fetch_sub(1, std::memory_order_relaxed);
+            m_injected.fetch_add(1, std::memory_order_relaxed);
+            return task;
+        }
+    }
+    size_t n = m_workers.size();
+    if(!t_rand) {
+        t_rand = (uint32_t)GetThreadId() * 2654435761u | 1;
+    }
+    t_rand ^= t_rand << 13;
+    t_rand ^= t_rand >> 17;
+    t_rand ^= t_rand << 5;
+    size_t start = t_rand % n;
+    for(size_t i = 0; i < n; ++i) {
+        size_t victim = (start + i) % n;
+        if((int)victim == self) {
+            continue;
+        }
+        if(Task* task = m_workers[victim]->steal()) {
+            if(self >= 0) {
+                Worker& w = *m_workers[self];
+                w.steals.store(w.steals.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            }
+            return task;
+        }
+    }
+    return nullptr;
+}
+
+void ThreadPool::runTask(Task* task) {
+    try {
+        (*task)();
+    } catch(std::exception& e) {
+        KONG_LOG_ERROR(g_logger) << "ThreadPool " << m_name << " task exception: " << e.what();
+    } catch(...) {
+        KONG_LOG_ERROR(g_logger) << "ThreadPool " << m_name << " task unknown exception";
+    }
+    delete task;
+}
+
+bool ThreadPool::runOne() {
+    int self = t_pool == this ? t_index : -1;
+    Task* task = take(self);
+    if(!task) {
+        return false;
+    }
+    runTask(task);
+    if(self >= 0) {
+        Worker& w = *m_workers[self];
+        w.tasks.store(w.tasks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void ThreadPool::run(size_t idx) {
+    t_pool = this;
+    t_index = idx;
+    if(!m_cpus.empty()) {
+        int cpu = m_cpus[idx % m_cpus.size()];
+        if(!Thread::SetAffinity(cpu)) {
+            KONG_LOG_WARN(g_logger) << "ThreadPool " << m_name << " worker " << idx
+                                    << " pin to cpu " << cpu << " fail";
+        }
+    }
+    Worker& w = *m_workers[idx];
+    int idle = 0;
+    while(true) {
+        if(runOne()) {
+            idle = 0;
+            continue;
+        }
+        if(m_stopping.load(std::memory_order_acquire)) {
+            break;
+        }
+        if(++idle < 16) {
+            sched_yield();
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        uint64_t epoch = m_epoch.load(std::memory_order_relaxed);
+        m_sleeping.fetch_add(1, std::memory_order_seq_cst);
+        lock.unlock();
+        Task* task = take(idx);
+        if(task) {
+            m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+            runTask(task);
+            w.tasks.store(w.tasks.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            idle = 0;
+            continue;
+        }
+        lock.lock();
+        while(m_epoch.load(std::memory_order_relaxed) == epoch && !m_stopping) {
+            w.sleeps.store(w.sleeps.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            m_sleepCond.wait(lock);
+        }
+        m_sleeping.fetch_sub(1, std::memory_order_relaxed);
+        idle = 0;
+    }
+    t_pool = nullptr;
+    t_index = -1;
+}
+
+size_t ThreadPool::autoGrain(size_t n) const {
+    size_t chunks = m_workers.size() * 8;
+    return std::max<size_t>(1, (n + chunks - 1) / chunks);
+}
+
+ThreadPoolStats ThreadPool::getStats() const {
+    ThreadPoolStats rt;
+    for(auto& i : m_workers) {
+        rt.tasks += i->tasks.load(std::memory_order_relaxed);
+        rt.steals += i->steals.load(std::memory_order_relaxed);
+        rt.sleeps += i->sleeps.load(std::memory_order_relaxed);
+    }
+    rt.injected = m_injected.load(std::memory_order_relaxed);
+    return rt;
+}
+
+TaskGraph::Node TaskGraph::add(std::function<void()> cb) {
+    m_nodes.push_back(NodeInfo());
+    m_nodes.back().cb = cb;
+    return m_nodes.size() - 1;
+}
+
+void TaskGraph::precede(Node before, Node after) {
+    m_nodes[before].successors.push_back(after);
+    ++m_nodes[after].indegree;
+}
+
+void TaskGraph::run(ThreadPool& pool) {
+    size_t n = m_nodes.size();
+    //拓扑排序检查环
+    std::vector<uint32_t> indegree(n);
+    std::vector<Node> ready;
+    for(size_t i = 0; i < n; ++i) {
+        indegree[i] = m_nodes[i].indegree;
+        if(!indegree[i]) {
+            ready.push_back(i);
+        }
+    }
+    size_t visited = 0;
+    for(size_t i = 0; i < ready.size(); ++i) {
+        ++visited;
+        for(auto s : m_nodes[ready[i]].successors) {
+            if(!--indegree[s]) {
+                ready.push_back(s);
+            }
+        }
+    }
+    if(visited != n) {
+        throw std::logic_error("TaskGraph has a cycle");
+    }
+
+    m_pending.reset(new std::atomic<uint32_t>[n]);
+    for(size_t i = 0; i < n; ++i) {
+        m_pending[i].store(m_nodes[i].indegree, std::memory_order_relaxed);
+    }
+    TaskGroup group(pool);
+    for(size_t i = 0; i < n; ++i) {
+        if(!m_nodes[i].indegree) {
+            schedule(group, i);
+        }
+    }
+    group.wait();
+}
+
+void TaskGraph::schedule(TaskGroup& group, Node node) {
+    group.run([this, &group, node]() {
+        NodeInfo& info = m_nodes[node];
+        info.cb();
+        for(auto s : info.successors) {
+            if(m_pending[s].fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                schedule(group, s);
+            }
+        }
+    });
+}
+
+}
@@ -0,0 +1,323 @@
+/**
+ * @file thread_pool.hpp
+ * @brief 工作窃取线程池: future、parallelFor/parallelReduce和任务依赖图
+ * @details 用于压缩日志段、建索引、解析大报文这类CPU密集的批处理, 不适合放在协程里做的工作
+ */
+#ifndef __KONG_THREAD_POOL_H__
+#define __KONG_THREAD_POOL_H__
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "thread.hpp"
+
+namespace kong {
+
+class ThreadPool;
+
+/**
+ * @brief 线程池统计
+ */
+struct ThreadPoolStats {
+    /// 执行的任务数
+    uint64_t tasks = 0;
+    /// 从其它线程队列窃取的任务数
+    uint64_t steals = 0;
+    /// 从全局队列取到的任务数
+    uint64_t injected = 0;
+    /// 进入休眠的次数
+    uint64_t sleeps = 0;
+};
+
+/**
+ * @brief 一组任务, wait()等待全部完成
+ * @details 等待时从线程池取任务执行(help while waiting), 在工作线程里嵌套并行不会死锁.
+ *          任务抛出的第一个异常在wait()中重新抛出
+ */
+class TaskGroup {
+public:
+    explicit TaskGroup(ThreadPool& pool)
+        :m_pool(pool) {
+    }
+
+    /**
+     * @brief 析构时等待未完成的任务, 不再抛出异常
+     */
+    ~TaskGroup();
+
+    /**
+     * @brief 提交任务, 在工作线程中调用时放入本线程的队列
+     */
+    void run(std::function<void()> cb);
+
+    /**
+     * @brief 等待所有任务完成
+     */
+    void wait();
+
+    ThreadPool& getPool() const { return m_pool;}
+private:
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    void done();
+private:
+    ThreadPool& m_pool;
+    /// 未完成的任务数, 在m_mutex内减少, wait()返回后完成方不再访问本对象
+    std::atomic<int64_t> m_count{0};
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::exception_ptr m_error;
+};
+
+/**
+ * @brief 工作窃取线程池
+ * @details 每个工作线程有一个Chase-Lev双端队列, 自己从底部存取, 其它线程从顶部窃取;
+ *          非工作线程提交的任务和本地队列满时的任务放入加锁的全局队列.
+ *          空闲线程先自旋窃取一会, 之后在条件变量上休眠
+ */
+class ThreadPool {
+friend class TaskGroup;
+public:
+    typedef std::shared_ptr<ThreadPool> ptr;
+
+    /**
+     * @brief 构造函数, 返回时工作线程已经启动
+     * @param[in] threads 工作线程数, 0表示可用的CPU数
+     * @param[in] name 线程名前缀, 工作线程名为name_序号
+     * @param[in] pin 是否把第i个工作线程绑定到第i个可用CPU
+     */
+    ThreadPool(size_t threads = 0, const std::string& name = "pool", bool pin = false);
+
+    /**
+     * @brief 执行完已提交的任务后停止工作线程
+     */
+    ~ThreadPool();
+
+    /**
+     * @brief 提交任务, 不关心结果. 任务抛出的异常记录日志后丢弃
+     */
+    void execute(std::function<void()> cb);
+
+    /**
+     * @brief 提交任务, 返回结果的future, 异常由future带回
+     */
+    template<class F, class... Args>
+    std::future<typename std::result_of<F(Args...)>::type> submit(F&& f, Args&&... args) {
+        typedef typename std::result_of<F(Args...)>::type R;
+        std::shared_ptr<std::packaged_task<R()> > task = std::make_shared<std::packaged_task<R()> >(
+                std::bind(std::forward<F>(f), std::forward<Args>(args)...));
+        std::future<R> rt = task->get_future();
+        execute([task]() { (*task)(); });
+        return rt;
+    }
+
+    /**
+     * @brief 等待future就绪, 等待期间执行线程池里的任务
+     */
+    template<class T>
+    T get(std::future<T>& f) {
+        while(f.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            if(!runOne()) {
+                f.wait_for(std::chrono::milliseconds(1));
+            }
+        }
+        return f.get();
+    }
+
+    /**
+     * @brief 对[begin, end)中每个i并行执行f(i)
+     * @param[in] grain 每个任务至少处理的元素数, 0表示按线程数自动切分
+     * @details 区间按二分递归切分, 一半留给自己, 一半放入队列供窃取, 负载不均时空闲线程会拿走大块
+     */
+    template<class F>
+    void parallelFor(size_t begin, size_t end, const F& f, size_t grain = 0);
+
+    /**
+     * @brief 把[begin, end)切成若干块, 每块map(b, e)得到部分结果, 再按块的顺序用reduce合并
+     * @details 合并顺序固定, 浮点求和等非结合的操作每次结果相同
+     */
+    template<class T, class Map, class Reduce>
+    T parallelReduce(size_t begin, size_t end, T identity, const Map& map, const Reduce& reduce, size_t grain = 0);
+
+    /**
+     * @brief 取一个任务在当前线程执行
+     * @return 没有任务时返回false
+     */
+    bool runOne();
+
+    size_t getThreads() const { return m_workers.size();}
+
+    const std::string& getName() const { return m_name;}
+
+    ThreadPoolStats getStats() const;
+
+    /**
+     * @brief 当前线程所属的线程池, 不是工作线程时返回nullptr
+     */
+    static ThreadPool* GetThis();
+
+    /**
+     * @brief 当前工作线程的序号, 不是工作线程时返回-1
+     */
+    static int GetWorkerIndex();
+private:
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    struct Worker;
+    typedef std::function<void()> Task;
+
+    /**
+     * @brief 工作线程放入自己的队列, 其它线程放入全局队列
+     */
+    void push(Task* task);
+
+    /**
+     * @brief 依次从自己的队列、全局队列、其它线程的队列取任务
+     */
+    Task* take(int self);
+    void runTask(Task* task);
+    void run(size_t idx);
+    void notify();
+
+    /**
+     * @brief 把粒度为0的区间切分成块, 每个线程约8块
+     */
+    size_t autoGrain(size_t n) const;
+private:
+    std::string m_name;
+    /// 工作线程绑定的CPU, 不绑定时为空
+    std::vector<int> m_cpus;
+    std::vector<std::unique_ptr<Worker> > m_workers;
+    std::vector<Thread::ptr> m_threads;
+
+    /// 全局队列
+    std::mutex m_mutex;
+    std::deque<Task*> m_global;
+    std::atomic<size_t> m_globalSize{0};
+
+    /// 休眠
+    std::mutex m_sleepMutex;
+    std::condition_variable m_sleepCond;
+    std::atomic<uint32_t> m_sleeping{0};
+    std::atomic<uint64_t> m_epoch{0};
+    std::atomic<bool> m_stopping{false};
+
+    /// 全局队列取到的任务数
+    std::atomic<uint64_t> m_injected{0};
+};
+
+/**
+ * @brief 任务依赖图(DAG)
+ * @details 节点在所有前驱完成后才提交到线程池, 前驱抛出异常时它的后继不再执行.
+ *          图可以反复run(), 每次重新计算依赖计数
+ *
+ *          kong::TaskGraph g;
+ *          auto a = g.add([]() { ... });
+ *          auto b = g.add([]() { ... });
+ *          auto c = g.add([]() { ... });
+ *          g.precede(a, c);
+ *          g.precede(b, c);
+ *          g.run(pool);
+ */
+class TaskGraph {
+public:
+    typedef size_t Node;
+
+    /**
+     * @brief 添加节点
+     */
+    Node add(std::function<void()> cb);
+
+    /**
+     * @brief before完成后才执行after
+     */
+    void precede(Node before, Node after);
+
+    /**
+     * @brief 执行整张图, 等待期间帮助执行线程池任务
+     * @exception 图中有环时抛出std::logic_error, 节点的异常在这里重新抛出
+     */
+    void run(ThreadPool& pool);
+
+    size_t size() const { return m_nodes.size();}
+private:
+    void schedule(TaskGroup& group, Node node);
+private:
+    struct NodeInfo {
+        std::function<void()> cb;
+        std::vector<Node> successors;
+        uint32_t indegree = 0;
+    };
+    std::vector<NodeInfo> m_nodes;
+    /// 本次执行中各节点未完成的前驱数
+    std::unique_ptr<std::atomic<uint32_t>[]> m_pending;
+};
+
+namespace detail {
+
+template<class F>
+void ParallelRange(TaskGroup& group, size_t begin, size_t end, size_t grain, const F& f) {
+    while(end - begin > grain) {
+        size_t mid = begin + (end - begin) / 2;
+        group.run([&group, mid, end, grain, &f]() {
+            ParallelRange(group, mid, end, grain, f);
+        });
+        end = mid;
+    }
+    for(size_t i = begin; i < end; ++i) {
+        f(i);
+    }
+}
+
+}
+
+template<class F>
+void ThreadPool::parallelFor(size_t begin, size_t end, const F& f, size_t grain) {
+    if(begin >= end) {
+        return;
+    }
+    if(!grain) {
+        grain = autoGrain(end - begin);
+    }
+    TaskGroup group(*this);
+    detail::ParallelRange(group, begin, end, grain, f);
+    group.wait();
+}
+
+template<class T, class Map, class Reduce>
+T ThreadPool::parallelReduce(size_t begin, size_t end, T identity, const Map& map, const Reduce& reduce, size_t grain) {
+    if(begin >= end) {
+        return identity;
+    }
+    if(!grain) {
+        grain = autoGrain(end - begin);
+    }
+    size_t chunks = (end - begin + grain - 1) / grain;
+    std::vector<T> parts(chunks, identity);
+    parallelFor(0, chunks, [&](size_t i) {
+        size_t b = begin + i * grain;
+        size_t e = std::min(end, b + grain);
+        parts[i] = map(b, e);
+    }, 1);
+    T rt = identity;
+    for(auto& i : parts) {
+        rt = reduce(rt, i);
+    }
+    return rt;
+}
+
+}
+
+#endif
@@ -1,5 +1,17 @@
 #include "util.hpp"
+#include <cxxabi.h>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
 #include <string>
+#include <sstream>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unwind.h>
 
 
 namespace kong {
@@ -14,5 +26,254 @@ uint32_t GetFiberId()
     return 0;
 }
 
+std::string Time2Str(time_t ts, const std::string& format) {
+    struct tm tm;
+    localtime_r(&ts, &tm);
+    char buf[64];
+    size_t n = strftime(buf, sizeof(buf), format.c_str(), &tm);
+    return std::string(buf, n);
+}
+
+namespace {
+
+struct UnwindState {
+    uintptr_t* pcs;
+    int n;
+    int max;
+    int skip;
+};
+
+_Unwind_Reason_Code UnwindFrame(struct _Unwind_Context* ctx, void* arg) {
+    UnwindState* st = (UnwindState*)arg;
+    if(st->n >= st->max) {
+        return _URC_END_OF_STACK;
+    }
+    uintptr_t pc = _Unwind_GetIP(ctx);
+    if(pc == 0) {
+        return _URC_END_OF_STACK;
+    }
+    if(st->skip > 0) {
+        --st->skip;
+    } else {
+        st->pcs[st->n++] = pc;
+    }
+    return _URC_NO_REASON;
+}
+
+}
+
+int Backtrace(uintptr_t* pcs, int max, int skip) {
+    //跳过Backtrace自身
+    UnwindState st = {pcs, 0, max, skip + 1};
+    _Unwind_Backtrace(&UnwindFrame, &st);
+    return st.n;
+}
+
+std::string Symbolize(uintptr_t pc) {
+    Dl_info info;
+    memset(&info, 0, sizeof(info));
+    std::stringstream ss;
+    if(!dladdr((void*)pc, &info)) {
+        ss << "0x" << std::hex << pc;
+        return ss.str();
+    }
+    if(info.dli_sname) {
+        int status = 0;
+        char* name = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+        std::string rt = (status == 0 && name) ? name : info.dli_sname;
+        free(name);
+        return rt;
+    }
+    std::string module = info.dli_fname ? info.dli_fname : "?";
+    size_t pos = module.rfind('/');
+    if(pos != std::string::npos) {
+        module = module.substr(pos + 1);
+    }
+    ss << module << "+0x" << std::hex << (pc - (uintptr_t)info.dli_fbase);
+    return ss.str();
+}
+
+void FSUtil::ListAllFile(std::vector<std::string>& files
+                        ,const std::string& path
+                        ,const std::string& subfix) {
+    DIR* dir = opendir(path.c_str());
+    if(dir == nullptr) {
+        return;
+    }
+    struct dirent* dp = nullptr;
+    while((dp = readdir(dir)) != nullptr) {
+        if(!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")) {
+            continue;
+        }
+        std::string file = path + "/" + dp->d_name;
+        struct stat st;
+        if(lstat(file.c_str(), &st)) {
+            continue;
+        }
+        if(S_ISDIR(st.st_mode)) {
+            ListAllFile(files, file, subfix);
+        } else if(S_ISREG(st.st_mode)) {
+            if(subfix.empty() || (file.size() >= subfix.size()
+                    && file.compare(file.size() - subfix.size(), subfix.size(), subfix) == 0)) {
+                files.push_back(file);
+            }
+        }
+    }
+    closedir(dir);
+}
+
+static int __lstat(const char* file, struct stat* st = nullptr) {
+    struct stat lst;
+    int ret = lstat(file, &lst);
+    if(st) {
+        *st = lst;
+    }
+    return ret;
+}
+
+static int __mkdir(const char* dirname) {
+    if(access(dirname, F_OK) == 0) {
+        return 0;
+    }
+    return mkdir(dirname, S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+}
+
+bool FSUtil::Mkdir(const std::string& dirname) {
+    if(__lstat(dirname.c_str()) == 0) {
+        return true;
+    }
+    std::string path = dirname;
+    for(size_t pos = path.find('/', 1); pos != std::string::npos; pos = path.find('/', pos + 1)) {
+        path[pos] = '\0';
+        int rt = __mkdir(path.c_str());
+        path[pos] = '/';
+        if(rt != 0) {
+            return false;
+        }
+    }
+    return __mkdir(path.c_str()) == 0;
+}
+
+bool FSUtil::IsRunningPidfile(const std::string& pidfile) {
+    //不看记录的pid: 进程崩溃后pid可能被别的进程复用, 而flock随持有进程退出释放
+    int fd = open(pidfile.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        return false;
+    }
+    bool running = false;
+    if(flock(fd, LOCK_SH | LOCK_NB)) {
+        running = errno == EWOULDBLOCK;
+    } else {
+        flock(fd, LOCK_UN);
+    }
+    close(fd);
+    return running;
+}
+
+bool FSUtil::Rm(const std::string& path) {
+    struct stat st;
+    if(lstat(path.c_str(), &st)) {
+        return true;
+    }
+    if(!S_ISDIR(st.st_mode)) {
+        return Unlink(path);
+    }
+
+    DIR* dir = opendir(path.c_str());
+    if(!dir) {
+        return false;
+    }
+    bool ret = true;
+    struct dirent* dp = nullptr;
+    while((dp = readdir(dir))) {
+        if(!strcmp(dp->d_name, ".") || !strcmp(dp->d_name, "..")) {
+            continue;
+        }
+        ret = Rm(path + "/" + dp->d_name) && ret;
+    }
+    closedir(dir);
+    if(rmdir(path.c_str())) {
+        ret = false;
+    }
+    return ret;
+}
+
+bool FSUtil::Mv(const std::string& from, const std::string& to) {
+    if(!Rm(to)) {
+        return false;
+    }
+    return rename(from.c_str(), to.c_str()) == 0;
+}
+
+bool FSUtil::Realpath(const std::string& path, std::string& rpath) {
+    if(__lstat(path.c_str())) {
+        return false;
+    }
+    char* ptr = ::realpath(path.c_str(), nullptr);
+    if(nullptr == ptr) {
+        return false;
+    }
+    std::string(ptr).swap(rpath);
+    free(ptr);
+    return true;
+}
+
+bool FSUtil::Symlink(const std::string& from, const std::string& to) {
+    if(!Rm(to)) {
+        return false;
+    }
+    return ::symlink(from.c_str(), to.c_str()) == 0;
+}
+
+bool FSUtil::Unlink(const std::string& filename, bool exist) {
+    if(!exist && __lstat(filename.c_str())) {
+        return true;
+    }
+    return ::unlink(filename.c_str()) == 0;
+}
+
+std::string FSUtil::Dirname(const std::string& filename) {
+    if(filename.empty()) {
+        return ".";
+    }
+    auto pos = filename.rfind('/');
+    if(pos == 0) {
+        return "/";
+    } else if(pos == std::string::npos) {
+        return ".";
+    } else {
+        return filename.substr(0, pos);
+    }
+}
+
+std::string FSUtil::Basename(const std::string& filename) {
+    if(filename.empty()) {
+        return filename;
+    }
+    auto pos = filename.rfind('/');
+    if(pos == std::string::npos) {
+        return filename;
+    } else {
+        return filename.substr(pos + 1);
+    }
+}
+
+bool FSUtil::OpenForRead(std::ifstream& ifs, const std::string& filename
+                        ,std::ios_base::openmode mode) {
+    ifs.open(filename.c_str(), mode);
+    return ifs.is_open();
+}
+
+bool FSUtil::OpenForWrite(std::ofstream& ofs, const std::string& filename
+                        ,std::ios_base::openmode mode) {
+    ofs.open(filename.c_str(), mode);
+    if(!ofs.is_open()) {
+        std::string dir = Dirname(filename);
+        Mkdir(dir);
+        ofs.open(filename.c_str(), mode);
+    }
+    return ofs.is_open();
+}
+
 
 } // namespace kong
\ No newline at end of file
@@ -8,6 +8,7 @@
 #include <cstdint>
 #include <pthread.h>
 #include <string>
+#include <time.h>
 #include <fstream>
 #include <vector>
 
@@ -18,26 +19,75 @@ pid_t GetThreadId();
 
 uint32_t GetFiberId();
 
-// class FSUtil {
-// public:
-
-//     static void ListAllFile(std::vector<std::string>& files
-//                             ,const std::string& path
-//                             ,const std::string& subfix);
-//     static bool Mkdir(const std::string& dirname);
-//     static bool IsRunningPidfile(const std::string& pidfile);
-//     static bool Rm(const std::string& path);
-//     static bool Mv(const std::string& from, const std::string& to);
-//     static bool Realpath(const std::string& path, std::string& rpath);
-//     static bool Symlink(const std::string& frm, const std::string& to);
-//     static bool Unlink(const std::string& filename, bool exist = false);
-//     static std::string Dirname(const std::string& filename);
-//     static std::string Basename(const std::string& filename);
-//     static bool OpenForRead(std::ifstream& ifs, const std::string& filename
-//                     ,std::ios_base::openmode mode);
-//     static bool OpenForWrite(std::ofstream& ofs, const std::string& filename
-//                     ,std::ios_base::openmode mode);
-// };
+/**
+ * @brief 把时间戳(秒)格式化为本地时间字符串
+ */
+std::string Time2Str(time_t ts = time(0), const std::string& format = "%Y-%m-%d %H:%M:%S");
+
+/**
+ * @brief 用_Unwind_Backtrace取当前调用栈的返回地址(最内层在前)
+ * @param[out] pcs 地址数组
+ * @param[in] max 最多取的帧数
+ * @param[in] skip 跳过最内层的帧数(不含本函数)
+ * @return 取到的帧数
+ * @details 不分配内存, 首次调用前libgcc要加载unwind信息, 在信号处理函数中使用前应先调用一次
+ */
+int Backtrace(uintptr_t* pcs, int max, int skip = 0);
+
+/**
+ * @brief 把代码地址解析为符号名
+ * @details 用dladdr只能解析动态符号表中的名字, 可执行文件需要用-rdynamic链接;
+ *          解析不到时返回"模块+0x偏移", 可以离线用addr2line解析
+ */
+std::string Symbolize(uintptr_t pc);
+
+/**
+ * @brief 文件系统工具
+ */
+class FSUtil {
+public:
+    /**
+     * @brief 递归列出path下以subfix结尾的文件
+     */
+    static void ListAllFile(std::vector<std::string>& files
+                            ,const std::string& path
+                            ,const std::string& subfix);
+
+    /**
+     * @brief 递归创建目录, 已存在时返回true
+     */
+    static bool Mkdir(const std::string& dirname);
+
+    /**
+     * @brief pid文件是否被运行中的进程持有, 即是否有进程对它持有Pidfile::Write加的flock
+     * @details 检查时短暂加共享锁, 与同时进行的Pidfile::Write冲突时由Write重试
+     */
+    static bool IsRunningPidfile(const std::string& pidfile);
+
+    /**
+     * @brief 递归删除文件或目录, 不存在时返回true
+     */
+    static bool Rm(const std::string& path);
+    static bool Mv(const std::string& from, const std::string& to);
+    static bool Realpath(const std::string& path, std::string& rpath);
+    static bool Symlink(const std::string& frm, const std::string& to);
+
+    /**
+     * @brief 删除文件
+     * @param[in] exist 为false时文件不存在也返回true
+     */
+    static bool Unlink(const std::string& filename, bool exist = false);
+    static std::string Dirname(const std::string& filename);
+    static std::string Basename(const std::string& filename);
+    static bool OpenForRead(std::ifstream& ifs, const std::string& filename
+                    ,std::ios_base::openmode mode);
+
+    /**
+     * @brief 打开文件写, 所在目录不存在时先创建
+     */
+    static bool OpenForWrite(std::ofstream& ofs, const std::string& filename
+                    ,std::ios_base::openmode mode);
+};
 
 
 
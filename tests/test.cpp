@@ -25,5 +25,19 @@ int main(int argc, char** argv) {
 
     auto l = kong::LoggerMgr::GetInstance()->getLogger("xx");
     KONG_LOG_INFO(l) << "xxx";
+
+    kong::Logger::ptr slog(new kong::Logger("structured"));
+    kong::LogAppender::ptr json_appender(new kong::StdoutLogAppender);
+    json_appender->setFormatter(kong::LogFormatter::ptr(new kong::StructuredLogFormatter));
+    slog->addAppender(json_appender);
+    kong::LogAppender::ptr logfmt_appender(new kong::StdoutLogAppender);
+    logfmt_appender->setFormatter(kong::LogFormatter::ptr(
+                new kong::StructuredLogFormatter(kong::StructuredLogFormatter::LOGFMT)));
+    slog->addAppender(logfmt_appender);
+    KONG_LOG_INFO(slog).kv("user", 42).kv("ratio", 0.1).kv("ok", true)
+        .kv("path", "/a b\"c\n") << "login \"quoted\"";
+
+    KONG_LOG_FORMAT_INFO(l, "user={} cost={:.3f}ms ratio={} hex={:#x} name={:>8}|{{}}", 42, 1.5, 0.1, 255, "kong");
+    KONG_LOG_FMT_INFO(l, "printf drop-in %s %d %5.2f", 7, "not-an-int", 3.14159);
     return 0;
 }
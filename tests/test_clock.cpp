@@ -0,0 +1,70 @@
+#include "utils/clock.hpp"
+#include "log/log.hpp"
+#include "test_util.hpp"
+#include <iostream>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+int main(int argc, char** argv) {
+    std::cout << "tsc=" << kong::Clock::IsTscEnabled()
+              << " hz=" << kong::Clock::TscHz() << std::endl;
+
+    const int n = 10000000;
+    uint64_t sum = 0;
+    uint64_t b = MonoNs();
+    for(int i = 0; i < n; ++i) {
+        sum += kong::Clock::NowNs();
+    }
+    uint64_t e = MonoNs();
+    std::cout << "Clock::NowNs " << (double)(e - b) / n << " ns/call" << std::endl;
+
+    b = MonoNs();
+    for(int i = 0; i < n; ++i) {
+        sum += MonoNs();
+    }
+    e = MonoNs();
+    std::cout << "clock_gettime " << (double)(e - b) / n << " ns/call" << std::endl;
+
+    //NowNs必须落在前后两次clock_gettime之间, 允许校准误差
+    const int64_t tolerance = 200000;
+    uint64_t last = 0;
+    for(int i = 0; i < 30; ++i) {
+        uint64_t m0 = MonoNs();
+        uint64_t c = kong::Clock::NowNs();
+        uint64_t m1 = MonoNs();
+        if(c < last) {
+            std::cout << "clock went backwards" << std::endl;
+            return 1;
+        }
+        last = c;
+        int64_t drift = (int64_t)(c - m0);
+        if(drift < -tolerance || drift > (int64_t)(m1 - m0) + tolerance) {
+            std::cout << "drift " << drift << " ns outside window " << (m1 - m0)
+                      << " ns +- " << tolerance << " ns" << std::endl;
+            return 1;
+        }
+        if(i % 10 == 0) {
+            std::cout << "drift " << drift << " ns (window " << (m1 - m0) << " ns)" << std::endl;
+        }
+        usleep(100 * 1000);
+    }
+
+    //%r为进程启动到事件发生的毫秒数
+    kong::Logger::ptr logger(new kong::Logger);
+    kong::LogFormatter::ptr fmt(new kong::LogFormatter("%r"));
+    uint64_t before = kong::Clock::ElapsedMs(kong::Clock::NowNs());
+    kong::LogEvent::ptr event(new kong::LogEvent(logger, kong::LogLevel::INFO, __FILE__, __LINE__
+                , 0, 0, kong::Clock::NowNs(), "main"));
+    uint64_t after = kong::Clock::ElapsedMs(kong::Clock::NowNs());
+    std::string r = fmt->format(logger, kong::LogLevel::INFO, event);
+    uint64_t ms = strtoull(r.c_str(), nullptr, 10);
+    std::cout << "%r = " << r << " ms, sum=" << (sum & 0xF) << std::endl;
+    //上面睡了约3秒
+    if(r.empty() || r.find_first_not_of("0123456789") != std::string::npos
+            || ms < before || ms > after || ms < 3000) {
+        std::cout << "%r out of range [" << before << ", " << after << "]" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,123 @@
+#include "log/compressed_log.hpp"
+#include "utils/lz4.hpp"
+#include <iostream>
+#include <fcntl.h>
+#include <random>
+#include <time.h>
+#include <unistd.h>
+
+static bool RoundTrip(const std::string& src) {
+    std::string c(kong::Lz4::CompressBound(src.size()), 0);
+    size_t n = kong::Lz4::Compress(src.data(), src.size(), &c[0], c.size());
+    std::string d(src.size(), 0);
+    int64_t m = kong::Lz4::Decompress(c.data(), n, &d[0], d.size());
+    return n > 0 && m == (int64_t)src.size() && d == src;
+}
+
+int main(int argc, char** argv) {
+    //编解码
+    std::mt19937 rng(1);
+    for(int i = 0; i < 2000; ++i) {
+        std::string s(rng() % 5000, 0);
+        int alphabet = 1 + rng() % 255;
+        for(auto& c : s) {
+            c = (char)(rng() % alphabet);
+        }
+        if(!RoundTrip(s)) {
+            std::cout << "lz4 round trip failed, size=" << s.size() << std::endl;
+            return 1;
+        }
+    }
+
+    const char* path = "/tmp/kong_test_compressed.log";
+    unlink(path);
+    const int n = 200000;
+    std::string expect;
+    uint64_t raw = 0, file = 0;
+    {
+        kong::Logger::ptr logger(new kong::Logger("compress"));
+        kong::CompressedFileLogAppender::ptr appender(new kong::CompressedFileLogAppender(path, 256 * 1024));
+        logger->addAppender(appender);
+        for(int i = 0; i < n; ++i) {
+            kong::LogEvent::ptr event(new kong::LogEvent(logger, kong::LogLevel::INFO, __FILE__, __LINE__
+                        ,kong::GetThreadId(), 0, kong::Clock::NowNs(), "main"));
+            event->getSS() << "request " << i << " user=" << (i * 7919 % 1000) << " cost=" << (i % 97) << "ms";
+            expect.append(logger->getFormatter()->format(logger, kong::LogLevel::INFO, event));
+            logger->log(kong::LogLevel::INFO, event);
+        }
+        appender->flush();
+        raw = appender->getRawBytes();
+        file = appender->getFileBytes();
+    }
+    std::cout << "raw " << raw << " file " << file << " ratio " << (double)raw / file << std::endl;
+
+    kong::CompressedLogReader reader(path);
+    kong::CompressedBlockHeader hdr;
+    std::string out;
+    while(reader.next(hdr)) {
+        if(!reader.read(hdr, out)) {
+            std::cout << "read block failed" << std::endl;
+            return 1;
+        }
+    }
+    if(out != expect) {
+        std::cout << "content mismatch " << out.size() << " vs " << expect.size() << std::endl;
+        return 1;
+    }
+
+    //从任意偏移找到下一个块
+    kong::CompressedLogReader reader2(path);
+    if(!reader2.sync(file / 2) || !reader2.next(hdr) || hdr.firstNs == 0) {
+        std::cout << "sync failed" << std::endl;
+        return 1;
+    }
+
+    //块数据中间损坏一个字节, 块头仍有效, 读取时由数据校验和发现
+    {
+        kong::CompressedLogReader r(path);
+        if(!r.next(hdr)) {
+            std::cout << "no block" << std::endl;
+            return 1;
+        }
+        int fd = open(path, O_RDWR);
+        char c;
+        off_t pos = sizeof(hdr) + hdr.compressedSize / 2;
+        pread(fd, &c, 1, pos);
+        c ^= 0x5a;
+        pwrite(fd, &c, 1, pos);
+        close(fd);
+        std::string block;
+        if(r.read(hdr, block)) {
+            std::cout << "corrupt block data not detected" << std::endl;
+            return 1;
+        }
+        //后面的块不受影响
+        if(!r.next(hdr) || !r.read(hdr, block)) {
+            std::cout << "block after corrupt one unreadable" << std::endl;
+            return 1;
+        }
+    }
+
+    //flush_ms为0: 没写满的块只在flush()时写盘, 等待期间后台线程不占CPU
+    unlink(path);
+    {
+        kong::Logger::ptr logger(new kong::Logger("compress"));
+        kong::CompressedFileLogAppender::ptr appender(new kong::CompressedFileLogAppender(path, 256 * 1024, 0));
+        logger->addAppender(appender);
+        KONG_LOG_INFO(logger) << "held until flush";
+        clock_t cpu = clock();
+        usleep(200 * 1000);
+        double cpu_ms = (double)(clock() - cpu) * 1000 / CLOCKS_PER_SEC;
+        if(appender->getFileBytes() != 0 || cpu_ms > 50) {
+            std::cout << "flush_ms=0 wrote " << appender->getFileBytes() << " bytes, cpu "
+                      << cpu_ms << " ms while idle" << std::endl;
+            return 1;
+        }
+        appender->flush();
+        if(appender->getFileBytes() == 0) {
+            std::cout << "flush_ms=0 flush wrote nothing" << std::endl;
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,458 @@
+#include "concurrent/concurrent.hpp"
+#include "utils/thread.hpp"
+#include "test_util.hpp"
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+//ThreadSanitizer下只跑压力测试, 并减少次数
+#if defined(__SANITIZE_THREAD__)
+static const bool s_tsan = true;
+#else
+static const bool s_tsan = false;
+#endif
+
+using namespace kong::concurrent;
+
+/**
+ * @brief 启动n个线程执行cb(序号)并等待结束
+ */
+static void RunThreads(int n, const std::string& name, const std::function<void(int)>& cb) {
+    std::vector<kong::Thread::ptr> threads;
+    for(int i = 0; i < n; ++i) {
+        threads.push_back(kong::Thread::ptr(new kong::Thread(std::bind(cb, i), name + "_" + std::to_string(i))));
+    }
+    for(auto& i : threads) {
+        i->join();
+    }
+}
+
+/// 对照组: 互斥锁加std::queue
+template<class T>
+class MutexQueue {
+public:
+    bool push(T&& v) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push(std::move(v));
+        return true;
+    }
+
+    bool pop(T& v) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if(m_queue.empty()) {
+            return false;
+        }
+        v = std::move(m_queue.front());
+        m_queue.pop();
+        return true;
+    }
+private:
+    std::mutex m_mutex;
+    std::queue<T> m_queue;
+};
+
+/**
+ * @brief producers个线程各写n个值(生产者<<32 | 序号), consumers个线程读出
+ * @return 每个消费者看到的同一生产者的序号都递增, 且全部值恰好读出一次时返回true
+ */
+template<class Q>
+static bool Transfer(Q& queue, int producers, int consumers, uint64_t n, uint64_t* ns = nullptr) {
+    std::atomic<uint64_t> consumed{0};
+    std::atomic<uint64_t> sum{0};
+    std::atomic<bool> ordered{true};
+    uint64_t total = n * producers;
+    uint64_t b = MonoNs();
+    RunThreads(producers + consumers, "transfer", [&](int idx) {
+        if(idx < producers) {
+            for(uint64_t i = 0; i < n; ++i) {
+                uint64_t v = ((uint64_t)idx << 32) | i;
+                while(!queue.push(std::move(v))) {
+                    sched_yield();
+                }
+            }
+            return;
+        }
+        std::vector<int64_t> last(producers, -1);
+        uint64_t local = 0;
+        uint64_t v;
+        while(consumed.load(std::memory_order_relaxed) < total) {
+            if(!queue.pop(v)) {
+                sched_yield();
+                continue;
+            }
+            consumed.fetch_add(1, std::memory_order_relaxed);
+            int p = v >> 32;
+            int64_t seq = v & 0xffffffff;
+            if(seq <= last[p]) {
+                ordered = false;
+            }
+            last[p] = seq;
+            local += seq;
+        }
+        sum += local;
+    });
+    if(ns) {
+        *ns = MonoNs() - b;
+    }
+    return ordered && consumed == total && sum == producers * (n * (n - 1) / 2);
+}
+
+static bool TestQueues() {
+    uint64_t n = s_tsan ? 20000 : 200000;
+    {
+        MpmcQueue<uint64_t> queue(1024);
+        CHECK(queue.capacity() == 1024);
+        CHECK(Transfer(queue, 4, 4, n));
+        CHECK(queue.empty());
+    }
+    {
+        //容量很小时频繁满/空
+        MpmcQueue<uint64_t> queue(2);
+        CHECK(Transfer(queue, 2, 3, n / 10));
+    }
+    {
+        SpscQueue<uint64_t> queue(1024);
+        CHECK(Transfer(queue, 1, 1, n));
+    }
+    return true;
+}
+
+struct Job : public MpscNode {
+    int producer = 0;
+    int seq = 0;
+};
+
+static bool TestMpsc() {
+    const int producers = 4;
+    const int n = s_tsan ? 20000 : 200000;
+    std::vector<std::vector<Job> > jobs(producers);
+    for(auto& i : jobs) {
+        std::vector<Job>(n).swap(i);
+    }
+    MpscQueue<Job> queue;
+    CHECK(queue.empty() && !queue.pop());
+    std::vector<int> last(producers, -1);
+    int received = 0;
+    bool ordered = true;
+    RunThreads(producers + 1, "mpsc", [&](int idx) {
+        if(idx < producers) {
+            for(int i = 0; i < n; ++i) {
+                jobs[idx][i].producer = idx;
+                jobs[idx][i].seq = i;
+                queue.push(&jobs[idx][i]);
+            }
+            return;
+        }
+        while(received < producers * n) {
+            Job* j = queue.pop();
+            if(!j) {
+                sched_yield();
+                continue;
+            }
+            ordered = ordered && j->seq == last[j->producer] + 1;
+            last[j->producer] = j->seq;
+            ++received;
+        }
+    });
+    CHECK(ordered && received == producers * n);
+    CHECK(queue.empty() && !queue.pop());
+    //节点出队后可以再次入队
+    queue.push(&jobs[0][0]);
+    CHECK(queue.pop() == &jobs[0][0] && !queue.pop());
+    return true;
+}
+
+static const uint32_t ALIVE = 0x11223344;
+static const uint32_t DEAD = 0xdeadbeef;
+static std::atomic<uint64_t> s_created{0};
+static std::atomic<uint64_t> s_destroyed{0};
+
+struct Tracked {
+    Tracked(uint64_t v)
+        :magic(ALIVE), value(v) {
+        ++s_created;
+    }
+    ~Tracked() {
+        magic = DEAD;
+        ++s_destroyed;
+    }
+    volatile uint32_t magic;
+    uint64_t value;
+};
+
+/**
+ * @brief 写者不断替换共享指针并退休旧对象, 读者在作用域内检查对象未被释放
+ */
+static bool TestEpoch() {
+    std::atomic<Tracked*> shared{new Tracked(0)};
+    std::atomic<bool> stop{false};
+    std::atomic<bool> ok{true};
+    const int readers = 3;
+    const uint64_t updates = s_tsan ? 20000 : 200000;
+    RunThreads(readers + 1, "epoch", [&](int idx) {
+        if(idx == readers) {
+            for(uint64_t i = 1; i <= updates; ++i) {
+                Tracked* old = shared.exchange(new Tracked(i), std::memory_order_acq_rel);
+                Epoch::Retire(old);
+            }
+            Epoch::Synchronize();
+            stop = true;
+            return;
+        }
+        uint64_t last = 0;
+        while(!stop) {
+            Epoch::Guard guard;
+            Tracked* t = shared.load(std::memory_order_acquire);
+            for(int i = 0; i < 10; ++i) {
+                if(t->magic != ALIVE) {
+                    ok = false;
+                }
+            }
+            if(t->value < last) {
+                ok = false;
+            }
+            last = t->value;
+            {
+                //嵌套作用域
+                Epoch::Guard inner;
+            }
+        }
+    });
+    CHECK(ok);
+    //写者线程退出前已全部回收
+    CHECK(s_destroyed == updates);
+    delete shared.load();
+    //线程退出时留下的待释放节点由其它线程回收
+    RunThreads(1, "epoch_orphan", [](int) {
+        Epoch::Retire(new Tracked(0));
+    });
+    uint64_t b = MonoNs();
+    while(s_destroyed != s_created && MonoNs() - b < 1000000000ULL) {
+        Epoch::Collect();
+    }
+    CHECK(s_destroyed == s_created);
+    std::cout << "epoch=" << Epoch::GetEpoch() << std::endl;
+    return true;
+}
+
+struct Entry {
+    uint64_t key;
+    uint64_t version;
+};
+
+/**
+ * @brief 每个写者独占一部分key, 读者校验值与key对应; 从很小的表开始, 过程中多次扩容
+ */
+static bool TestHashMap() {
+    ConcurrentHashMap<uint64_t, Entry> map(4, 4);
+    const int writers = 2;
+    const int readers = 2;
+    const uint64_t keys = 4096;
+    const int ops = s_tsan ? 20000 : 200000;
+    std::vector<std::set<uint64_t> > present(writers);
+    std::atomic<int> done{0};
+    std::atomic<bool> ok{true};
+    RunThreads(writers + readers, "hashmap", [&](int idx) {
+        if(idx < writers) {
+            uint32_t seed = idx + 1;
+            for(int i = 0; i < ops; ++i) {
+                seed = seed * 1103515245 + 12345;
+                uint64_t key = ((seed >> 8) % (keys / writers)) * writers + idx;
+                int op = (seed >> 4) % 4;
+                if(op == 0) {
+                    bool erased = map.erase(key);
+                    if(erased != (present[idx].erase(key) == 1)) {
+                        ok = false;
+                    }
+                } else if(op == 1) {
+                    bool inserted = map.insert(key, Entry{key, (uint64_t)i});
+                    if(inserted != present[idx].insert(key).second) {
+                        ok = false;
+                    }
+                } else {
+                    map.assign(key, Entry{key, (uint64_t)i});
+                    present[idx].insert(key);
+                }
+            }
+            ++done;
+            return;
+        }
+        uint64_t hits = 0;
+        while(done < writers) {
+            for(uint64_t key = 0; key < keys; key += 7) {
+                Entry e;
+                if(map.find(key, e)) {
+                    ++hits;
+                    if(e.key != key) {
+                        ok = false;
+                    }
+                }
+            }
+        }
+        (void)hits;
+    });
+    CHECK(ok);
+    size_t expect = 0;
+    for(auto& i : present) {
+        expect += i.size();
+        for(auto k : i) {
+            CHECK(map.contains(k));
+        }
+    }
+    CHECK(map.size() == expect);
+    size_t visited = 0;
+    map.forEach([&visited](const uint64_t& k, const Entry& e) {
+        visited += k == e.key;
+    });
+    CHECK(visited == expect);
+    CHECK(map.bucketCount() * 2 >= expect);
+    std::cout << "hash map: " << expect << " keys, " << map.bucketCount() << " buckets" << std::endl;
+    return true;
+}
+
+/**
+ * @brief 各队列与互斥锁加std::queue的吞吐对比
+ */
+static bool BenchQueues() {
+    const uint64_t n = 1000000;
+    for(auto pc : std::vector<std::pair<int, int> >{{1, 1}, {2, 2}, {4, 4}}) {
+        uint64_t lf = 0;
+        uint64_t mq = 0;
+        {
+            MpmcQueue<uint64_t> queue(4096);
+            CHECK(Transfer(queue, pc.first, pc.second, n / pc.first, &lf));
+        }
+        {
+            MutexQueue<uint64_t> queue;
+            CHECK(Transfer(queue, pc.first, pc.second, n / pc.first, &mq));
+        }
+        std::cout << "mpmc " << pc.first << "P" << pc.second << "C: "
+                  << n * 1000.0 / lf << " Mops/s, mutex+std::queue "
+                  << n * 1000.0 / mq << " Mops/s" << std::endl;
+    }
+    {
+        uint64_t lf = 0;
+        uint64_t mq = 0;
+        SpscQueue<uint64_t> queue(4096);
+        CHECK(Transfer(queue, 1, 1, n, &lf));
+        MutexQueue<uint64_t> mqueue;
+        CHECK(Transfer(mqueue, 1, 1, n, &mq));
+        std::cout << "spsc 1P1C: " << n * 1000.0 / lf << " Mops/s, mutex+std::queue "
+                  << n * 1000.0 / mq << " Mops/s" << std::endl;
+    }
+    {
+        const int producers = 4;
+        std::vector<std::vector<Job> > jobs(producers);
+        for(auto& i : jobs) {
+            std::vector<Job>(n / producers).swap(i);
+        }
+        MpscQueue<Job> queue;
+        MutexQueue<Job*> mqueue;
+        uint64_t times[2];
+        for(int round = 0; round < 2; ++round) {
+            uint64_t b = MonoNs();
+            uint64_t received = 0;
+            RunThreads(producers + 1, "bench_mpsc", [&](int idx) {
+                if(idx < producers) {
+                    for(auto& j : jobs[idx]) {
+                        if(round == 0) {
+                            queue.push(&j);
+                        } else {
+                            Job* p = &j;
+                            mqueue.push(std::move(p));
+                        }
+                    }
+                    return;
+                }
+                Job* j;
+                while(received < n) {
+                    if(round == 0 ? (j = queue.pop()) != nullptr : mqueue.pop(j)) {
+                        ++received;
+                    } else {
+                        sched_yield();
+                    }
+                }
+            });
+            times[round] = MonoNs() - b;
+        }
+        std::cout << "mpsc 4P1C: " << n * 1000.0 / times[0] << " Mops/s, mutex+std::queue "
+                  << n * 1000.0 / times[1] << " Mops/s" << std::endl;
+    }
+    return true;
+}
+
+/**
+ * @brief 读多写少(每100次操作1次写)的哈希表吞吐, 对照组为互斥锁/读写锁加std::unordered_map
+ */
+static bool BenchHashMap() {
+    const uint64_t keys = 10000;
+    const int threads = 4;
+    const int ops = 500000;
+    auto run = [&](const std::string& name, const std::function<bool(uint64_t)>& read
+                   ,const std::function<void(uint64_t)>& write) {
+        uint64_t b = MonoNs();
+        std::atomic<uint64_t> hits{0};
+        RunThreads(threads, "bench_map", [&](int idx) {
+            uint32_t seed = idx + 1;
+            uint64_t local = 0;
+            for(int i = 0; i < ops; ++i) {
+                seed = seed * 1103515245 + 12345;
+                uint64_t key = (seed >> 8) % keys;
+                if(i % 100 == 0) {
+                    write(key);
+                } else {
+                    local += read(key);
+                }
+            }
+            hits += local;
+        });
+        uint64_t ns = MonoNs() - b;
+        std::cout << name << ": " << (double)threads * ops * 1000 / ns << " Mops/s" << std::endl;
+    };
+
+    ConcurrentHashMap<uint64_t, uint64_t> cmap(16384);
+    std::unordered_map<uint64_t, uint64_t> umap;
+    for(uint64_t i = 0; i < keys; ++i) {
+        cmap.assign(i, i);
+        umap[i] = i;
+    }
+    run("ConcurrentHashMap", [&cmap](uint64_t k) {
+        uint64_t v;
+        return cmap.find(k, v);
+    }, [&cmap](uint64_t k) {
+        cmap.assign(k, k + 1);
+    });
+
+    std::mutex mutex;
+    run("mutex+unordered_map", [&](uint64_t k) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return umap.find(k) != umap.end();
+    }, [&](uint64_t k) {
+        std::lock_guard<std::mutex> lock(mutex);
+        umap[k] = k + 1;
+    });
+
+    kong::RWMutex rwmutex;
+    run("RWMutex+unordered_map", [&](uint64_t k) {
+        kong::RWMutex::ReadLock lock(rwmutex);
+        return umap.find(k) != umap.end();
+    }, [&](uint64_t k) {
+        kong::RWMutex::WriteLock lock(rwmutex);
+        umap[k] = k + 1;
+    });
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if(!TestQueues() || !TestMpsc() || !TestEpoch() || !TestHashMap()) {
+        return 1;
+    }
+    if(!s_tsan && (!BenchQueues() || !BenchHashMap())) {
+        return 1;
+    }
+    std::cout << "concurrent tests ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,409 @@
+#include "utils/daemon.hpp"
+#include "utils/util.hpp"
+#include "net/handoff.hpp"
+#include "test_util.hpp"
+#include <arpa/inet.h>
+#include <atomic>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <netinet/in.h>
+#include <poll.h>
+#include <signal.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using kong::HandoffClient;
+using kong::HandoffServer;
+
+static bool TestPidfile() {
+    const std::string path = "daemon_test.pid";
+    kong::FSUtil::Unlink(path);
+    CHECK(kong::Pidfile::Write(path) && kong::FSUtil::IsRunningPidfile(path));
+    //自己重写允许
+    CHECK(kong::Pidfile::Write(path));
+    //其它进程在持有锁期间写入失败
+    pid_t pid = fork();
+    if(pid == 0) {
+        _exit(kong::Pidfile::Write(path) ? 0 : 1);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 1);
+    CHECK(kong::Pidfile::Remove(path) && !kong::FSUtil::IsRunningPidfile(path));
+    //不是本进程持有的pidfile不删除
+    {
+        std::ofstream ofs(path);
+        ofs << getppid() << std::endl;
+    }
+    CHECK(!kong::Pidfile::Remove(path));
+    //记录的进程不在运行也不影响加锁; 多个进程同时启动只有一个成功
+    std::vector<pid_t> pids;
+    for(int i = 0; i < 4; ++i) {
+        pid = fork();
+        if(pid == 0) {
+            bool ok = kong::Pidfile::Write(path);
+            usleep(200 * 1000);
+            _exit(ok ? 0 : 1);
+        }
+        pids.push_back(pid);
+    }
+    int winners = 0;
+    for(auto i : pids) {
+        waitpid(i, &status, 0);
+        winners += WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    }
+    CHECK(winners == 1);
+    kong::FSUtil::Unlink(path);
+    return true;
+}
+
+/**
+ * @brief 看门狗刚fork出工作进程时收到SIGTERM, 也要转发给工作进程并退出
+ */
+static bool TestWatchdogStop(int argc, char** argv) {
+    for(int i = 0; i < 20; ++i) {
+        pid_t pid = fork();
+        if(pid == 0) {
+            kong::DaemonOptions opt;
+            opt.restart_delay_ms = 0;
+            int rt = kong::RunWatchdog(argc, argv, [](int argc, char** argv) {
+                sleep(10);
+                return 0;
+            }, opt);
+            _exit(rt & 0xff);
+        }
+        usleep(i * 200);
+        kill(pid, SIGTERM);
+        int status = 0;
+        uint64_t deadline = MonoMs() + 3000;
+        while(waitpid(pid, &status, WNOHANG) == 0) {
+            if(MonoMs() > deadline) {
+                kill(pid, SIGKILL);
+                waitpid(pid, &status, 0);
+                std::cout << "watchdog ignored SIGTERM, delay " << i * 200 << "us" << std::endl;
+                return false;
+            }
+            usleep(1000);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 工作进程前两次被SIGKILL杀死, 第三次正常退出
+ */
+static bool TestWatchdog(int argc, char** argv, bool& isWorker, int& workerCode) {
+    pid_t self = getpid();
+    kong::DaemonOptions opt;
+    opt.restart_delay_ms = 5;
+    uint64_t b = MonoMs();
+    int rt = kong::RunWatchdog(argc, argv, [](int argc, char** argv) {
+        if(kong::ProcessInfoMgr::GetInstance()->restart_count < 2) {
+            raise(SIGKILL);
+        }
+        return 0;
+    }, opt);
+    if(getpid() != self) {
+        isWorker = true;
+        workerCode = rt;
+        return true;
+    }
+    uint64_t ms = MonoMs() - b;
+    kong::ProcessInfo* info = kong::ProcessInfoMgr::GetInstance();
+    std::cout << "watchdog: 2 crashes recovered in " << ms << " ms " << info->toString() << std::endl;
+    CHECK(rt == 0 && info->restart_count == 2 && ms < 1000);
+    return true;
+}
+
+/**
+ * @brief 回显服务: 每收到一个字节回复本进程pid
+ */
+class EchoPid {
+public:
+    explicit EchoPid(int lfd)
+        :m_lfd(lfd) {
+    }
+
+    /**
+     * @brief accept直到stop被置位, 之后等待已有连接处理完
+     */
+    void serve(std::atomic<bool>& stop) {
+        while(!stop) {
+            pollfd pfd = {m_lfd, POLLIN, 0};
+            if(::poll(&pfd, 1, 20) <= 0) {
+                continue;
+            }
+            //监听socket与另一个进程共享, 可能被对方抢先accept
+            int fd = accept4(m_lfd, nullptr, nullptr, SOCK_CLOEXEC);
+            if(fd < 0) {
+                continue;
+            }
+            ++m_active;
+            std::thread([this, fd]() {
+                char c;
+                pid_t pid = getpid();
+                while(recv(fd, &c, 1, 0) == 1 && send(fd, &pid, sizeof(pid), MSG_NOSIGNAL) == sizeof(pid));
+                close(fd);
+                --m_active;
+            }).detach();
+        }
+        while(m_active) {
+            usleep(1000);
+        }
+    }
+private:
+    int m_lfd;
+    std::atomic<int> m_active{0};
+};
+
+/**
+ * @brief 旧进程: 创建监听socket, 交接后停止accept, 处理完已有连接退出
+ */
+static int RunOld(const std::string& path, int notifyFd) {
+    int lfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
+    socklen_t len = sizeof(sa);
+    if(bind(lfd, (sockaddr*)&sa, len) || listen(lfd, 1024) || getsockname(lfd, (sockaddr*)&sa, &len)) {
+        return 1;
+    }
+    uint16_t port = ntohs(sa.sin_port);
+    std::atomic<bool> stop{false};
+    HandoffServer hs(path);
+    hs.addListener("echo", lfd);
+    if(!hs.start([&stop]() { stop = true;})) {
+        return 1;
+    }
+    if(write(notifyFd, &port, sizeof(port)) != sizeof(port)) {
+        return 1;
+    }
+    close(notifyFd);
+    EchoPid(lfd).serve(stop);
+    //只关闭自己的fd, 监听socket在新进程中继续工作
+    close(lfd);
+    hs.stop();
+    return hs.isHandedOff() ? 0 : 1;
+}
+
+/**
+ * @brief 新进程: 继承监听socket, 开始accept后通知旧进程, 直到SIGTERM
+ */
+static int RunNew(const std::string& path) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &set, nullptr);
+
+    HandoffClient hc;
+    if(!hc.acquire(path, 1000)) {
+        return 2;
+    }
+    int lfd = hc.getListener("echo");
+    std::atomic<bool> stop{false};
+    EchoPid server(lfd);
+    std::thread acceptor([&server, &stop]() { server.serve(stop);});
+    bool ok = hc.ready(1000);
+    //接手交接地址, 供下一次升级
+    HandoffServer hs(path);
+    hs.addListener("echo", lfd);
+    ok = ok && hs.start([&stop]() { stop = true;});
+    int sig;
+    sigwait(&set, &sig);
+    stop = true;
+    acceptor.join();
+    hs.stop();
+    return ok ? 0 : 3;
+}
+
+static pid_t Spawn(const char* self, const char* role, const std::string& path, int fd) {
+    pid_t pid = fork();
+    if(pid == 0) {
+        std::string fdstr = std::to_string(fd);
+        execl(self, self, role, path.c_str(), fdstr.c_str(), (char*)nullptr);
+        _exit(127);
+    }
+    return pid;
+}
+
+/// 一次短连接请求, 返回服务端pid, 失败返回-1
+static pid_t Request(uint16_t port, std::atomic<uint64_t>& refused) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
+    pid_t pid = -1;
+    if(connect(fd, (sockaddr*)&sa, sizeof(sa))) {
+        ++refused;
+    } else if(send(fd, "x", 1, MSG_NOSIGNAL) != 1 || recv(fd, &pid, sizeof(pid), MSG_WAITALL) != sizeof(pid)) {
+        pid = -1;
+    }
+    close(fd);
+    return pid;
+}
+
+/**
+ * @brief 以nobody身份连接交接地址, 返回connect的errno, 连上时返回收到的字节数取负
+ */
+static int ConnectAsNobody(const std::string& path) {
+    pid_t pid = fork();
+    if(pid == 0) {
+        //子进程只用系统调用, 不碰父进程其它线程可能持有的锁
+        if(setgid(65534) || setuid(65534)) {
+            _exit(255);
+        }
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path.c_str(), path.size());
+        if(path[0] == '@') {
+            addr.sun_path[0] = '\0';
+        }
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(connect(fd, (sockaddr*)&addr, offsetof(sockaddr_un, sun_path) + path.size())) {
+            _exit(errno);
+        }
+        char buf[256];
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        _exit(n > 0 ? 200 : 0);
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+/**
+ * @brief 交接地址只对同一用户开放: 文件权限0600, 抽象地址按SO_PEERCRED拒绝
+ */
+static bool TestHandoffPeer() {
+    const std::string file = "kong_handoff_peer_" + std::to_string(getpid()) + ".sock";
+    const std::string abstract = "@kong_handoff_peer_" + std::to_string(getpid());
+    int p[2];
+    CHECK(pipe(p) == 0);
+    HandoffServer fs(file);
+    fs.addListener("x", p[0]);
+    CHECK(fs.start(nullptr));
+    struct stat st;
+    CHECK(stat(file.c_str(), &st) == 0 && S_ISSOCK(st.st_mode) && (st.st_mode & 0777) == 0600);
+    HandoffServer as(abstract);
+    as.addListener("x", p[0]);
+    CHECK(as.start(nullptr));
+    if(geteuid() == 0) {
+        CHECK(ConnectAsNobody(file) == EACCES);
+        //抽象地址能连上, 但在发送fd之前就被关闭
+        CHECK(ConnectAsNobody(abstract) == 0);
+    } else {
+        std::cout << "not root, skip cross-user handoff check" << std::endl;
+    }
+    //同一用户照常交接
+    HandoffClient hc;
+    CHECK(hc.acquire(abstract, 1000) && hc.getListener("x") >= 0);
+    close(hc.getListener("x"));
+    as.stop();
+    fs.stop();
+    CHECK(access(file.c_str(), F_OK) != 0);
+    close(p[0]);
+    close(p[1]);
+    std::cout << "handoff peer check ok" << std::endl;
+    return true;
+}
+
+static bool TestHandoff(const char* self) {
+    const std::string path = "kong_handoff_test_" + std::to_string(getpid()) + ".sock";
+    int pipefd[2];
+    CHECK(pipe(pipefd) == 0);
+    pid_t oldPid = Spawn(self, "old", path, pipefd[1]);
+    close(pipefd[1]);
+    uint16_t port = 0;
+    CHECK(read(pipefd[0], &port, sizeof(port)) == sizeof(port));
+    close(pipefd[0]);
+
+    //升级前建立的长连接, 旧进程要处理完它才退出
+    int longConn = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
+    CHECK(connect(longConn, (sockaddr*)&sa, sizeof(sa)) == 0);
+
+    std::atomic<bool> stop{false};
+    std::atomic<uint64_t> refused{0}, failed{0}, total{0};
+    std::map<pid_t, uint64_t> served;
+    std::thread client([&]() {
+        while(!stop) {
+            pid_t pid = Request(port, refused);
+            ++total;
+            if(pid > 0) {
+                ++served[pid];
+            } else {
+                ++failed;
+            }
+        }
+    });
+
+    usleep(200000);
+    pid_t newPid = Spawn(self, "new", path, -1);
+    //旧进程停止accept后, 长连接仍由旧进程服务
+    int status = 0;
+    uint64_t b = MonoMs();
+    pid_t echoed = 0;
+    while(MonoMs() - b < 3000) {
+        pid_t p = Request(port, refused);
+        if(p == newPid) {
+            break;
+        }
+        usleep(1000);
+    }
+    CHECK(send(longConn, "x", 1, 0) == 1 && recv(longConn, &echoed, sizeof(echoed), MSG_WAITALL) == sizeof(echoed));
+    CHECK(echoed == oldPid);
+    close(longConn);
+    CHECK(waitpid(oldPid, &status, 0) == oldPid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    usleep(200000);
+    stop = true;
+    client.join();
+    kill(newPid, SIGTERM);
+    CHECK(waitpid(newPid, &status, 0) == newPid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+    std::cout << "handoff: " << total << " requests, refused " << refused << ", failed " << failed
+              << ", served by old " << served[oldPid] << ", by new " << served[newPid] << std::endl;
+    CHECK(refused == 0 && failed == 0 && served[oldPid] > 0 && served[newPid] > 0);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if(argc > 2 && std::string(argv[1]) == "old") {
+        return RunOld(argv[2], atoi(argv[3]));
+    }
+    if(argc > 2 && std::string(argv[1]) == "new") {
+        return RunNew(argv[2]);
+    }
+    if(!TestPidfile() || !TestWatchdogStop(argc, argv)) {
+        return 1;
+    }
+    bool isWorker = false;
+    int workerCode = 0;
+    if(!TestWatchdog(argc, argv, isWorker, workerCode)) {
+        return 1;
+    }
+    if(isWorker) {
+        return workerCode;
+    }
+    if(!TestHandoffPeer() || !TestHandoff("/proc/self/exe")) {
+        return 1;
+    }
+    std::cout << "daemon tests ok" << std::endl;
+    return 0;
+}
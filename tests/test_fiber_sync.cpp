@@ -0,0 +1,267 @@
+#include "utils/fiber_sync.hpp"
+#include "utils/channel.hpp"
+#include "test_util.hpp"
+#include <condition_variable>
+#include <iostream>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <unistd.h>
+
+/// 对照组: std::mutex + std::condition_variable实现的有界队列
+class StdQueue {
+public:
+    StdQueue(size_t cap)
+        :m_cap(cap) {
+    }
+
+    void send(int v) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notFull.wait(lock, [this]() { return m_queue.size() < m_cap;});
+        m_queue.push(v);
+        m_notEmpty.notify_one();
+    }
+
+    bool recv(int& v) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_notEmpty.wait(lock, [this]() { return !m_queue.empty();});
+        v = m_queue.front();
+        m_queue.pop();
+        m_notFull.notify_one();
+        return true;
+    }
+private:
+    size_t m_cap;
+    std::mutex m_mutex;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    std::queue<int> m_queue;
+};
+
+/// 两个执行体来回传递一个值, 返回单次往返耗时
+template<class Q>
+static double PingPong(int rounds) {
+    Q ping(1), pong(1);
+    std::thread peer([&]() {
+        int v;
+        for(int i = 0; i < rounds; ++i) {
+            ping.recv(v);
+            pong.send(v + 1);
+        }
+    });
+    uint64_t b = MonoNs();
+    int v = 0;
+    for(int i = 0; i < rounds; ++i) {
+        ping.send(v);
+        pong.recv(v);
+    }
+    double ns = (double)(MonoNs() - b) / rounds;
+    peer.join();
+    return v == rounds ? ns : -1;
+}
+
+/// 多个生产者汇入一个消费者, 返回每秒消息数
+template<class Q>
+static double FanIn(int producers, int n) {
+    Q q(1024);
+    std::vector<std::thread> ts;
+    uint64_t b = MonoNs();
+    for(int p = 0; p < producers; ++p) {
+        ts.emplace_back([&q, n]() {
+            for(int i = 0; i < n; ++i) {
+                q.send(i);
+            }
+        });
+    }
+    int v;
+    for(int i = 0; i < producers * n; ++i) {
+        q.recv(v);
+    }
+    double sec = (double)(MonoNs() - b) / 1e9;
+    for(auto& t : ts) {
+        t.join();
+    }
+    return producers * n / sec;
+}
+
+int main(int argc, char** argv) {
+    //互斥量
+    kong::FiberMutex mutex;
+    long counter = 0;
+    std::vector<std::thread> ts;
+    for(int t = 0; t < 4; ++t) {
+        ts.emplace_back([&]() {
+            for(int i = 0; i < 100000; ++i) {
+                std::lock_guard<kong::FiberMutex> lock(mutex);
+                ++counter;
+            }
+        });
+    }
+    for(auto& t : ts) {
+        t.join();
+    }
+    ts.clear();
+    if(counter != 400000) {
+        std::cout << "mutex counter " << counter << std::endl;
+        return 1;
+    }
+
+    //条件变量 + WaitGroup
+    kong::FiberCondition cond;
+    kong::WaitGroup wg;
+    bool go = false;
+    int started = 0;
+    wg.add(4);
+    for(int t = 0; t < 4; ++t) {
+        ts.emplace_back([&]() {
+            std::lock_guard<kong::FiberMutex> lock(mutex);
+            cond.wait(mutex, [&]() { return go;});
+            ++started;
+            wg.done();
+        });
+    }
+    {
+        std::lock_guard<kong::FiberMutex> lock(mutex);
+        go = true;
+    }
+    cond.notify_all();
+    wg.wait();
+    for(auto& t : ts) {
+        t.join();
+    }
+    ts.clear();
+    if(started != 4) {
+        std::cout << "condition started " << started << std::endl;
+        return 1;
+    }
+
+    //信号量限制并发数
+    kong::FiberSemaphore sem(2);
+    std::atomic<int> inside{0}, peak{0};
+    for(int t = 0; t < 6; ++t) {
+        ts.emplace_back([&]() {
+            for(int i = 0; i < 2000; ++i) {
+                sem.wait();
+                int cur = ++inside;
+                int p = peak.load();
+                while(cur > p && !peak.compare_exchange_weak(p, cur));
+                --inside;
+                sem.notify();
+            }
+        });
+    }
+    for(auto& t : ts) {
+        t.join();
+    }
+    ts.clear();
+    if(peak > 2 || !sem.tryWait() || !sem.tryWait() || sem.tryWait()) {
+        std::cout << "semaphore peak " << peak << std::endl;
+        return 1;
+    }
+
+    //有界通道保持顺序, 关闭后仍能取完剩余元素
+    kong::Channel<int> ch(4);
+    std::thread producer([&]() {
+        for(int i = 0; i < 10000; ++i) {
+            ch.send(i);
+        }
+        ch.close();
+    });
+    int v, expect = 0;
+    while(ch.recv(v)) {
+        if(v != expect++) {
+            std::cout << "channel order " << v << " expect " << expect - 1 << std::endl;
+            return 1;
+        }
+    }
+    producer.join();
+    if(expect != 10000 || ch.send(1) || ch.trySend(1)) {
+        std::cout << "channel close failed, received " << expect << std::endl;
+        return 1;
+    }
+
+    //无界通道发送不挂起
+    kong::Channel<std::string> unbounded;
+    for(int i = 0; i < 100000; ++i) {
+        unbounded.send(std::to_string(i));
+    }
+    std::string s;
+    if(unbounded.size() != 100000 || !unbounded.tryRecv(s) || s != "0") {
+        std::cout << "unbounded channel failed" << std::endl;
+        return 1;
+    }
+
+    //select: 两个生产者, 两个select消费者共享一个普通消费者, 总数不丢不重
+    kong::Channel<int> a(2), b(2);
+    std::thread pa([&]() { for(int i = 0; i < 5000; ++i) a.send(1); a.close();});
+    std::thread pb([&]() { for(int i = 0; i < 5000; ++i) b.send(2); b.close();});
+    std::atomic<long> sum{0};
+    auto selector = [&]() {
+        bool aopen = true, bopen = true;
+        while(aopen || bopen) {
+            int x = 0, y = 0;
+            bool ok = false;
+            kong::Select sel;
+            int ia = aopen ? sel.recv(a, x, &ok) : -1;
+            int ib = bopen ? sel.recv(b, y, &ok) : -1;
+            int idx = sel.wait();
+            if(idx == ia) {
+                ok ? sum += x : aopen = false;
+            } else if(idx == ib) {
+                ok ? sum += y : bopen = false;
+            }
+        }
+    };
+    std::thread s1(selector), s2(selector);
+    std::thread plain([&]() { int x; while(a.recv(x)) sum += x;});
+    pa.join();
+    pb.join();
+    s1.join();
+    s2.join();
+    plain.join();
+    if(sum != 5000 * 1 + 5000 * 2) {
+        std::cout << "select sum " << sum << std::endl;
+        return 1;
+    }
+
+    //select发送分支和default
+    kong::Channel<int> full(1);
+    int one = 1, two = 2;
+    kong::Select sendSel;
+    sendSel.send(full, one);
+    if(sendSel.tryOnce() != 0 || sendSel.tryOnce() != -1) {
+        std::cout << "select send failed" << std::endl;
+        return 1;
+    }
+    std::thread drain([&]() { usleep(10000); int x; full.recv(x);});
+    kong::Select sendSel2;
+    sendSel2.send(full, two);
+    if(sendSel2.wait() != 0 || (full.tryRecv(v), v) != 2) {
+        std::cout << "select blocking send failed" << std::endl;
+        return 1;
+    }
+    drain.join();
+    std::cout << "sync primitives ok" << std::endl;
+
+    //性能: 无竞争加解锁, 往返延迟, 汇聚吞吐
+    const int n = argc > 1 ? atoi(argv[1]) : 200000;
+    std::mutex smutex;
+    uint64_t t0 = MonoNs();
+    for(int i = 0; i < n * 10; ++i) {
+        std::lock_guard<kong::FiberMutex> lock(mutex);
+    }
+    double fm = (double)(MonoNs() - t0) / (n * 10);
+    t0 = MonoNs();
+    for(int i = 0; i < n * 10; ++i) {
+        std::lock_guard<std::mutex> lock(smutex);
+    }
+    double sm = (double)(MonoNs() - t0) / (n * 10);
+    std::cout << "uncontended lock/unlock: FiberMutex " << fm << " ns, std::mutex " << sm << " ns" << std::endl;
+    std::cout << "ping-pong round trip: Channel " << PingPong<kong::Channel<int> >(n / 10)
+              << " ns, mutex+condvar " << PingPong<StdQueue>(n / 10) << " ns" << std::endl;
+    for(int p : {1, 4}) {
+        std::cout << "fan-in " << p << " producers: Channel " << (uint64_t)FanIn<kong::Channel<int> >(p, n / p)
+                  << " msg/s, mutex+condvar " << (uint64_t)FanIn<StdQueue>(p, n / p) << " msg/s" << std::endl;
+    }
+    return 0;
+}
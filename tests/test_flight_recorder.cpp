@@ -0,0 +1,157 @@
+#include "log/flight_recorder.hpp"
+#include "test_util.hpp"
+#include <iostream>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+int main(int argc, char** argv) {
+    //多线程写入, 读回校验
+    {
+        kong::FlightRecorderAppender::ptr fr(new kong::FlightRecorderAppender("/kong-flight-test", 64 * 1024, 8, false));
+        if(!fr->isValid()) {
+            std::cout << "create segment failed" << std::endl;
+            return 1;
+        }
+        kong::Logger::ptr logger(new kong::Logger("flight"));
+        logger->addAppender(fr);
+
+        const int n = 200000;
+        std::vector<std::thread> threads;
+        for(int t = 0; t < 4; ++t) {
+            threads.emplace_back([logger, t]() {
+                for(int i = 0; i < n; ++i) {
+                    KONG_LOG_DEBUG(logger) << "thread " << t << " seq " << i;
+                }
+            });
+        }
+        uint64_t b = MonoNs();
+        for(auto& i : threads) {
+            i.join();
+        }
+        uint64_t e = MonoNs();
+        std::cout << "flight recorder " << (double)(e - b) / n << " ns/event per thread" << std::endl;
+
+        kong::FlightRecorderReader reader("/kong-flight-test");
+        std::vector<kong::FlightRecord> records;
+        reader.read(records);
+        std::cout << "records kept " << records.size() << ", last: "
+                  << (records.empty() ? "" : reader.format(records.back())) << std::endl;
+        if(records.empty() || records.back().msg.find(" seq " + std::to_string(n - 1)) == std::string::npos) {
+            std::cout << "newest record missing" << std::endl;
+            return 1;
+        }
+
+        KONG_LOG_FATAL(logger) << "fatal freezes";
+        KONG_LOG_INFO(logger) << "ignored after freeze";
+        records.clear();
+        reader.read(records);
+        if(!fr->isFrozen() || records.back().msg != "fatal freezes") {
+            std::cout << "freeze failed" << std::endl;
+            return 1;
+        }
+    }
+
+    //一个线程轮流写超过线程缓存数的记录器, 被挤出缓存后应找回自己的环而不是再认领一个
+    {
+        std::vector<kong::FlightRecorderAppender::ptr> frs;
+        std::vector<kong::Logger::ptr> loggers;
+        for(int i = 0; i < 6; ++i) {
+            frs.emplace_back(new kong::FlightRecorderAppender("/kong-flight-test" + std::to_string(i), 4096, 1, false));
+            loggers.emplace_back(new kong::Logger("flight"));
+            loggers.back()->addAppender(frs.back());
+        }
+        for(int round = 0; round < 10; ++round) {
+            for(auto& i : loggers) {
+                KONG_LOG_DEBUG(i) << "round " << round;
+            }
+        }
+        for(auto& i : frs) {
+            if(i->getDropped() != 0) {
+                std::cout << "ring leaked after cache eviction, dropped=" << i->getDropped() << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    //环比线程少, 已退出线程的环被独占回收
+    {
+        kong::FlightRecorderAppender::ptr fr(new kong::FlightRecorderAppender("/kong-flight-test", 4096, 2, false));
+        kong::Logger::ptr logger(new kong::Logger("flight"));
+        logger->addAppender(fr);
+        for(int round = 0; round < 20; ++round) {
+            std::vector<std::thread> threads;
+            for(int t = 0; t < 2; ++t) {
+                threads.emplace_back([logger, round, t]() {
+                    KONG_LOG_DEBUG(logger) << "round " << round << " thread " << t;
+                });
+            }
+            for(auto& i : threads) {
+                i.join();
+            }
+        }
+        kong::FlightRecorderReader reader("/kong-flight-test");
+        std::vector<kong::FlightRecord> records;
+        reader.read(records);
+        if(fr->getDropped() != 0 || records.empty()
+                || records.back().msg.find("round 19") == std::string::npos) {
+            std::cout << "dead ring reclaim failed, dropped=" << fr->getDropped() << std::endl;
+            return 1;
+        }
+    }
+
+    //同名段属于存活进程时不能被截断, 段只有属主可读写
+    {
+        kong::FlightRecorderAppender::ptr live(new kong::FlightRecorderAppender("/kong-flight-test", 4096, 1, false));
+        kong::Logger::ptr logger(new kong::Logger("flight"));
+        logger->addAppender(live);
+        KONG_LOG_DEBUG(logger) << "still here";
+        kong::FlightRecorderAppender::ptr other(new kong::FlightRecorderAppender("/kong-flight-test", 4096, 1, false));
+        kong::FlightRecorderReader reader("/kong-flight-test");
+        std::vector<kong::FlightRecord> records;
+        reader.read(records);
+        struct stat st;
+        if(other->isValid() || records.empty() || records.back().msg != "still here"
+                || stat("/dev/shm/kong-flight-test", &st) != 0 || (st.st_mode & 0777) != 0600) {
+            std::cout << "live segment not protected, other valid=" << other->isValid()
+                      << " records=" << records.size() << std::endl;
+            return 1;
+        }
+    }
+
+    //子进程崩溃后读取
+    pid_t pid = fork();
+    if(pid == 0) {
+        kong::FlightRecorderAppender::ptr fr(new kong::FlightRecorderAppender);
+        kong::Logger::ptr logger(new kong::Logger("crash"));
+        logger->addAppender(fr);
+        for(int i = 0; i < 100; ++i) {
+            KONG_LOG_DEBUG(logger) << "before crash " << i;
+        }
+        abort();
+    }
+    int status = 0;
+    waitpid(pid, &status, 0);
+    kong::FlightRecorderReader reader("/kong-flight-" + std::to_string(pid));
+    std::vector<kong::FlightRecord> records;
+    reader.read(records);
+    if(!WIFSIGNALED(status) || !reader.isValid() || !reader.getHeader()->frozen
+            || records.size() != 100) {
+        std::cout << "crash dump failed, records=" << records.size() << std::endl;
+        return 1;
+    }
+    //崩溃进程留下的段可以被重用
+    {
+        kong::FlightRecorderAppender::ptr reuse(new kong::FlightRecorderAppender(
+                    "/kong-flight-" + std::to_string(pid), 4096, 1, false));
+        if(!reuse->isValid()) {
+            std::cout << "dead process segment not reused" << std::endl;
+            return 1;
+        }
+    }
+    std::cout << "crash dump: " << reader.format(records.back()) << std::endl;
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include "utils/format.hpp"
+#include "utils/strutil.hpp"
+#include <errno.h>
+#include <iostream>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int s_failed = 0;
+static int s_total = 0;
+
+static void Expect(const std::string& got, const std::string& expect, const char* what) {
+    ++s_total;
+    if(got != expect) {
+        ++s_failed;
+        std::cout << "mismatch " << what << ": got [" << got << "] expect [" << expect << "]" << std::endl;
+    }
+}
+
+/// 同一组参数分别交给kong::fmt::Printf和snprintf, 结果必须一致
+#define PRINTF_CASE(...) \
+    do { \
+        char buf[1024]; \
+        snprintf(buf, sizeof(buf), __VA_ARGS__); \
+        Expect(kong::fmt::Printf(__VA_ARGS__), buf, #__VA_ARGS__); \
+    } while(0)
+
+static void TestPrintf() {
+    //整数: 宽度, 精度, 标志, 负数
+    PRINTF_CASE("%d", -1);
+    PRINTF_CASE("%i|%5d|%-5d|", 0, 42, 42);
+    PRINTF_CASE("%05d %+d % d", -42, 7, 7);
+    PRINTF_CASE("%.3d|%8.3d|%-8.3d|", 5, -5, 5);
+    PRINTF_CASE("%lld %lld", (long long)INT64_MIN, (long long)INT64_MAX);
+    //负数用无符号转换时按参数原宽度解释
+    PRINTF_CASE("%x %X %o %u", -1, -255, -8, -1);
+    PRINTF_CASE("%lx %lu", -1L, -2L);
+    PRINTF_CASE("%llx %llu", -1LL, (long long)INT64_MIN);
+    PRINTF_CASE("%x %u", (short)-1, (signed char)-2);
+    PRINTF_CASE("%hx %hhx %hu %hhu", -1, -1, -1, -1);
+    PRINTF_CASE("%hd %hhd", 70000, 300);
+    PRINTF_CASE("%x %o %u", 'A', 'A', 'A');
+    PRINTF_CASE("%#x %#X %#o %08x %-8x|", 255, 255, 8, 0xbeef, 0xbeef);
+    PRINTF_CASE("%#010x %.4x %#.3x", 255, 255, 1);
+    PRINTF_CASE("[%.0d][%.0x][%5.0d]", 0, 0, 0);
+    PRINTF_CASE("%u %x", 4294967295u, 4294967295u);
+    PRINTF_CASE("%lu %lx", (unsigned long)UINT64_MAX, (unsigned long)UINT64_MAX);
+    PRINTF_CASE("%*d|%-*d|%.*d", 6, 42, 6, 42, 4, 7);
+    //字符和字符串
+    PRINTF_CASE("%c|%5c|%-5c|", 'A', 'B', 'C');
+    PRINTF_CASE("%s|%10s|%-10s|", "abc", "abc", "abc");
+    PRINTF_CASE("%.2s|%5.1s|%-5.3s|", "abcdef", "abcdef", "abcdef");
+    PRINTF_CASE("%s", "");
+    //浮点
+    PRINTF_CASE("%f %F", 3.14159, -2.5);
+    PRINTF_CASE("%.2f %.0f %.10f", 2.005, 2.5, 1.0 / 3);
+    PRINTF_CASE("%10.3f|%-10.3f|%010.3f", -1.5, -1.5, -1.5);
+    PRINTF_CASE("%+.1f % .1f %+f", 2.25, 2.25, -0.0);
+    PRINTF_CASE("%e %E %.3e", 12345.678, 0.000123, -1e-300);
+    PRINTF_CASE("%g %g %g %G", 0.0001, 1e20, 123456789.0, 1e-10);
+    PRINTF_CASE("%.3g %10.4g|%-10.2e|", 3.14159, 2.71828, 6.02e23);
+    PRINTF_CASE("%f %e", 1e308, 5e-324);
+    PRINTF_CASE("%.*f %*.*f|", 2, 3.14159, 8, 1, 2.25);
+    PRINTF_CASE("%5.2f%% done", 99.5);
+    //整数参数用浮点转换, 浮点参数用整数转换由类型决定, 不做比较
+
+    //%m: 包括strerror会写静态缓冲区的未知错误码
+    errno = ENOENT;
+    Expect(kong::fmt::Printf("open: %m"), std::string("open: ") + strerror(ENOENT), "%m");
+    errno = 12345;
+    Expect(kong::fmt::Printf("%m"), "Unknown error 12345", "%m unknown");
+}
+
+/// 2000个字符的字面量文本, 编译期校验的递归深度不能随长度增长
+#define TEXT10(s) s s s s s s s s s s
+#define LONG_TEXT TEXT10(TEXT10(TEXT10("0123456789"))) TEXT10(TEXT10(TEXT10("abcdefghij")))
+
+static_assert(kong::fmt::CountPlaceholders("a{}b{:x}c{{}}") == 2, "count");
+static_assert(kong::fmt::CountPlaceholders("{") == -1 && kong::fmt::CountPlaceholders("}") == -1
+        && kong::fmt::CountPlaceholders("{x}") == -1 && kong::fmt::CountPlaceholders("{{}") == -1, "malformed");
+static_assert(kong::fmt::CountPlaceholders(LONG_TEXT "{}" LONG_TEXT "{:d}" LONG_TEXT) == 2, "long count");
+static_assert(KONG_FMT_CHECK(LONG_TEXT "{:d}" LONG_TEXT "{:s}" LONG_TEXT "{:.2f}", 1, "x", 2.5), "long check");
+
+static void TestFormat() {
+    Expect(kong::fmt::Format(LONG_TEXT "{}", 7), std::string(LONG_TEXT) + "7", "long format");
+    Expect(kong::fmt::Format("{} {} {}", -1, 2u, "x"), "-1 2 x", "basic");
+    Expect(kong::fmt::Format("{:x} {:X} {:o} {:b}", 255, 255, 8, 5), "ff FF 10 101", "bases");
+    Expect(kong::fmt::Format("{:>5}|{:<5}|{:^5}|", 1, 2, 3), "    1|2    |  3  |", "align");
+    Expect(kong::fmt::Format("{:*^7}", "ab"), "**ab***", "fill");
+    Expect(kong::fmt::Format("{:05d} {:+d}", -42, 3), "-0042 +3", "sign");
+    Expect(kong::fmt::Format("{:.2f} {}", 2.5, 0.1), "2.50 0.1", "double");
+    Expect(kong::fmt::Format("{} {}", true, 'c'), "true c", "bool char");
+    Expect(kong::fmt::Format("{{}} {}", 1), "{} 1", "escape");
+}
+
+/**
+ * @brief 有效数字的位数: 第一个到最后一个非零数字之间的位数, 不算符号、小数点和指数
+ */
+static size_t Digits(const char* s) {
+    std::string d;
+    for(; *s && *s != 'e' && *s != 'E'; ++s) {
+        if(*s >= '0' && *s <= '9') {
+            d.push_back(*s);
+        }
+    }
+    size_t b = d.find_first_not_of('0');
+    if(b == std::string::npos) {
+        return 0;
+    }
+    return d.find_last_not_of('0') - b + 1;
+}
+
+static void TestGrisu() {
+    struct {
+        double v;
+        const char* s;
+    } fixed[] = {
+        {0.0, "0"}, {1.0, "1"}, {-1.5, "-1.5"}, {0.1, "0.1"}, {0.3, "0.3"},
+        {123.456, "123.456"}, {1.0 / 3, "0.3333333333333333"}, {100, "100"},
+        {5e-324, "5e-324"}, {1.7976931348623157e308, "1.7976931348623157e308"},
+        {2.2250738585072014e-308, "2.2250738585072014e-308"}, {9007199254740993.0, "9007199254740992"},
+        {1e23, "1e23"}, {5e-7, "5e-7"},
+    };
+    for(auto& i : fixed) {
+        char buf[64];
+        buf[kong::StrUtil::DoubleToChars(buf, i.v)] = 0;
+        Expect(buf, i.s, "grisu fixed");
+    }
+
+    //随机位模式: 必须精确还原, 且位数与最短表示相同(Grisu3无法确定时走printf后备)
+    std::mt19937_64 rng(12345);
+    const int n = 200000;
+    int longer = 0;
+    for(int i = 0; i < n; ++i) {
+        uint64_t bits = rng();
+        double v;
+        memcpy(&v, &bits, sizeof(v));
+        if(v != v || v - v != 0) {
+            continue;
+        }
+        char buf[64];
+        buf[kong::StrUtil::DoubleToChars(buf, v)] = 0;
+        ++s_total;
+        if(strtod(buf, nullptr) != v) {
+            ++s_failed;
+            std::cout << "grisu round trip failed: " << buf << std::endl;
+            continue;
+        }
+        //最短的能精确还原v的%.Ng
+        char shortest[64];
+        for(int p = 1; p <= 17; ++p) {
+            snprintf(shortest, sizeof(shortest), "%.*g", p, v);
+            if(strtod(shortest, nullptr) == v) {
+                break;
+            }
+        }
+        if(Digits(buf) > Digits(shortest)) {
+            ++longer;
+        }
+    }
+    std::cout << "grisu: " << n << " random doubles round-trip, " << longer
+              << " not shortest" << std::endl;
+    ++s_total;
+    if(longer) {
+        ++s_failed;
+        std::cout << "grisu output not shortest" << std::endl;
+    }
+}
+
+int main(int argc, char** argv) {
+    TestPrintf();
+    TestFormat();
+    TestGrisu();
+    std::cout << s_total - s_failed << "/" << s_total << " format checks passed" << std::endl;
+    return s_failed ? 1 : 0;
+}
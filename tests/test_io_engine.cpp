@@ -0,0 +1,291 @@
+#include "net/io_engine.hpp"
+#include "test_util.hpp"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using kong::IoEngine;
+
+/// 文件读写, 注册缓冲区, 取消
+static bool TestBasic(IoEngine::ptr engine) {
+    const char* path = "io_engine_test.dat";
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    static char buf[8192];
+    iovec iov = {buf, sizeof(buf)};
+    bool fixed = engine->registerBuffers(&iov, 1);
+    memcpy(buf, "hello io engine", 15);
+    int wres = 0, rres = 0;
+    engine->write(fd, buf, 15, [&wres](int res) { wres = res;});
+    while(!wres) {
+        engine->poll(100);
+    }
+    lseek(fd, 0, SEEK_SET);
+    char out[32] = {0};
+    engine->read(fd, out, sizeof(out), [&rres](int res) { rres = res;});
+    while(!rres) {
+        engine->poll(100);
+    }
+    engine->cancel(fd);
+    engine->poll(0);
+    close(fd);
+    unlink(path);
+    if(wres != 15 || rres != 15 || memcmp(out, "hello io engine", 15)) {
+        std::cout << "file io failed write=" << wres << " read=" << rres << std::endl;
+        return false;
+    }
+
+    //没有数据的读被取消
+    int sv[2];
+    socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sv);
+    int cres = 0;
+    engine->read(sv[0], out, sizeof(out), [&cres](int res) { cres = res;});
+    engine->poll(0);
+    engine->cancel(sv[0]);
+    for(int i = 0; i < 10 && !cres; ++i) {
+        engine->poll(100);
+    }
+    close(sv[0]);
+    close(sv[1]);
+    if(cres != -ECANCELED) {
+        std::cout << "cancel failed res=" << cres << std::endl;
+        return false;
+    }
+    std::cout << IoEngine::ToString(engine->getType()) << " basic ok, fixed buffers "
+              << (fixed ? "on" : "off") << std::endl;
+    return true;
+}
+
+/**
+ * @brief 取消发出后目标请求先完成, 完成回调里新发起的请求不能被这次取消误伤
+ * @details io_uring按地址匹配取消, 对象池会立即复用刚归还的op地址
+ */
+static bool TestCancelReuse(IoEngine::ptr engine) {
+    int sa[2], sb[2], sc[2];
+    socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sa);
+    socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sb);
+    socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0, sc);
+    static char abuf[16], bbuf[16], xbuf[16];
+    write(sa[1], "x", 1);
+    write(sb[1], "a", 1);
+    int xres = 0, ares = 0, bres = 0;
+    engine->read(sa[0], xbuf, sizeof(xbuf), [&](int res) {
+        xres = res;
+        //a的完成事件已在队列里, 取消请求要到下次poll()才提交
+        engine->cancel(sb[0]);
+    });
+    engine->read(sb[0], abuf, sizeof(abuf), [&](int res) {
+        ares = res;
+        engine->read(sc[0], bbuf, sizeof(bbuf), [&bres](int res) { bres = res;});
+    });
+    for(int i = 0; i < 10 && !ares; ++i) {
+        engine->poll(100);
+    }
+    for(int i = 0; i < 3; ++i) {
+        engine->poll(10);
+    }
+    write(sc[1], "b", 1);
+    for(int i = 0; i < 10 && !bres; ++i) {
+        engine->poll(100);
+    }
+    engine->cancel(sa[0]);
+    engine->cancel(sb[0]);
+    engine->cancel(sc[0]);
+    engine->poll(0);
+    for(int fd : {sa[0], sa[1], sb[0], sb[1], sc[0], sc[1]}) {
+        close(fd);
+    }
+    if(xres != 1 || bres != 1 || bbuf[0] != 'b') {
+        std::cout << IoEngine::ToString(engine->getType()) << " cancel reuse failed x=" << xres
+                  << " a=" << ares << " b=" << bres << std::endl;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 回环echo: conns个客户端连接各自收发rounds次, 客户端和服务端跑在同一个引擎里
+ */
+struct EchoBench {
+    static const int kMsgSize = 64;
+
+    struct Client {
+        EchoBench* bench;
+        int fd;
+        int round = 0;
+        int got = 0;
+        char* sendBuf;
+        char* recvBuf;
+    };
+
+    IoEngine::ptr engine;
+    int conns;
+    int rounds;
+    int listenFd = -1;
+    std::vector<char> bufs;
+    std::vector<Client> clients;
+    int finished = 0;
+    int serverOpen = 0;
+    uint64_t requests = 0;
+    bool ok = true;
+
+    EchoBench(IoEngine::ptr e, int c, int r)
+        :engine(e)
+        ,conns(c)
+        ,rounds(r)
+        ,bufs(c * kMsgSize * 2)
+        ,clients(c) {
+    }
+
+    void serve(int fd) {
+        ++serverOpen;
+        engine->registerFile(fd);
+        engine->recvMultishot(fd, [this, fd](int res, const char* data) {
+            if(res > 0) {
+                std::string* out = new std::string(data, res);
+                engine->write(fd, out->c_str(), out->size(), [out](int) { delete out;});
+                return;
+            }
+            engine->unregisterFile(fd);
+            engine->cancel(fd);
+            close(fd);
+            --serverOpen;
+        });
+    }
+
+    void sendNext(Client* c) {
+        memset(c->sendBuf, 'a' + (c->round + c->fd) % 26, kMsgSize);
+        c->got = 0;
+        engine->write(c->fd, c->sendBuf, kMsgSize, [this](int res) {
+            if(res != kMsgSize) {
+                ok = false;
+            }
+        });
+        engine->read(c->fd, c->recvBuf, kMsgSize, [this, c](int res) { onRead(c, res);});
+    }
+
+    void onRead(Client* c, int res) {
+        if(res <= 0) {
+            ok = false;
+            finish(c);
+            return;
+        }
+        c->got += res;
+        if(c->got < kMsgSize) {
+            engine->read(c->fd, c->recvBuf + c->got, kMsgSize - c->got, [this, c](int res) { onRead(c, res);});
+            return;
+        }
+        if(memcmp(c->sendBuf, c->recvBuf, kMsgSize)) {
+            ok = false;
+        }
+        ++requests;
+        if(++c->round < rounds) {
+            sendNext(c);
+        } else {
+            finish(c);
+        }
+    }
+
+    void finish(Client* c) {
+        engine->unregisterFile(c->fd);
+        engine->cancel(c->fd);
+        close(c->fd);
+        ++finished;
+    }
+
+    bool run() {
+        listenFd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        sockaddr_in sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sin_family = AF_INET;
+        inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
+        socklen_t len = sizeof(sa);
+        if(bind(listenFd, (sockaddr*)&sa, len) || listen(listenFd, 1024)
+                || getsockname(listenFd, (sockaddr*)&sa, &len)) {
+            std::cout << "listen failed errno=" << errno << std::endl;
+            return false;
+        }
+        bool accepting = true;
+        engine->accept(listenFd, [this, &accepting](int fd) {
+            if(fd >= 0) {
+                serve(fd);
+            } else {
+                accepting = false;
+            }
+        }, true);
+
+        iovec iov = {&bufs[0], bufs.size()};
+        engine->registerBuffers(&iov, 1);
+        for(int i = 0; i < conns; ++i) {
+            Client* c = &clients[i];
+            c->bench = this;
+            c->fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            c->sendBuf = &bufs[i * kMsgSize * 2];
+            c->recvBuf = c->sendBuf + kMsgSize;
+            engine->connect(c->fd, (sockaddr*)&sa, sizeof(sa), [this, c](int res) {
+                if(res) {
+                    std::cout << "connect failed res=" << res << std::endl;
+                    ok = false;
+                    finish(c);
+                    return;
+                }
+                engine->registerFile(c->fd);
+                sendNext(c);
+            });
+        }
+
+        uint64_t b = MonoNs();
+        IoEngine::Stats before = engine->getStats();
+        while(finished < conns) {
+            engine->poll(1000);
+        }
+        double sec = (MonoNs() - b) / 1e9;
+        IoEngine::Stats after = engine->getStats();
+
+        while(serverOpen) {
+            engine->poll(100);
+        }
+        engine->cancel(listenFd);
+        while(accepting) {
+            engine->poll(100);
+        }
+        close(listenFd);
+        std::cout << IoEngine::ToString(engine->getType()) << " echo " << conns << " conns x " << rounds
+                  << ": " << (uint64_t)(requests / sec) << " req/s, "
+                  << (double)(after.syscalls - before.syscalls) / requests << " syscalls/req" << std::endl;
+        return ok && requests == (uint64_t)conns * rounds;
+    }
+};
+
+int main(int argc, char** argv) {
+    signal(SIGPIPE, SIG_IGN);
+    int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+    std::cout << "io_uring supported: " << IoEngine::UringSupported() << std::endl;
+    IoEngine::ptr def = IoEngine::Create();
+    if(IoEngine::UringSupported() != (def->getType() == IoEngine::URING)) {
+        std::cout << "auto detection picked " << IoEngine::ToString(def->getType()) << std::endl;
+        return 1;
+    }
+
+    std::vector<IoEngine::Type> types = {IoEngine::EPOLL};
+    if(IoEngine::UringSupported()) {
+        types.push_back(IoEngine::URING);
+    }
+    for(IoEngine::Type type : types) {
+        if(!TestBasic(IoEngine::Create(type)) || !TestCancelReuse(IoEngine::Create(type))) {
+            return 1;
+        }
+        for(int conns : {1, 64}) {
+            EchoBench bench(IoEngine::Create(type), conns, conns == 1 ? rounds * 10 : rounds);
+            if(!bench.run()) {
+                std::cout << IoEngine::ToString(type) << " echo failed" << std::endl;
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,191 @@
+#include "log/log_coalescer.hpp"
+#include "test_util.hpp"
+#include <atomic>
+#include <iostream>
+#include <mutex>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// 记录输出的内容
+class CaptureSink : public kong::LogAppender {
+public:
+    void log(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        lines.push_back(event->getContent());
+    }
+    std::vector<std::string> lines;
+    std::mutex mutex;
+};
+
+static kong::Logger::ptr MakeLogger(const std::string& name, std::shared_ptr<CaptureSink>& sink, uint32_t window_ms) {
+    kong::Logger::ptr logger(new kong::Logger(name));
+    sink.reset(new CaptureSink);
+    logger->addAppender(sink);
+    logger->setCoalescer(kong::LogCoalescer::ptr(new kong::LogCoalescer(window_ms)));
+    return logger;
+}
+
+static void Refused(kong::Logger::ptr logger, int port) {
+    KONG_LOG_ERROR(logger) << "connect 10.0.0.1:" << port << " refused";
+}
+
+static bool TestRepeat() {
+    std::shared_ptr<CaptureSink> sink;
+    kong::Logger::ptr logger = MakeLogger("coalesce.repeat", sink, 60000);
+    for(int i = 0; i < 1000; ++i) {
+        Refused(logger, 80);
+    }
+    CHECK(sink->lines.size() == 1);
+    Refused(logger, 81);
+    Refused(logger, 81);
+    KONG_LOG_INFO(logger) << "done";
+    for(auto& i : sink->lines) {
+        std::cout << i << std::endl;
+    }
+    CHECK(sink->lines.size() == 5);
+    CHECK(sink->lines[0] == "connect 10.0.0.1:80 refused");
+    CHECK(sink->lines[1] == "last message repeated 999 times");
+    CHECK(sink->lines[2] == "connect 10.0.0.1:81 refused");
+    CHECK(sink->lines[3] == "last message repeated 1 times");
+    CHECK(sink->lines[4] == "done");
+    return true;
+}
+
+static bool TestDistinct() {
+    std::shared_ptr<CaptureSink> sink;
+    kong::Logger::ptr logger = MakeLogger("coalesce.distinct", sink, 60000);
+    //内容相同, 调用点不同
+    KONG_LOG_WARN(logger) << "same";
+    KONG_LOG_WARN(logger) << "same";
+    //调用点和内容相同, 结构化字段不同
+    for(int i = 0; i < 3; ++i) {
+        KONG_LOG_WARN(logger).kv("attempt", i) << "retry";
+    }
+    for(int i = 0; i < 3; ++i) {
+        KONG_LOG_WARN(logger).kv("ok", true) << "probe";
+    }
+    kong::LogCoalescer::FlushThread();
+    CHECK(sink->lines.size() == 7);
+    CHECK(sink->lines[6] == "last message repeated 2 times");
+    return true;
+}
+
+static bool TestWindow() {
+    std::shared_ptr<CaptureSink> sink;
+    kong::Logger::ptr logger = MakeLogger("coalesce.window", sink, 50);
+    for(int i = 0; i < 10; ++i) {
+        Refused(logger, 80);
+    }
+    usleep(60 * 1000);
+    //窗口到期: 先写出计数, 再作为新窗口的第一条写出
+    Refused(logger, 80);
+    Refused(logger, 80);
+    CHECK(sink->lines.size() == 3);
+    CHECK(sink->lines[1] == "last message repeated 9 times");
+    CHECK(sink->lines[2] == "connect 10.0.0.1:80 refused");
+    kong::LogCoalescer::FlushThread();
+    CHECK(sink->lines.size() == 4);
+    return true;
+}
+
+static bool TestThreads() {
+    std::shared_ptr<CaptureSink> sink;
+    kong::Logger::ptr logger = MakeLogger("coalesce.threads", sink, 60000);
+    std::vector<kong::Thread::ptr> threads;
+    for(int i = 0; i < 4; ++i) {
+        threads.push_back(kong::Thread::ptr(new kong::Thread([logger]() {
+            for(int j = 0; j < 10000; ++j) {
+                Refused(logger, 80);
+            }
+        }, "coalesce_" + std::to_string(i))));
+    }
+    for(auto& i : threads) {
+        i->join();
+    }
+    //每个线程各自合并, 线程退出时写出计数
+    CHECK(sink->lines.size() == 8);
+    size_t summaries = 0;
+    for(auto& i : sink->lines) {
+        summaries += i == "last message repeated 9999 times";
+    }
+    CHECK(summaries == 4);
+    return true;
+}
+
+/**
+ * @brief 写完一串重复日志后线程空闲(不退出也不再写日志), 计数由刷新线程在约2个窗口内写出
+ */
+static bool TestIdleFlush() {
+    std::shared_ptr<CaptureSink> sink;
+    const uint32_t window_ms = 100;
+    kong::Logger::ptr logger = MakeLogger("coalesce.idle", sink, window_ms);
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> logged{0};
+    kong::Thread::ptr t(new kong::Thread([&]() {
+        for(int i = 0; i < 10; ++i) {
+            Refused(logger, 80);
+        }
+        logged = MonoNs();
+        while(!done) {
+            usleep(1000);
+        }
+    }, "coalesce_idle"));
+    while(!logged) {
+        usleep(1000);
+    }
+    uint64_t seen = 0;
+    while(MonoNs() - logged < 4 * window_ms * 1000000ULL) {
+        {
+            std::lock_guard<std::mutex> lock(sink->mutex);
+            if(sink->lines.size() == 2) {
+                seen = MonoNs();
+                break;
+            }
+        }
+        usleep(1000);
+    }
+    done = true;
+    t->join();
+    CHECK(seen);
+    std::cout << "idle thread summary after " << (seen - logged) / 1000000 << " ms" << std::endl;
+    CHECK(seen - logged <= 2 * window_ms * 1000000ULL);
+    CHECK(sink->lines[1] == "last message repeated 9 times");
+    return true;
+}
+
+/**
+ * @brief 同一条错误连续写入文件, 对比开关合并时的写入量和耗时
+ */
+static bool Bench() {
+    const int n = 200000;
+    const std::string path = "/tmp/kong_coalesce_bench.log";
+    for(bool coalesce : {false, true}) {
+        unlink(path.c_str());
+        kong::Logger::ptr logger(new kong::Logger("coalesce.bench"));
+        logger->addAppender(kong::LogAppender::ptr(new kong::FileLogAppender(path, 0)));
+        if(coalesce) {
+            logger->setCoalescer(kong::LogCoalescer::ptr(new kong::LogCoalescer(1000)));
+        }
+        uint64_t b = MonoNs();
+        for(int i = 0; i < n; ++i) {
+            Refused(logger, 80);
+        }
+        kong::LogCoalescer::FlushThread();
+        uint64_t ns = MonoNs() - b;
+        logger.reset();
+        struct stat st;
+        CHECK(stat(path.c_str(), &st) == 0);
+        std::cout << "coalesce=" << coalesce << ": " << (double)ns / n << " ns/event, "
+                  << st.st_size << " bytes written" << std::endl;
+    }
+    unlink(path.c_str());
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if(!TestRepeat() || !TestDistinct() || !TestWindow() || !TestThreads() || !TestIdleFlush() || !Bench()) {
+        return 1;
+    }
+    std::cout << "log coalesce tests ok" << std::endl;
+    return 0;
+}
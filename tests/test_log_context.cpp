@@ -0,0 +1,140 @@
+#include "log/log.hpp"
+#include "test_util.hpp"
+#include <iostream>
+#include <thread>
+
+/// 记录最后一条渲染结果
+class CaptureAppender : public kong::LogAppender {
+public:
+    void log(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event) override {
+        m_last = m_formatter->format(logger, level, event);
+    }
+    std::string m_last;
+};
+
+static bool Expect(const std::string& got, const std::string& expect) {
+    if(got != expect) {
+        std::cout << "expect [" << expect << "] got [" << got << "]" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    kong::Logger::ptr logger(new kong::Logger("ctx"));
+    std::shared_ptr<CaptureAppender> a(new CaptureAppender);
+    logger->addAppender(a);
+    logger->setFormatter("[%X{trace_id}] %m%X%n");
+
+    KONG_LOG_INFO(logger) << "none";
+    if(!Expect(a->m_last, "[] none\n")) {
+        return 1;
+    }
+
+    kong::LogEvent::ptr kept;
+    {
+        KONG_LOG_CONTEXT("trace_id", "abc123");
+        KONG_LOG_CONTEXT("tenant", 42);
+        KONG_LOG_INFO(logger) << "outer";
+        if(!Expect(a->m_last, "[abc123] outer trace_id=abc123 tenant=42\n")) {
+            return 1;
+        }
+        {
+            //内层覆盖同名字段, 退出后恢复
+            KONG_LOG_CONTEXT("trace_id", "inner id");
+            KONG_LOG_INFO(logger) << "inner";
+            if(!Expect(a->m_last, "[inner id] inner trace_id=\"inner id\" tenant=42\n")) {
+                return 1;
+            }
+        }
+        KONG_LOG_INFO(logger) << "back";
+        if(!Expect(a->m_last, "[abc123] back trace_id=abc123 tenant=42\n")) {
+            return 1;
+        }
+
+        //其它线程看不到本线程的上下文
+        std::thread([logger, a]() {
+            KONG_LOG_INFO(logger) << "other";
+        }).join();
+        if(!Expect(a->m_last, "[] other\n")) {
+            return 1;
+        }
+
+        //事件保存创建时的上下文, 作用域结束后再格式化仍然可用
+        kept = kong::MakePooled<kong::LogEvent>(logger, kong::LogLevel::INFO
+                , __FILE__, __LINE__, 0, 0, kong::Clock::NowNs(), "main");
+        kept->getSS() << "kept";
+    }
+    if(kong::LogContext::Current()) {
+        std::cout << "context not restored" << std::endl;
+        return 1;
+    }
+    logger->log(kong::LogLevel::INFO, kept);
+    if(!Expect(a->m_last, "[abc123] kept trace_id=abc123 tenant=42\n")) {
+        return 1;
+    }
+
+    //结构化格式同样带上下文
+    {
+        KONG_LOG_CONTEXT("trace_id", "t\"1");
+        logger->setFormatter(kong::LogFormatter::ptr(new kong::StructuredLogFormatter(kong::StructuredLogFormatter::JSON)));
+        KONG_LOG_INFO(logger) << "json";
+        if(a->m_last.find(",\"msg\":\"json\",\"trace_id\":\"t\\\"1\"}") == std::string::npos) {
+            std::cout << "json context missing: " << a->m_last << std::endl;
+            return 1;
+        }
+    }
+
+    //键按logfmt规则替换不能出现的字符
+    {
+        KONG_LOG_CONTEXT("a b=\"", 1);
+        logger->setFormatter("%m%X%n");
+        KONG_LOG_INFO(logger) << "key";
+        if(!Expect(a->m_last, "key a_b__=1\n")) {
+            return 1;
+        }
+    }
+
+    //上下文字段与每条日志附加kv字段的开销对比, 每次都创建事件并渲染
+    const int n = argc > 1 ? atoi(argv[1]) : 200000;
+    kong::LogFormatter::ptr ctx_fmt(new kong::LogFormatter("%m%X%n"));
+    kong::LogFormatter::ptr kv_fmt(new kong::LogFormatter("%m%K%n"));
+    std::string out;
+    double ctx_ns = 0;
+    {
+        //请求开始时设置一次, 之后每条日志复用
+        KONG_LOG_CONTEXT("trace_id", "4bf92f3577b34da6a3ce929d0e0e4736");
+        KONG_LOG_CONTEXT("tenant", "acme");
+        uint64_t b = MonoNs();
+        for(int i = 0; i < n; ++i) {
+            kong::LogEvent::ptr e = kong::MakePooled<kong::LogEvent>(logger, kong::LogLevel::INFO
+                    , __FILE__, __LINE__, 0, 0, kong::Clock::NowNs(), "main");
+            out.clear();
+            ctx_fmt->render(out, logger, kong::LogLevel::INFO, e);
+        }
+        ctx_ns = (double)(MonoNs() - b) / n;
+    }
+    //每条日志都重新设置上下文, 上下文的最坏情况
+    uint64_t b = MonoNs();
+    for(int i = 0; i < n; ++i) {
+        KONG_LOG_CONTEXT("trace_id", "4bf92f3577b34da6a3ce929d0e0e4736");
+        KONG_LOG_CONTEXT("tenant", "acme");
+        kong::LogEvent::ptr e = kong::MakePooled<kong::LogEvent>(logger, kong::LogLevel::INFO
+                , __FILE__, __LINE__, 0, 0, kong::Clock::NowNs(), "main");
+        out.clear();
+        ctx_fmt->render(out, logger, kong::LogLevel::INFO, e);
+    }
+    double scope_ns = (double)(MonoNs() - b) / n;
+    b = MonoNs();
+    for(int i = 0; i < n; ++i) {
+        kong::LogEvent::ptr e = kong::MakePooled<kong::LogEvent>(logger, kong::LogLevel::INFO
+                , __FILE__, __LINE__, 0, 0, kong::Clock::NowNs(), "main");
+        e->kv("trace_id", "4bf92f3577b34da6a3ce929d0e0e4736").kv("tenant", "acme");
+        out.clear();
+        kv_fmt->render(out, logger, kong::LogLevel::INFO, e);
+    }
+    double kv_ns = (double)(MonoNs() - b) / n;
+    std::cout << "event + render: context set once " << ctx_ns << " ns, context set per event "
+              << scope_ns << " ns, per-event kv fields " << kv_ns << " ns" << std::endl;
+    return 0;
+}
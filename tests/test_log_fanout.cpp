@@ -0,0 +1,76 @@
+#include "log/log.hpp"
+#include "test_util.hpp"
+#include <iostream>
+
+/// 每个Appender各自格式化(改动前的行为)
+class SelfFormatAppender : public kong::LogAppender {
+public:
+    SelfFormatAppender()
+        :m_ofs("/dev/null") {
+    }
+
+    void log(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event) override {
+        if(level >= m_level) {
+            m_buf.clear();
+            m_formatter->render(m_buf, logger, level, event);
+            m_ofs.write(m_buf.data(), m_buf.size());
+        }
+    }
+private:
+    std::ofstream m_ofs;
+    std::string m_buf;
+};
+
+/// 记录收到的渲染结果
+class CaptureAppender : public kong::LogAppender {
+public:
+    void log(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event) override {
+        m_last.reset();
+    }
+
+    void logRendered(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event, const kong::LogBuffer& buf) override {
+        m_last = buf;
+    }
+
+    bool acceptsRendered() const override { return true;}
+
+    kong::LogBuffer m_last;
+};
+
+static double Run(kong::Logger::ptr logger, int n) {
+    uint64_t b = MonoNs();
+    for(int i = 0; i < n; ++i) {
+        KONG_LOG_INFO(logger) << "request " << i << " done";
+    }
+    return (double)(MonoNs() - b) / n;
+}
+
+int main(int argc, char** argv) {
+    //同一格式器的Appender共享同一份渲染结果
+    kong::Logger::ptr logger(new kong::Logger("fanout"));
+    std::shared_ptr<CaptureAppender> a(new CaptureAppender);
+    std::shared_ptr<CaptureAppender> b(new CaptureAppender);
+    std::shared_ptr<CaptureAppender> c(new CaptureAppender);
+    c->setFormatter(kong::LogFormatter::ptr(new kong::LogFormatter("%p %m%n")));
+    logger->addAppender(a);
+    logger->addAppender(b);
+    logger->addAppender(c);
+    KONG_LOG_INFO(logger) << "hello";
+    if(!a->m_last || a->m_last != b->m_last || a->m_last == c->m_last || *c->m_last != "INFO hello\n") {
+        std::cout << "render sharing failed" << std::endl;
+        return 1;
+    }
+
+    const int n = 200000;
+    kong::Logger::ptr old_logger(new kong::Logger("fanout"));
+    kong::Logger::ptr new_logger(new kong::Logger("fanout"));
+    for(int i = 0; i < 3; ++i) {
+        old_logger->addAppender(kong::LogAppender::ptr(new SelfFormatAppender));
+        new_logger->addAppender(kong::LogAppender::ptr(new kong::FileLogAppender("/dev/null", 0)));
+    }
+    double old_ns = Run(old_logger, n);
+    double new_ns = Run(new_logger, n);
+    std::cout << "3 appenders: render per appender " << old_ns << " ns/event, render once "
+              << new_ns << " ns/event" << std::endl;
+    return 0;
+}
@@ -0,0 +1,74 @@
+#include "log/log.hpp"
+#include <iostream>
+#include <stdlib.h>
+#include <time.h>
+
+static int s_failed = 0;
+
+static void Expect(const std::string& got, const std::string& expect, const char* what) {
+    if(got != expect) {
+        ++s_failed;
+        std::cout << "mismatch " << what << ":\n got    [" << got << "]\n expect [" << expect << "]" << std::endl;
+    }
+}
+
+/// 固定时间、调用点和线程信息的事件, 输出可以逐字比较
+static kong::LogEvent::ptr MakeEvent(kong::Logger::ptr logger, kong::LogLevel::Level level) {
+    return kong::LogEvent::ptr(new kong::LogEvent(logger, level, "test_log_format.cpp", 7, 0, 11, 22, 0, "main"));
+}
+
+int main(int argc, char** argv) {
+    setenv("TZ", "UTC", 1);
+    tzset();
+
+    kong::Logger::ptr logger(new kong::Logger("structured"));
+    kong::LogFormatter::ptr json(new kong::StructuredLogFormatter);
+    kong::LogFormatter::ptr logfmt(new kong::StructuredLogFormatter(kong::StructuredLogFormatter::LOGFMT));
+    kong::LogFormatter::ptr plain(new kong::LogFormatter("%d%T%p%T%m%K%n"));
+
+    //值需要加引号和转义
+    kong::LogEvent::ptr event = MakeEvent(logger, kong::LogLevel::INFO);
+    event->kv("user", 42).kv("ratio", 0.1).kv("ok", true).kv("path", "/a b\"c\n");
+    event->getSS() << "login \"quoted\"";
+    Expect(json->format(logger, kong::LogLevel::INFO, event),
+           "{\"time\":\"1970-01-01 00:00:00\",\"level\":\"INFO\",\"logger\":\"structured\","
+           "\"thread\":11,\"thread_name\":\"main\",\"fiber\":22,\"file\":\"test_log_format.cpp\",\"line\":7,"
+           "\"msg\":\"login \\\"quoted\\\"\",\"user\":42,\"ratio\":0.1,\"ok\":true,"
+           "\"path\":\"/a b\\\"c\\n\"}\n", "json values");
+    Expect(logfmt->format(logger, kong::LogLevel::INFO, event),
+           "time=\"1970-01-01 00:00:00\" level=INFO logger=structured thread=11 thread_name=main"
+           " fiber=22 file=test_log_format.cpp line=7 msg=\"login \\\"quoted\\\"\" user=42 ratio=0.1 ok=true"
+           " path=\"/a b\\\"c\\n\"\n", "logfmt values");
+    Expect(plain->format(logger, kong::LogLevel::INFO, event),
+           "1970-01-01 00:00:00\tINFO\tlogin \"quoted\" user=42 ratio=0.1 ok=true path=\"/a b\\\"c\\n\"\n",
+           "pattern values");
+
+    //键不能加引号, 空格、等号、引号、控制字符替换为'_', 空键写成"_"
+    event = MakeEvent(logger, kong::LogLevel::WARN);
+    event->kv("a b", 1).kv("k=v", 2).kv("q\"\n", 3).kv("", 4);
+    event->getSS() << "keys";
+    Expect(logfmt->format(logger, kong::LogLevel::WARN, event),
+           "time=\"1970-01-01 00:00:00\" level=WARN logger=structured thread=11 thread_name=main"
+           " fiber=22 file=test_log_format.cpp line=7 msg=keys a_b=1 k_v=2 q__=3 _=4\n", "logfmt keys");
+    Expect(plain->format(logger, kong::LogLevel::WARN, event),
+           "1970-01-01 00:00:00\tWARN\tkeys a_b=1 k_v=2 q__=3 _=4\n", "pattern keys");
+    Expect(json->format(logger, kong::LogLevel::WARN, event),
+           "{\"time\":\"1970-01-01 00:00:00\",\"level\":\"WARN\",\"logger\":\"structured\","
+           "\"thread\":11,\"thread_name\":\"main\",\"fiber\":22,\"file\":\"test_log_format.cpp\",\"line\":7,"
+           "\"msg\":\"keys\",\"a b\":1,\"k=v\":2,\"q\\\"\\n\":3,\"\":4}\n", "json keys");
+
+    //{}占位符和printf兼容格式
+    event = MakeEvent(logger, kong::LogLevel::INFO);
+    event->fmt("user={} cost={:.3f}ms ratio={} hex={:#x} name={:>8}|{{}}", 42, 1.5, 0.1, 255, "kong");
+    Expect(event->getContent(), "user=42 cost=1.500ms ratio=0.1 hex=0xff name=    kong|{}", "fmt");
+    event = MakeEvent(logger, kong::LogLevel::INFO);
+    event->fmtPrintf("printf drop-in %s %d %5.2f", 7, "not-an-int", 3.14159);
+    Expect(event->getContent(), "printf drop-in 7 not-an-int  3.14", "fmtPrintf");
+
+    if(s_failed) {
+        std::cout << s_failed << " log format checks failed" << std::endl;
+        return 1;
+    }
+    std::cout << "log format tests ok" << std::endl;
+    return 0;
+}
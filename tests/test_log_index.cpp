@@ -0,0 +1,77 @@
+#include "log/log.hpp"
+#include "log/log_index.hpp"
+#include <iostream>
+#include <fstream>
+#include <unistd.h>
+#include <time.h>
+
+/**
+ * @brief 校验索引连续覆盖日志文件且块边界落在记录开头, 累加含ERROR的块数
+ */
+static bool Check(const std::string& path, size_t& errors) {
+    kong::LogIndexReader index;
+    if(!index.load(path)) {
+        std::cout << "load index " << path << " failed" << std::endl;
+        return false;
+    }
+    auto& entries = index.getEntries();
+    std::ifstream ifs(path.c_str());
+    std::string line;
+    uint64_t pos = 0;
+    size_t error_blocks = 0;
+    for(auto& e : entries) {
+        if(e.offset != pos || e.minNs > e.maxNs) {
+            std::cout << "index gap at " << pos << std::endl;
+            return false;
+        }
+        ifs.seekg(e.offset);
+        std::getline(ifs, line);
+        if(line.find("[INFO]") == std::string::npos && line.find("[ERROR]") == std::string::npos) {
+            std::cout << "block not aligned to a record: " << line << std::endl;
+            return false;
+        }
+        if(e.levelMask & (1u << kong::LogLevel::ERROR)) {
+            ++error_blocks;
+        }
+        pos = e.offset + e.length;
+    }
+    std::cout << path << ": blocks " << entries.size() << " error blocks " << error_blocks
+              << " indexed " << pos << " bytes" << std::endl;
+    errors += error_blocks;
+    return !entries.empty();
+}
+
+int main(int argc, char** argv) {
+    const char* path = "/tmp/kong_test_log_index.log";
+    std::string rotated = std::string(path) + ".1";
+    for(auto& i : {std::string(path), rotated}) {
+        unlink(i.c_str());
+        unlink((i + ".idx").c_str());
+    }
+
+    //一天的日志, 每隔一段出现一次ERROR, 写到一半时被外部轮转为.1
+    const int n = 200000;
+    time_t base = time(0) - 86400;
+    {
+        kong::Logger::ptr logger(new kong::Logger("index"));
+        logger->addAppender(kong::LogAppender::ptr(new kong::FileLogAppender(path, 16 * 1024)));
+        for(int i = 0; i < n; ++i) {
+            kong::LogLevel::Level level = i % 5000 == 0 ? kong::LogLevel::ERROR : kong::LogLevel::INFO;
+            kong::LogEvent::ptr event(new kong::LogEvent(logger, level, __FILE__, __LINE__, 0
+                        ,kong::GetThreadId(), 0, base + (uint64_t)i * 86400 / n, "main"));
+            event->getSS() << "request " << i << " done";
+            logger->log(level, event);
+            if(i == n / 2) {
+                rename(path, rotated.c_str());
+            }
+        }
+    }
+
+    //轮转文件保留自己的索引, 新文件重建索引
+    size_t errors = 0;
+    if(!Check(rotated, errors) || !Check(path, errors) || errors != (size_t)n / 5000) {
+        std::cout << "error blocks " << errors << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "log/log.hpp"
+#include "test_util.hpp"
+#include <iostream>
+
+static kong::LoggerRef g_logger("test.ref");
+
+/// 记录收到的日志器指针的引用计数
+class RefCountAppender : public kong::LogAppender {
+public:
+    void log(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event) override {
+        ++count;
+        loggerUse = logger.use_count();
+        eventLoggerUse = event->getLogger().use_count();
+        managerUse = KONG_LOG_NAME("test.ref").use_count() - 1;
+    }
+    int count = 0;
+    long loggerUse = -1;
+    long eventLoggerUse = -1;
+    long managerUse = -1;
+};
+
+/// 静态初始化阶段使用
+struct StaticUser {
+    StaticUser() {
+        KONG_LOG_INFO(g_logger) << "logged during static initialization";
+    }
+};
+static StaticUser s_user;
+
+int main(int argc, char** argv) {
+    KONG_LOG_NAMED_INFO("test.ref") << "named macro";
+    if(KONG_LOG_NAME("test.ref").get() != g_logger.get()) {
+        std::cout << "ref resolved to a different logger" << std::endl;
+        return 1;
+    }
+
+    //重新配置后引用依然有效
+    g_logger->setLevel(kong::LogLevel::ERROR);
+    KONG_LOG_INFO(g_logger) << "filtered";
+    KONG_LOG_ERROR(g_logger) << "after reconfigure";
+
+    //缓存路径不碰引用计数: 事件和Appender拿到的是不共享控制块的指针, 管理器持有的计数不变
+    std::shared_ptr<RefCountAppender> rc(new RefCountAppender);
+    g_logger->addAppender(rc);
+    long before = KONG_LOG_NAME("test.ref").use_count() - 1;
+    for(int i = 0; i < 3; ++i) {
+        KONG_LOG_NAMED_ERROR("test.ref") << "named " << i;
+        if(rc->count != i + 1 || rc->loggerUse != 0 || rc->eventLoggerUse != 0
+                || rc->managerUse != before) {
+            std::cout << "named statement touched the refcount: logger=" << rc->loggerUse
+                      << " event=" << rc->eventLoggerUse << " manager=" << rc->managerUse
+                      << " before=" << before << std::endl;
+            return 1;
+        }
+    }
+    KONG_LOG_ERROR(g_logger) << "ref";
+    if(rc->count != 4 || rc->loggerUse != 0 || rc->eventLoggerUse != 0 || rc->managerUse != before) {
+        std::cout << "LoggerRef statement touched the refcount" << std::endl;
+        return 1;
+    }
+    g_logger->clearAppenders();
+
+    //级别被过滤时只剩查找的开销
+    const int n = 5000000;
+    uint64_t b = MonoNs();
+    for(int i = 0; i < n; ++i) {
+        KONG_LOG_DEBUG(KONG_LOG_NAME("test.ref")) << i;
+    }
+    uint64_t e = MonoNs();
+    std::cout << "KONG_LOG_NAME " << (double)(e - b) / n << " ns/statement" << std::endl;
+
+    b = MonoNs();
+    for(int i = 0; i < n; ++i) {
+        KONG_LOG_NAMED_DEBUG("test.ref") << i;
+    }
+    e = MonoNs();
+    std::cout << "KONG_LOG_NAMED " << (double)(e - b) / n << " ns/statement" << std::endl;
+    return 0;
+}
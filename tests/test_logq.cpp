@@ -0,0 +1,128 @@
+#include "log/log.hpp"
+#include "test_util.hpp"
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+/// 一小时的日志, 每秒一条, 级别按INFO/WARN/ERROR轮换, 每50条带一个needle
+static const int s_count = 3600;
+
+static std::string FormatTime(time_t t) {
+    struct tm tm;
+    localtime_r(&t, &tm);
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    return buf;
+}
+
+/**
+ * @brief 运行kong-logq, 返回输出的各行中"event "之后的序号, stats为-v输出的统计
+ */
+static bool RunLogq(const std::string& logq, const std::string& args, const std::string& file
+                ,std::vector<int>& ids, std::string& stats) {
+    std::string errfile = file + ".stats";
+    std::string cmd = logq + " -v " + args + " " + file + " 2>" + errfile;
+    FILE* fp = popen(cmd.c_str(), "r");
+    if(!fp) {
+        return false;
+    }
+    ids.clear();
+    char line[4096];
+    while(fgets(line, sizeof(line), fp)) {
+        const char* p = strstr(line, "event ");
+        ids.push_back(p ? atoi(p + 6) : -1);
+    }
+    int status = pclose(fp);
+    FILE* err = fopen(errfile.c_str(), "r");
+    stats.clear();
+    if(err && fgets(line, sizeof(line), err)) {
+        stats = line;
+    }
+    if(err) {
+        fclose(err);
+    }
+    unlink(errfile.c_str());
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * @brief 从-v统计中取出"blocks 选中/总数"
+ */
+static bool ParseBlocks(const std::string& stats, int& selected, int& total) {
+    return sscanf(stats.c_str(), "blocks %d/%d", &selected, &total) == 2;
+}
+
+static kong::LogLevel::Level LevelOf(int i) {
+    static const kong::LogLevel::Level levels[] = {kong::LogLevel::INFO, kong::LogLevel::WARN, kong::LogLevel::ERROR};
+    return levels[i % 3];
+}
+
+static bool TestQueries(const std::string& logq) {
+    const std::string path = "/tmp/kong_test_logq.log";
+    unlink(path.c_str());
+    unlink((path + ".idx").c_str());
+    time_t base = time(0) - 2 * 3600;
+    {
+        kong::Logger::ptr logger(new kong::Logger("logq"));
+        logger->addAppender(kong::LogAppender::ptr(new kong::FileLogAppender(path, 4096)));
+        for(int i = 0; i < s_count; ++i) {
+            kong::LogEvent::ptr event(new kong::LogEvent(logger, LevelOf(i), __FILE__, __LINE__, 0
+                        ,kong::GetThreadId(), 0, base + i, "main"));
+            event->getSS() << "event " << i << (i % 50 == 0 ? " needle" : "");
+            logger->log(LevelOf(i), event);
+        }
+    }
+    CHECK(access((path + ".idx").c_str(), F_OK) == 0);
+
+    std::vector<int> ids;
+    std::string stats;
+    int selected = 0, total = 0;
+    //时间范围: 两端包含, 只扫描索引选中的块
+    std::string range = "-s '" + FormatTime(base + 1000) + "' -e '" + FormatTime(base + 1099) + "'";
+    CHECK(RunLogq(logq, range, path, ids, stats));
+    CHECK(ids.size() == 100);
+    for(size_t i = 0; i < ids.size(); ++i) {
+        CHECK(ids[i] == 1000 + (int)i);
+    }
+    CHECK(ParseBlocks(stats, selected, total) && total > 10 && selected * 5 < total);
+    std::cout << "time range: " << stats;
+
+    //最低级别
+    CHECK(RunLogq(logq, "-l ERROR", path, ids, stats));
+    CHECK(ids.size() == s_count / 3);
+    for(size_t i = 0; i < ids.size(); ++i) {
+        CHECK(ids[i] == 3 * (int)i + 2);
+    }
+
+    //子串与时间组合
+    CHECK(RunLogq(logq, "-g needle", path, ids, stats));
+    CHECK(ids.size() == s_count / 50);
+    for(size_t i = 0; i < ids.size(); ++i) {
+        CHECK(ids[i] == 50 * (int)i);
+    }
+    CHECK(RunLogq(logq, range + " -g needle -c logq", path, ids, stats));
+    CHECK(ids.size() == 2 && ids[0] == 1000 && ids[1] == 1050);
+    CHECK(RunLogq(logq, "-c other", path, ids, stats) && ids.empty());
+
+    unlink(path.c_str());
+    unlink((path + ".idx").c_str());
+    return true;
+}
+
+int main(int argc, char** argv) {
+    //kong-logq与测试程序在同一目录
+    std::string dir = argv[0];
+    size_t pos = dir.rfind('/');
+    dir = pos == std::string::npos ? "." : dir.substr(0, pos);
+    if(!TestQueries(dir + "/kong-logq")) {
+        return 1;
+    }
+    std::cout << "logq ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,183 @@
+#include "utils/lru_cache.hpp"
+#include "log/log.hpp"
+#include "test_util.hpp"
+#include <algorithm>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+
+static kong::Logger::ptr g_logger = KONG_LOG_ROOT();
+
+using kong::CachePolicy;
+using kong::LruCache;
+using kong::TimedCache;
+
+static bool TestLru() {
+    //单分片, 淘汰顺序确定
+    LruCache<int, std::string> cache(3, 1);
+    cache.set(1, "a");
+    cache.set(2, "b");
+    cache.set(3, "c");
+    std::string v;
+    CHECK(cache.get(1, v) && v == "a");
+    cache.set(4, "d");
+    //2最久未使用
+    CHECK(!cache.exists(2) && cache.exists(1) && cache.exists(3) && cache.exists(4));
+    cache.set(3, "cc");
+    cache.set(5, "e");
+    CHECK(!cache.exists(1) && cache.get(3, v) && v == "cc");
+    CHECK(cache.del(5) && !cache.del(5) && cache.size() == 2);
+    kong::CacheStats st = cache.getStats();
+    CHECK(st.hits == 2 && st.evictions == 2 && st.sets == 6);
+    return true;
+}
+
+static bool TestClock() {
+    LruCache<int, int> cache(3, 1, CachePolicy::CLOCK);
+    cache.set(1, 1);
+    cache.set(2, 2);
+    cache.set(3, 3);
+    int v;
+    //1被访问过, 获得第二次机会; 淘汰2
+    CHECK(cache.get(1, v));
+    cache.set(4, 4);
+    CHECK(cache.exists(1) && !cache.exists(2) && cache.exists(3) && cache.exists(4));
+    //大量插入后容量不超限
+    for(int i = 10; i < 1000; ++i) {
+        cache.set(i, i);
+        cache.get(i - 1, v);
+    }
+    CHECK(cache.size() == 3);
+    return true;
+}
+
+static bool TestWeight() {
+    //按字节数计容量
+    LruCache<std::string, std::string> cache(100, 1, CachePolicy::LRU
+            ,[](const std::string& k, const std::string& v) { return k.size() + v.size();});
+    cache.set("a", std::string(40, 'x'));
+    cache.set("b", std::string(40, 'x'));
+    CHECK(cache.getStats().weight == 82);
+    cache.set("c", std::string(40, 'x'));
+    CHECK(!cache.exists("a") && cache.exists("b") && cache.exists("c"));
+    //单个超过容量的条目仍可写入, 其它条目被淘汰
+    cache.set("d", std::string(200, 'x'));
+    CHECK(cache.size() == 1 && cache.exists("d"));
+    return true;
+}
+
+static bool TestTimed() {
+    TimedCache<int, int> cache(100, 4);
+    cache.set(1, 1, 50);
+    cache.set(2, 2, 0);
+    cache.set(3, 3, 50);
+    CHECK(cache.expired(3, 10000));
+    int v;
+    CHECK(cache.get(1, v) && v == 1);
+    usleep(80000);
+    //exists不删除条目, 留给checkTimeout
+    CHECK(!cache.exists(1) && cache.get(2, v) && cache.exists(3));
+    CHECK(cache.checkTimeout() == 1 && cache.size() == 2);
+    //覆盖写入时更新过期时间
+    cache.set(2, 22, 1);
+    usleep(5000);
+    CHECK(cache.checkTimeout() == 1 && !cache.exists(2));
+    KONG_LOG_INFO(g_logger) << "timed cache " << cache.toStatusString();
+    return true;
+}
+
+/**
+ * @brief 对照组: 一把锁保护的std::map
+ */
+class MapCache {
+public:
+    bool get(int key, int& value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto it = m_map.find(key);
+        if(it == m_map.end()) {
+            return false;
+        }
+        value = it->second;
+        return true;
+    }
+
+    void set(int key, int value) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_map[key] = value;
+    }
+private:
+    std::mutex m_mutex;
+    std::map<int, int> m_map;
+};
+
+/**
+ * @brief threads个线程各做ops次操作, 90%读; 返回每秒操作数
+ */
+template<class Cache>
+static double Bench(Cache& cache, int threads, int ops) {
+    std::vector<std::thread> ts;
+    uint64_t b = MonoNs();
+    for(int t = 0; t < threads; ++t) {
+        ts.emplace_back([&cache, t, ops]() {
+            uint64_t x = 0x9E3779B97F4A7C15ULL * (t + 1);
+            int v;
+            for(int i = 0; i < ops; ++i) {
+                x ^= x << 13;
+                x ^= x >> 7;
+                x ^= x << 17;
+                //热点: 80%的访问落在20%的key上
+                int key = (x % 10 < 8) ? (x >> 8) % 20000 : (x >> 8) % 100000;
+                if(x % 100 < 90) {
+                    cache.get(key, v);
+                } else {
+                    cache.set(key, i);
+                }
+            }
+        });
+    }
+    for(auto& t : ts) {
+        t.join();
+    }
+    return (double)threads * ops / ((MonoNs() - b) / 1e9);
+}
+
+int main(int argc, char** argv) {
+    if(!TestLru() || !TestClock() || !TestWeight() || !TestTimed()) {
+        return 1;
+    }
+    std::cout << "cache tests ok" << std::endl;
+    int ops = argc > 1 ? atoi(argv[1]) : 1000000;
+    std::cout << "threads  map+mutex  LRU(1 shard)  LRU(64 shards)  CLOCK(64 shards)  (Mops/s, best of 3)" << std::endl;
+    for(int threads : {1, 2, 4, 8, 16, 32}) {
+        MapCache map;
+        LruCache<int, int> global(50000, 1);
+        LruCache<int, int> lru(50000, 64);
+        LruCache<int, int> clock(50000, 64, CachePolicy::CLOCK);
+        //预热到稳定状态: 缓存已满, 热点key都在缓存中
+        for(int k = 100000; k-- > 0;) {
+            map.set(k, k);
+            global.set(k, k);
+            lru.set(k, k);
+            clock.set(k, k);
+        }
+        int per = ops / threads;
+        double best[4] = {0, 0, 0, 0};
+        for(int r = 0; r < 3; ++r) {
+            best[0] = std::max(best[0], Bench(map, threads, per));
+            best[1] = std::max(best[1], Bench(global, threads, per));
+            best[2] = std::max(best[2], Bench(lru, threads, per));
+            best[3] = std::max(best[3], Bench(clock, threads, per));
+        }
+        std::cout << threads;
+        for(double b : best) {
+            std::cout << "  " << b / 1e6;
+        }
+        std::cout << std::endl;
+        if(threads == 32) {
+            KONG_LOG_INFO(g_logger) << "clock cache " << clock.toStatusString();
+        }
+    }
+    return 0;
+}
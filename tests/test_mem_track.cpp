@@ -0,0 +1,192 @@
+#include "utils/mem_track.hpp"
+#include "metrics/metrics.hpp"
+#include "utils/thread.hpp"
+#include "test_util.hpp"
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+using kong::MemStats;
+using kong::MemTracker;
+
+static const kong::MemSnapshot::Tag* FindTag(const kong::MemSnapshot& snap, const std::string& name) {
+    for(auto& i : snap.tags) {
+        if(i.name == name) {
+            return &i;
+        }
+    }
+    return nullptr;
+}
+
+/// 测试程序用-rdynamic链接, 报告中能看到函数名
+extern "C" __attribute__((noinline)) std::vector<char*>* MemTestLeaky(int n) {
+    std::vector<char*>* rt = new std::vector<char*>();
+    for(int i = 0; i < n; ++i) {
+        rt->push_back(new char[1000]);
+    }
+    return rt;
+}
+
+static bool TestCounting() {
+    CHECK(MemTracker::IsInstalled());
+    MemStats b = MemTracker::GetThreadStats();
+    std::vector<int*> v;
+    for(int i = 0; i < 100; ++i) {
+        v.push_back(new int(i));
+    }
+    MemStats m = MemTracker::GetThreadStats() - b;
+    CHECK(m.alloc_count >= 100 && m.alloc_bytes >= 100 * sizeof(int));
+    for(auto i : v) {
+        delete i;
+    }
+    m = MemTracker::GetThreadStats() - b;
+    CHECK(m.free_count >= 100);
+    return true;
+}
+
+static bool TestTags() {
+    std::vector<std::string*> kept;
+    kept.reserve(64);
+    {
+        KONG_MEM_SCOPE("test.parser");
+        for(int i = 0; i < 50; ++i) {
+            kept.push_back(new std::string(200, 'x'));
+        }
+        {
+            KONG_MEM_SCOPE("test.inner");
+            //volatile避免编译器消除成对的new/delete
+            char* volatile p = new char[4096];
+            delete[] p;
+        }
+        //内层作用域结束后恢复外层标签
+        kept.push_back(new std::string(200, 'y'));
+    }
+    kong::MemSnapshot snap = MemTracker::Snapshot();
+    const kong::MemSnapshot::Tag* parser = FindTag(snap, "test.parser");
+    const kong::MemSnapshot::Tag* inner = FindTag(snap, "test.inner");
+    CHECK(parser && parser->stats.liveCount() >= 102 && parser->stats.liveBytes() >= 51 * 200);
+    CHECK(inner && inner->stats.alloc_bytes == 4096 && inner->stats.liveBytes() == 0);
+    //在别的作用域和线程释放, 仍记在分配时的标签上
+    kong::Thread t([&kept]() {
+        for(auto i : kept) {
+            delete i;
+        }
+    }, "mem_free");
+    t.join();
+    snap = MemTracker::Snapshot();
+    parser = FindTag(snap, "test.parser");
+    CHECK(parser->stats.liveCount() == 0 && parser->stats.liveBytes() == 0);
+    CHECK(MemTracker::RegisterTag("test.parser") == MemTracker::RegisterTag("test.parser"));
+    std::cout << snap.toString();
+    return true;
+}
+
+static bool TestSampling() {
+    MemTracker::SetSampleRate(1);
+    std::vector<char*>* leaked = MemTestLeaky(20);
+    MemTracker::SetSampleRate(0);
+    std::string report = MemTracker::LiveSamplesReport(5);
+    std::cout << report;
+    CHECK(report.find("MemTestLeaky") != std::string::npos);
+    CHECK(report.find("count=20 bytes=20000") != std::string::npos);
+    CHECK(MemTracker::LiveSamplesReport(5, 60000).find("MemTestLeaky") == std::string::npos);
+    for(auto i : *leaked) {
+        delete[] i;
+    }
+    delete leaked;
+    CHECK(MemTracker::LiveSamplesReport(5).find("MemTestLeaky") == std::string::npos);
+    CHECK(MemTracker::Snapshot().sampled_live == 0);
+
+    //1/100抽样时, 抽中的数量应在期望附近
+    MemTracker::SetSampleRate(100);
+    std::vector<int*> v;
+    for(int i = 0; i < 100000; ++i) {
+        v.push_back(new int(i));
+    }
+    uint64_t sampled = MemTracker::Snapshot().sampled_live;
+    MemTracker::SetSampleRate(0);
+    for(auto i : v) {
+        delete i;
+    }
+    std::cout << "1/100 sampling: " << sampled << " of 100000 live allocations sampled" << std::endl;
+    CHECK(sampled > 700 && sampled < 1400);
+    return true;
+}
+
+static bool TestMetrics() {
+    MemTracker::UpdateMetrics();
+    kong::metrics::MetricRegistry::Labels labels;
+    labels["tag"] = "all";
+    auto g = kong::metrics::MetricsMgr::GetInstance()->getGauge("kong_mem_alloc_count", "", labels);
+    CHECK(g->value() > 0);
+    MemTracker::LogSnapshot(KONG_LOG_NAME("system"));
+    return true;
+}
+
+class NullAppender : public kong::LogAppender {
+public:
+    void log(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event) override {}
+    void logRendered(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event
+                     ,const kong::LogBuffer& buf) override {}
+    bool acceptsRendered() const override { return true;}
+};
+
+/**
+ * @brief 每条日志、每次stringstream格式化的分配次数
+ */
+static bool MeasureChurn() {
+    kong::Logger::ptr logger(new kong::Logger("mem_churn"));
+    logger->addAppender(kong::LogAppender::ptr(new NullAppender));
+    const int n = 10000;
+    for(int i = 0; i < 100; ++i) {
+        KONG_LOG_INFO(logger) << "warm up " << i;
+    }
+    MemStats b = MemTracker::GetThreadStats();
+    for(int i = 0; i < n; ++i) {
+        KONG_LOG_INFO(logger) << "request id=" << i << " path=/index.html";
+    }
+    MemStats log = MemTracker::GetThreadStats() - b;
+
+    b = MemTracker::GetThreadStats();
+    size_t total = 0;
+    for(int i = 0; i < n; ++i) {
+        std::stringstream ss;
+        ss << "request id=" << i << " path=/index.html";
+        total += ss.str().size();
+    }
+    MemStats sstream = MemTracker::GetThreadStats() - b;
+    std::cout << "per KONG_LOG_INFO: " << (double)log.alloc_count / n << " allocs, "
+              << log.alloc_bytes / n << " bytes" << std::endl;
+    std::cout << "per stringstream format: " << (double)sstream.alloc_count / n << " allocs, "
+              << sstream.alloc_bytes / n << " bytes (" << total / n << " chars)" << std::endl;
+    CHECK(log.alloc_count > 0 && log.liveCount() == 0);
+    return true;
+}
+
+/**
+ * @brief new/delete一对的耗时, 分别在不抽样和1/1000抽样时
+ */
+static bool Bench() {
+    const int n = 2000000;
+    for(uint32_t rate : {0u, 1000u}) {
+        MemTracker::SetSampleRate(rate);
+        uint64_t b = MonoNs();
+        for(int i = 0; i < n; ++i) {
+            int* volatile p = new int(i);
+            delete p;
+        }
+        uint64_t ns = MonoNs() - b;
+        std::cout << "new+delete sample_rate=" << rate << ": " << (double)ns / n << " ns/op" << std::endl;
+    }
+    MemTracker::SetSampleRate(0);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if(!TestCounting() || !TestTags() || !TestSampling() || !TestMetrics()
+            || !MeasureChurn() || !Bench()) {
+        return 1;
+    }
+    std::cout << "mem track tests ok" << std::endl;
+    return 0;
+}
@@ -0,0 +1,176 @@
+#include "metrics/metrics.hpp"
+#include "metrics/metrics_exporter.hpp"
+#include "test_util.hpp"
+#include <arpa/inet.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace kong::metrics;
+
+static std::string HttpGet(uint16_t port, const std::string& path) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
+    std::string rsp;
+    if(connect(fd, (sockaddr*)&sa, sizeof(sa)) == 0) {
+        std::string req = "GET " + path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        send(fd, req.c_str(), req.size(), 0);
+        char buf[4096];
+        ssize_t n;
+        while((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+            rsp.append(buf, n);
+        }
+    }
+    close(fd);
+    return rsp;
+}
+
+int main(int argc, char** argv) {
+    MetricRegistry* reg = MetricsMgr::GetInstance();
+
+    //多线程计数, 包括已退出线程的值
+    Counter::ptr requests = reg->getCounter("requests_total", "Handled requests", {{"stage", "decode"}});
+    Gauge::ptr inflight = reg->getGauge("inflight", "Requests in flight");
+    Histogram::ptr latency = reg->getHistogram("latency_ns", "Request latency");
+    std::vector<std::thread> ts;
+    for(int t = 0; t < 4; ++t) {
+        ts.emplace_back([requests, inflight, latency]() {
+            for(int i = 1; i <= 25000; ++i) {
+                inflight->inc();
+                requests->inc();
+                latency->record(i);
+                inflight->dec();
+            }
+        });
+    }
+    for(auto& t : ts) {
+        t.join();
+    }
+    if(requests->value() != 100000 || inflight->value() != 0) {
+        std::cout << "counter " << requests->value() << " gauge " << inflight->value() << std::endl;
+        return 1;
+    }
+    inflight->inc();
+    inflight->set(7);
+    if(inflight->value() != 7) {
+        std::cout << "gauge set failed: " << inflight->value() << std::endl;
+        return 1;
+    }
+
+    //分位数误差在桶宽以内
+    HistogramSnapshot snap = latency->snapshot();
+    for(double q : {0.5, 0.9, 0.99}) {
+        double expect = q * 25000;
+        double got = snap.percentile(q);
+        if(std::abs(got - expect) / expect > 1.0 / 32) {
+            std::cout << "p" << q << " expect " << expect << " got " << got << std::endl;
+            return 1;
+        }
+    }
+    if(snap.getCount() != 100000 || snap.getSum() != 4 * 25000ULL * 25001 / 2) {
+        std::cout << "histogram count " << snap.getCount() << " sum " << snap.getSum() << std::endl;
+        return 1;
+    }
+    HistogramSnapshot merged = snap;
+    merged.merge(snap);
+    if(merged.getCount() != 200000 || merged.percentile(0.5) != snap.percentile(0.5)) {
+        std::cout << "merge failed" << std::endl;
+        return 1;
+    }
+    for(uint64_t v : {0ULL, 31ULL, 32ULL, 1000ULL, 123456789ULL, 1ULL << 43}) {
+        uint32_t idx = Histogram::BucketIndex(v);
+        if(v < Histogram::BucketLower(idx) || v > Histogram::BucketUpper(idx)) {
+            std::cout << "bucket " << idx << " does not contain " << v << std::endl;
+            return 1;
+        }
+    }
+
+    //注册表
+    if(reg->getCounter("requests_total", "", {{"stage", "decode"}}) != requests
+            || reg->getGauge("requests_total") || reg->getHistogram("inflight")) {
+        std::cout << "registry lookup failed" << std::endl;
+        return 1;
+    }
+    //不合法的指标名和标签名在注册时拒绝
+    if(reg->getCounter("bad-name") || reg->getCounter("1st") || reg->getCounter("ok_total", "", {{"bad label", "x"}})
+            || reg->getCounter("ok_total", "", {{"9x", "x"}}) || reg->getCounter("ok_total", "", {{"__name__", "x"}})
+            || reg->getCounter("ok_total", "", {{"a:b", "x"}}) || !reg->getCounter("ns:ok_total", "", {{"_a1", "x"}})) {
+        std::cout << "name validation failed" << std::endl;
+        return 1;
+    }
+    reg->getGauge("escaped_help", "line one\nback\\slash");
+
+    std::string text = reg->toPrometheus();
+    if(text.find("# HELP escaped_help line one\\nback\\\\slash\n# TYPE escaped_help gauge\n") == std::string::npos) {
+        std::cout << "HELP text not escaped" << std::endl;
+        return 1;
+    }
+    if(text.find("# TYPE requests_total counter\nrequests_total{stage=\"decode\"} 100000\n") == std::string::npos
+            || text.find("inflight 7\n") == std::string::npos
+            || text.find("latency_ns_count 100000\n") == std::string::npos
+            || text.find("latency_ns{quantile=\"0.99\"} ") == std::string::npos) {
+        std::cout << text;
+        return 1;
+    }
+
+    //导出到文件和HTTP端点
+    MetricsExporter exporter(50);
+    exporter.setFile("metrics_test.prom");
+    exporter.start();
+    usleep(120 * 1000);
+    exporter.stop();
+    std::ifstream ifs("metrics_test.prom");
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    if(ss.str() != reg->toPrometheus()) {
+        std::cout << "prometheus file mismatch" << std::endl;
+        return 1;
+    }
+    remove("metrics_test.prom");
+
+    PrometheusHttpServer server(0);
+    if(!server.start()) {
+        std::cout << "http server start failed" << std::endl;
+        return 1;
+    }
+    std::string rsp = HttpGet(server.getPort(), "/metrics");
+    if(rsp.compare(0, 15, "HTTP/1.1 200 OK") || rsp.find("requests_total{stage=\"decode\"} 100000") == std::string::npos
+            || HttpGet(server.getPort(), "/other").compare(0, 12, "HTTP/1.1 404")) {
+        std::cout << "http export failed: " << rsp << std::endl;
+        return 1;
+    }
+    server.stop();
+    std::cout << reg->toSummary();
+
+    //记录开销
+    const int n = argc > 1 ? atoi(argv[1]) : 10000000;
+    Counter::ptr c = reg->getCounter("bench_total");
+    Histogram::ptr h = reg->getHistogram("bench_ns");
+    std::atomic<uint64_t> shared{0};
+    uint64_t b = MonoNs();
+    for(int i = 0; i < n; ++i) {
+        c->inc();
+    }
+    double counter_ns = (double)(MonoNs() - b) / n;
+    b = MonoNs();
+    for(int i = 0; i < n; ++i) {
+        h->record(i & 0xffff);
+    }
+    double hist_ns = (double)(MonoNs() - b) / n;
+    b = MonoNs();
+    for(int i = 0; i < n; ++i) {
+        shared.fetch_add(1, std::memory_order_relaxed);
+    }
+    double atomic_ns = (double)(MonoNs() - b) / n;
+    std::cout << "counter.inc " << counter_ns << " ns, histogram.record " << hist_ns
+              << " ns, shared atomic fetch_add " << atomic_ns << " ns" << std::endl;
+    return 0;
+}
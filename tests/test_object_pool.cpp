@@ -0,0 +1,149 @@
+#include "utils/object_pool.hpp"
+#include "utils/spsc_queue.hpp"
+#include "log/log.hpp"
+#include "test_util.hpp"
+#include <iostream>
+#include <thread>
+
+struct Foo {
+    Foo(int v)
+        :value(v) {
+    }
+    int value;
+    char pad[60];
+};
+
+static kong::PoolStats StatsOf(size_t size) {
+    for(auto& i : kong::SlabAllocator::GetStats()) {
+        if(i.objectSize >= size) {
+            return i;
+        }
+    }
+    return kong::PoolStats();
+}
+
+/// 多线程同时申请释放, 每轮持有live个对象
+template<class Alloc, class Free>
+static double Churn(int threads, int n, Alloc alloc, Free free) {
+    uint64_t b = MonoNs();
+    std::vector<std::thread> ts;
+    for(int t = 0; t < threads; ++t) {
+        ts.emplace_back([n, alloc, free]() {
+            const int live = 64;
+            void* objs[live];
+            for(int i = 0; i < n; i += live) {
+                for(int j = 0; j < live; ++j) {
+                    objs[j] = alloc();
+                }
+                for(int j = 0; j < live; ++j) {
+                    free(objs[j]);
+                }
+            }
+        });
+    }
+    for(auto& t : ts) {
+        t.join();
+    }
+    return (double)(MonoNs() - b) / ((double)threads * n);
+}
+
+int main(int argc, char** argv) {
+    //基本申请释放
+    {
+        std::vector<Foo*> v;
+        for(int i = 0; i < 1000; ++i) {
+            v.push_back(kong::ObjectPool<Foo>::Create(i));
+        }
+        kong::PoolStats s = StatsOf(sizeof(Foo));
+        if(s.inUse != 1000) {
+            std::cout << "in use " << s.inUse << " != 1000" << std::endl;
+            return 1;
+        }
+        for(int i = 0; i < 1000; ++i) {
+            if(v[i]->value != i) {
+                std::cout << "object " << i << " corrupted" << std::endl;
+                return 1;
+            }
+            kong::ObjectPool<Foo>::Destroy(v[i]);
+        }
+        if(StatsOf(sizeof(Foo)).inUse != 0) {
+            std::cout << "objects leaked" << std::endl;
+            return 1;
+        }
+    }
+
+    //跨线程释放: 一个线程申请, 另一个线程释放, 稳定后不再申请slab
+    {
+        uint64_t slabs = 0;
+        for(int round = 0; round < 5; ++round) {
+            kong::SpscQueue<Foo*> queue(1024);
+            std::thread producer([&queue]() {
+                for(int i = 0; i < 100000; ++i) {
+                    Foo* f = kong::ObjectPool<Foo>::Create(i);
+                    while(!queue.push(std::move(f))) {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+            std::thread consumer([&queue]() {
+                Foo* f = nullptr;
+                for(int i = 0; i < 100000; ) {
+                    if(queue.pop(f)) {
+                        if(f->value != i) {
+                            std::cout << "cross thread value mismatch" << std::endl;
+                            exit(1);
+                        }
+                        kong::ObjectPool<Foo>::Destroy(f);
+                        ++i;
+                    } else {
+                        std::this_thread::yield();
+                    }
+                }
+            });
+            producer.join();
+            consumer.join();
+            kong::PoolStats s = StatsOf(sizeof(Foo));
+            if(s.inUse != 0) {
+                std::cout << "cross thread in use " << s.inUse << std::endl;
+                return 1;
+            }
+            if(round == 1) {
+                slabs = s.slabs;
+            } else if(round > 1 && s.slabs != slabs) {
+                std::cout << "slabs kept growing: " << slabs << " -> " << s.slabs << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    //allocate_shared: 对象和控制块一起来自池
+    {
+        kong::Logger::ptr logger(new kong::Logger("pool"));
+        size_t before = 0;
+        for(auto& i : kong::SlabAllocator::GetStats()) {
+            before += i.inUse;
+        }
+        kong::LogEvent::ptr e = kong::MakePooled<kong::LogEvent>(logger, kong::LogLevel::INFO
+                , __FILE__, __LINE__, 0, 0, kong::Clock::NowNs(), "main");
+        size_t after = 0;
+        for(auto& i : kong::SlabAllocator::GetStats()) {
+            after += i.inUse;
+        }
+        if(after != before + 1) {
+            std::cout << "allocate_shared not pooled" << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << kong::SlabAllocator::DumpStats();
+
+    int n = argc > 1 ? atoi(argv[1]) : 2000000;
+    for(int threads = 1; threads <= 4; threads *= 2) {
+        double m = Churn(threads, n, []() { return ::operator new(sizeof(Foo));}
+                , [](void* p) { ::operator delete(p);});
+        double p = Churn(threads, n, []() { return kong::SlabAllocator::Alloc(sizeof(Foo));}
+                , [](void* p) { kong::SlabAllocator::Free(p, sizeof(Foo));});
+        std::cout << "threads " << threads << ": malloc " << m << " ns/op, pool " << p << " ns/op" << std::endl;
+    }
+    return 0;
+}
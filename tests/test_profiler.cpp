@@ -0,0 +1,185 @@
+#include "utils/profiler.hpp"
+#include "log/log_context.hpp"
+#include "test_util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iostream>
+#include <signal.h>
+#include <sstream>
+#include <string.h>
+#include <unistd.h>
+
+static volatile uint64_t s_sink = 0;
+
+/// 折叠栈中要能看到的函数不能是static, 测试程序用-rdynamic链接
+extern "C" __attribute__((noinline)) uint64_t ProfSpin(uint64_t n) {
+    uint64_t x = s_sink;
+    for(uint64_t i = 0; i < n; ++i) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    s_sink = x;
+    return x;
+}
+
+//使用返回值, 避免尾调用优化掉本函数的栈帧
+extern "C" __attribute__((noinline)) void ProfBusyA(uint64_t n) {
+    s_sink += ProfSpin(n * 3);
+}
+
+extern "C" __attribute__((noinline)) void ProfBusyB(uint64_t n) {
+    s_sink += ProfSpin(n);
+}
+
+static void Work(uint64_t n, int rounds) {
+    for(int i = 0; i < rounds; ++i) {
+        ProfBusyA(n);
+        ProfBusyB(n);
+    }
+}
+
+/**
+ * @brief 统计折叠栈中包含pattern的样本数
+ */
+static uint64_t CountSamples(const std::string& folded, const std::string& pattern) {
+    std::istringstream iss(folded);
+    std::string line;
+    uint64_t rt = 0;
+    while(std::getline(iss, line)) {
+        size_t pos = line.rfind(' ');
+        if(pos != std::string::npos && line.find(pattern) != std::string::npos) {
+            rt += std::stoull(line.substr(pos + 1));
+        }
+    }
+    return rt;
+}
+
+static bool TestProcessMode() {
+    kong::Profiler prof;
+    kong::ProfileOptions opt;
+    opt.frequency = 199;
+    CHECK(prof.start(opt) && prof.isRunning());
+    uint64_t b = MonoNs();
+    Work(1000000, 200);
+    uint64_t ms = (MonoNs() - b) / 1000000;
+    prof.stop();
+    std::string folded = prof.getFolded();
+    kong::ProfileStats st = prof.getStats();
+    uint64_t a = CountSamples(folded, "ProfBusyA;ProfSpin");
+    uint64_t bb = CountSamples(folded, "ProfBusyB;ProfSpin");
+    std::cout << "process mode: " << ms << " ms " << st.toString() << " A=" << a << " B=" << bb << std::endl;
+    //CPU时间约ms, 样本数应接近ms*199/1000
+    CHECK(st.samples > ms * 199 / 1000 / 2 && st.dropped == 0);
+    CHECK(a + bb > st.samples * 8 / 10);
+    CHECK(a > bb * 2 && a < bb * 4);
+    return true;
+}
+
+static bool TestThreadModeAndTags() {
+    std::atomic<int> go{0};
+    std::vector<kong::Thread::ptr> threads;
+    for(int i = 0; i < 2; ++i) {
+        threads.push_back(std::make_shared<kong::Thread>([&go, i]() {
+            KONG_LOG_CONTEXT("req", i == 0 ? "alpha" : "beta");
+            while(!go) {
+                usleep(100);
+            }
+            if(i == 0) {
+                ProfBusyA(1000000 * 60);
+            } else {
+                ProfBusyB(1000000 * 60);
+            }
+        }, "prof_w" + std::to_string(i)));
+    }
+    kong::Profiler prof;
+    kong::ProfileOptions opt;
+    opt.mode = kong::ProfileMode::THREAD;
+    opt.frequency = 197;
+    opt.tag_fiber = true;
+    opt.context_key = "req";
+    CHECK(prof.start(opt));
+    go = 1;
+    for(auto& i : threads) {
+        i->join();
+    }
+    prof.stop();
+    std::string folded = prof.getFolded();
+    uint64_t w0 = CountSamples(folded, "prof_w0;fiber_0;req=alpha;");
+    uint64_t w1 = CountSamples(folded, "prof_w1;fiber_0;req=beta;");
+    std::cout << "thread mode: " << prof.getStats().toString() << " w0=" << w0 << " w1=" << w1 << std::endl;
+    CHECK(w0 > 0 && w1 > 0);
+    CHECK(w0 == CountSamples(folded, "prof_w0;"));
+    //同一时间只能有一个Profiler在采样
+    kong::Profiler other;
+    CHECK(prof.start(opt) && !other.start(opt));
+    prof.stop();
+    return true;
+}
+
+static bool TestSignalToggle() {
+    const std::string path = "profile_test.folded";
+    unlink(path.c_str());
+    kong::Profiler prof;
+    CHECK(prof.enableSignalToggle(SIGUSR2, path));
+    raise(SIGUSR2);
+    uint64_t b = MonoNs();
+    while(!prof.isRunning() && MonoNs() - b < 1000000000ULL) {
+        usleep(1000);
+    }
+    CHECK(prof.isRunning());
+    Work(1000000, 50);
+    raise(SIGUSR2);
+    b = MonoNs();
+    while(access(path.c_str(), F_OK) && MonoNs() - b < 1000000000ULL) {
+        usleep(1000);
+    }
+    prof.disableSignalToggle();
+    std::ifstream ifs(path);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    std::cout << "signal toggle: " << prof.getStats().toString() << std::endl;
+    CHECK(!prof.isRunning() && CountSamples(ss.str(), "ProfSpin") > 0);
+    unlink(path.c_str());
+    return true;
+}
+
+/**
+ * @brief 99Hz下对同一工作量计时, 对比不采样时的耗时
+ */
+static bool BenchOverhead() {
+    const int kRounds = 5;
+    uint64_t base = UINT64_MAX, profiled = UINT64_MAX;
+    kong::ProfileStats st;
+    for(int r = 0; r < kRounds; ++r) {
+        uint64_t b = MonoNs();
+        Work(1000000, 100);
+        base = std::min(base, MonoNs() - b);
+
+        kong::Profiler prof;
+        prof.start();
+        b = MonoNs();
+        Work(1000000, 100);
+        uint64_t t = MonoNs() - b;
+        prof.stop();
+        if(t < profiled) {
+            profiled = t;
+            st = prof.getStats();
+        }
+    }
+    double overhead = (double)profiled / base - 1;
+    double handler = (double)st.handler_ns / (profiled ? profiled : 1);
+    std::cout << "overhead at 99Hz: base " << base / 1000000 << " ms, profiled " << profiled / 1000000
+              << " ms (" << overhead * 100 << "%), handler time " << handler * 100 << "% of "
+              << st.samples << " samples, " << (st.samples ? st.handler_ns / st.samples : 0)
+              << " ns/sample" << std::endl;
+    CHECK(handler < 0.01);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if(!TestProcessMode() || !TestThreadModeAndTags() || !TestSignalToggle() || !BenchOverhead()) {
+        return 1;
+    }
+    std::cout << "profiler tests ok" << std::endl;
+    return 0;
+}
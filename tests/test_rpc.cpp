@@ -0,0 +1,254 @@
+#include "net/rpc.hpp"
+#include "test_util.hpp"
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <unistd.h>
+
+using kong::ByteArray;
+using kong::RpcClient;
+using kong::RpcResult;
+using kong::RpcServer;
+using kong::RpcStatus;
+
+static int Add(int a, int b) {
+    return a + b;
+}
+
+static bool TestByteArray() {
+    ByteArray ba;
+    ba.writeFuint8(0xAB);
+    ba.writeFint16(-2);
+    ba.writeFuint32(0x12345678);
+    ba.writeFint64(-3);
+    ba.writeUint32(300);
+    ba.writeInt32(-1);
+    ba.writeInt64(INT64_MIN);
+    ba.writeUint64(UINT64_MAX);
+    ba.writeDouble(3.25);
+    ba.writeStringVint("hello");
+    ba.writeStringF32("world");
+    //varint: 300占2字节, zigzag(-1)=1占1字节
+    CHECK(ba.size() == 1 + 2 + 4 + 8 + 2 + 1 + 10 + 10 + 8 + 6 + 9);
+    ByteArray rd(ba.release());
+    CHECK(rd.readFuint8() == 0xAB);
+    CHECK(rd.readFint16() == -2);
+    CHECK(rd.readFuint32() == 0x12345678);
+    CHECK(rd.readFint64() == -3);
+    CHECK(rd.readUint32() == 300);
+    CHECK(rd.readInt32() == -1);
+    CHECK(rd.readInt64() == INT64_MIN);
+    CHECK(rd.readUint64() == UINT64_MAX);
+    CHECK(rd.readDouble() == 3.25);
+    CHECK(rd.readStringVint() == "hello");
+    CHECK(rd.readStringF32() == "world");
+    CHECK(rd.getReadSize() == 0);
+    bool thrown = false;
+    try {
+        rd.readFuint8();
+    } catch(std::out_of_range&) {
+        thrown = true;
+    }
+    CHECK(thrown);
+    return true;
+}
+
+static void Register(RpcServer& server) {
+    server.registerMethod("add", Add);
+    server.registerMethod("echo", [](const std::string& s) { return s;});
+    server.registerMethod("sum", [](const std::vector<int64_t>& v) {
+        int64_t s = 0;
+        for(auto i : v) {
+            s += i;
+        }
+        return s;
+    });
+    server.registerMethod("invert", [](const std::map<std::string, uint32_t>& m) {
+        std::map<uint32_t, std::string> r;
+        for(auto& i : m) {
+            r[i.second] = i.first;
+        }
+        return r;
+    });
+    server.registerMethod("noop", []() {});
+    server.registerMethod("sleep", [](uint32_t ms) {
+        usleep(ms * 1000);
+        return ms;
+    });
+    server.registerMethod("fail", [](const std::string& msg) -> int {
+        throw std::runtime_error(msg);
+    });
+}
+
+static bool TestCalls(RpcServer& server) {
+    RpcClient client;
+    CHECK(client.connect("127.0.0.1", server.getPort()));
+    RpcResult<int> a = client.call<int>("add", 1000, 20, 22);
+    CHECK(a.ok() && a.value == 42);
+    RpcResult<std::string> e = client.call<std::string>("echo", 1000, std::string(100000, 'x'));
+    CHECK(e.ok() && e.value.size() == 100000);
+    RpcResult<int64_t> s = client.call<int64_t>("sum", 1000, std::vector<int64_t>{-5, 10, 1LL << 40});
+    CHECK(s.ok() && s.value == 5 + (1LL << 40));
+    std::map<std::string, uint32_t> m = {{"a", 1}, {"b", 2}};
+    RpcResult<std::map<uint32_t, std::string> > inv
+            = client.call<std::map<uint32_t, std::string> >("invert", 1000, m);
+    CHECK(inv.ok() && inv.value.size() == 2 && inv.value[2] == "b");
+    CHECK(client.call<void>("noop", 1000).ok());
+
+    RpcResult<int> nf = client.call<int>("missing", 1000);
+    CHECK(nf.code == RpcStatus::NOT_FOUND);
+    //参数类型不匹配: add需要两个int
+    RpcResult<int> bad = client.call<int>("add", 1000, 1);
+    CHECK(bad.code == RpcStatus::BAD_REQUEST);
+    RpcResult<int> fail = client.call<int>("fail", 1000, std::string("boom"));
+    CHECK(fail.code == RpcStatus::HANDLER_ERROR && fail.error == "boom");
+
+    //超时的调用不影响之后的调用, 迟到的响应被丢弃
+    uint64_t b = MonoNs();
+    RpcResult<uint32_t> slow = client.call<uint32_t>("sleep", 50, 200u);
+    CHECK(slow.code == RpcStatus::TIMEOUT && MonoNs() - b < 150000000ULL);
+    RpcResult<uint32_t> fast = client.call<uint32_t>("sleep", 1000, 1u);
+    CHECK(fast.ok() && fast.value == 1);
+
+    //同一连接上并发的调用乱序完成
+    std::vector<std::thread> threads;
+    std::atomic<int> ok{0};
+    for(int t = 0; t < 8; ++t) {
+        threads.emplace_back([&client, &ok, t]() {
+            for(int i = 0; i < 200; ++i) {
+                RpcResult<int> r = client.call<int>("add", 5000, t, i);
+                if(r.ok() && r.value == t + i) {
+                    ++ok;
+                }
+            }
+        });
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+    CHECK(ok == 8 * 200);
+    std::cout << "rpc calls ok, frames " << client.getSession()->getFramesSent()
+              << " send calls " << client.getSession()->getSendCalls() << std::endl;
+    return true;
+}
+
+static bool TestClose() {
+    RpcServer::ptr server(new RpcServer(2));
+    Register(*server);
+    CHECK(server->bind("127.0.0.1", 0) && server->start());
+    RpcClient client;
+    CHECK(client.connect("127.0.0.1", server->getPort()));
+    RpcResult<uint32_t> r;
+    std::thread caller([&client, &r]() { r = client.call<uint32_t>("sleep", 5000, 300u);});
+    usleep(50000);
+    server->stop();
+    caller.join();
+    CHECK(r.code == RpcStatus::CLOSED);
+    CHECK(client.call<int>("add", 1000, 1, 2).code == RpcStatus::CLOSED);
+    return true;
+}
+
+static std::atomic<int> s_blockStarted{0};
+static std::atomic<bool> s_blockRelease{false};
+
+/**
+ * @brief 工作线程都在执行时请求最多排满队列, 读线程阻塞; 放行后全部完成.
+ *        stop之后可以重新bind和start
+ */
+static bool TestBackpressure() {
+    RpcServer server(1, 2);
+    Register(server);
+    server.registerMethod("block", []() {
+        ++s_blockStarted;
+        while(!s_blockRelease) {
+            usleep(1000);
+        }
+    });
+    CHECK(server.bind("127.0.0.1", 0) && server.start());
+    RpcClient client;
+    CHECK(client.connect("127.0.0.1", server.getPort()));
+    const int n = 20;
+    std::atomic<int> ok{0};
+    std::vector<std::thread> callers;
+    for(int i = 0; i < n; ++i) {
+        callers.emplace_back([&client, &ok]() {
+            ok += client.call<void>("block", 5000).ok();
+        });
+    }
+    usleep(200000);
+    CHECK(s_blockStarted == 1 && server.getPendingCount() <= 2);
+    s_blockRelease = true;
+    for(auto& t : callers) {
+        t.join();
+    }
+    CHECK(ok == n && s_blockStarted == n);
+    client.close();
+    server.stop();
+
+    CHECK(server.bind("127.0.0.1", 0) && server.start());
+    RpcClient again;
+    CHECK(again.connect("127.0.0.1", server.getPort()));
+    RpcResult<int> r = again.call<int>("add", 1000, 2, 3);
+    CHECK(r.ok() && r.value == 5);
+    server.stop();
+    std::cout << "rpc backpressure and restart ok" << std::endl;
+    return true;
+}
+
+/**
+ * @brief concurrency个线程共用一条连接各发count次调用
+ */
+static void Bench(uint16_t port, int concurrency, int count) {
+    RpcClient client;
+    client.connect("127.0.0.1", port);
+    std::vector<std::vector<uint64_t> > lat(concurrency);
+    std::vector<std::thread> threads;
+    uint64_t b = MonoNs();
+    for(int t = 0; t < concurrency; ++t) {
+        threads.emplace_back([&client, &lat, t, count]() {
+            lat[t].reserve(count);
+            for(int i = 0; i < count; ++i) {
+                uint64_t s = MonoNs();
+                client.call<int>("add", 5000, t, i);
+                lat[t].push_back(MonoNs() - s);
+            }
+        });
+    }
+    for(auto& t : threads) {
+        t.join();
+    }
+    uint64_t ns = MonoNs() - b;
+    std::vector<uint64_t> all;
+    for(auto& v : lat) {
+        all.insert(all.end(), v.begin(), v.end());
+    }
+    std::sort(all.begin(), all.end());
+    kong::RpcSession::ptr s = client.getSession();
+    std::cout << "concurrency " << concurrency << ": " << (uint64_t)(all.size() / (ns / 1e9)) << " qps"
+              << ", p50 " << all[all.size() / 2] / 1000.0 << "us"
+              << ", p99 " << all[all.size() * 99 / 100] / 1000.0 << "us"
+              << ", frames/send " << (double)s->getFramesSent() / s->getSendCalls() << std::endl;
+}
+
+int main(int argc, char** argv) {
+    if(!TestByteArray()) {
+        return 1;
+    }
+    RpcServer server(4);
+    Register(server);
+    if(!server.bind("127.0.0.1", 0) || !server.start()) {
+        std::cout << "server start failed" << std::endl;
+        return 1;
+    }
+    if(!TestCalls(server) || !TestClose() || !TestBackpressure()) {
+        return 1;
+    }
+    int count = argc > 1 ? atoi(argv[1]) : 20000;
+    for(int c : {1, 4, 16, 64}) {
+        Bench(server.getPort(), c, count / c);
+    }
+    server.stop();
+    return 0;
+}
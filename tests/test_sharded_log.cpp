@@ -0,0 +1,214 @@
+#include "log/sharded_appender.hpp"
+#include "test_util.hpp"
+#include <iostream>
+#include <deque>
+#include <stdio.h>
+#include <thread>
+#include <unistd.h>
+
+/// 记录输出顺序, 内容为"生产者 序号"
+class OrderSink : public kong::LogAppender {
+public:
+    void log(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event) override {
+        ts.push_back(event->getTimestamp());
+        int producer = 0, seq = 0;
+        sscanf(event->getContent().c_str(), "%d %d", &producer, &seq);
+        seqs.push_back(std::make_pair(producer, seq));
+    }
+    std::vector<uint64_t> ts;
+    std::vector<std::pair<int, int> > seqs;
+};
+
+/// 只计数
+class NullSink : public kong::LogAppender {
+public:
+    void log(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event) override {
+        ++count;
+    }
+    void logRendered(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event, const kong::LogBuffer& buf) override {
+        ++count;
+    }
+    bool acceptsRendered() const override { return true;}
+    uint64_t count = 0;
+};
+
+/// 对照组: 所有线程共用一个加锁队列
+class SingleQueueAppender : public kong::LogAppender {
+public:
+    SingleQueueAppender(kong::LogAppender::ptr sink)
+        :m_sink(sink) {
+        m_thread.reset(new kong::Thread([this]() {
+            std::deque<Item> batch;
+            while(true) {
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    while(m_queue.empty() && !m_stop) {
+                        m_cond.wait(lock);
+                    }
+                    if(m_queue.empty() && m_stop) {
+                        break;
+                    }
+                    batch.swap(m_queue);
+                }
+                for(auto& i : batch) {
+                    m_sink->logRendered(i.logger, i.level, i.event, i.buf);
+                }
+                batch.clear();
+            }
+        }, "single_queue"));
+    }
+
+    ~SingleQueueAppender() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond.notify_one();
+        m_thread->join();
+    }
+
+    void log(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event) override {
+    }
+
+    void logRendered(kong::Logger::ptr logger, kong::LogLevel::Level level, kong::LogEvent::ptr event, const kong::LogBuffer& buf) override {
+        Item item{level, logger, event, buf};
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_queue.push_back(std::move(item));
+        m_cond.notify_one();
+    }
+
+    bool acceptsRendered() const override { return true;}
+private:
+    struct Item {
+        kong::LogLevel::Level level;
+        kong::Logger::ptr logger;
+        kong::LogEvent::ptr event;
+        kong::LogBuffer buf;
+    };
+    kong::LogAppender::ptr m_sink;
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    std::deque<Item> m_queue;
+    bool m_stop = false;
+    kong::Thread::ptr m_thread;
+};
+
+/**
+ * @brief 时间戳相同的日志按(分片, 写入顺序)输出, 先创建分片的线程在前
+ */
+static bool TestEqualTimestamps() {
+    std::shared_ptr<OrderSink> sink(new OrderSink);
+    kong::ShardedLogAppender::ptr appender(new kong::ShardedLogAppender(sink, 5, 1024));
+    kong::Logger::ptr logger(new kong::Logger("tie"));
+    logger->addAppender(appender);
+    const uint64_t ts = kong::Clock::NowNs();
+    const int n = 500;
+    auto produce = [logger, ts, n](int t) {
+        for(int i = 0; i < n; ++i) {
+            kong::LogEvent::ptr event(new kong::LogEvent(logger, kong::LogLevel::INFO, __FILE__, __LINE__
+                        ,0, 0, ts, "tie"));
+            event->getSS() << t << ' ' << i;
+            logger->log(kong::LogLevel::INFO, event);
+        }
+    };
+    //线程0先写完, 分片id较小; 线程1交错写入后两者的日志时间戳都一样
+    std::thread first(produce, 0);
+    first.join();
+    std::thread second(produce, 1);
+    second.join();
+    appender->flush();
+    CHECK(sink->seqs.size() == 2 * (size_t)n);
+    for(size_t i = 0; i < sink->seqs.size(); ++i) {
+        CHECK(sink->seqs[i].first == (int)(i / n) && sink->seqs[i].second == (int)(i % n));
+    }
+    CHECK(appender->getLate() == 0);
+    return true;
+}
+
+static double Bench(kong::LogAppender::ptr appender, int threads, int n) {
+    kong::Logger::ptr logger(new kong::Logger("bench"));
+    logger->setFormatter(kong::LogFormatter::ptr(new kong::LogFormatter("%m%n")));
+    logger->addAppender(appender);
+    uint64_t b = MonoNs();
+    std::vector<std::thread> ts;
+    for(int t = 0; t < threads; ++t) {
+        ts.emplace_back([logger, n]() {
+            for(int i = 0; i < n; ++i) {
+                KONG_LOG_INFO(logger) << "event";
+            }
+        });
+    }
+    for(auto& t : ts) {
+        t.join();
+    }
+    //在本线程析构appender, 等待队列中的日志输出完
+    logger->clearAppenders();
+    appender.reset();
+    return (double)threads * n / ((MonoNs() - b) / 1e9);
+}
+
+int main(int argc, char** argv) {
+    //多线程写入后按时间戳有序输出
+    {
+        std::shared_ptr<OrderSink> sink(new OrderSink);
+        kong::ShardedLogAppender::ptr appender(new kong::ShardedLogAppender(sink, 5, 1024));
+        kong::Logger::ptr logger(new kong::Logger("sharded"));
+        logger->addAppender(appender);
+        const int n = 20000;
+        std::vector<std::thread> ts;
+        for(int t = 0; t < 4; ++t) {
+            ts.emplace_back([logger, t]() {
+                for(int i = 0; i < n; ++i) {
+                    KONG_LOG_INFO(logger) << t << ' ' << i;
+                }
+            });
+        }
+        for(auto& t : ts) {
+            t.join();
+        }
+        appender->flush();
+        size_t unordered = 0;
+        for(size_t i = 1; i < sink->ts.size(); ++i) {
+            if(sink->ts[i] < sink->ts[i - 1]) {
+                ++unordered;
+            }
+        }
+        std::cout << "emitted " << sink->ts.size() << " unordered " << unordered
+                  << " late " << appender->getLate() << " full waits " << appender->getFullWaits() << std::endl;
+        if(sink->ts.size() != 4 * n || unordered > appender->getLate()) {
+            return 1;
+        }
+        //同一生产者的日志严格按写入顺序输出, 不丢不重
+        std::vector<int> next(4, 0);
+        for(auto& i : sink->seqs) {
+            if(i.first < 0 || i.first >= 4 || i.second != next[i.first]) {
+                std::cout << "producer " << i.first << " emitted seq " << i.second << " expected "
+                          << (i.first >= 0 && i.first < 4 ? next[i.first] : -1) << std::endl;
+                return 1;
+            }
+            ++next[i.first];
+        }
+        //退出线程的分片会被回收
+        uint64_t deadline = MonoNs() + 2000000000ULL;
+        while(appender->getShardCount() != 0 && MonoNs() < deadline) {
+            usleep(1000);
+        }
+        if(appender->getShardCount() != 0) {
+            std::cout << "shards not reclaimed: " << appender->getShardCount() << std::endl;
+            return 1;
+        }
+    }
+
+    if(!TestEqualTimestamps()) {
+        return 1;
+    }
+
+    int n = argc > 1 ? atoi(argv[1]) : 50000;
+    for(int threads = 1; threads <= 8; threads *= 2) {
+        double single = Bench(kong::LogAppender::ptr(new SingleQueueAppender(kong::LogAppender::ptr(new NullSink))), threads, n);
+        double sharded = Bench(kong::LogAppender::ptr(new kong::ShardedLogAppender(kong::LogAppender::ptr(new NullSink))), threads, n);
+        std::cout << "threads " << threads << ": single queue " << (uint64_t)single
+                  << " events/s, sharded " << (uint64_t)sharded << " events/s" << std::endl;
+    }
+    return 0;
+}
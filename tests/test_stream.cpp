@@ -0,0 +1,255 @@
+#include "net/socket_stream.hpp"
+#include "utils/daemon.hpp"
+#include "utils/util.hpp"
+#include "test_util.hpp"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <iostream>
+#include <netinet/in.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+using kong::FSUtil;
+using kong::SocketStream;
+
+/// 当前线程消耗的CPU时间(微秒)
+static uint64_t ThreadCpuUs() {
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL
+            + ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+}
+
+/// 建立一对已连接的TCP回环socket
+static bool TcpPair(int fds[2]) {
+    int lfd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
+    socklen_t len = sizeof(sa);
+    if(bind(lfd, (sockaddr*)&sa, len) || listen(lfd, 1) || getsockname(lfd, (sockaddr*)&sa, &len)) {
+        close(lfd);
+        return false;
+    }
+    fds[0] = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if(connect(fds[0], (sockaddr*)&sa, len)) {
+        close(lfd);
+        return false;
+    }
+    fds[1] = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+    close(lfd);
+    return fds[1] >= 0;
+}
+
+/// 读到对端关闭, 返回(字节数, 校验和)
+static std::pair<uint64_t, uint64_t> Drain(int fd) {
+    SocketStream ss(fd);
+    std::vector<char> buf(256 * 1024);
+    uint64_t total = 0, sum = 0;
+    int n;
+    while((n = ss.read(&buf[0], buf.size())) > 0) {
+        for(int i = 0; i < n; ++i) {
+            sum = sum * 31 + (unsigned char)buf[i];
+        }
+        total += n;
+    }
+    return std::make_pair(total, sum);
+}
+
+static uint64_t FileSum(const std::string& path, uint64_t& size) {
+    std::ifstream ifs;
+    FSUtil::OpenForRead(ifs, path, std::ios::binary);
+    std::vector<char> buf(256 * 1024);
+    uint64_t sum = 0;
+    size = 0;
+    while(ifs.read(&buf[0], buf.size()) || ifs.gcount()) {
+        for(std::streamsize i = 0; i < ifs.gcount(); ++i) {
+            sum = sum * 31 + (unsigned char)buf[i];
+        }
+        size += ifs.gcount();
+    }
+    return sum;
+}
+
+static bool TestFSUtil() {
+    const std::string root = "stream_test_dir";
+    FSUtil::Rm(root);
+    std::ofstream ofs;
+    if(!FSUtil::Mkdir(root + "/a/b") || !FSUtil::OpenForWrite(ofs, root + "/x/y/file.txt", std::ios::trunc)) {
+        std::cout << "mkdir/open for write failed" << std::endl;
+        return false;
+    }
+    ofs << "data";
+    ofs.close();
+    std::vector<std::string> files;
+    FSUtil::ListAllFile(files, root, ".txt");
+    std::string real;
+    if(files.size() != 1 || files[0] != root + "/x/y/file.txt"
+            || !FSUtil::Realpath(files[0], real) || real[0] != '/'
+            || FSUtil::Dirname(files[0]) != root + "/x/y" || FSUtil::Basename(files[0]) != "file.txt"
+            || FSUtil::Dirname("file") != "." || FSUtil::Dirname("/file") != "/") {
+        std::cout << "list/realpath/dirname failed" << std::endl;
+        return false;
+    }
+    std::ifstream ifs;
+    std::string content;
+    if(!FSUtil::Symlink(real, root + "/a/link.txt") || !FSUtil::Mv(root + "/a/link.txt", root + "/a/b/moved.txt")
+            || !FSUtil::OpenForRead(ifs, root + "/a/b/moved.txt", std::ios::in) || !(ifs >> content) || content != "data") {
+        std::cout << "symlink/mv failed" << std::endl;
+        return false;
+    }
+    {
+        //记录的pid在运行但没人持有锁, 相当于进程崩溃后pid被复用
+        std::ofstream reused(root + "/reused.pid");
+        reused << getpid() << std::endl;
+    }
+    if(!kong::Pidfile::Write(root + "/test.pid") || !FSUtil::IsRunningPidfile(root + "/test.pid")
+            || FSUtil::IsRunningPidfile(root + "/reused.pid")
+            || FSUtil::IsRunningPidfile(root + "/none.pid")
+            || !kong::Pidfile::Remove(root + "/test.pid")) {
+        std::cout << "pidfile check failed" << std::endl;
+        return false;
+    }
+    if(!FSUtil::Unlink(root + "/none") || FSUtil::Unlink(root + "/none", true)
+            || !FSUtil::Rm(root) || access(root.c_str(), F_OK) == 0) {
+        std::cout << "rm failed" << std::endl;
+        return false;
+    }
+    std::cout << "FSUtil ok" << std::endl;
+    return true;
+}
+
+/**
+ * @brief 经ByteArray读写: 写入后读位置后移, 读到的数据追加到末尾
+ */
+static bool TestByteArrayStream() {
+    int fds[2];
+    CHECK(TcpPair(fds));
+    SocketStream writer(fds[0]);
+    SocketStream reader(fds[1]);
+    kong::ByteArray::ptr out(new kong::ByteArray);
+    out->writeFuint32(0x12345678);
+    out->writeStringVint(std::string(300000, 'k'));
+    size_t total = out->size();
+    //只写一部分, 剩余部分再整体写出
+    CHECK(writer.write(out, 4) == 4 && out->getPosition() == 4);
+    std::thread t([&writer, out]() { writer.writeFixSize(out, out->getReadSize());});
+    kong::ByteArray::ptr in(new kong::ByteArray);
+    in->writeFuint8(0xee);
+    CHECK(reader.readFixSize(in, total) == (int)total);
+    t.join();
+    CHECK(out->getReadSize() == 0 && in->size() == total + 1);
+    CHECK(in->readFuint8() == 0xee && in->readFuint32() == 0x12345678
+            && in->readStringVint() == std::string(300000, 'k'));
+    //没写满的预留被丢弃; 读位置之后的数据不足时writeFixSize失败
+    CHECK(writer.write("abc", 3) == 3);
+    CHECK(reader.read(in, 4096) == 3 && in->getReadSize() == 3 && in->toString() == "abc");
+    CHECK(writer.writeFixSize(in, 4) == -1 && in->getReadSize() == 3);
+    writer.close();
+    CHECK(reader.read(in, 16) == 0 && in->getReadSize() == 3);
+    std::cout << "ByteArray stream ok" << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if(!TestFSUtil() || !TestByteArrayStream()) {
+        return 1;
+    }
+
+    const uint64_t size = (argc > 1 ? atoi(argv[1]) : 32) * 1024 * 1024ULL;
+    const std::string path = "stream_test.dat";
+    {
+        std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+        std::vector<char> block(1024 * 1024);
+        for(size_t i = 0; i < block.size(); ++i) {
+            block[i] = (char)(i * 7 + i / 251);
+        }
+        for(uint64_t i = 0; i < size; i += block.size()) {
+            block[0] = (char)i;
+            ofs.write(&block[0], block.size());
+        }
+    }
+    uint64_t fileSize;
+    uint64_t expect = FileSum(path, fileSize);
+
+    //发送文件: sendfile vs 读到用户态再写
+    for(int zero = 1; zero >= 0; --zero) {
+        int fds[2];
+        if(!TcpPair(fds)) {
+            std::cout << "tcp pair failed" << std::endl;
+            return 1;
+        }
+        std::pair<uint64_t, uint64_t> got;
+        std::thread reader([&got, &fds]() { got = Drain(fds[1]);});
+        uint64_t b = MonoNs(), cpu = ThreadCpuUs();
+        int64_t sent = 0;
+        {
+            SocketStream out(fds[0]);
+            if(zero) {
+                sent = out.sendFile(path);
+            } else {
+                int fd = open(path.c_str(), O_RDONLY);
+                std::vector<char> buf(256 * 1024);
+                ssize_t n;
+                while((n = ::read(fd, &buf[0], buf.size())) > 0 && out.writeFixSize(&buf[0], n) > 0) {
+                    sent += n;
+                }
+                close(fd);
+            }
+        }
+        double ms = (MonoNs() - b) / 1e6;
+        cpu = ThreadCpuUs() - cpu;
+        reader.join();
+        if((uint64_t)sent != fileSize || got.first != fileSize || got.second != expect) {
+            std::cout << "send file mismatch sent=" << sent << " got=" << got.first << std::endl;
+            return 1;
+        }
+        std::cout << (zero ? "sendfile " : "read+write ") << fileSize / (1024 * 1024) << "MB: "
+                  << ms << " ms, sender cpu " << cpu / 1000.0 << " ms" << std::endl;
+    }
+
+    //socket到socket代理: splice vs 读到用户态再写
+    for(int zero = 1; zero >= 0; --zero) {
+        int up[2], down[2];
+        if(!TcpPair(up) || !TcpPair(down)) {
+            std::cout << "tcp pair failed" << std::endl;
+            return 1;
+        }
+        std::pair<uint64_t, uint64_t> got;
+        std::thread reader([&got, &down]() { got = Drain(down[1]);});
+        std::thread writer([&up, &path]() {
+            SocketStream(up[0]).sendFile(path);
+        });
+        uint64_t b = MonoNs(), cpu = ThreadCpuUs();
+        int64_t moved = 0;
+        {
+            SocketStream from(up[1]);
+            SocketStream to(down[0]);
+            if(zero) {
+                moved = to.spliceFrom(from);
+            } else {
+                std::vector<char> buf(256 * 1024);
+                int n;
+                while((n = from.read(&buf[0], buf.size())) > 0 && to.writeFixSize(&buf[0], n) > 0) {
+                    moved += n;
+                }
+            }
+        }
+        double ms = (MonoNs() - b) / 1e6;
+        cpu = ThreadCpuUs() - cpu;
+        writer.join();
+        reader.join();
+        if((uint64_t)moved != fileSize || got.first != fileSize || got.second != expect) {
+            std::cout << "proxy mismatch moved=" << moved << " got=" << got.first << std::endl;
+            return 1;
+        }
+        std::cout << (zero ? "splice proxy " : "read+write proxy ") << fileSize / (1024 * 1024) << "MB: "
+                  << ms << " ms, proxy cpu " << cpu / 1000.0 << " ms" << std::endl;
+    }
+    FSUtil::Unlink(path);
+    return 0;
+}
@@ -0,0 +1,295 @@
+#include "utils/thread_pool.hpp"
+#include "utils/lz4.hpp"
+#include "test_util.hpp"
+#include <cmath>
+#include <iostream>
+#include <sched.h>
+#include <stdexcept>
+
+static bool TestSubmit() {
+    kong::ThreadPool pool(4, "tp_submit");
+    std::vector<std::future<int> > results;
+    for(int i = 0; i < 100; ++i) {
+        results.push_back(pool.submit([](int a, int b) { return a * b;}, i, 2));
+    }
+    for(int i = 0; i < 100; ++i) {
+        CHECK(results[i].get() == i * 2);
+    }
+    std::future<int> f = pool.submit([]() -> int { throw std::runtime_error("boom");});
+    bool caught = false;
+    try {
+        f.get();
+    } catch(std::runtime_error& e) {
+        caught = true;
+    }
+    CHECK(caught);
+
+    //外部线程并发提交
+    std::atomic<int> count{0};
+    std::vector<kong::Thread::ptr> threads;
+    for(int i = 0; i < 4; ++i) {
+        threads.push_back(kong::Thread::ptr(new kong::Thread([&pool, &count]() {
+            for(int j = 0; j < 10000; ++j) {
+                pool.execute([&count]() { ++count;});
+            }
+        }, "tp_producer_" + std::to_string(i))));
+    }
+    for(auto& i : threads) {
+        i->join();
+    }
+    while(count != 40000) {
+        pool.runOne();
+    }
+    return true;
+}
+
+static bool TestParallelFor() {
+    kong::ThreadPool pool(4, "tp_for");
+    const size_t n = 1000000;
+    std::vector<std::atomic<uint8_t> > hits(n);
+    for(auto& i : hits) {
+        i = 0;
+    }
+    pool.parallelFor(0, n, [&hits](size_t i) {
+        ++hits[i];
+    });
+    for(size_t i = 0; i < n; ++i) {
+        CHECK(hits[i] == 1);
+    }
+    //空区间和小区间
+    pool.parallelFor(5, 5, [](size_t) {});
+    std::atomic<int> small{0};
+    pool.parallelFor(0, 3, [&small](size_t) { ++small;});
+    CHECK(small == 3);
+
+    std::vector<double> data(n);
+    for(size_t i = 0; i < n; ++i) {
+        data[i] = 1.0 / (i + 1);
+    }
+    auto map = [&data](size_t b, size_t e) {
+        double s = 0;
+        for(size_t i = b; i < e; ++i) {
+            s += data[i];
+        }
+        return s;
+    };
+    auto reduce = [](double a, double b) { return a + b;};
+    double s1 = pool.parallelReduce(0, n, 0.0, map, reduce);
+    double s2 = pool.parallelReduce(0, n, 0.0, map, reduce);
+    //合并顺序固定, 结果逐位相同
+    CHECK(s1 == s2);
+    CHECK(std::fabs(s1 - map(0, n)) < 1e-9);
+
+    bool caught = false;
+    try {
+        pool.parallelFor(0, 1000, [](size_t i) {
+            if(i == 777) {
+                throw std::runtime_error("bad item");
+            }
+        });
+    } catch(std::runtime_error& e) {
+        caught = true;
+    }
+    CHECK(caught);
+    return true;
+}
+
+/**
+ * @brief 嵌套并行: 工作线程里再并行、等待future, 线程数少于任务数也不死锁
+ */
+static bool TestNested() {
+    kong::ThreadPool pool(2, "tp_nested");
+    std::atomic<uint64_t> total{0};
+    pool.parallelFor(0, 16, [&pool, &total](size_t i) {
+        pool.parallelFor(0, 1000, [&total](size_t j) {
+            total += j;
+        });
+    }, 1);
+    CHECK(total == 16 * 999 * 1000 / 2);
+
+    kong::ThreadPool single(1, "tp_single");
+    std::future<int> f = single.submit([&single]() {
+        std::future<int> inner = single.submit([]() { return 42;});
+        //唯一的工作线程在等待时执行inner
+        return single.get(inner) + 1;
+    });
+    CHECK(single.get(f) == 43);
+    return true;
+}
+
+static bool TestGraph() {
+    kong::ThreadPool pool(4, "tp_graph");
+    std::mutex mutex;
+    std::vector<std::string> order;
+    auto step = [&mutex, &order](const std::string& name) {
+        return [&mutex, &order, name]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            order.push_back(name);
+        };
+    };
+    //load -> (parse, index) -> compress -> publish
+    kong::TaskGraph g;
+    auto load = g.add(step("load"));
+    auto parse = g.add(step("parse"));
+    auto index = g.add(step("index"));
+    auto compress = g.add(step("compress"));
+    auto publish = g.add(step("publish"));
+    g.precede(load, parse);
+    g.precede(load, index);
+    g.precede(parse, compress);
+    g.precede(index, compress);
+    g.precede(compress, publish);
+    for(int round = 0; round < 100; ++round) {
+        order.clear();
+        g.run(pool);
+        CHECK(order.size() == 5);
+        CHECK(order[0] == "load" && order[3] == "compress" && order[4] == "publish");
+    }
+
+    //前驱失败时后继不执行
+    kong::TaskGraph failing;
+    bool ran = false;
+    auto a = failing.add([]() { throw std::runtime_error("load fail");});
+    auto b = failing.add([&ran]() { ran = true;});
+    failing.precede(a, b);
+    bool caught = false;
+    try {
+        failing.run(pool);
+    } catch(std::runtime_error& e) {
+        caught = true;
+    }
+    CHECK(caught && !ran);
+
+    kong::TaskGraph cycle;
+    auto x = cycle.add([]() {});
+    auto y = cycle.add([]() {});
+    cycle.precede(x, y);
+    cycle.precede(y, x);
+    caught = false;
+    try {
+        cycle.run(pool);
+    } catch(std::logic_error& e) {
+        caught = true;
+    }
+    CHECK(caught);
+    return true;
+}
+
+static bool TestPin() {
+    std::vector<int> cpus = kong::Thread::GetAvailableCpus();
+    kong::ThreadPool pool(cpus.size(), "tp_pin", true);
+    std::vector<int> pinned(cpus.size(), -1);
+    std::atomic<size_t> arrived{0};
+    //每个工作线程各执行一个任务: 所有任务都在等其它任务到达
+    for(size_t i = 0; i < cpus.size(); ++i) {
+        pool.execute([&pinned, &arrived, &cpus]() {
+            cpu_set_t set;
+            sched_getaffinity(0, sizeof(set), &set);
+            if(CPU_COUNT(&set) == 1) {
+                pinned[kong::ThreadPool::GetWorkerIndex()] = sched_getcpu();
+            }
+            ++arrived;
+            while(arrived < cpus.size()) {
+                sched_yield();
+            }
+        });
+    }
+    while(arrived < cpus.size()) {
+        sched_yield();
+    }
+    for(size_t i = 0; i < cpus.size(); ++i) {
+        CHECK(pinned[i] == cpus[i]);
+    }
+    return true;
+}
+
+/**
+ * @brief 可完全并行的循环在不同线程数下的加速比: 压缩64个256KB的块, 以及纯计算
+ */
+static bool Bench() {
+    const size_t blocks = 64;
+    const size_t block_size = 256 * 1024;
+    std::vector<std::string> input(blocks);
+    uint32_t seed = 12345;
+    for(auto& i : input) {
+        i.resize(block_size);
+        for(size_t j = 0; j < block_size; ++j) {
+            seed = seed * 1103515245 + 12345;
+            //类日志文本, 有一定重复
+            i[j] = "abcdefgh 0123456789\n"[(seed >> 16) % 20];
+        }
+    }
+    std::vector<std::string> output(blocks);
+    auto compress = [&input, &output](size_t i) {
+        output[i].resize(kong::Lz4::CompressBound(input[i].size()));
+        size_t n = kong::Lz4::Compress(input[i].data(), input[i].size(), &output[i][0], output[i].size());
+        output[i].resize(n);
+    };
+    const size_t n = 1 << 22;
+    auto compute = [](size_t b, size_t e) {
+        double s = 0;
+        for(size_t i = b; i < e; ++i) {
+            s += std::sqrt((double)i) * std::sin((double)i);
+        }
+        return s;
+    };
+
+    //不计时的预热: 输出缓冲区首次分配和缺页不能只算在串行基准上
+    for(size_t i = 0; i < blocks; ++i) {
+        compress(i);
+    }
+    volatile double warm_sum = compute(0, n);
+    (void)warm_sum;
+    uint64_t b = MonoNs();
+    for(size_t i = 0; i < blocks; ++i) {
+        compress(i);
+    }
+    uint64_t serial_lz4 = MonoNs() - b;
+    b = MonoNs();
+    volatile double serial_sum = compute(0, n);
+    uint64_t serial_compute = MonoNs() - b;
+    (void)serial_sum;
+
+    size_t cpus = kong::Thread::GetAvailableCpus().size();
+    std::cout << "available cpus: " << cpus << std::endl;
+    std::cout << "serial: lz4 " << serial_lz4 / 1000000.0 << "ms, compute "
+              << serial_compute / 1000000.0 << "ms" << std::endl;
+    for(size_t threads : {1, 2, 4, 8}) {
+        kong::ThreadPool pool(threads, "tp_bench");
+        b = MonoNs();
+        pool.parallelFor(0, blocks, compress, 1);
+        uint64_t lz4 = MonoNs() - b;
+        b = MonoNs();
+        pool.parallelReduce(0, n, 0.0, compute, [](double x, double y) { return x + y;});
+        uint64_t comp = MonoNs() - b;
+        kong::ThreadPoolStats stats = pool.getStats();
+        std::cout << "threads=" << threads
+                  << " lz4 " << lz4 / 1000000.0 << "ms speedup=" << (double)serial_lz4 / lz4
+                  << " compute " << comp / 1000000.0 << "ms speedup=" << (double)serial_compute / comp
+                  << " (tasks=" << stats.tasks << " steals=" << stats.steals
+                  << " injected=" << stats.injected << ")" << std::endl;
+    }
+
+    //任务调度本身的开销
+    kong::ThreadPool pool(cpus, "tp_bench");
+    const int tasks = 200000;
+    std::atomic<int> count{0};
+    b = MonoNs();
+    kong::TaskGroup group(pool);
+    for(int i = 0; i < tasks; ++i) {
+        group.run([&count]() { ++count;});
+    }
+    group.wait();
+    uint64_t ns = MonoNs() - b;
+    CHECK(count == tasks);
+    std::cout << "empty task: " << (double)ns / tasks << " ns/task" << std::endl;
+    return true;
+}
+
+int main(int argc, char** argv) {
+    if(!TestSubmit() || !TestParallelFor() || !TestNested() || !TestGraph() || !TestPin() || !Bench()) {
+        return 1;
+    }
+    std::cout << "thread pool tests ok" << std::endl;
+    return 0;
+}
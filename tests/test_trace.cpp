@@ -0,0 +1,98 @@
+#include "log/trace.hpp"
+#include "test_util.hpp"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+static size_t Count(const std::string& str, const std::string& sub) {
+    size_t n = 0;
+    for(size_t pos = str.find(sub); pos != std::string::npos; pos = str.find(sub, pos + 1)) {
+        ++n;
+    }
+    return n;
+}
+
+static void Decode(int i) {
+    KONG_TRACE_SCOPE("decode");
+    if(i % 10 == 0) {
+        KONG_TRACE_SCOPE_CAT("db", "query");
+    }
+}
+
+static void Disabled() {
+    KONG_TRACE_SCOPE_CAT("off", "noop");
+}
+
+int main(int argc, char** argv) {
+    const char* path = "trace_test.json";
+    kong::Tracer::SetEnabled("default", true);
+    if(!kong::Tracer::StartFile(path, 10)) {
+        std::cout << "start failed" << std::endl;
+        return 1;
+    }
+    std::vector<std::thread> ts;
+    for(int t = 0; t < 2; ++t) {
+        ts.emplace_back([]() {
+            kong::Thread::SetName("worker");
+            for(int i = 0; i < 1000; ++i) {
+                Decode(i);
+            }
+            KONG_TRACE_BEGIN("request");
+            KONG_TRACE_END("request");
+        });
+    }
+    for(auto& t : ts) {
+        t.join();
+    }
+    //运行时启用分类
+    kong::Tracer::SetEnabled("db", true);
+    for(int i = 0; i < 100; ++i) {
+        Decode(i);
+    }
+    kong::Tracer::Stop();
+
+    std::ifstream ifs(path);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    std::string json = ss.str();
+    size_t decode = Count(json, "\"name\":\"decode\"");
+    size_t query = Count(json, "\"name\":\"query\"");
+    std::cout << "decode " << decode << " query " << query << " dropped " << kong::Tracer::GetDropped() << std::endl;
+    if(json.compare(0, 2, "[\n") || json.compare(json.size() - 3, 3, "\n]\n")
+            || decode != 2100 || query != 10
+            || Count(json, "\"ph\":\"B\"") != 2 || Count(json, "\"ph\":\"E\"") != 2
+            || Count(json, "\"name\":\"worker\"") != 2) {
+        std::cout << "unexpected trace output" << std::endl;
+        return 1;
+    }
+
+    //未启用分类的开销
+    const int n = argc > 1 ? atoi(argv[1]) : 10000000;
+    uint64_t b = MonoNs();
+    for(int i = 0; i < n; ++i) {
+        Disabled();
+    }
+    double off_ns = (double)(MonoNs() - b) / n;
+
+    kong::Tracer::StartFile(path, 10);
+    const int m = 100000;
+    b = MonoNs();
+    for(int i = 0; i < m; ++i) {
+        Decode(1);
+    }
+    double on_ns = (double)(MonoNs() - b) / m;
+    kong::Tracer::Stop();
+    std::cout << "disabled scope " << off_ns << " ns, enabled scope " << on_ns << " ns" << std::endl;
+
+    //第二个会话的文件里同样有本线程的线程名
+    std::ifstream ifs2(path);
+    std::stringstream ss2;
+    ss2 << ifs2.rdbuf();
+    if(Count(ss2.str(), "\"name\":\"thread_name\"") != 1) {
+        std::cout << "second session lacks thread_name metadata" << std::endl;
+        return 1;
+    }
+    remove(path);
+    return 0;
+}
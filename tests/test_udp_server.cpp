@@ -0,0 +1,258 @@
+#include "net/udp_server.hpp"
+#include "test_util.hpp"
+#include <arpa/inet.h>
+#include <algorithm>
+#include <iostream>
+#include <netinet/udp.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+using kong::UdpServer;
+using kong::UdpBatch;
+
+static sockaddr_in Loopback(uint16_t port) {
+    sockaddr_in sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sin_family = AF_INET;
+    sa.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &sa.sin_addr);
+    return sa;
+}
+
+/// 以GSO一次发出count个等长包, 内核不支持时逐个发送
+static void SendSegments(int fd, const sockaddr_in& to, const char* data, uint16_t seg, int count) {
+    msghdr h;
+    memset(&h, 0, sizeof(h));
+    iovec iov = {(void*)data, (size_t)seg * count};
+    h.msg_name = (void*)&to;
+    h.msg_namelen = sizeof(to);
+    h.msg_iov = &iov;
+    h.msg_iovlen = 1;
+    char ctrl[CMSG_SPACE(sizeof(uint16_t))];
+    memset(ctrl, 0, sizeof(ctrl));
+    h.msg_control = ctrl;
+    h.msg_controllen = sizeof(ctrl);
+    cmsghdr* c = CMSG_FIRSTHDR(&h);
+    c->cmsg_level = SOL_UDP;
+    c->cmsg_type = UDP_SEGMENT;
+    c->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+    memcpy(CMSG_DATA(c), &seg, sizeof(seg));
+    if(sendmsg(fd, &h, 0) < 0) {
+        for(int i = 0; i < count; ++i) {
+            sendto(fd, data + i * seg, seg, 0, (const sockaddr*)&to, sizeof(to));
+        }
+    }
+}
+
+/// echo: 客户端用GSO发送, 服务端GRO接收并按段拆开, 回复用GSO合并
+static bool TestEcho() {
+    UdpServer::Options opt;
+    opt.gro = true;
+    opt.gso = true;
+    UdpServer server(opt);
+    if(!server.bind("127.0.0.1", 0)) {
+        return false;
+    }
+    std::atomic<uint64_t> maxBatch{0};
+    server.start([&maxBatch](UdpBatch& batch) {
+        if(batch.size() > maxBatch) {
+            maxBatch = batch.size();
+        }
+        for(size_t i = 0; i < batch.size(); ++i) {
+            batch.reply(batch[i], batch[i].data, batch[i].len);
+        }
+    });
+
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in to = Loopback(server.getPort());
+    const int kSeg = 100, kPerSend = 10, kSends = 100;
+    std::vector<bool> seen(kSends * kPerSend, false);
+    int received = 0;
+    char buf[kSeg * kPerSend];
+    for(int s = 0; s < kSends; ++s) {
+        for(int i = 0; i < kPerSend; ++i) {
+            uint32_t seq = s * kPerSend + i;
+            memset(buf + i * kSeg, 'a' + seq % 26, kSeg);
+            memcpy(buf + i * kSeg, &seq, sizeof(seq));
+        }
+        SendSegments(fd, to, buf, kSeg, kPerSend);
+        //边发边收, 避免回复堆满接收缓冲区
+        pollfd pfd = {fd, POLLIN, 0};
+        while(::poll(&pfd, 1, s + 1 == kSends ? 500 : 0) > 0) {
+            char rb[2048];
+            ssize_t n = recv(fd, rb, sizeof(rb), 0);
+            uint32_t seq;
+            memcpy(&seq, rb, sizeof(seq));
+            if(n != kSeg || seq >= seen.size() || seen[seq] || rb[kSeg - 1] != (char)('a' + seq % 26)) {
+                std::cout << "bad echo len=" << n << " seq=" << seq << std::endl;
+                return false;
+            }
+            seen[seq] = true;
+            if(++received == kSends * kPerSend) {
+                break;
+            }
+        }
+    }
+    close(fd);
+    server.stop();
+    UdpServer::Stats st = server.getStats();
+    std::cout << "echo " << received << "/" << kSends * kPerSend << " gro=" << server.isGroEnabled()
+              << " gso=" << server.isGsoEnabled() << " max batch " << maxBatch
+              << " recv calls " << st.recvCalls << " send calls " << st.sendCalls << std::endl;
+    return received == kSends * kPerSend && st.replies == st.packets;
+}
+
+/// 一次发出count个小包
+static void Fill(int fd, uint16_t port, int count) {
+    sockaddr_in to = Loopback(port);
+    const int kBatch = 64;
+    char payload[64] = "telemetry";
+    mmsghdr msgs[kBatch];
+    iovec iov = {payload, sizeof(payload)};
+    memset(msgs, 0, sizeof(msgs));
+    for(int i = 0; i < kBatch; ++i) {
+        msgs[i].msg_hdr.msg_name = &to;
+        msgs[i].msg_hdr.msg_namelen = sizeof(to);
+        msgs[i].msg_hdr.msg_iov = &iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    for(int i = 0; i < count; i += kBatch) {
+        sendmmsg(fd, msgs, std::min(kBatch, count - i), 0);
+    }
+}
+
+/**
+ * @brief 每轮先把kPerRound个包灌进接收队列, 再计时收完, 比较单包接收开销;
+ *        raw recvmmsg是同一线程直接调用的下限, 与UdpServer的差值是分发和回调的开销
+ * @details 单核机器上收发线程交替运行, 边发边收时队列里很少积压, 测不出批量的差别
+ */
+int main(int argc, char** argv) {
+    if(!TestEcho()) {
+        std::cout << "echo test failed" << std::endl;
+        return 1;
+    }
+    const int rounds = argc > 1 ? atoi(argv[1]) : 50;
+    const int kPerRound = 2000;
+    int sender = socket(AF_INET, SOCK_DGRAM, 0);
+
+    //UdpServer: recvmmsg批量收包. 回调在闸门关闭时阻塞, 让包在内核队列里积压
+    UdpServer server;
+    server.bind("127.0.0.1", 0);
+    std::atomic<bool> open{false};
+    std::atomic<bool> parked{false};
+    std::atomic<uint64_t> got{0};
+    std::atomic<uint64_t> target{0};
+    std::atomic<uint64_t> doneNs{0};
+    std::atomic<uint64_t> beginNs{0};
+    server.start([&](UdpBatch& batch) {
+        if(!open) {
+            while(!open) {
+                parked = true;
+                usleep(100);
+            }
+            //从工作线程醒来开始计时, 不把唤醒延迟算进收包开销
+            beginNs = MonoNs();
+        }
+        if((got += batch.size()) >= target) {
+            doneNs = MonoNs();
+        }
+    });
+    uint64_t batchedNs = 0, batchedPkts = 0;
+    for(int r = 0; r < rounds; ++r) {
+        open = false;
+        parked = false;
+        doneNs = 0;
+        beginNs = 0;
+        target = ~0ULL;
+        Fill(sender, server.getPort(), 1);
+        while(!parked) {
+            usleep(100);
+        }
+        uint64_t base = got + 1;
+        Fill(sender, server.getPort(), kPerRound);
+        target = base + kPerRound;
+        open = true;
+        for(int i = 0; i < 1000 && !doneNs; ++i) {
+            usleep(1000);
+        }
+        if(!doneNs) {
+            std::cout << "packets dropped in round " << r << std::endl;
+            return 1;
+        }
+        batchedNs += doneNs - beginNs;
+        batchedPkts += kPerRound;
+    }
+    server.stop();
+    UdpServer::Stats st = server.getStats();
+
+    //对照组: 逐个recvfrom
+    int fd = socket(AF_INET, SOCK_DGRAM, 0);
+    int rcvbuf = 4 * 1024 * 1024;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    sockaddr_in sa = Loopback(0);
+    socklen_t len = sizeof(sa);
+    bind(fd, (sockaddr*)&sa, len);
+    getsockname(fd, (sockaddr*)&sa, &len);
+    uint64_t naiveNs = 0, naivePkts = 0;
+    uint64_t rawNs = 0, rawPkts = 0;
+    for(int r = 0; r < rounds; ++r) {
+        //同一线程直接recvmmsg, 只有系统调用本身的开销
+        Fill(sender, ntohs(sa.sin_port), kPerRound);
+        uint64_t b = MonoNs();
+        const int kBatch = 64;
+        static char bufs[kBatch][2048];
+        sockaddr_storage froms[kBatch];
+        iovec iovs[kBatch];
+        mmsghdr msgs[kBatch];
+        memset(msgs, 0, sizeof(msgs));
+        for(int i = 0; i < kBatch; ++i) {
+            iovs[i].iov_base = bufs[i];
+            iovs[i].iov_len = sizeof(bufs[i]);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            msgs[i].msg_hdr.msg_name = &froms[i];
+        }
+        while(true) {
+            for(int i = 0; i < kBatch; ++i) {
+                msgs[i].msg_hdr.msg_namelen = sizeof(froms[i]);
+            }
+            int n = recvmmsg(fd, msgs, kBatch, MSG_DONTWAIT, nullptr);
+            if(n <= 0) {
+                break;
+            }
+            rawPkts += n;
+        }
+        rawNs += MonoNs() - b;
+    }
+    for(int r = 0; r < rounds; ++r) {
+        Fill(sender, ntohs(sa.sin_port), kPerRound);
+        uint64_t b = MonoNs();
+        char buf[2048];
+        while(true) {
+            sockaddr_storage from;
+            socklen_t flen = sizeof(from);
+            if(recvfrom(fd, buf, sizeof(buf), MSG_DONTWAIT, (sockaddr*)&from, &flen) < 0) {
+                break;
+            }
+            ++naivePkts;
+        }
+        naiveNs += MonoNs() - b;
+    }
+    close(fd);
+    close(sender);
+
+    if(naivePkts != (uint64_t)rounds * kPerRound) {
+        std::cout << "recvfrom dropped " << rounds * kPerRound - naivePkts << " packets" << std::endl;
+    }
+    std::cout << "recvmmsg: " << (uint64_t)(batchedPkts / (batchedNs / 1e9)) << " pkt/s, "
+              << batchedNs / (double)batchedPkts << " ns/pkt, "
+              << (double)st.packets / st.recvCalls << " pkt/syscall" << std::endl;
+    std::cout << "raw recvmmsg: " << (uint64_t)(rawPkts / (rawNs / 1e9)) << " pkt/s, "
+              << rawNs / (double)rawPkts << " ns/pkt" << std::endl;
+    std::cout << "recvfrom: " << (uint64_t)(naivePkts / (naiveNs / 1e9)) << " pkt/s, "
+              << naiveNs / (double)naivePkts << " ns/pkt, 1 pkt/syscall" << std::endl;
+    return 0;
+}
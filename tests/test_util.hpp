@@ -0,0 +1,37 @@
+/**
+ * @file test_util.hpp
+ * @brief 测试程序共用的检查宏和计时函数
+ */
+#ifndef __KONG_TEST_UTIL_H__
+#define __KONG_TEST_UTIL_H__
+
+#include <cstdint>
+#include <iostream>
+#include <time.h>
+
+/**
+ * @brief 条件不成立时打印条件和行号, 所在的测试函数返回false
+ */
+#define CHECK(cond) \
+    if(!(cond)) { \
+        std::cout << "check failed: " #cond " line " << __LINE__ << std::endl; \
+        return false; \
+    }
+
+/**
+ * @brief 直接读CLOCK_MONOTONIC(纳秒), 不经过kong::Clock, 可作为它的参照
+ */
+inline uint64_t MonoNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/**
+ * @brief CLOCK_MONOTONIC(毫秒)
+ */
+inline uint64_t MonoMs() {
+    return MonoNs() / 1000000;
+}
+
+#endif
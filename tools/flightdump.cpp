@@ -0,0 +1,80 @@
+/**
+ * @file flightdump.cpp
+ * @brief 读取飞行记录仪共享内存
+ * @details 用法: kong-flightdump [-n 秒数] [-a] [-r] <pid|shm名>
+ *          默认输出最后10秒, 以冻结时刻(未冻结时以最新一条记录)为终点
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <iostream>
+#include "log/flight_recorder.hpp"
+
+static void Usage(const char* prog) {
+    std::cerr << "usage: " << prog << " [-n seconds] [-a] [-r] <pid|shm name>" << std::endl
+              << "  -n  dump the last N seconds (default 10)" << std::endl
+              << "  -a  dump all records" << std::endl
+              << "  -r  remove the segment after dumping" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    double seconds = 10;
+    bool all = false;
+    bool remove = false;
+    int opt;
+    while((opt = getopt(argc, argv, "n:arh")) != -1) {
+        switch(opt) {
+            case 'n':
+                seconds = atof(optarg);
+                break;
+            case 'a':
+                all = true;
+                break;
+            case 'r':
+                remove = true;
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    if(optind >= argc) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    std::string name = argv[optind];
+    if(strspn(name.c_str(), "0123456789") == name.size()) {
+        name = "/kong-flight-" + name;
+    }
+    kong::FlightRecorderReader reader(name);
+    if(!reader.isValid()) {
+        std::cerr << "open " << name << " failed" << std::endl;
+        return 1;
+    }
+
+    const kong::FlightSegmentHeader* h = reader.getHeader();
+    uint64_t freeze_ns = h->freezeNs.load();
+    std::cout << "# segment=" << name << " pid=" << h->pid
+              << " rings=" << h->ringCount << " ring_size=" << h->ringSize
+              << " frozen=" << h->frozen.load() << std::endl;
+
+    std::vector<kong::FlightRecord> records;
+    reader.read(records);
+    if(!records.empty()) {
+        uint64_t end = h->frozen.load() && freeze_ns ? freeze_ns : records.back().timestamp;
+        uint64_t span = (uint64_t)(seconds * 1e9);
+        uint64_t begin = (all || end < span) ? 0 : end - span;
+        for(auto& r : records) {
+            if(r.timestamp >= begin) {
+                std::cout << reader.format(r) << std::endl;
+            }
+        }
+    }
+
+    if(remove) {
+        shm_unlink(name[0] == '/' ? name.c_str() : ("/" + name).c_str());
+    }
+    return 0;
+}
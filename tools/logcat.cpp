@@ -0,0 +1,134 @@
+/**
+ * @file logcat.cpp
+ * @brief 解压 CompressedFileLogAppender 写出的文件
+ * @details 用法: kong-logcat [-s 开始时间] [-e 结束时间] [-o 偏移] [-i] 文件...
+ *          时间范围按块过滤(块头记录首尾日志时间, 不命中的块不解压), 输出命中的整块
+ *          -o 从任意偏移开始, 自动找到下一个块边界; -i 只输出块信息
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <iostream>
+#include "log/compressed_log.hpp"
+
+static bool ParseTime(const char* str, uint64_t& ns) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* rt = strptime(str, "%Y-%m-%d %H:%M:%S", &tm);
+    if(!rt || *rt) {
+        memset(&tm, 0, sizeof(tm));
+        rt = strptime(str, "%Y-%m-%d %H:%M", &tm);
+        if(!rt || *rt) {
+            return false;
+        }
+    }
+    tm.tm_isdst = -1;
+    ns = (uint64_t)mktime(&tm) * 1000000000ULL;
+    return true;
+}
+
+static std::string FormatNs(uint64_t ns) {
+    time_t t = ns / 1000000000ULL;
+    struct tm tm;
+    localtime_r(&t, &tm);
+    char buf[64];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    return buf;
+}
+
+static void Usage(const char* prog) {
+    std::cerr << "usage: " << prog << " [options] file..." << std::endl
+              << "  -s time    skip blocks ending before \"YYYY-mm-dd HH:MM[:SS]\"" << std::endl
+              << "  -e time    skip blocks starting after time" << std::endl
+              << "  -o offset  start at the first block after byte offset" << std::endl
+              << "  -i         print block headers instead of content" << std::endl;
+}
+
+int main(int argc, char** argv) {
+    uint64_t start = 0;
+    uint64_t end = UINT64_MAX;
+    uint64_t offset = 0;
+    bool info = false;
+    int opt;
+    while((opt = getopt(argc, argv, "s:e:o:ih")) != -1) {
+        switch(opt) {
+            case 's':
+                if(!ParseTime(optarg, start)) {
+                    std::cerr << "invalid time: " << optarg << std::endl;
+                    return 1;
+                }
+                break;
+            case 'e':
+                if(!ParseTime(optarg, end)) {
+                    std::cerr << "invalid time: " << optarg << std::endl;
+                    return 1;
+                }
+                end += 999999999ULL;
+                break;
+            case 'o':
+                offset = strtoull(optarg, nullptr, 10);
+                break;
+            case 'i':
+                info = true;
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    if(optind >= argc) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    int rt = 0;
+    std::string out;
+    for(int i = optind; i < argc; ++i) {
+        kong::CompressedLogReader reader(argv[i]);
+        if(!reader.isValid()) {
+            std::cerr << "open " << argv[i] << " failed" << std::endl;
+            rt = 1;
+            continue;
+        }
+        if(offset && !reader.sync(offset)) {
+            continue;
+        }
+        kong::CompressedBlockHeader hdr;
+        uint64_t raw = 0, file = 0;
+        while(reader.next(hdr)) {
+            if(info) {
+                std::cout << reader.getOffset() << "\t" << FormatNs(hdr.firstNs)
+                          << "\t" << FormatNs(hdr.lastNs) << "\tcount=" << hdr.count
+                          << "\traw=" << hdr.rawSize << "\tsize=" << hdr.compressedSize
+                          << (hdr.flags & kong::CompressedBlockHeader::STORED ? "\tstored" : "")
+                          << std::endl;
+                raw += hdr.rawSize;
+                file += sizeof(hdr) + hdr.compressedSize;
+                reader.skip(hdr);
+                continue;
+            }
+            if(hdr.lastNs < start || hdr.firstNs > end) {
+                reader.skip(hdr);
+                continue;
+            }
+            uint64_t pos = reader.getOffset();
+            out.clear();
+            if(!reader.read(hdr, out)) {
+                std::cerr << argv[i] << ": corrupt block at " << pos << std::endl;
+                rt = 1;
+                if(!reader.sync(pos + 1)) {
+                    break;
+                }
+                continue;
+            }
+            fwrite(out.data(), 1, out.size(), stdout);
+        }
+        if(info && file) {
+            std::cout << "# raw " << raw << " file " << file
+                      << " ratio " << (double)raw / file << std::endl;
+        }
+    }
+    return rt;
+}
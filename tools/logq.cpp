@@ -0,0 +1,372 @@
+/**
+ * @file logq.cpp
+ * @brief 借助稀疏索引查询日志文件
+ * @details 用法: kong-logq [-s 开始时间] [-e 结束时间] [-l 最低级别] [-c 日志器] [-g 子串] [-v] 文件...
+ *          时间格式 "YYYY-mm-dd HH:MM:SS" 或 "HH:MM[:SS]"(日期取日志文件中的第一条)
+ *          按默认格式匹配行: 行首为 "%Y-%m-%d %H:%M:%S" 时间, 级别为 [LEVEL], 日志器为 [name]
+ *          不以时间开头的行视为上一条日志的续行
+ *          FileLogAppender构造时指定了索引块大小才有 .idx 索引, 没有索引时扫描整个文件
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "log/log.hpp"
+#include "log/log_index.hpp"
+
+namespace {
+
+/// 时间前缀长度 "YYYY-mm-dd HH:MM:SS"
+static const size_t s_timeLen = 19;
+static const size_t s_chunkSize = 4 * 1024 * 1024;
+
+struct Query {
+    std::string start;
+    std::string end;
+    uint64_t startNs = 0;
+    uint64_t endNs = UINT64_MAX;
+    int minLevel = 0;
+    std::string logger;
+    std::string grep;
+    bool verbose = false;
+};
+
+struct Stats {
+    uint64_t blocks = 0;
+    uint64_t selected = 0;
+    uint64_t bytes = 0;
+    uint64_t matched = 0;
+};
+
+bool IsTimePrefix(const char* p, size_t n) {
+    if(n < s_timeLen) {
+        return false;
+    }
+    static const char* mask = "dddd-dd-dd dd:dd:dd";
+    for(size_t i = 0; i < s_timeLen; ++i) {
+        if(mask[i] == 'd' ? (p[i] < '0' || p[i] > '9') : p[i] != mask[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 返回行中第一个 [LEVEL] 的级别, 没有返回0
+ */
+int LineLevel(const char* p, size_t n) {
+    const char* end = p + n;
+    while((p = (const char*)memchr(p, '[', end - p)) != nullptr) {
+        ++p;
+        for(int l = kong::LogLevel::DEBUG; l <= kong::LogLevel::FATAL; ++l) {
+            const char* name = kong::LogLevel::ToString((kong::LogLevel::Level)l);
+            size_t len = strlen(name);
+            if((size_t)(end - p) > len && p[len] == ']' && memcmp(p, name, len) == 0) {
+                return l;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * @brief 解析时间参数, 返回墙上时间(纳秒), 并规范化为 "YYYY-mm-dd HH:MM:SS"
+ */
+bool ParseTime(const std::string& str, const std::string& date, std::string& norm, uint64_t& ns) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    std::string full = str.find('-') == std::string::npos ? date + " " + str : str;
+    const char* rt = strptime(full.c_str(), "%Y-%m-%d %H:%M:%S", &tm);
+    if(!rt || *rt) {
+        memset(&tm, 0, sizeof(tm));
+        rt = strptime(full.c_str(), "%Y-%m-%d %H:%M", &tm);
+        if(!rt || *rt) {
+            return false;
+        }
+    }
+    tm.tm_isdst = -1;
+    time_t t = mktime(&tm);
+    char buf[32];
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    norm = buf;
+    ns = (uint64_t)t * 1000000000ULL;
+    return true;
+}
+
+class Scanner {
+public:
+    Scanner(const Query& q, Stats& stats)
+        :m_q(q)
+        ,m_stats(stats) {
+        m_out.reserve(1024 * 1024);
+    }
+
+    ~Scanner() {
+        flushOut();
+    }
+
+    /**
+     * @brief 扫描文件的[begin, end)区间, begin须位于一条日志的开头
+     */
+    void scan(int fd, uint64_t begin, uint64_t end) {
+        std::vector<char> buf;
+        size_t keep = 0;
+        uint64_t pos = begin;
+        m_lastMatched = false;
+        while(pos < end) {
+            size_t want = std::min<uint64_t>(s_chunkSize, end - pos);
+            buf.resize(keep + want);
+            ssize_t rt = pread(fd, &buf[keep], want, pos);
+            if(rt <= 0) {
+                break;
+            }
+            pos += rt;
+            m_stats.bytes += rt;
+            size_t size = keep + rt;
+            size_t done = process(&buf[0], size, pos >= end);
+            keep = size - done;
+            if(keep) {
+                memmove(&buf[0], &buf[done], keep);
+            }
+        }
+    }
+private:
+    /**
+     * @brief 处理完整的日志, 返回已消费的字节数
+     */
+    size_t process(const char* data, size_t size, bool last) {
+        const char* p = data;
+        const char* end = data + size;
+        const char* event = nullptr;
+        while(p < end) {
+            const char* nl = (const char*)memchr(p, '\n', end - p);
+            if(!nl && !last) {
+                break;
+            }
+            const char* next = nl ? nl + 1 : end;
+            if(IsTimePrefix(p, end - p)) {
+                m_timed = true;
+                if(event) {
+                    match(event, p - event);
+                }
+                event = p;
+            } else if(!m_timed) {
+                match(p, next - p);
+            } else if(!event) {
+                //上一块的续行, 上一条日志已经输出过
+                if(m_lastMatched) {
+                    emit(p, next - p);
+                }
+            }
+            p = next;
+        }
+        if(event) {
+            if(last) {
+                match(event, p - event);
+            } else {
+                return event - data;
+            }
+        }
+        return p - data;
+    }
+
+    void match(const char* p, size_t n) {
+        m_lastMatched = false;
+        if(m_timed && IsTimePrefix(p, n)) {
+            if((!m_q.start.empty() && memcmp(p, m_q.start.c_str(), s_timeLen) < 0)
+                    || (!m_q.end.empty() && memcmp(p, m_q.end.c_str(), s_timeLen) > 0)) {
+                return;
+            }
+        }
+        if(m_q.minLevel && LineLevel(p, n) < m_q.minLevel) {
+            return;
+        }
+        if(!m_q.logger.empty() && !memmem(p, n, m_q.logger.c_str(), m_q.logger.size())) {
+            return;
+        }
+        if(!m_q.grep.empty() && !memmem(p, n, m_q.grep.c_str(), m_q.grep.size())) {
+            return;
+        }
+        m_lastMatched = true;
+        ++m_stats.matched;
+        emit(p, n);
+    }
+
+    void emit(const char* p, size_t n) {
+        m_out.append(p, n);
+        if(n && p[n - 1] != '\n') {
+            m_out.push_back('\n');
+        }
+        if(m_out.size() >= 1024 * 1024) {
+            flushOut();
+        }
+    }
+
+    void flushOut() {
+        fwrite(m_out.data(), 1, m_out.size(), stdout);
+        m_out.clear();
+    }
+private:
+    const Query& m_q;
+    Stats& m_stats;
+    std::string m_out;
+    /// 文件中的日志是否带时间前缀
+    bool m_timed = false;
+    bool m_lastMatched = false;
+};
+
+/**
+ * @brief 日志文件的第一条时间的日期部分
+ */
+std::string FirstDate(int fd, const kong::LogIndexReader& index) {
+    char buf[s_timeLen];
+    if(pread(fd, buf, sizeof(buf), 0) == (ssize_t)sizeof(buf) && IsTimePrefix(buf, sizeof(buf))) {
+        return std::string(buf, 10);
+    }
+    time_t t = index.getEntries().empty() ? time(0)
+            : (time_t)(index.getEntries()[0].minNs / 1000000000ULL);
+    struct tm tm;
+    localtime_r(&t, &tm);
+    char date[16];
+    strftime(date, sizeof(date), "%Y-%m-%d", &tm);
+    return date;
+}
+
+bool QueryFile(const std::string& filename, Query q, const std::string& start
+            ,const std::string& end, Stats& stats) {
+    int fd = open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        std::cerr << "open " << filename << " failed: " << strerror(errno) << std::endl;
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    uint64_t size = st.st_size;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    kong::LogIndexReader index;
+    index.load(filename);
+    std::string date = FirstDate(fd, index);
+    if((!start.empty() && !ParseTime(start, date, q.start, q.startNs))
+            || (!end.empty() && !ParseTime(end, date, q.end, q.endNs))) {
+        std::cerr << "invalid time: " << (start.empty() ? end : start) << std::endl;
+        close(fd);
+        return false;
+    }
+    if(!end.empty()) {
+        //结束时间精确到秒, 包含整秒
+        q.endNs += 999999999ULL;
+    }
+    uint32_t level_mask = q.minLevel ? ~((1u << q.minLevel) - 1) : ~0u;
+
+    Scanner scanner(q, stats);
+    uint64_t range_begin = 0;
+    uint64_t range_end = 0;
+    //相邻的区间合并后一次扫描
+    auto add = [&](uint64_t b, uint64_t e) {
+        if(b != range_end) {
+            if(range_end > range_begin) {
+                scanner.scan(fd, range_begin, range_end);
+            }
+            range_begin = b;
+        }
+        range_end = e;
+    };
+
+    //未被索引覆盖的区间总是扫描
+    uint64_t pos = 0;
+    for(auto& e : index.getEntries()) {
+        ++stats.blocks;
+        if(e.offset > pos) {
+            add(pos, e.offset);
+        }
+        if(e.maxNs >= q.startNs && e.minNs <= q.endNs && (e.levelMask & level_mask)) {
+            ++stats.selected;
+            add(e.offset, e.offset + e.length);
+        }
+        pos = e.offset + e.length;
+    }
+    if(pos < size) {
+        add(pos, size);
+    }
+    if(range_end > range_begin) {
+        scanner.scan(fd, range_begin, range_end);
+    }
+    close(fd);
+    return true;
+}
+
+void Usage(const char* prog) {
+    std::cerr << "usage: " << prog << " [options] file..." << std::endl
+              << "  -s time    start time, \"YYYY-mm-dd HH:MM:SS\" or \"HH:MM[:SS]\"" << std::endl
+              << "  -e time    end time (inclusive)" << std::endl
+              << "  -l level   minimum level (DEBUG INFO WARN ERROR FATAL)" << std::endl
+              << "  -c name    logger name" << std::endl
+              << "  -g text    substring" << std::endl
+              << "  -v         print statistics to stderr" << std::endl;
+}
+
+}
+
+int main(int argc, char** argv) {
+    Query q;
+    std::string start;
+    std::string end;
+    int opt;
+    while((opt = getopt(argc, argv, "s:e:l:c:g:vh")) != -1) {
+        switch(opt) {
+            case 's':
+                start = optarg;
+                break;
+            case 'e':
+                end = optarg;
+                break;
+            case 'l':
+                q.minLevel = kong::LogLevel::FromString(optarg);
+                if(!q.minLevel) {
+                    std::cerr << "invalid level: " << optarg << std::endl;
+                    return 1;
+                }
+                break;
+            case 'c':
+                q.logger = std::string("[") + optarg + "]";
+                break;
+            case 'g':
+                q.grep = optarg;
+                break;
+            case 'v':
+                q.verbose = true;
+                break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    if(optind >= argc) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    Stats stats;
+    uint64_t begin = kong::Clock::NowNs();
+    int rt = 0;
+    for(int i = optind; i < argc; ++i) {
+        if(!QueryFile(argv[i], q, start, end, stats)) {
+            rt = 1;
+        }
+    }
+    fflush(stdout);
+    if(q.verbose) {
+        std::cerr << "blocks " << stats.selected << "/" << stats.blocks
+                  << " scanned " << stats.bytes << " bytes"
+                  << " matched " << stats.matched
+                  << " in " << (kong::Clock::NowNs() - begin) / 1000000.0 << " ms" << std::endl;
+    }
+    return rt;
+}